@@ -106,6 +106,8 @@ nice_input_message_iter_compare (const NiceInputMessageIter *a,
 
 #define NICE_AGENT_TIMER_TA_DEFAULT 20      /* timer Ta, msecs (impl. defined) */
 #define NICE_AGENT_TIMER_TR_DEFAULT 25000   /* timer Tr, msecs (impl. defined) */
+#define NICE_AGENT_TIMER_CONSENT_DEFAULT 5000 /* consent checks, msecs (RFC 7675) */
+#define NICE_AGENT_TIMER_CONSENT_TIMEOUT 30000 /* consent expiry, msecs (RFC 7675) */
 #define NICE_AGENT_MAX_CONNECTIVITY_CHECKS_DEFAULT 100 /* see RFC 8445 6.1.2.5 */
 
 
@@ -146,6 +148,14 @@ struct _NiceAgent
   NiceNominationMode nomination_mode; /* property: Nomination mode */
   gboolean support_renomination;  /* property: support RENOMINATION STUN attribute */
   guint idle_timeout;             /* property: conncheck timeout before stop */
+  gboolean pseudotcp_pacing;      /* property: pseudo-TCP sender pacing */
+  guint pseudotcp_min_rto;        /* property: pseudo-TCP minimum RTO */
+  gboolean pseudotcp_rack;        /* property: pseudo-TCP RACK-TLP */
+  guint stun_pacing_rate;         /* property: STUN pacing rate, bytes/s */
+  gint64 stun_pacing_budget;      /* bytes the checks may still use in
+                                     the current tick */
+  gint64 stun_pacing_time;        /* monotonic time the budget was last
+                                     refilled */
 
   GSList *local_addresses;        /* list of NiceAddresses for local
 				     interfaces */
@@ -154,9 +164,21 @@ struct _NiceAgent
   GMainContext *main_context;     /* main context pointer */
   guint next_candidate_id;        /* id of next created candidate */
   guint next_stream_id;           /* id of next created candidate */
+  guint64 next_check_pair_seq;    /* insertion order of the next pair added
+                                     to a check list */
   NiceRNG *rng;                   /* random number generator */
   GSList *discovery_list;         /* list of CandidateDiscovery items */
   GSList *triggered_check_queue;  /* pairs in the triggered check list */
+  GHashTable *frozen_pairs;       /* foundation -> GSequence of FROZEN pairs
+                                     of the check lists */
+  GHashTable *succeeded_foundations; /* foundation -> number of SUCCEEDED
+                                        pairs of the check lists */
+  GHashTable *check_pairs;        /* local and remote candidates -> GSList
+                                     of the pairs between them */
+  GHashTable *socket_pairs;       /* local socket and remote candidate ->
+                                     GSList of the pairs between them */
+  GHashTable *conncheck_transactions; /* StunTransactionId -> outstanding
+                                         StunTransaction of a pair */
   guint discovery_unsched_items;  /* number of discovery items unscheduled */
   GSource *discovery_timer_source; /* source of discovery timer */
   GSource *conncheck_timer_source; /* source of conncheck timer */
@@ -175,10 +197,14 @@ struct _NiceAgent
 #endif
   gchar *software_attribute;       /* SOFTWARE attribute */
   gboolean reliable;               /* property: reliable */
+  gboolean reliable_messages;      /* property: reliable-messages */
+  gboolean consent_freshness;      /* property: consent-freshness */
+  guint consent_interval;          /* msecs between consent checks */
+  guint consent_timeout;           /* msecs before consent expires */
+  gboolean bytestream_tcp;         /* property: bytestream-tcp */
   gboolean keepalive_conncheck;    /* property: keepalive_conncheck */
 
   GQueue pending_signals;
-  guint16 rfc4571_expecting_length;
   gboolean use_ice_udp;
   gboolean use_ice_tcp;
   gboolean use_ice_trickle;
@@ -186,6 +212,8 @@ struct _NiceAgent
   guint conncheck_ongoing_idle_delay; /* ongoing delay before timer stop */
   gboolean controlling_mode;          /* controlling mode used by the
                                          conncheck */
+  NiceCapture *capture;               /* packet capture, created on the first
+                                         nice_agent_start_capture() */
   /* XXX: add pointer to internal data struct for ABI-safe extensions */
 };
 
@@ -219,6 +247,11 @@ void agent_signal_component_state_change (
   guint component_id,
   NiceComponentState state);
 
+void agent_signal_component_milestone (
+  NiceAgent *agent,
+  NiceComponent *component,
+  NiceComponentMilestone milestone);
+
 void agent_signal_new_candidate (
   NiceAgent *agent,
   NiceCandidate *candidate);
@@ -241,6 +274,9 @@ void agent_timeout_add_with_context (NiceAgent *agent, GSource **out,
 void agent_timeout_add_seconds_with_context (NiceAgent *agent, GSource **out,
     const gchar *name, guint interval, NiceTimeoutLockedCallback function,
     gpointer data);
+void agent_timeout_add_ready_time_with_context (NiceAgent *agent,
+    GSource **out, const gchar *name, gint64 ready_time,
+    NiceTimeoutLockedCallback function, gpointer data);
 
 StunUsageIceCompatibility agent_to_ice_compatibility (NiceAgent *agent);
 StunUsageTurnCompatibility agent_to_turn_compatibility (NiceAgent *agent);
@@ -326,6 +362,50 @@ void nice_debug (const char *fmt, ...) G_GNUC_PRINTF (1, 2);
 void nice_debug_verbose (const char *fmt, ...) G_GNUC_PRINTF (1, 2);
 #endif
 
+/*
+ * Structured logging.
+ *
+ * nice_log() records an event made of a static format string, up to four
+ * integer or pointer values and optionally an address. Nothing is evaluated
+ * unless its category and level are enabled, which is a single atomic load,
+ * and the message is only formatted when it is printed as debug output or
+ * when the ring buffer (see nice_debug_ring_start()) is dumped, so it can be
+ * kept recording in production.
+ *
+ * The format string may only use %p, %u, %d and %x for the values, in order,
+ * %s for a value which is a static string, such as G_STRFUNC, and %a for the
+ * address, which is printed with its port. Unused values are passed as 0.
+ */
+typedef enum {
+  NICE_LOG_AGENT,
+  NICE_LOG_CONNCHECK,
+  NICE_LOG_N_CATEGORIES
+} NiceLogCategory;
+
+/* Bit masks of nice_log_flags[], the ring buffer levels being shifted by
+ * NICE_LOG_RING_SHIFT. */
+#define NICE_LOG_DEBUG (1 << 0)
+#define NICE_LOG_VERBOSE (1 << 1)
+#define NICE_LOG_RING_SHIFT 8
+
+extern gint nice_log_flags[NICE_LOG_N_CATEGORIES];
+
+#define nice_log_is_enabled(category, level) \
+  ((g_atomic_int_get (&nice_log_flags[category]) & \
+      ((level) | ((level) << NICE_LOG_RING_SHIFT))) != 0)
+
+#define NICE_LOG_PTR(p) ((guint64) (guintptr) (p))
+
+void nice_log_record (NiceLogCategory category, gint level,
+    const NiceAddress *addr, const gchar *format,
+    guint64 v0, guint64 v1, guint64 v2, guint64 v3);
+
+#define nice_log(category, level, addr, format, v0, v1, v2, v3) G_STMT_START { \
+  if (G_UNLIKELY (nice_log_is_enabled (category, level))) \
+    nice_log_record (category, level, addr, format, (guint64) (v0), \
+        (guint64) (v1), (guint64) (v2), (guint64) (v3)); \
+} G_STMT_END
+
 #if !GLIB_CHECK_VERSION(2, 59, 0)
 #if __GNUC__ > 6
 #define G_GNUC_FALLTHROUGH __attribute__((fallthrough))
@@ -60,6 +60,7 @@
 #include "debug.h"
 
 #include "socket.h"
+#include "capture.h"
 #include "stun/usages/turn.h"
 #include "candidate-priv.h"
 #include "component.h"
@@ -67,6 +68,7 @@
 #include "discovery.h"
 #include "agent.h"
 #include "agent-priv.h"
+#include "trace.h"
 #include "iostream.h"
 
 #include "stream.h"
@@ -82,9 +84,16 @@
 #define DEFAULT_STUN_PORT  3478
 #define DEFAULT_UPNP_TIMEOUT 200  /* milliseconds */
 #define DEFAULT_IDLE_TIMEOUT 5000 /* milliseconds */
+#define DEFAULT_PSEUDOTCP_MIN_RTO 1000 /* milliseconds */
 
 #define MAX_TCP_MTU 1400 /* Use 1400 because of VPNs and we assume IEE 802.3 */
 
+/* In message-oriented reliable mode, start copying a partially received
+ * message out of the pseudo-TCP receive buffer once this much of it is
+ * pending, so that messages larger than the receive window still make
+ * progress. Smaller messages are read in one go once complete. */
+#define RELIABLE_MESSAGE_REASSEMBLY_THRESHOLD (32 * 1024)
+
 
 static void
 nice_debug_input_message_composition (const NiceInputMessage *messages,
@@ -123,6 +132,12 @@ enum
   PROP_ICE_TRICKLE,
   PROP_SUPPORT_RENOMINATION,
   PROP_IDLE_TIMEOUT,
+  PROP_PSEUDOTCP_PACING,
+  PROP_PSEUDOTCP_MIN_RTO,
+  PROP_PSEUDOTCP_RACK,
+  PROP_RELIABLE_MESSAGES,
+  PROP_STUN_PACING_RATE,
+  PROP_CONSENT_FRESHNESS,
 };
 
 
@@ -139,6 +154,7 @@ enum
   SIGNAL_NEW_SELECTED_PAIR_FULL,
   SIGNAL_NEW_CANDIDATE_FULL,
   SIGNAL_NEW_REMOTE_CANDIDATE_FULL,
+  SIGNAL_COMPONENT_MILESTONE,
 
   N_SIGNALS,
 };
@@ -748,8 +764,13 @@ nice_agent_class_init (NiceAgentClass *klass)
    * remaining bytes in the packet to be dropped, breaking the reliability
    * of the stream.
    * <para>
-   * This property is currently read-only, and will become read/write once
-   * bytestream mode will be supported.
+   * In reliable mode, setting this property to %TRUE makes ICE-TCP
+   * connections behave as a bytestream: pseudo-TCP isn't used on them, the
+   * kernel's TCP providing reliability and congestion control, and the data
+   * of the RFC 4571 frames sent by the peer is received as one continuous
+   * stream, large frames being read straight into the application's buffers.
+   * It should be set before any stream is added. Before version 0.1.19, this
+   * property was read-only.
    * </para>
    *
    * Since: 0.1.8
@@ -760,7 +781,7 @@ nice_agent_class_init (NiceAgentClass *klass)
         "Bytestream TCP",
         "Use bytestream mode for reliable TCP and Pseudo-TCP connections",
         FALSE,
-        G_PARAM_READABLE));
+        G_PARAM_READWRITE));
 
   /**
    * NiceAgent:keepalive-conncheck:
@@ -892,6 +913,152 @@ nice_agent_class_init (NiceAgentClass *klass)
         FALSE,
         G_PARAM_READWRITE));
 
+   /**
+    * NiceAgent:pseudotcp-pacing
+    *
+    * Whether the pseudo-TCP sockets used by a reliable agent over ICE-UDP
+    * should pace their data segments across the round-trip time instead of
+    * sending whole congestion windows in bursts. This reduces self-inflicted
+    * loss through TURN relays and NATs with shallow buffers.
+    *
+    * This property only affects pseudo-TCP sockets created after it is set,
+    * so it should be set before adding streams.
+    * <para> See also: #PseudoTcpSocket:pacing </para>
+    *
+    * Since: 0.1.19
+    */
+   g_object_class_install_property (gobject_class, PROP_PSEUDOTCP_PACING,
+      g_param_spec_boolean (
+        "pseudotcp-pacing",
+        "Pseudo-TCP pacing",
+        "Whether pseudo-TCP spreads data segments across the round-trip time",
+        FALSE,
+        G_PARAM_READWRITE));
+
+  /**
+    * NiceAgent:pseudotcp-min-rto
+    *
+    * The lower bound, in milliseconds, of the retransmission timeout of the
+    * pseudo-TCP sockets used by a reliable agent over ICE-UDP. Lowering it
+    * below the RFC 6298 value of one second lets interactive streams recover
+    * faster from losses on short paths.
+    *
+    * This property only affects pseudo-TCP sockets created after it is set,
+    * so it should be set before adding streams.
+    * <para> See also: #PseudoTcpSocket:min-rto </para>
+    *
+    * Since: 0.1.19
+    */
+   g_object_class_install_property (gobject_class, PROP_PSEUDOTCP_MIN_RTO,
+      g_param_spec_uint (
+        "pseudotcp-min-rto",
+        "Pseudo-TCP minimum RTO",
+        "Lower bound of the pseudo-TCP retransmission timeout (in milliseconds)",
+        1, 60000,
+        DEFAULT_PSEUDOTCP_MIN_RTO,
+        G_PARAM_READWRITE));
+
+  /**
+    * NiceAgent:pseudotcp-rack
+    *
+    * Whether the pseudo-TCP sockets used by a reliable agent over ICE-UDP
+    * should use time-based loss detection and tail loss probes (RACK-TLP,
+    * RFC 8985), so that losses at the end of short messages are recovered in
+    * about a round-trip time instead of after a retransmission timeout.
+    *
+    * This property only affects pseudo-TCP sockets created after it is set,
+    * so it should be set before adding streams.
+    * <para> See also: #PseudoTcpSocket:rack </para>
+    *
+    * Since: 0.1.19
+    */
+   g_object_class_install_property (gobject_class, PROP_PSEUDOTCP_RACK,
+      g_param_spec_boolean (
+        "pseudotcp-rack",
+        "Pseudo-TCP RACK-TLP",
+        "Whether pseudo-TCP uses time-based loss detection and tail loss probes",
+        FALSE,
+        G_PARAM_READWRITE));
+
+  /**
+   * NiceAgent:reliable-messages:
+   *
+   * Whether a reliable agent preserves the boundaries of the messages passed
+   * to nice_agent_send_messages_nonblocking() over pseudo-TCP. Each message
+   * is prefixed with its length, as in RFC 4571, and
+   * nice_agent_recv_messages() then fills exactly one #NiceInputMessage per
+   * message sent by the peer, only once it has been received in full;
+   * similarly, the #NiceAgentRecvFunc attached with nice_agent_attach_recv()
+   * is called once per message. Messages larger than the receive buffers are
+   * truncated, as they would be on a datagram socket.
+   *
+   * Messages are limited to 65535 bytes, and are either queued in full or not
+   * at all: nice_agent_send() never does a partial write in this mode. Empty
+   * messages, which the peer could not tell from EOS, are rejected with
+   * %G_IO_ERROR_INVALID_ARGUMENT.
+   *
+   * Both peers must enable this mode, and it only has an effect if
+   * #NiceAgent:reliable is %TRUE and pseudo-TCP over ICE-UDP is used.
+   *
+   * Since: 0.1.19
+   */
+   g_object_class_install_property (gobject_class, PROP_RELIABLE_MESSAGES,
+      g_param_spec_boolean (
+        "reliable-messages",
+        "Message-oriented reliable mode",
+        "Whether the reliable transport preserves message boundaries",
+        FALSE,
+        G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+  /**
+   * NiceAgent:stun-pacing-rate:
+   *
+   * The rate, in bytes per second, at which connectivity checks may be sent
+   * across all the streams and components of the agent, as allowed by
+   * RFC 8445 section 14.
+   *
+   * With the default of 0, a single check is sent every
+   * #NiceAgent:stun-pacing-timer, so an agent with many streams takes
+   * proportionally longer to go through its check lists. Otherwise, as many
+   * checks are sent on each tick of the timer as the rate allows, and at
+   * least one.
+   *
+   * Since: 0.1.19
+   */
+   g_object_class_install_property (gobject_class, PROP_STUN_PACING_RATE,
+      g_param_spec_uint (
+        "stun-pacing-rate",
+        "STUN pacing rate",
+        "Bytes per second that connectivity checks may use, 0 to send one "
+        "check per pacing timer tick",
+        0, G_MAXUINT,
+        0,
+        G_PARAM_READWRITE));
+
+  /**
+   * NiceAgent:consent-freshness:
+   *
+   * Whether the agent verifies, as described in RFC 7675, that the peer
+   * still consents to receive media on the selected pair of each component.
+   *
+   * A connectivity check is then sent on the selected pair every 5 seconds
+   * on average, randomized between 4 and 6 seconds, in place of the
+   * keepalives. If no response is received for 30 seconds, consent
+   * expires: the component goes to %NICE_COMPONENT_STATE_FAILED, and sending
+   * on it fails until another pair is selected.
+   *
+   * This is only done in %NICE_COMPATIBILITY_RFC5245 mode.
+   *
+   * Since: 0.1.19
+   */
+   g_object_class_install_property (gobject_class, PROP_CONSENT_FRESHNESS,
+      g_param_spec_boolean (
+        "consent-freshness",
+        "Consent freshness",
+        "Whether the peer's consent to receive media is checked periodically",
+        FALSE,
+        G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
   /* install signals */
 
   /**
@@ -1188,6 +1355,34 @@ nice_agent_class_init (NiceAgentClass *klass)
           NICE_TYPE_CANDIDATE,
           G_TYPE_INVALID);
 
+  /**
+   * NiceAgent::component-milestone
+   * @agent: The #NiceAgent object
+   * @stream_id: The ID of the stream
+   * @component_id: The ID of the component
+   * @milestone: The #NiceComponentMilestone reached
+   * @time: The monotonic time at which it was reached, in microseconds
+   *
+   * This signal is fired the first time a component reaches each step of its
+   * establishment, as also recorded in its #NiceComponentTimeline.
+   *
+   * See also: nice_agent_get_component_timeline()
+   * Since: 0.1.19
+   */
+  signals[SIGNAL_COMPONENT_MILESTONE] =
+      g_signal_new (
+          "component-milestone",
+          G_OBJECT_CLASS_TYPE (klass),
+          G_SIGNAL_RUN_LAST,
+          0,
+          NULL,
+          NULL,
+          NULL,
+          G_TYPE_NONE,
+          4,
+          G_TYPE_UINT, G_TYPE_UINT, G_TYPE_UINT, G_TYPE_INT64,
+          G_TYPE_INVALID);
+
   /* Init debug options depending on env variables */
   nice_debug_init ();
 }
@@ -1252,6 +1447,9 @@ nice_agent_init (NiceAgent *agent)
   agent->nomination_mode = NICE_NOMINATION_MODE_AGGRESSIVE;
   agent->support_renomination = FALSE;
   agent->idle_timeout = DEFAULT_IDLE_TIMEOUT;
+  agent->pseudotcp_min_rto = DEFAULT_PSEUDOTCP_MIN_RTO;
+  agent->consent_interval = NICE_AGENT_TIMER_CONSENT_DEFAULT;
+  agent->consent_timeout = NICE_AGENT_TIMER_CONSENT_TIMEOUT;
 
   agent->discovery_list = NULL;
   agent->discovery_unsched_items = 0;
@@ -1270,6 +1468,8 @@ nice_agent_init (NiceAgent *agent)
   agent->rng = nice_rng_new ();
   priv_generate_tie_breaker (agent);
 
+  conn_check_init_indexes (agent);
+
   g_queue_init (&agent->pending_signals);
 
   g_mutex_init (&agent->agent_mutex);
@@ -1311,17 +1511,31 @@ nice_agent_new_full (GMainContext *ctx,
       "compatibility", compat,
       "main-context", ctx,
       "reliable", (flags & NICE_AGENT_OPTION_RELIABLE) ? TRUE : FALSE,
+      "reliable-messages",
+      (flags & NICE_AGENT_OPTION_RELIABLE_MESSAGES) ? TRUE : FALSE,
       "nomination-mode", (flags & NICE_AGENT_OPTION_REGULAR_NOMINATION) ?
       NICE_NOMINATION_MODE_REGULAR : NICE_NOMINATION_MODE_AGGRESSIVE,
       "full-mode", (flags & NICE_AGENT_OPTION_LITE_MODE) ? FALSE : TRUE,
       "ice-trickle", (flags & NICE_AGENT_OPTION_ICE_TRICKLE) ? TRUE : FALSE,
       "support-renomination", (flags & NICE_AGENT_OPTION_SUPPORT_RENOMINATION) ? TRUE : FALSE,
+      "consent-freshness",
+      (flags & NICE_AGENT_OPTION_CONSENT_FRESHNESS) ? TRUE : FALSE,
       NULL);
 
   return agent;
 }
 
 
+/* Whether the ICE-TCP connections of @agent are handled as a bytestream, as
+ * reported by #NiceAgent:bytestream-tcp. */
+static gboolean
+agent_is_bytestream_tcp (NiceAgent *agent)
+{
+  return agent->reliable &&
+      (agent->bytestream_tcp ||
+          agent->compatibility == NICE_COMPATIBILITY_GOOGLE);
+}
+
 static void
 nice_agent_get_property (
   GObject *object,
@@ -1420,6 +1634,10 @@ nice_agent_get_property (
       g_value_set_boolean (value, agent->reliable);
       break;
 
+    case PROP_RELIABLE_MESSAGES:
+      g_value_set_boolean (value, agent->reliable_messages);
+      break;
+
     case PROP_ICE_UDP:
       g_value_set_boolean (value, agent->use_ice_udp);
       break;
@@ -1429,14 +1647,7 @@ nice_agent_get_property (
       break;
 
     case PROP_BYTESTREAM_TCP:
-      if (agent->reliable) {
-        if (agent->compatibility == NICE_COMPATIBILITY_GOOGLE)
-          g_value_set_boolean (value, TRUE);
-        else
-          g_value_set_boolean (value, FALSE);
-      } else {
-        g_value_set_boolean (value, FALSE);
-      }
+      g_value_set_boolean (value, agent_is_bytestream_tcp (agent));
       break;
 
     case PROP_KEEPALIVE_CONNCHECK:
@@ -1466,6 +1677,26 @@ nice_agent_get_property (
       g_value_set_boolean (value, agent->use_ice_trickle);
       break;
 
+    case PROP_PSEUDOTCP_PACING:
+      g_value_set_boolean (value, agent->pseudotcp_pacing);
+      break;
+
+    case PROP_PSEUDOTCP_MIN_RTO:
+      g_value_set_uint (value, agent->pseudotcp_min_rto);
+      break;
+
+    case PROP_PSEUDOTCP_RACK:
+      g_value_set_boolean (value, agent->pseudotcp_rack);
+      break;
+
+    case PROP_STUN_PACING_RATE:
+      g_value_set_uint (value, agent->stun_pacing_rate);
+      break;
+
+    case PROP_CONSENT_FRESHNESS:
+      g_value_set_boolean (value, agent->consent_freshness);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -1639,6 +1870,10 @@ nice_agent_set_property (
       agent->reliable = g_value_get_boolean (value);
       break;
 
+    case PROP_RELIABLE_MESSAGES:
+      agent->reliable_messages = g_value_get_boolean (value);
+      break;
+
       /* Don't allow ice-udp and ice-tcp to be disabled at the same time */
     case PROP_ICE_UDP:
       if (agent->use_ice_tcp == TRUE || g_value_get_boolean (value) == TRUE)
@@ -1654,7 +1889,9 @@ nice_agent_set_property (
       break;
 
     case PROP_BYTESTREAM_TCP:
-      /* TODO: support bytestream mode and set property to writable */
+      /* Ignored in unreliable mode, where every send/recv is packetized. */
+      if (agent->reliable)
+        agent->bytestream_tcp = g_value_get_boolean (value);
       break;
 
     case PROP_KEEPALIVE_CONNCHECK:
@@ -1681,6 +1918,26 @@ nice_agent_set_property (
       agent->use_ice_trickle = g_value_get_boolean (value);
       break;
 
+    case PROP_PSEUDOTCP_PACING:
+      agent->pseudotcp_pacing = g_value_get_boolean (value);
+      break;
+
+    case PROP_PSEUDOTCP_MIN_RTO:
+      agent->pseudotcp_min_rto = g_value_get_uint (value);
+      break;
+
+    case PROP_PSEUDOTCP_RACK:
+      agent->pseudotcp_rack = g_value_get_boolean (value);
+      break;
+
+    case PROP_STUN_PACING_RATE:
+      agent->stun_pacing_rate = g_value_get_uint (value);
+      break;
+
+    case PROP_CONSENT_FRESHNESS:
+      agent->consent_freshness = g_value_get_boolean (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -1709,6 +1966,14 @@ pseudo_tcp_socket_create (NiceAgent *agent, NiceStream *stream, NiceComponent *c
                                       pseudo_tcp_socket_closed,
                                       pseudo_tcp_socket_write_packet};
   component->tcp = pseudo_tcp_socket_new (0, &tcp_callbacks);
+  g_clear_pointer (&component->tcp_frame_buf, g_free);
+  component->tcp_frame_buf_len = 0;
+  component->tcp_frame_header_len = 0;
+  g_object_set (component->tcp,
+      "pacing", agent->pseudotcp_pacing,
+      "min-rto", agent->pseudotcp_min_rto,
+      "rack", agent->pseudotcp_rack,
+      NULL);
   component->tcp_writable_cancellable = g_cancellable_new ();
   nice_debug ("Agent %p: Create Pseudo Tcp Socket for component %d",
       agent, component->id);
@@ -1755,7 +2020,9 @@ pseudo_tcp_socket_opened (PseudoTcpSocket *sock, gpointer user_data)
 
 /* Will attempt to queue all @n_messages into the pseudo-TCP transmission
  * buffer. This is always used in reliable mode, so essentially treats @messages
- * as a massive flat array of buffers.
+ * as a massive flat array of buffers, unless @framed is %TRUE, in which case
+ * each message is queued whole, prefixed with its RFC 4571 length, or not at
+ * all.
  *
  * Returns the number of messages successfully sent on success (which may be
  * zero if sending the first buffer of the message would have blocked), or
@@ -1765,7 +2032,7 @@ pseudo_tcp_socket_opened (PseudoTcpSocket *sock, gpointer user_data)
 static gint
 pseudo_tcp_socket_send_messages (PseudoTcpSocket *self,
     const NiceOutputMessage *messages, guint n_messages, gboolean allow_partial,
-    GError **error)
+    gboolean framed, GError **error)
 {
   guint i;
   gint bytes_sent = 0;
@@ -1774,15 +2041,60 @@ pseudo_tcp_socket_send_messages (PseudoTcpSocket *self,
     const NiceOutputMessage *message = &messages[i];
     guint j;
 
-    /* If allow_partial is FALSE and there’s not enough space for the
-     * entire message, bail now before queuing anything. This doesn’t
-     * gel with the fact this function is only used in reliable mode,
-     * and there is no concept of a ‘message’, but is necessary
-     * because the calling API has no way of returning to the client
-     * and indicating that a message was partially sent. */
-    if (!allow_partial &&
+    if (framed) {
+      gsize message_len = output_message_get_size (message);
+      guint16 rfc4571_frame;
+
+      if (message_len > G_MAXUINT16) {
+        if (i > 0)
+          goto out;
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+            "Message of %" G_GSIZE_FORMAT " bytes is too large for a "
+            "message-oriented reliable stream.", message_len);
+        return -1;
+      }
+
+      /* The peer would receive it as a zero-length message, which reads as
+       * EOS. */
+      if (message_len == 0) {
+        if (i > 0)
+          goto out;
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+            "Empty messages cannot be sent on a message-oriented reliable "
+            "stream.");
+        return -1;
+      }
+
+      /* The message must not be split, even if allow_partial is TRUE, or the
+       * framing would get out of step. */
+      if (message_len + sizeof (rfc4571_frame) >
+          pseudo_tcp_socket_get_available_send_space (self))
+        goto out;
+
+      rfc4571_frame = htons ((guint16) message_len);
+      if (pseudo_tcp_socket_send (self, (const gchar *) &rfc4571_frame,
+              sizeof (rfc4571_frame)) < 0) {
+        if (pseudo_tcp_socket_get_error (self) == EWOULDBLOCK)
+          goto out;
+
+        if (pseudo_tcp_socket_get_error (self) == ENOTCONN ||
+            pseudo_tcp_socket_get_error (self) == EPIPE)
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+              "TCP connection is not yet established.");
+        else
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+            "Error writing data to pseudo-TCP socket.");
+        return -1;
+      }
+    } else if (!allow_partial &&
         output_message_get_size (message) >
         pseudo_tcp_socket_get_available_send_space (self)) {
+      /* If allow_partial is FALSE and there’s not enough space for the
+       * entire message, bail now before queuing anything. This doesn’t
+       * gel with the fact this function is only used in reliable mode,
+       * and there is no concept of a ‘message’, but is necessary
+       * because the calling API has no way of returning to the client
+       * and indicating that a message was partially sent. */
       return i;
     }
 
@@ -1899,6 +2211,184 @@ done:
   return nice_input_message_iter_get_n_valid_messages (iter);
 }
 
+/* Handle a non-positive return value @len from pseudo_tcp_socket_recv() in
+ * pseudo_tcp_socket_recv_framed_message(). */
+static gint
+pseudo_tcp_socket_framed_recv_error (PseudoTcpSocket *self, gssize len,
+    GError **error)
+{
+  if (len == 0) {
+    /* Reached EOS. */
+    return 0;
+  } else if (pseudo_tcp_socket_get_error (self) == EWOULDBLOCK) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+        "Error reading data from pseudo-TCP socket: would block.");
+  } else if (pseudo_tcp_socket_get_error (self) == ENOTCONN) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+        "Error reading data from pseudo-TCP socket: not connected.");
+  } else {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+        "Error reading data from pseudo-TCP socket.");
+  }
+
+  return -1;
+}
+
+/* Receive the next whole message from @component’s pseudo-TCP socket in
+ * message-oriented reliable mode, scattering it across the buffers of
+ * @message. Bytes which do not fit in @message are discarded.
+ *
+ * The message is only read out of the pseudo-TCP receive buffer once it has
+ * arrived in full, so that it can be copied straight into @message. Only
+ * messages too large for that are reassembled in @component first.
+ *
+ * Returns 1 if a message was received, 0 on EOS, or a negative number on
+ * error (%G_IO_ERROR_WOULD_BLOCK if no complete message is available yet). */
+static gint
+pseudo_tcp_socket_recv_framed_message (NiceComponent *component,
+    NiceInputMessage *message, GError **error)
+{
+  PseudoTcpSocket *self = component->tcp;
+  gsize message_len, remaining, offset;
+  gssize len;
+  guint i;
+
+  /* Read the length header. Empty messages are never sent, and would look
+   * like EOS to the application, so any from the peer is skipped. */
+  do {
+    while (component->tcp_frame_header_len <
+        sizeof (component->tcp_frame_header)) {
+      len = pseudo_tcp_socket_recv (self,
+          (gchar *) component->tcp_frame_header +
+          component->tcp_frame_header_len,
+          sizeof (component->tcp_frame_header) -
+          component->tcp_frame_header_len);
+      if (len <= 0)
+        return pseudo_tcp_socket_framed_recv_error (self, len, error);
+
+      component->tcp_frame_header_len += len;
+    }
+
+    message_len = (component->tcp_frame_header[0] << 8) |
+        component->tcp_frame_header[1];
+    if (message_len == 0)
+      component->tcp_frame_header_len = 0;
+  } while (message_len == 0);
+
+  if (component->tcp_frame_buf == NULL &&
+      (gsize) MAX (pseudo_tcp_socket_get_available_bytes (self), 0) <
+      message_len) {
+    if (pseudo_tcp_socket_get_available_bytes (self) <
+        RELIABLE_MESSAGE_REASSEMBLY_THRESHOLD) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+          "Error reading data from pseudo-TCP socket: incomplete message.");
+      return -1;
+    }
+
+    component->tcp_frame_buf = g_malloc (message_len);
+    component->tcp_frame_buf_len = 0;
+  }
+
+  if (component->tcp_frame_buf != NULL) {
+    while (component->tcp_frame_buf_len < message_len) {
+      len = pseudo_tcp_socket_recv (self,
+          (gchar *) component->tcp_frame_buf + component->tcp_frame_buf_len,
+          message_len - component->tcp_frame_buf_len);
+      if (len <= 0)
+        return pseudo_tcp_socket_framed_recv_error (self, len, error);
+
+      component->tcp_frame_buf_len += len;
+    }
+  }
+
+  /* The whole message is available: copy it out. */
+  message->length = 0;
+  remaining = message_len;
+  offset = 0;
+
+  for (i = 0;
+       remaining > 0 &&
+       ((message->n_buffers >= 0 && i < (guint) message->n_buffers) ||
+        (message->n_buffers < 0 && message->buffers[i].buffer != NULL));
+       i++) {
+    GInputVector *buffer = &message->buffers[i];
+    gsize n = MIN (buffer->size, remaining);
+
+    if (component->tcp_frame_buf != NULL) {
+      memcpy (buffer->buffer, component->tcp_frame_buf + offset, n);
+    } else {
+      len = pseudo_tcp_socket_recv (self, buffer->buffer, n);
+      if (len <= 0)
+        return pseudo_tcp_socket_framed_recv_error (self, len, error);
+      n = len;
+    }
+
+    message->length += n;
+    offset += n;
+    remaining -= n;
+  }
+
+  /* Discard anything which didn’t fit. */
+  while (remaining > 0 && component->tcp_frame_buf == NULL) {
+    guint8 discard[1024];
+
+    len = pseudo_tcp_socket_recv (self, (gchar *) discard,
+        MIN (remaining, sizeof (discard)));
+    if (len <= 0)
+      return pseudo_tcp_socket_framed_recv_error (self, len, error);
+    remaining -= len;
+  }
+
+  if (message->length < message_len) {
+    nice_debug ("%s: Truncated %" G_GSIZE_FORMAT " byte message to %"
+        G_GSIZE_FORMAT " bytes", G_STRFUNC, message_len, message->length);
+  }
+
+  g_clear_pointer (&component->tcp_frame_buf, g_free);
+  component->tcp_frame_buf_len = 0;
+  component->tcp_frame_header_len = 0;
+
+  return 1;
+}
+
+/* Message-oriented counterpart of pseudo_tcp_socket_recv_messages(): fill one
+ * message in @messages per message received, from @iter onwards.
+ *
+ * Returns the number of valid messages in @messages on success (which may be
+ * zero if the peer has disconnected), or a negative number on error
+ * (including if the request would have blocked returning no messages). */
+static gint
+pseudo_tcp_socket_recv_framed_messages (NiceComponent *component,
+    NiceInputMessage *messages, guint n_messages, NiceInputMessageIter *iter,
+    GError **error)
+{
+  GError *child_error = NULL;
+
+  g_assert (iter->buffer == 0 && iter->offset == 0);
+
+  for (; iter->message < n_messages; iter->message++) {
+    gint ret;
+
+    ret = pseudo_tcp_socket_recv_framed_message (component,
+        &messages[iter->message], &child_error);
+
+    if (ret == 0) {
+      break;
+    } else if (ret < 0) {
+      if (g_error_matches (child_error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK) &&
+          iter->message > 0) {
+        g_clear_error (&child_error);
+        break;
+      }
+
+      g_propagate_error (error, child_error);
+      return ret;
+    }
+  }
+
+  return nice_input_message_iter_get_n_valid_messages (iter);
+}
+
 /* This is called with the agent lock held. */
 static void
 pseudo_tcp_socket_readable (PseudoTcpSocket *sock, gpointer user_data)
@@ -1935,6 +2425,41 @@ pseudo_tcp_socket_readable (PseudoTcpSocket *sock, gpointer user_data)
       guint8 buf[MAX_BUFFER_SIZE];
       gssize len;
 
+      if (agent->reliable_messages) {
+        GInputVector local_buf = { buf, sizeof (buf) };
+        NiceInputMessage local_message = { &local_buf, 1, NULL, 0 };
+        GError *child_error = NULL;
+        gint ret;
+
+        /* Emit one callback per message. */
+        ret = pseudo_tcp_socket_recv_framed_message (component,
+            &local_message, &child_error);
+
+        if (ret == 0) {
+          /* Reached EOS. */
+          component->tcp_readable = FALSE;
+          pseudo_tcp_socket_close (component->tcp, FALSE);
+          break;
+        } else if (ret < 0) {
+          if (!g_error_matches (child_error, G_IO_ERROR,
+                  G_IO_ERROR_WOULD_BLOCK)) {
+            nice_debug ("%s: calling priv_pseudo_tcp_error()", G_STRFUNC);
+            priv_pseudo_tcp_error (agent, component);
+          }
+          if (component->recv_buf_error != NULL)
+            g_propagate_error (component->recv_buf_error, child_error);
+          else
+            g_clear_error (&child_error);
+          break;
+        }
+
+        /* Empty messages can’t be passed to the I/O callback. */
+        if (local_message.length > 0)
+          nice_component_emit_io_callback (agent, component, buf,
+              local_message.length);
+        goto emitted;
+      }
+
       /* FIXME: Why copy into a temporary buffer here? Why can’t the I/O
        * callbacks be emitted directly from the pseudo-TCP receive buffer? */
       len = pseudo_tcp_socket_recv (sock, (gchar *) buf, sizeof(buf));
@@ -1973,6 +2498,7 @@ pseudo_tcp_socket_readable (PseudoTcpSocket *sock, gpointer user_data)
 
       nice_component_emit_io_callback (agent, component, buf, len);
 
+ emitted:
       if (!agent_find_component (agent, stream_id, component_id,
               &stream, &component)) {
         nice_debug ("Stream or Component disappeared during the callback");
@@ -1993,9 +2519,14 @@ pseudo_tcp_socket_readable (PseudoTcpSocket *sock, gpointer user_data)
      * error occurs. Copy the data directly into the client’s receive message
      * array without making any callbacks. Update component->recv_messages_iter
      * as we go. */
-    n_valid_messages = pseudo_tcp_socket_recv_messages (sock,
-        component->recv_messages, component->n_recv_messages,
-        &component->recv_messages_iter, &child_error);
+    if (agent->reliable_messages)
+      n_valid_messages = pseudo_tcp_socket_recv_framed_messages (component,
+          component->recv_messages, component->n_recv_messages,
+          &component->recv_messages_iter, &child_error);
+    else
+      n_valid_messages = pseudo_tcp_socket_recv_messages (sock,
+          component->recv_messages, component->n_recv_messages,
+          &component->recv_messages_iter, &child_error);
 
     nice_debug_verbose ("%s: Client buffers case: Received %d valid messages:",
         G_STRFUNC, n_valid_messages);
@@ -2082,7 +2613,10 @@ pseudo_tcp_socket_write_packet (PseudoTcpSocket *psocket,
   if (agent == NULL)
     return WR_FAIL;
 
-  if (component->selected_pair.local != NULL) {
+  if (component->selected_pair.keepalive.consent_lost) {
+    nice_debug ("%s: WARNING: Failed to send pseudo-TCP packet from agent %p "
+        "as consent to send has expired.", G_STRFUNC, agent);
+  } else if (component->selected_pair.local != NULL) {
     NiceSocket *sock;
     NiceAddress *addr;
 
@@ -2107,6 +2641,10 @@ pseudo_tcp_socket_write_packet (PseudoTcpSocket *psocket,
      * its transmission rate and, hopefully, the usage of system resources
      * which caused the EWOULDBLOCK in the first place. */
     if (nice_socket_send (sock, addr, len, buffer) >= 0) {
+      component->stats.packets_sent++;
+      component->stats.bytes_sent += len;
+      component->selected_pair.keepalive.last_media_sent =
+          g_get_monotonic_time ();
       g_object_unref (agent);
       return WR_SUCCESS;
     }
@@ -2133,6 +2671,10 @@ notify_pseudo_tcp_socket_clock_agent_locked (NiceAgent *agent,
     return G_SOURCE_REMOVE;
 
   pseudo_tcp_socket_notify_clock (component->tcp);
+
+  /* The clock source was disarmed before this callback ran; make sure
+   * adjust_tcp_clock() re-arms it even if the next deadline is unchanged. */
+  component->last_clock_timeout = 0;
   adjust_tcp_clock (agent, stream, component);
 
   return G_SOURCE_CONTINUE;
@@ -2146,18 +2688,20 @@ adjust_tcp_clock (NiceAgent *agent, NiceStream *stream, NiceComponent *component
 
     if (pseudo_tcp_socket_get_next_clock (component->tcp, &timeout)) {
       if (timeout != component->last_clock_timeout) {
+        long interval = timeout - (guint32) (g_get_monotonic_time () / 1000);
+        gint64 ready_time;
+
+        /* Prevent integer overflows */
+        if (interval < 0 || interval > G_MAXINT)
+          interval = G_MAXINT;
+        ready_time = g_get_monotonic_time () + (gint64) interval * 1000;
+
         component->last_clock_timeout = timeout;
         if (component->tcp_clock) {
-          g_source_set_ready_time (component->tcp_clock, timeout * 1000);
-        }
-        if (!component->tcp_clock) {
-          long interval = timeout - (guint32) (g_get_monotonic_time () / 1000);
-
-          /* Prevent integer overflows */
-          if (interval < 0 || interval > G_MAXINT)
-            interval = G_MAXINT;
-          agent_timeout_add_with_context (agent, &component->tcp_clock,
-              "Pseudo-TCP clock", interval,
+          g_source_set_ready_time (component->tcp_clock, ready_time);
+        } else {
+          agent_timeout_add_ready_time_with_context (agent,
+              &component->tcp_clock, "Pseudo-TCP clock", ready_time,
               notify_pseudo_tcp_socket_clock_agent_locked, component);
         }
       }
@@ -2323,7 +2867,12 @@ void agent_signal_gathering_done (NiceAgent *agent)
   for (i = agent->streams; i; i = i->next) {
     NiceStream *stream = i->data;
     if (stream->gathering) {
+      GSList *j;
+
       stream->gathering = FALSE;
+      for (j = stream->components; j; j = j->next)
+        agent_signal_component_milestone (agent, j->data,
+            NICE_COMPONENT_MILESTONE_GATHERING_DONE);
       agent_queue_signal (agent, signals[SIGNAL_CANDIDATE_GATHERING_DONE],
           stream->id);
     }
@@ -2423,6 +2972,9 @@ void agent_signal_new_selected_pair (NiceAgent *agent, guint stream_id,
     adjust_tcp_clock (agent, stream, component);
   }
 
+  NICE_TRACE (selected_pair, agent, stream_id, component_id, lcandidate,
+      rcandidate);
+
   if (nice_debug_is_enabled ()) {
     gchar ip[100];
     guint port;
@@ -2572,10 +3124,69 @@ void agent_signal_component_state_change (NiceAgent *agent, guint stream_id, gui
   if (agent->reliable)
     process_queued_tcp_packets (agent, stream, component);
 
+  if (new_state == NICE_COMPONENT_STATE_CONNECTED)
+    agent_signal_component_milestone (agent, component,
+        NICE_COMPONENT_MILESTONE_CONNECTED);
+  else if (new_state == NICE_COMPONENT_STATE_READY)
+    agent_signal_component_milestone (agent, component,
+        NICE_COMPONENT_MILESTONE_READY);
+  else if (new_state == NICE_COMPONENT_STATE_FAILED)
+    agent_signal_component_milestone (agent, component,
+        NICE_COMPONENT_MILESTONE_FAILED);
+
   agent_queue_signal (agent, signals[SIGNAL_COMPONENT_STATE_CHANGED],
       stream_id, component_id, new_state);
 }
 
+/* Records the first time @component reaches @milestone. */
+void
+agent_signal_component_milestone (NiceAgent *agent, NiceComponent *component,
+    NiceComponentMilestone milestone)
+{
+  NiceComponentTimeline *timeline = &component->timeline;
+  gint64 *time;
+
+  switch (milestone) {
+    case NICE_COMPONENT_MILESTONE_GATHERING_STARTED:
+      time = &timeline->gathering_started;
+      break;
+    case NICE_COMPONENT_MILESTONE_GATHERING_DONE:
+      time = &timeline->gathering_done;
+      break;
+    case NICE_COMPONENT_MILESTONE_FIRST_CHECK_SENT:
+      time = &timeline->first_check_sent;
+      break;
+    case NICE_COMPONENT_MILESTONE_FIRST_CHECK_SUCCEEDED:
+      time = &timeline->first_check_succeeded;
+      break;
+    case NICE_COMPONENT_MILESTONE_NOMINATED:
+      time = &timeline->nominated;
+      break;
+    case NICE_COMPONENT_MILESTONE_CONNECTED:
+      time = &timeline->connected;
+      break;
+    case NICE_COMPONENT_MILESTONE_READY:
+      time = &timeline->ready;
+      break;
+    case NICE_COMPONENT_MILESTONE_FAILED:
+      time = &timeline->failed;
+      break;
+    default:
+      g_return_if_reached ();
+  }
+
+  if (*time != 0)
+    return;
+
+  *time = g_get_monotonic_time ();
+
+  nice_debug ("Agent %p : stream %u component %u reached milestone %u.",
+      agent, component->stream_id, component->id, milestone);
+
+  agent_queue_signal (agent, signals[SIGNAL_COMPONENT_MILESTONE],
+      component->stream_id, component->id, milestone, *time);
+}
+
 guint64
 agent_candidate_pair_priority (NiceAgent *agent, NiceCandidate *local, NiceCandidate *remote)
 {
@@ -3082,6 +3693,10 @@ nice_agent_gather_candidates (
   nice_debug ("Agent %p : In %s mode, starting candidate gathering.", agent,
       agent->full_mode ? "ICE-FULL" : "ICE-LITE");
 
+  for (i = stream->components; i; i = i->next)
+    agent_signal_component_milestone (agent, i->data,
+        NICE_COMPONENT_MILESTONE_GATHERING_STARTED);
+
 #ifdef HAVE_GUPNP
   if (agent->upnp_enabled && agent->upnp == NULL && !agent->force_relay) {
     agent->upnp = gupnp_simple_igd_thread_new ();
@@ -3370,6 +3985,7 @@ nice_agent_gather_candidates (
       }
       g_slist_free (component->local_candidates);
       component->local_candidates = NULL;
+      nice_component_invalidate_credentials (component);
     }
     discovery_prune_stream (agent, stream_id);
   }
@@ -3556,8 +4172,7 @@ static void priv_update_pair_foundations (NiceAgent *agent,
             pair->local->foundation, pair->remote->foundation);
         if (strncmp (pair->foundation, foundation,
             NICE_CANDIDATE_PAIR_MAX_FOUNDATION)) {
-          g_strlcpy (pair->foundation, foundation,
-              NICE_CANDIDATE_PAIR_MAX_FOUNDATION);
+          conn_check_set_pair_foundation (agent, pair, foundation);
           nice_debug ("Agent %p : Updating pair %p foundation to '%s'",
               agent, pair, pair->foundation);
           if (pair->state == NICE_CHECK_SUCCEEDED)
@@ -3700,12 +4315,14 @@ static gboolean priv_add_remote_candidate (
             "to change to '%s' now (ICE restart only).", agent,
             candidate->password, password);
     }
+    nice_component_invalidate_credentials (component);
 
     /* since the type of the existing candidate may have changed,
      * the pairs priority and foundation related to this candidate need
      * to be recomputed...
      */
-    recalculate_pair_priorities (agent);
+    conn_check_recalculate_candidate_pair_priorities (agent, stream,
+        candidate);
     priv_update_pair_foundations (agent, stream_id, component_id, candidate);
     /* ... and maybe we now have another nominated pair with a higher
      * priority as the result of this priorities update.
@@ -3798,8 +4415,7 @@ static gboolean priv_add_remote_candidate (
         component, candidate) < 0)
       goto errors;
 
-    component->remote_candidates = g_slist_append (component->remote_candidates,
-        candidate);
+    nice_component_add_remote_candidate (component, candidate);
   }
   return TRUE;
 
@@ -3861,9 +4477,14 @@ nice_agent_set_local_credentials (
 
   /* note: oddly enough, ufrag and pwd can be empty strings */
   if (stream && ufrag && pwd) {
+    GSList *i;
+
     g_strlcpy (stream->local_ufrag, ufrag, NICE_STREAM_MAX_UFRAG);
     g_strlcpy (stream->local_password, pwd, NICE_STREAM_MAX_PWD);
 
+    for (i = stream->components; i; i = i->next)
+      nice_component_invalidate_credentials (i->data);
+
     ret = TRUE;
     goto done;
   }
@@ -4070,6 +4691,7 @@ agent_recv_message_unlocked (
   RecvStatus retval;
   gint sockret;
   gboolean is_turn;
+  NiceSocket *recv_sock;
 
   /* We need an address for packet parsing, below. */
   if (message->from == NULL) {
@@ -4150,121 +4772,16 @@ agent_recv_message_unlocked (
         }
         sockret = 0;
       } else {
-        /* In the case of a real ICE-TCP connection, we can use the socket as a
-         * bytestream and do the read here with caching of data being read
-         */
-        gssize available = g_socket_get_available_bytes (nicesock->fileno);
-
-        /* TODO: Support bytestream reads */
-        message->length = 0;
-        sockret = 0;
-        if (available <= 0) {
-          sockret = available;
-
-          /* If we don't call check_connect_result on an outbound connection,
-           * then is_connected will always return FALSE. That's why we check
-           * both conditions to make sure g_socket_is_connected returns the
-           * correct result, otherwise we end up closing valid connections
-           */
-          if (g_socket_check_connect_result (nicesock->fileno, NULL) == FALSE ||
-              g_socket_is_connected (nicesock->fileno) == FALSE) {
-            /* If we receive a readable event on a TCP_BSD socket which is
-             * not connected, it means that it failed to connect, so we must
-             * return an error to make the socket fail/closed
-             */
-            sockret = -1;
-          } else {
-            gint flags = G_SOCKET_MSG_PEEK;
-
-            /* If available bytes are 0, but the socket is still considered
-             * connected, then either we're just trying to see if there's more
-             * data available or the peer closed the connection.
-             * The only way to know is to do a read, so we do here a peek and
-             * check the return value, if it's 0, it means the peer has closed
-             * the connection, so we must return an error instead of WOULD_BLOCK
-             */
-            if (g_socket_receive_message (nicesock->fileno, NULL,
-                    NULL, 0, NULL, NULL, &flags, NULL, NULL) == 0)
-              sockret = -1;
-          }
-        } else if (agent->rfc4571_expecting_length == 0) {
-          if ((gsize) available >= sizeof(guint16)) {
-            guint16 rfc4571_frame;
-            GInputVector local_buf = { &rfc4571_frame, sizeof(guint16)};
-            NiceInputMessage local_message = { &local_buf, 1, message->from, 0};
-
-            sockret = nice_socket_recv_messages (nicesock, &local_message, 1);
-            if (sockret == 1 && local_message.length >= sizeof (guint16)) {
-              agent->rfc4571_expecting_length = ntohs (rfc4571_frame);
-              available = g_socket_get_available_bytes (nicesock->fileno);
-            }
-          }
-        }
-        if (agent->rfc4571_expecting_length > 0) {
-          GInputVector *local_bufs;
-          NiceInputMessage local_message;
-          gsize off;
-          guint n_bufs = 0;
-          guint i;
-
-          /* Count the number of buffers. */
-          if (message->n_buffers == -1) {
-            for (i = 0; message->buffers[i].buffer != NULL; i++)
-              n_bufs++;
-          } else {
-            n_bufs = message->n_buffers;
-          }
-
-          local_bufs = g_alloca (n_bufs * sizeof (GInputVector));
-          local_message.buffers = local_bufs;
-          local_message.from = message->from;
-          local_message.length = 0;
-          local_message.n_buffers = 0;
-
-          /* Only read up to the expected number of bytes in the frame */
-          off = 0;
-          for (i = 0; i < n_bufs; i++) {
-            if (message->buffers[i].size + off < message->length) {
-              /* Skip already full buffers */
-              off += message->buffers[i].size;
-            } else {
-              gssize diff = 0;
-
-              /* If we have a partially full buffer, offset the pointer */
-              if (off < message->length)
-                diff = message->length - off;
-
-              /* Those buffers are filled */
-              local_bufs[local_message.n_buffers].buffer =
-                  ((char *) message->buffers[i].buffer) + diff;
-              local_bufs[local_message.n_buffers].size =
-                  MIN (message->buffers[i].size - diff,
-                       agent->rfc4571_expecting_length - off);
-              off += local_message.buffers[local_message.n_buffers].size;
-              local_message.n_buffers++;
-
-              /* If we have a big enough buffer, let's just stop */
-              if (off == message->length + agent->rfc4571_expecting_length)
-                break;
-            }
-          }
-          sockret = nice_socket_recv_messages (nicesock, &local_message, 1);
-          if (sockret == 1) {
-            message->length += local_message.length;
-            agent->rfc4571_expecting_length -= local_message.length;
-            if (agent->rfc4571_expecting_length != 0) {
-              retval = RECV_WOULD_BLOCK;  /* EWOULDBLOCK */
-              nice_debug_verbose ("%s: Agent %p: TCP message incomplete",
-                G_STRFUNC, agent);
-              goto done;
-            }
-          }
-        }
-      }
-    }
-  } else {
-    sockret = nice_socket_recv_messages (nicesock, message, 1);
-  }
+        /* In the case of a real ICE-TCP connection, the socket reads ahead
+         * from the bytestream and keeps the RFC 4571 framing state of its own
+         * connection, handing out one frame at a time. A failed connection
+         * attempt or a peer closing the connection shows up as an error. */
+        sockret = nice_tcp_bsd_socket_recv_framed (nicesock, message);
+      }
+    }
+  } else {
+    sockret = nice_socket_recv_messages (nicesock, message, 1);
+  }
 
   if (sockret == 0) {
     retval = RECV_WOULD_BLOCK;  /* EWOULDBLOCK */
@@ -4289,18 +4806,24 @@ agent_recv_message_unlocked (
     goto done;
   }
 
-  if (nice_debug_is_verbose ()) {
-    gchar tmpbuf[INET6_ADDRSTRLEN];
-    nice_address_to_string (message->from, tmpbuf);
-    nice_debug_verbose ("%s: Agent %p : Packet received on local socket %p "
-        "(fd %d) from [%s]:%u (%" G_GSSIZE_FORMAT " octets).", G_STRFUNC, agent,
-        nicesock, nicesock->fileno ? g_socket_get_fd (nicesock->fileno) : -1, tmpbuf,
-        nice_address_get_port (message->from), message->length);
-  }
+  NICE_TRACE (recv, agent, stream->id, component->id, message->length);
+
+  nice_log (NICE_LOG_AGENT, NICE_LOG_VERBOSE, message->from,
+      "Agent %p : Packet received on local socket %p (fd %d) from %a "
+      "(%u octets).", NICE_LOG_PTR (agent), NICE_LOG_PTR (nicesock),
+      nicesock->fileno ? g_socket_get_fd (nicesock->fileno) : -1,
+      message->length);
 
+  recv_sock = nicesock;
   is_turn = _agent_recv_turn_message_unlocked (agent, stream, component, &nicesock,
       message, &retval);
 
+  /* Data decapsulated from a TURN relay is captured again, as received on
+   * the relay socket. */
+  if (G_UNLIKELY (nicesock->capture != NULL) && nicesock != recv_sock &&
+      retval == RECV_SUCCESS)
+    nice_capture_record_received (nicesock, message, 1);
+
   if (agent->force_relay && !is_turn) {
     /* Ignore messages not from TURN if TURN is required */
     retval = RECV_WOULD_BLOCK;  /* EWOULDBLOCK */
@@ -4362,11 +4885,14 @@ agent_recv_message_unlocked (
           nice_address_get_port (message->from), nicesock->type);
     }
 
+    component->stats.packets_dropped++;
     retval = RECV_OOB;
     goto done;
   }
 
   agent->media_after_tick = TRUE;
+  component->stats.packets_received++;
+  component->stats.bytes_received += message->length;
 
   /* Unhandled STUN; try handling TCP data, then pass to the client. */
   if (message->length > 0  && agent->reliable) {
@@ -4419,6 +4945,196 @@ done:
   return retval;
 }
 
+/* Whether data received on @nicesock is handled as a bytestream. A data frame
+ * which has been partly received is always finished as such, so that the
+ * framing isn’t lost if #NiceAgent:bytestream-tcp is changed. */
+static gboolean
+agent_socket_is_bytestream (NiceAgent *agent, NiceSocket *nicesock)
+{
+  return agent->reliable && nicesock->type == NICE_SOCKET_TYPE_TCP_BSD &&
+      (agent_is_bytestream_tcp (agent) ||
+          nice_tcp_bsd_socket_get_data_remaining (nicesock) > 0);
+}
+
+/* Advance @iter by @len bytes received into @message, moving to the next
+ * message once all the buffers of @message are full. */
+static void
+input_message_iter_advance (NiceInputMessageIter *iter,
+    NiceInputMessage *message, gsize len)
+{
+  while ((message->n_buffers >= 0 && iter->buffer < (guint) message->n_buffers) ||
+      (message->n_buffers < 0 && message->buffers[iter->buffer].buffer != NULL)) {
+    gsize space = message->buffers[iter->buffer].size - iter->offset;
+
+    if (len < space) {
+      iter->offset += len;
+      return;
+    }
+
+    len -= space;
+    iter->buffer++;
+    iter->offset = 0;
+  }
+
+  iter->message++;
+  iter->buffer = 0;
+  iter->offset = 0;
+}
+
+/*
+ * agent_recv_bytestream_unlocked:
+ * @agent: a #NiceAgent
+ * @stream: the stream to receive from
+ * @component: the component to receive from
+ * @nicesock: the ICE-TCP socket to receive on
+ * @messages: the messages to receive into
+ * @n_messages: the number of @messages
+ * @iter: the position in @messages to receive at, updated on return
+ *
+ * Receive data from an ICE-TCP connection in bytestream mode. Frames carrying
+ * STUN are handled out-of-band as in agent_recv_message_unlocked(). The
+ * payload of the other frames is received as one continuous stream, filling
+ * each message’s buffers in turn regardless of the frame boundaries. Most of
+ * a large frame is read straight into the buffers.
+ *
+ * This must be called with the agent’s lock held.
+ *
+ * Returns: %RECV_SUCCESS if any data was received, %RECV_WOULD_BLOCK if none
+ * was available, or %RECV_ERROR on error
+ */
+static RecvStatus
+agent_recv_bytestream_unlocked (
+  NiceAgent *agent,
+  NiceStream *stream,
+  NiceComponent *component,
+  NiceSocket *nicesock,
+  NiceInputMessage *messages,
+  guint n_messages,
+  NiceInputMessageIter *iter)
+{
+  RecvStatus retval = RECV_WOULD_BLOCK;
+  gboolean received = FALSE;
+  gboolean has_padding =
+      (agent->compatibility != NICE_COMPATIBILITY_OC2007 &&
+       agent->compatibility != NICE_COMPATIBILITY_OC2007R2);
+
+  while (iter->message < n_messages) {
+    NiceInputMessage *message = &messages[iter->message];
+    GInputVector *local_bufs;
+    guint n_bufs = 0;
+    guint i;
+    gssize len;
+
+    if (nice_tcp_bsd_socket_get_data_remaining (nicesock) == 0) {
+      NiceAddress from;
+      guint16 frame_len;
+      guint8 *payload;
+      gsize payload_len;
+      gint ret;
+
+      /* At a frame boundary. Look at enough of the next frame to tell
+       * whether it could be STUN. */
+      ret = nice_tcp_bsd_socket_peek_frame (nicesock,
+          STUN_MESSAGE_HEADER_LENGTH, &frame_len, &payload, &payload_len,
+          &from);
+      if (ret <= 0) {
+        retval = (ret == 0) ? RECV_WOULD_BLOCK : RECV_ERROR;
+        break;
+      }
+
+      if (frame_len >= STUN_MESSAGE_HEADER_LENGTH &&
+          STUN_MESSAGE_HEADER_LENGTH +
+              ((payload[2] << 8) | payload[3]) == frame_len) {
+        /* Possibly STUN, so it needs all of the frame. */
+        ret = nice_tcp_bsd_socket_peek_frame (nicesock, frame_len, &frame_len,
+            &payload, &payload_len, &from);
+        if (ret <= 0) {
+          retval = (ret == 0) ? RECV_WOULD_BLOCK : RECV_ERROR;
+          break;
+        }
+
+        if (stun_message_validate_buffer_length (payload, frame_len,
+                has_padding) == frame_len &&
+            conn_check_handle_inbound_stun (agent, stream, component, nicesock,
+                &from, (gchar *) payload, frame_len)) {
+          nice_debug ("%s: Valid STUN packet received.", G_STRFUNC);
+          nice_tcp_bsd_socket_skip_frame (nicesock);
+          continue;
+        }
+      }
+
+      if (!nice_component_verify_remote_candidate (component, &from,
+              nicesock)) {
+        /* Frames fit in the read-ahead buffer, so drop it from there. */
+        ret = nice_tcp_bsd_socket_peek_frame (nicesock, frame_len, &frame_len,
+            &payload, &payload_len, &from);
+        if (ret <= 0) {
+          retval = (ret == 0) ? RECV_WOULD_BLOCK : RECV_ERROR;
+          break;
+        }
+
+        nice_debug_verbose ("Agent %p : %d:%d DROPPING frame from unknown "
+            "source", agent, stream->id, component->id);
+        nice_tcp_bsd_socket_skip_frame (nicesock);
+        component->stats.packets_dropped++;
+        continue;
+      }
+
+      agent->media_after_tick = TRUE;
+      component->stats.packets_received++;
+      component->stats.bytes_received += frame_len;
+      nice_tcp_bsd_socket_begin_data_frame (nicesock);
+      continue;
+    }
+
+    if (iter->buffer == 0 && iter->offset == 0)
+      message->length = 0;
+
+    /* Count the number of buffers. */
+    if (message->n_buffers == -1) {
+      for (i = 0; message->buffers[i].buffer != NULL; i++)
+        n_bufs++;
+    } else {
+      n_bufs = message->n_buffers;
+    }
+
+    if (iter->buffer >= n_bufs) {
+      input_message_iter_advance (iter, message, 0);
+      continue;
+    }
+
+    /* Receive into the space left in the message’s buffers. */
+    local_bufs = g_alloca ((n_bufs - iter->buffer) * sizeof (GInputVector));
+    for (i = iter->buffer; i < n_bufs; i++)
+      local_bufs[i - iter->buffer] = message->buffers[i];
+    local_bufs[0].buffer = (guint8 *) local_bufs[0].buffer + iter->offset;
+    local_bufs[0].size -= iter->offset;
+
+    len = nice_tcp_bsd_socket_recv_data (nicesock, local_bufs,
+        n_bufs - iter->buffer);
+
+    if (len < 0) {
+      retval = RECV_ERROR;
+      break;
+    } else if (len == 0) {
+      if (nice_tcp_bsd_socket_get_data_remaining (nicesock) == 0)
+        continue;
+
+      retval = RECV_WOULD_BLOCK;
+      break;
+    }
+
+    nice_debug_verbose ("%s: Agent %p: received %" G_GSSIZE_FORMAT " bytes of "
+        "bytestream data", G_STRFUNC, agent, len);
+
+    received = TRUE;
+    message->length += len;
+    input_message_iter_advance (iter, message, len);
+  }
+
+  return received ? RECV_SUCCESS : retval;
+}
+
 /* Print the composition of an array of messages. No-op if debugging is
  * disabled. */
 static void
@@ -4737,6 +5453,58 @@ nice_agent_recv_cancelled_cb (GCancellable *cancellable, gpointer user_data)
   return G_SOURCE_REMOVE;
 }
 
+/* Frames which an ICE-TCP socket has already read ahead don’t make it readable
+ * again, so receive them before polling the sockets; otherwise they would wait
+ * for the peer to send more data. Like component_io_cb(), this receives one
+ * frame into each of the component’s receive messages, or fills them with the
+ * bytestream. */
+static void
+component_recv_pending_frames (NiceAgent *agent, NiceStream *stream,
+    NiceComponent *component)
+{
+  guint socket_sources_age = component->socket_sources_age;
+  GSList *l;
+
+  for (l = component->socket_sources; l != NULL; l = l->next) {
+    SocketSource *socket_source = l->data;
+    NiceSocket *nicesock = socket_source->socket;
+
+    if (agent_socket_is_bytestream (agent, nicesock)) {
+      if (nice_tcp_bsd_socket_has_pending_data (nicesock))
+        agent_recv_bytestream_unlocked (agent, stream, component, nicesock,
+            component->recv_messages, component->n_recv_messages,
+            &component->recv_messages_iter);
+
+      if (component->socket_sources_age != socket_sources_age)
+        return;
+      continue;
+    }
+
+    /* Don’t want to trample over partially-valid buffers. */
+    if (component->recv_messages_iter.buffer != 0 ||
+        component->recv_messages_iter.offset != 0)
+      continue;
+
+    while (nice_tcp_bsd_socket_has_pending_data (nicesock) &&
+        !nice_input_message_iter_is_at_end (&component->recv_messages_iter,
+            component->recv_messages, component->n_recv_messages)) {
+      RecvStatus retval;
+
+      retval = agent_recv_message_unlocked (agent, stream, component, nicesock,
+          &component->recv_messages[component->recv_messages_iter.message]);
+
+      if (retval == RECV_SUCCESS)
+        component->recv_messages_iter.message++;
+      else if (retval != RECV_OOB)
+        break;
+
+      /* Handling a STUN message may have added or removed sockets. */
+      if (component->socket_sources_age != socket_sources_age)
+        return;
+    }
+  }
+}
+
 static gint
 nice_agent_recv_messages_blocking_or_nonblocking (NiceAgent *agent,
   guint stream_id, guint component_id, gboolean blocking,
@@ -4829,7 +5597,8 @@ nice_agent_recv_messages_blocking_or_nonblocking (NiceAgent *agent,
 
   while (!received_enough &&
          !g_queue_is_empty (&component->pending_io_messages)) {
-    pending_io_messages_recv_messages (component, agent->reliable,
+    pending_io_messages_recv_messages (component,
+        agent->reliable && !agent->reliable_messages,
         component->recv_messages, component->n_recv_messages,
         &component->recv_messages_iter);
 
@@ -4849,9 +5618,19 @@ nice_agent_recv_messages_blocking_or_nonblocking (NiceAgent *agent,
    * before trying the sockets. */
   if (agent->reliable &&
       pseudo_tcp_socket_get_available_bytes (component->tcp) > 0) {
-    pseudo_tcp_socket_recv_messages (component->tcp,
-        component->recv_messages, component->n_recv_messages,
-        &component->recv_messages_iter, &child_error);
+    if (agent->reliable_messages) {
+      pseudo_tcp_socket_recv_framed_messages (component,
+          component->recv_messages, component->n_recv_messages,
+          &component->recv_messages_iter, &child_error);
+
+      /* The rest of a partially received message may still be on its way. */
+      if (g_error_matches (child_error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+        g_clear_error (&child_error);
+    } else {
+      pseudo_tcp_socket_recv_messages (component->tcp,
+          component->recv_messages, component->n_recv_messages,
+          &component->recv_messages_iter, &child_error);
+    }
     adjust_tcp_clock (agent, stream, component);
 
     nice_debug_verbose ("%s: %p: Received %d valid messages from pseudo-TCP read "
@@ -4865,6 +5644,14 @@ nice_agent_recv_messages_blocking_or_nonblocking (NiceAgent *agent,
     error_reported = (child_error != NULL);
   }
 
+  if (!received_enough && !error_reported) {
+    component_recv_pending_frames (agent, stream, component);
+
+    received_enough =
+        nice_input_message_iter_is_at_end (&component->recv_messages_iter,
+            component->recv_messages, component->n_recv_messages);
+  }
+
   /* Each iteration of the main context will either receive some data, a
    * cancellation error or a socket error. In non-reliable mode, the iter’s
    * @message counter will be incremented after each read.
@@ -5021,6 +5808,29 @@ nice_agent_recv_messages_nonblocking (NiceAgent *agent, guint stream_id,
       component_id, FALSE, messages, n_messages, cancellable, error);
 }
 
+NICEAPI_EXPORT GSource *
+nice_agent_create_recv_source (NiceAgent *agent, guint stream_id,
+    guint component_id, GCancellable *cancellable)
+{
+  GSource *source = NULL;
+
+  g_return_val_if_fail (NICE_IS_AGENT (agent), NULL);
+  g_return_val_if_fail (stream_id >= 1, NULL);
+  g_return_val_if_fail (component_id >= 1, NULL);
+  g_return_val_if_fail (
+      cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
+
+  agent_lock (agent);
+
+  if (agent_find_component (agent, stream_id, component_id, NULL, NULL))
+    source = nice_component_input_source_new (agent, stream_id, component_id,
+        NULL, cancellable);
+
+  agent_unlock_and_emit (agent);
+
+  return source;
+}
+
 NICEAPI_EXPORT gssize
 nice_agent_recv_nonblocking (NiceAgent *agent, guint stream_id,
     guint component_id, guint8 *buf, gsize buf_len, GCancellable *cancellable,
@@ -5059,6 +5869,158 @@ nice_agent_recv_nonblocking (NiceAgent *agent, guint stream_id,
  * of messages otherwise.
  */
 
+/* Largest payload of the RFC 4571 frames messages are split into, leaving
+ * enough space for TURN overhead as well. */
+#define MAX_FRAME_PAYLOAD 0xF800
+
+/* Maximum number of vectors in a single framed send, including the frame
+ * headers. */
+#define MAX_FRAMED_SEND_VECTORS 64
+
+/* Frames being gathered for a single vectored send in
+ * agent_send_framed_messages(). Lives on the stack. */
+typedef struct {
+  GOutputVector bufs[MAX_FRAMED_SEND_VECTORS];
+  guint16 headers[MAX_FRAMED_SEND_VECTORS / 2];
+  guint n_bufs;
+  guint n_headers;
+  guint n_messages;       /* messages whose last byte is in @bufs */
+  gboolean continuation;  /* @bufs continue an already accepted message */
+} FramedSend;
+
+/* Send the gathered frames. If they start a new message, the socket may
+ * refuse them because it can’t send right now; otherwise they must be sent
+ * (or queued) so that the peer doesn’t see a truncated frame.
+ *
+ * Returns: 1 if the frames were sent or queued, 0 if they were refused, or
+ * -1 on error */
+static gint
+framed_send_flush (FramedSend *send, NiceComponent *component,
+    NiceSocket *sock, const NiceAddress *addr)
+{
+  NiceOutputMessage local_message = { send->bufs, send->n_bufs };
+  gint ret;
+
+  if (send->n_bufs == 0)
+    return 1;
+
+  if (send->continuation)
+    ret = nice_socket_send_messages_reliable (sock, addr, &local_message, 1);
+  else
+    ret = nice_socket_send_messages (sock, addr, &local_message, 1);
+
+  if (component->tcp_writable_cancellable &&
+      !nice_socket_can_send (sock, addr))
+    g_cancellable_reset (component->tcp_writable_cancellable);
+
+  send->n_bufs = 0;
+  send->n_headers = 0;
+
+  return ret;
+}
+
+/* Send @messages over the reliable @sock, framing them with RFC 4571.
+ *
+ * The frame headers and the vectors pointing into the messages’ buffers are
+ * gathered on the stack, so that the frames of many messages go out in a
+ * single vectored send, without any allocation. Messages longer than
+ * %MAX_FRAME_PAYLOAD are split into several frames. Once the start of a
+ * message has been accepted by the socket, the rest of it is sent reliably so
+ * that the message is sent as a whole.
+ *
+ * Returns: the number of non-empty messages sent, or -1 on error */
+static gint
+agent_send_framed_messages (NiceComponent *component, NiceSocket *sock,
+    const NiceAddress *addr, const NiceOutputMessage *messages,
+    guint n_messages)
+{
+  FramedSend send;
+  gint n_sent = 0;
+  gint ret;
+  guint i;
+
+  send.n_bufs = 0;
+  send.n_headers = 0;
+  send.n_messages = 0;
+  send.continuation = FALSE;
+
+  for (i = 0; i < n_messages; i++) {
+    const NiceOutputMessage *message = &messages[i];
+    gsize message_len = output_message_get_size (message);
+    guint j = 0;
+    gsize buf_offset = 0;
+
+    while (message_len > 0) {
+      gsize frame_left = MIN (message_len, MAX_FRAME_PAYLOAD);
+
+      /* A header and at least one chunk of payload must fit. */
+      if (send.n_bufs + 2 > MAX_FRAMED_SEND_VECTORS) {
+        ret = framed_send_flush (&send, component, sock, addr);
+        if (ret != 1)
+          goto flush_failed;
+        n_sent += send.n_messages;
+        send.n_messages = 0;
+        send.continuation = (message_len < output_message_get_size (message));
+      }
+
+      send.headers[send.n_headers] = htons ((guint16) frame_left);
+      send.bufs[send.n_bufs].buffer = &send.headers[send.n_headers];
+      send.bufs[send.n_bufs].size = sizeof (guint16);
+      send.n_headers++;
+      send.n_bufs++;
+      message_len -= frame_left;
+
+      /* Point at the frame’s payload in the message’s buffers. */
+      while (frame_left > 0) {
+        const GOutputVector *buffer = &message->buffers[j];
+        gsize len = MIN (buffer->size - buf_offset, frame_left);
+
+        if (len > 0) {
+          if (send.n_bufs == MAX_FRAMED_SEND_VECTORS) {
+            /* Split the frame; the rest of it is sent reliably. */
+            ret = framed_send_flush (&send, component, sock, addr);
+            if (ret != 1)
+              goto flush_failed;
+            n_sent += send.n_messages;
+            send.n_messages = 0;
+            send.continuation = TRUE;
+          }
+
+          send.bufs[send.n_bufs].buffer =
+              (const guint8 *) buffer->buffer + buf_offset;
+          send.bufs[send.n_bufs].size = len;
+          send.n_bufs++;
+        }
+
+        buf_offset += len;
+        frame_left -= len;
+        if (buf_offset == buffer->size) {
+          j++;
+          buf_offset = 0;
+        }
+      }
+    }
+
+    /* An empty message sends no frame, and isn’t counted as sent. */
+    if (output_message_get_size (message) > 0)
+      send.n_messages++;
+  }
+
+  ret = framed_send_flush (&send, component, sock, addr);
+  if (ret == 1)
+    n_sent += send.n_messages;
+  else if (ret < 0 && n_sent == 0)
+    n_sent = ret;
+
+  return n_sent;
+
+flush_failed:
+  /* Refused or failed before the start of the message was accepted. */
+  if (ret < 0 && n_sent == 0)
+    return ret;
+  return n_sent;
+}
+
 static gint
 nice_agent_send_messages_nonblocking_internal (
   NiceAgent *agent,
@@ -5088,28 +6050,35 @@ nice_agent_send_messages_nonblocking_internal (
 
   /* FIXME: Cancellation isn’t yet supported, but it doesn’t matter because
    * we only deal with non-blocking writes. */
-  if (component->selected_pair.local != NULL) {
-    if (nice_debug_is_enabled ()) {
-      gchar tmpbuf[INET6_ADDRSTRLEN];
-      nice_address_to_string (&component->selected_pair.remote->c.addr, tmpbuf);
-
-      nice_debug_verbose ("Agent %p : s%d:%d: sending %u messages to "
-          "[%s]:%d", agent, stream_id, component_id, n_messages, tmpbuf,
-          nice_address_get_port (&component->selected_pair.remote->c.addr));
-    }
+  if (component->selected_pair.keepalive.consent_lost) {
+    g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE,
+        "Consent to send has expired.");
+  } else if (component->selected_pair.local != NULL) {
+    nice_log (NICE_LOG_AGENT, NICE_LOG_VERBOSE,
+        &component->selected_pair.remote->c.addr,
+        "Agent %p : s%u:%u: sending %u messages to %a",
+        NICE_LOG_PTR (agent), stream_id, component_id, n_messages);
 
     if(agent->reliable &&
         !nice_socket_is_reliable (component->selected_pair.local->sockptr)) {
       if (!pseudo_tcp_socket_is_closed (component->tcp)) {
         /* Send on the pseudo-TCP socket. */
         n_sent = pseudo_tcp_socket_send_messages (component->tcp, messages,
-            n_messages, allow_partial, &child_error);
+            n_messages, allow_partial, agent->reliable_messages,
+            &child_error);
         adjust_tcp_clock (agent, stream, component);
 
         if (!pseudo_tcp_socket_can_send (component->tcp))
           g_cancellable_reset (component->tcp_writable_cancellable);
-        if (n_sent < 0 && !g_error_matches (child_error, G_IO_ERROR,
-                G_IO_ERROR_WOULD_BLOCK)) {
+        /* A message rejected in message-oriented mode leaves the
+         * connection usable. */
+        if (n_sent < 0 &&
+            !g_error_matches (child_error, G_IO_ERROR,
+                G_IO_ERROR_WOULD_BLOCK) &&
+            !g_error_matches (child_error, G_IO_ERROR,
+                G_IO_ERROR_MESSAGE_TOO_LARGE) &&
+            !g_error_matches (child_error, G_IO_ERROR,
+                G_IO_ERROR_INVALID_ARGUMENT)) {
           /* Signal errors */
           priv_pseudo_tcp_error (agent, component);
         }
@@ -5125,100 +6094,9 @@ nice_agent_send_messages_nonblocking_internal (
       addr = &component->selected_pair.remote->c.addr;
 
       if (nice_socket_is_reliable (sock)) {
-        guint i;
-
         /* ICE-TCP requires that all packets be framed with RFC4571 */
-        n_sent = 0;
-        for (i = 0; i < n_messages; i++) {
-          const NiceOutputMessage *message = &messages[i];
-          gsize message_len = output_message_get_size (message);
-          gsize offset = 0;
-          gsize current_offset = 0;
-          gsize offset_in_buffer = 0;
-          gint n_sent_framed;
-          GOutputVector *local_bufs;
-          NiceOutputMessage local_message;
-          guint j;
-          guint n_bufs = 0;
-
-          /* Count the number of buffers. */
-          if (message->n_buffers == -1) {
-            for (j = 0; message->buffers[j].buffer != NULL; j++)
-              n_bufs++;
-          } else {
-            n_bufs = message->n_buffers;
-          }
-
-          local_bufs = g_malloc_n (n_bufs + 1, sizeof (GOutputVector));
-          local_message.buffers = local_bufs;
-
-          while (message_len > 0) {
-            guint16 packet_len;
-            guint16 rfc4571_frame;
-
-            /* Split long messages into 62KB packets, leaving enough space
-             * for TURN overhead as well */
-            if (message_len > 0xF800)
-              packet_len = 0xF800;
-            else
-              packet_len = (guint16) message_len;
-            message_len -= packet_len;
-            rfc4571_frame = htons (packet_len);
-
-            local_bufs[0].buffer = &rfc4571_frame;
-            local_bufs[0].size = sizeof (guint16);
-
-            local_message.n_buffers = 1;
-            /* If we had to split the message, we need to find which buffer
-             * to start copying from and our offset within that buffer */
-            offset_in_buffer = 0;
-            current_offset = 0;
-            for (j = 0; j < n_bufs; j++) {
-              if (message->buffers[j].size < offset - current_offset) {
-                current_offset += message->buffers[j].size;
-                continue;
-              } else {
-                offset_in_buffer = offset - current_offset;
-                current_offset = offset;
-                break;
-              }
-            }
-
-            /* Keep j position in array and start copying from there */
-            for (; j < n_bufs; j++) {
-              local_bufs[local_message.n_buffers].buffer =
-                  ((guint8 *) message->buffers[j].buffer) + offset_in_buffer;
-              local_bufs[local_message.n_buffers].size =
-                  MIN (message->buffers[j].size, packet_len);
-              packet_len -= local_bufs[local_message.n_buffers].size;
-              offset += local_bufs[local_message.n_buffers++].size;
-              offset_in_buffer = 0;
-            }
-
-            /* If we sent part of the message already, then send the rest
-             * reliably so the message is sent as a whole even if it's split */
-            if (current_offset == 0)
-              n_sent_framed = nice_socket_send_messages (sock, addr,
-                  &local_message, 1);
-            else
-              n_sent_framed = nice_socket_send_messages_reliable (sock, addr,
-                  &local_message, 1);
-
-            if (component->tcp_writable_cancellable &&
-                !nice_socket_can_send (sock, addr))
-              g_cancellable_reset (component->tcp_writable_cancellable);
-
-            if (n_sent_framed < 0 && n_sent == 0)
-              n_sent = n_sent_framed;
-            if (n_sent_framed != 1)
-              break;
-            /* This is the last split frame, increment n_sent */
-            if (message_len == 0)
-              n_sent ++;
-          }
-          g_free (local_bufs);
-        }
-
+        n_sent = agent_send_framed_messages (component, sock, addr, messages,
+            n_messages);
       } else {
         n_sent = nice_socket_send_messages (sock, addr, messages, n_messages);
       }
@@ -5226,9 +6104,19 @@ nice_agent_send_messages_nonblocking_internal (
       if (n_sent < 0) {
         g_set_error (&child_error, G_IO_ERROR, G_IO_ERROR_FAILED,
             "Error writing data to socket.");
-      } else if (n_sent > 0 && allow_partial) {
-        g_assert_cmpuint (n_messages, ==, 1);
-        n_sent = output_message_get_size (messages);
+      } else if (n_sent > 0) {
+        gint i;
+
+        component->stats.packets_sent += n_sent;
+        for (i = 0; i < n_sent; i++)
+          component->stats.bytes_sent += output_message_get_size (&messages[i]);
+        component->selected_pair.keepalive.last_media_sent =
+            g_get_monotonic_time ();
+
+        if (allow_partial) {
+          g_assert_cmpuint (n_messages, ==, 1);
+          n_sent = output_message_get_size (messages);
+        }
       }
     }
   } else {
@@ -5442,6 +6330,7 @@ nice_agent_dispose (GObject *object)
 
   /* step: free resources for the connectivity check timers */
   conn_check_free (agent);
+  conn_check_free_indexes (agent);
 
   priv_remove_keepalive_timer (agent);
 
@@ -5478,6 +6367,12 @@ nice_agent_dispose (GObject *object)
     free_queued_signal (sig);
   }
 
+  /* Only once all the sockets which could refer to it are gone. */
+  if (agent->capture) {
+    nice_capture_free (agent->capture);
+    agent->capture = NULL;
+  }
+
   g_free (agent->stun_server_ip);
   agent->stun_server_ip = NULL;
 
@@ -5655,9 +6550,17 @@ component_io_cb (GSocket *gsocket, GIOCondition condition, gpointer user_data)
       NiceInputMessage local_message = { &local_bufs, 1, NULL, 0 };
       RecvStatus retval;
 
-      /* Receive a single message. */
-      retval = agent_recv_message_unlocked (agent, stream, component,
-          socket_source->socket, &local_message);
+      /* Receive a single message, or as much of the bytestream as fits. */
+      if (agent_socket_is_bytestream (agent, socket_source->socket)) {
+        NiceInputMessageIter iter;
+
+        nice_input_message_iter_reset (&iter);
+        retval = agent_recv_bytestream_unlocked (agent, stream, component,
+            socket_source->socket, &local_message, 1, &iter);
+      } else {
+        retval = agent_recv_message_unlocked (agent, stream, component,
+            socket_source->socket, &local_message);
+      }
 
       if (retval == RECV_WOULD_BLOCK) {
         /* EWOULDBLOCK. */
@@ -5687,6 +6590,29 @@ component_io_cb (GSocket *gsocket, GIOCondition condition, gpointer user_data)
       }
       has_io_callback = nice_component_has_io_callback (component);
     }
+  } else if (component->recv_messages != NULL &&
+      agent_socket_is_bytestream (agent, socket_source->socket)) {
+    RecvStatus retval;
+
+    /* Receive as much of the bytestream as fits, continuing where the
+     * previous read left off in the buffers. */
+    retval = agent_recv_bytestream_unlocked (agent, stream, component,
+        socket_source->socket, component->recv_messages,
+        component->n_recv_messages, &component->recv_messages_iter);
+
+    if (retval == RECV_SUCCESS) {
+      g_clear_error (component->recv_buf_error);
+    } else if (retval == RECV_WOULD_BLOCK) {
+      if (nice_input_message_iter_get_n_valid_messages (
+              &component->recv_messages_iter) == 0 &&
+          component->recv_buf_error != NULL &&
+          *component->recv_buf_error == NULL) {
+        g_set_error_literal (component->recv_buf_error, G_IO_ERROR,
+            G_IO_ERROR_WOULD_BLOCK, g_strerror (EAGAIN));
+      }
+    } else if (retval == RECV_ERROR) {
+      remove_source = TRUE;
+    }
   } else if (component->recv_messages != NULL) {
     RecvStatus retval;
 
@@ -5784,7 +6710,9 @@ nice_agent_attach_recv (
     goto done;
   }
 
-  if (ctx == NULL)
+  /* Detaching without a context hands the sockets back to the component’s
+   * own context, which nice_agent_recv_messages() iterates. */
+  if (ctx == NULL && func != NULL)
     ctx = g_main_context_default ();
 
   /* Set the component’s I/O context. */
@@ -6072,6 +7000,58 @@ void agent_timeout_add_seconds_with_context (NiceAgent *agent,
       function, user_data);
 }
 
+static gboolean
+ready_time_source_dispatch (GSource *source, GSourceFunc callback,
+    gpointer user_data)
+{
+  /* Disarm the source; the callback sets the next ready time if any. */
+  g_source_set_ready_time (source, -1);
+
+  return callback (user_data);
+}
+
+static GSourceFuncs ready_time_source_funcs = {
+  NULL,
+  NULL,
+  ready_time_source_dispatch,
+  NULL,
+};
+
+/* Like agent_timeout_add_with_context(), but the source fires once at the
+ * monotonic time @ready_time (in microseconds) and then stays idle until the
+ * callback, or anyone else, moves it with g_source_set_ready_time(). Unlike a
+ * timeout source, it does not re-arm itself with a fixed interval after
+ * dispatch, so it can be rescheduled in place for every deadline.
+ */
+void agent_timeout_add_ready_time_with_context (NiceAgent *agent,
+    GSource **out, const gchar *name, gint64 ready_time,
+    NiceTimeoutLockedCallback function, gpointer user_data)
+{
+  GSource *source;
+  TimeoutData *data;
+
+  g_return_if_fail (function != NULL);
+  g_return_if_fail (out != NULL);
+
+  /* Destroy any existing source. */
+  if (*out != NULL) {
+    g_source_destroy (*out);
+    g_source_unref (*out);
+    *out = NULL;
+  }
+
+  source = g_source_new (&ready_time_source_funcs, sizeof (GSource));
+  g_source_set_ready_time (source, ready_time);
+
+  g_source_set_name (source, name);
+  data = timeout_data_new (agent, function, user_data);
+  g_source_set_callback (source, timeout_cb, data,
+      (GDestroyNotify)timeout_data_destroy);
+  g_source_attach (source, agent->main_context);
+
+  *out = source;
+}
+
 NICEAPI_EXPORT gboolean
 nice_agent_set_selected_remote_candidate (
   NiceAgent *agent,
@@ -6920,6 +7900,189 @@ agent_socket_send (NiceSocket *sock, const NiceAddress *addr, gsize len,
   }
 }
 
+NICEAPI_EXPORT gboolean
+nice_agent_get_component_stats (NiceAgent *agent,
+    guint stream_id, guint component_id, NiceComponentStats *stats)
+{
+  NiceComponent *component;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (NICE_IS_AGENT (agent), FALSE);
+  g_return_val_if_fail (stream_id >= 1, FALSE);
+  g_return_val_if_fail (component_id >= 1, FALSE);
+  g_return_val_if_fail (stats != NULL, FALSE);
+
+  agent_lock (agent);
+
+  if (agent_find_component (agent, stream_id, component_id, NULL,
+          &component)) {
+    *stats = component->stats;
+
+    if (component->tcp != NULL)
+      g_object_get (component->tcp,
+          "cwnd", &stats->tcp_cwnd,
+          "retransmissions", &stats->tcp_retransmissions,
+          NULL);
+
+    ret = TRUE;
+  }
+
+  agent_unlock (agent);
+
+  return ret;
+}
+
+NICEAPI_EXPORT gboolean
+nice_agent_get_component_timeline (NiceAgent *agent,
+    guint stream_id, guint component_id, NiceComponentTimeline *timeline)
+{
+  NiceComponent *component;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (NICE_IS_AGENT (agent), FALSE);
+  g_return_val_if_fail (stream_id >= 1, FALSE);
+  g_return_val_if_fail (component_id >= 1, FALSE);
+  g_return_val_if_fail (timeline != NULL, FALSE);
+
+  agent_lock (agent);
+
+  if (agent_find_component (agent, stream_id, component_id, NULL,
+          &component)) {
+    *timeline = component->timeline;
+    ret = TRUE;
+  }
+
+  agent_unlock (agent);
+
+  return ret;
+}
+
+NICEAPI_EXPORT GSList *
+nice_agent_get_candidate_pair_stats (NiceAgent *agent,
+    guint stream_id, guint component_id)
+{
+  NiceStream *stream;
+  NiceComponent *component;
+  GSList *ret = NULL, *i;
+
+  g_return_val_if_fail (NICE_IS_AGENT (agent), NULL);
+  g_return_val_if_fail (stream_id >= 1, NULL);
+  g_return_val_if_fail (component_id >= 1, NULL);
+
+  agent_lock (agent);
+
+  if (!agent_find_component (agent, stream_id, component_id, &stream,
+          &component))
+    goto done;
+
+  /* A role conflict may have left the priorities to be recalculated. */
+  conn_check_refresh_pair_priorities (agent, stream);
+
+  for (i = stream->conncheck_list; i; i = i->next) {
+    CandidateCheckPair *p = i->data;
+    NiceCandidatePairStats *stats;
+
+    if (p->component_id != component_id)
+      continue;
+
+    stats = g_slice_new0 (NiceCandidatePairStats);
+    stats->local = nice_candidate_copy (p->local);
+    stats->remote = nice_candidate_copy (p->remote);
+    stats->priority = p->priority;
+    stats->valid = p->valid;
+    stats->nominated = p->nominated;
+    stats->selected =
+        p->local == (NiceCandidate *) component->selected_pair.local &&
+        p->remote == (NiceCandidate *) component->selected_pair.remote;
+    stats->rtt = p->rtt;
+    stats->smoothed_rtt = p->smoothed_rtt;
+    stats->requests_sent = p->requests_sent;
+    stats->requests_received = p->requests_received;
+    stats->responses_sent = p->responses_sent;
+    stats->responses_received = p->responses_received;
+    stats->last_request_sent = p->last_request_sent;
+    stats->last_request_received = p->last_request_received;
+    stats->last_response_received = p->last_response_received;
+    if (stats->selected && agent->consent_freshness) {
+      stats->consent_time = component->selected_pair.keepalive.consent_time;
+      stats->consent_lost = component->selected_pair.keepalive.consent_lost;
+    }
+
+    ret = g_slist_prepend (ret, stats);
+  }
+
+  ret = g_slist_reverse (ret);
+
+done:
+  agent_unlock (agent);
+
+  return ret;
+}
+
+NICEAPI_EXPORT void
+nice_candidate_pair_stats_free (NiceCandidatePairStats *stats)
+{
+  if (stats == NULL)
+    return;
+
+  nice_candidate_free (stats->local);
+  nice_candidate_free (stats->remote);
+  g_slice_free (NiceCandidatePairStats, stats);
+}
+
+NICEAPI_EXPORT gboolean
+nice_agent_start_capture (NiceAgent *agent, const gchar *filename,
+    GError **error)
+{
+  GSList *i, *j, *k;
+  gboolean ret;
+
+  g_return_val_if_fail (NICE_IS_AGENT (agent), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  agent_lock (agent);
+
+  if (agent->capture == NULL)
+    agent->capture = nice_capture_new ();
+
+  ret = nice_capture_start (agent->capture, filename, error);
+
+  /* Sockets attached from now on are hooked up as they are attached. */
+  for (i = agent->streams; ret && i; i = i->next) {
+    NiceStream *stream = i->data;
+
+    for (j = stream->components; j; j = j->next) {
+      NiceComponent *component = j->data;
+
+      for (k = component->socket_sources; k; k = k->next) {
+        SocketSource *socket_source = k->data;
+
+        socket_source->socket->capture = agent->capture;
+      }
+    }
+  }
+
+  agent_unlock (agent);
+
+  return ret;
+}
+
+NICEAPI_EXPORT void
+nice_agent_stop_capture (NiceAgent *agent)
+{
+  g_return_if_fail (NICE_IS_AGENT (agent));
+
+  agent_lock (agent);
+
+  /* The sockets keep pointing to the capture, which ignores them until it is
+   * started again. */
+  if (agent->capture)
+    nice_capture_stop (agent->capture);
+
+  agent_unlock (agent);
+}
+
 NiceComponentState
 nice_agent_get_component_state (NiceAgent *agent,
     guint stream_id, guint component_id)
@@ -223,6 +223,149 @@ typedef struct {
   gint n_buffers;
 } NiceOutputMessage;
 
+/**
+ * NiceComponentStats:
+ * @bytes_sent: bytes of data sent on the selected pair, including pseudo-TCP
+ * segment headers in reliable mode, but not STUN
+ * @packets_sent: packets of data sent, counted as @bytes_sent
+ * @bytes_received: bytes of data received from valid remote candidates,
+ * counted as @bytes_sent
+ * @packets_received: packets of data received, counted as @bytes_received
+ * @packets_dropped: packets received from a source which is not a valid
+ * remote candidate, and so discarded
+ * @stun_requests_sent: STUN connectivity check and keepalive requests sent,
+ * including retransmissions
+ * @stun_requests_received: STUN requests received
+ * @stun_responses_sent: STUN success and error responses sent
+ * @stun_responses_received: STUN success and error responses received
+ * @stun_retransmissions: STUN requests sent again because no response arrived
+ * in time
+ * @rtt: round-trip time of the last connectivity check or keepalive
+ * transaction which was answered without being retransmitted, in
+ * microseconds, or 0 if there was none yet
+ * @smoothed_rtt: exponentially weighted average of the @rtt samples, as for
+ * TCP, in microseconds
+ * @tcp_retransmissions: pseudo-TCP segments retransmitted; only set for
+ * reliable agents (see #PseudoTcpSocket:retransmissions)
+ * @tcp_cwnd: current pseudo-TCP congestion window, in bytes; only set for
+ * reliable agents
+ *
+ * Transport statistics of a component, as returned by
+ * nice_agent_get_component_stats(). The counters start at zero when the
+ * component is created, and are never reset. The structure is padded so that
+ * counters can be added without breaking the ABI.
+ *
+ * Since: 0.1.19
+ */
+typedef struct {
+  guint64 bytes_sent;
+  guint64 packets_sent;
+  guint64 bytes_received;
+  guint64 packets_received;
+  guint64 packets_dropped;
+  guint64 stun_requests_sent;
+  guint64 stun_requests_received;
+  guint64 stun_responses_sent;
+  guint64 stun_responses_received;
+  guint64 stun_retransmissions;
+  guint rtt;
+  guint smoothed_rtt;
+  guint64 tcp_retransmissions;
+  guint tcp_cwnd;
+
+  /*< private >*/
+  gpointer _padding[8];
+} NiceComponentStats;
+
+/**
+ * NiceCandidatePairStats:
+ * @local: (transfer full): a copy of the local candidate of the pair
+ * @remote: (transfer full): a copy of the remote candidate of the pair
+ * @priority: the pair priority
+ * @valid: whether a connectivity check on the pair succeeded
+ * @nominated: whether the pair has been nominated
+ * @selected: whether the pair is the selected pair of its component
+ * @rtt: round-trip time of the last connectivity check or keepalive on the
+ * pair which was answered without being retransmitted, in microseconds, or 0
+ * if there was none yet
+ * @smoothed_rtt: exponentially weighted average of the @rtt samples, in
+ * microseconds
+ * @requests_sent: connectivity check and keepalive requests sent on the pair,
+ * including retransmissions
+ * @requests_received: connectivity check requests received on the pair
+ * @responses_sent: successful responses sent to @requests_received
+ * @responses_received: responses received to @requests_sent
+ * @last_request_sent: monotonic time (see g_get_monotonic_time()) at which
+ * the last request was sent, or 0
+ * @last_request_received: monotonic time at which the last request was
+ * received, or 0
+ * @last_response_received: monotonic time at which the last response was
+ * received, or 0. The peer is known to still be reachable over the pair, and
+ * willing to receive on it, as long as this is recent.
+ * @consent_time: monotonic time at which the peer last granted consent to
+ * send on the pair, when it is the selected pair and
+ * #NiceAgent:consent-freshness is enabled, or 0
+ * @consent_lost: whether consent to send on the selected pair expired, in
+ * which case its component failed and sending on it fails
+ *
+ * Statistics of a candidate pair of the connectivity check list, as returned
+ * by nice_agent_get_candidate_pair_stats(). Free it with
+ * nice_candidate_pair_stats_free().
+ *
+ * Since: 0.1.19
+ */
+typedef struct {
+  NiceCandidate *local;
+  NiceCandidate *remote;
+  guint64 priority;
+  gboolean valid;
+  gboolean nominated;
+  gboolean selected;
+  guint rtt;
+  guint smoothed_rtt;
+  guint64 requests_sent;
+  guint64 requests_received;
+  guint64 responses_sent;
+  guint64 responses_received;
+  gint64 last_request_sent;
+  gint64 last_request_received;
+  gint64 last_response_received;
+  gint64 consent_time;
+  gboolean consent_lost;
+} NiceCandidatePairStats;
+
+/**
+ * NiceComponentTimeline:
+ * @gathering_started: see %NICE_COMPONENT_MILESTONE_GATHERING_STARTED
+ * @gathering_done: see %NICE_COMPONENT_MILESTONE_GATHERING_DONE
+ * @first_check_sent: see %NICE_COMPONENT_MILESTONE_FIRST_CHECK_SENT
+ * @first_check_succeeded: see %NICE_COMPONENT_MILESTONE_FIRST_CHECK_SUCCEEDED
+ * @nominated: see %NICE_COMPONENT_MILESTONE_NOMINATED
+ * @connected: see %NICE_COMPONENT_MILESTONE_CONNECTED
+ * @ready: see %NICE_COMPONENT_MILESTONE_READY
+ * @failed: see %NICE_COMPONENT_MILESTONE_FAILED
+ *
+ * The monotonic times (see g_get_monotonic_time()), in microseconds, at which
+ * a component first reached each step of its establishment, 0 meaning not
+ * yet. An ICE restart resets those which follow the gathering. The structure
+ * is padded so that steps can be added without breaking the ABI.
+ *
+ * Since: 0.1.19
+ */
+typedef struct {
+  gint64 gathering_started;
+  gint64 gathering_done;
+  gint64 first_check_sent;
+  gint64 first_check_succeeded;
+  gint64 nominated;
+  gint64 connected;
+  gint64 ready;
+  gint64 failed;
+
+  /*< private >*/
+  gpointer _padding[8];
+} NiceComponentTimeline;
+
 
 #define NICE_TYPE_AGENT nice_agent_get_type()
 
@@ -292,6 +435,45 @@ typedef enum
   NICE_COMPONENT_STATE_LAST
 } NiceComponentState;
 
+/**
+ * NiceComponentMilestone:
+ * @NICE_COMPONENT_MILESTONE_GATHERING_STARTED: nice_agent_gather_candidates()
+ * was called on the stream
+ * @NICE_COMPONENT_MILESTONE_GATHERING_DONE: the stream finished gathering
+ * its candidates
+ * @NICE_COMPONENT_MILESTONE_FIRST_CHECK_SENT: the first connectivity check
+ * request was sent
+ * @NICE_COMPONENT_MILESTONE_FIRST_CHECK_SUCCEEDED: the first successful
+ * response to a connectivity check was received
+ * @NICE_COMPONENT_MILESTONE_NOMINATED: a pair was nominated and selected
+ * for the first time
+ * @NICE_COMPONENT_MILESTONE_CONNECTED: the component first reached
+ * %NICE_COMPONENT_STATE_CONNECTED
+ * @NICE_COMPONENT_MILESTONE_READY: the component first reached
+ * %NICE_COMPONENT_STATE_READY
+ * @NICE_COMPONENT_MILESTONE_FAILED: the component first reached
+ * %NICE_COMPONENT_STATE_FAILED
+ * @NICE_COMPONENT_MILESTONE_LAST: Dummy milestone
+ *
+ * The steps of the establishment of a component whose time is recorded in
+ * its #NiceComponentTimeline.
+ * <para> See also: #NiceAgent::component-milestone </para>
+ *
+ * Since: 0.1.19
+ */
+typedef enum
+{
+  NICE_COMPONENT_MILESTONE_GATHERING_STARTED,
+  NICE_COMPONENT_MILESTONE_GATHERING_DONE,
+  NICE_COMPONENT_MILESTONE_FIRST_CHECK_SENT,
+  NICE_COMPONENT_MILESTONE_FIRST_CHECK_SUCCEEDED,
+  NICE_COMPONENT_MILESTONE_NOMINATED,
+  NICE_COMPONENT_MILESTONE_CONNECTED,
+  NICE_COMPONENT_MILESTONE_READY,
+  NICE_COMPONENT_MILESTONE_FAILED,
+  NICE_COMPONENT_MILESTONE_LAST
+} NiceComponentMilestone;
+
 
 /**
  * NiceComponentType:
@@ -407,6 +589,10 @@ typedef enum
  * @NICE_AGENT_OPTION_ICE_TRICKLE: Enable ICE trickle mode
  * @NICE_AGENT_OPTION_SUPPORT_RENOMINATION: Enable renomination triggered by NOMINATION STUN attribute
  * proposed here: https://tools.ietf.org/html/draft-thatcher-ice-renomination-00
+ * @NICE_AGENT_OPTION_RELIABLE_MESSAGES: Preserve message boundaries in
+ * reliable mode (see #NiceAgent:reliable-messages). Since: 0.1.19
+ * @NICE_AGENT_OPTION_CONSENT_FRESHNESS: Enable RFC 7675 consent freshness
+ * (see #NiceAgent:consent-freshness). Since: 0.1.19
  *
  * These are options that can be passed to nice_agent_new_full(). They set
  * various properties on the agent. Not including them sets the property to
@@ -420,6 +606,8 @@ typedef enum {
   NICE_AGENT_OPTION_LITE_MODE = 1 << 2,
   NICE_AGENT_OPTION_ICE_TRICKLE = 1 << 3,
   NICE_AGENT_OPTION_SUPPORT_RENOMINATION = 1 << 4,
+  NICE_AGENT_OPTION_RELIABLE_MESSAGES = 1 << 5,
+  NICE_AGENT_OPTION_CONSENT_FRESHNESS = 1 << 6,
 } NiceAgentOption;
 
 /**
@@ -973,6 +1161,10 @@ nice_agent_restart_stream (
  * ensure all pending I/O callbacks have been received before calling this
  * function to unset @func, otherwise data loss of received packets may occur.
  *
+ * Since 0.1.19, if @ctx is %NULL too, the sockets are handed back to the
+ * component's own context rather than attached to the default one, so that
+ * the pair can then be received from with nice_agent_recv_messages().
+ *
  * Returns: %TRUE on success, %FALSE if the stream or component IDs are invalid.
  */
 gboolean
@@ -1043,7 +1235,9 @@ nice_agent_recv (
  * block until @n_messages messages have been received, each of which does not
  * have to fill all the buffers in its #NiceInputMessage. In the non-reliable
  * case, each #NiceInputMessage must have enough buffers to contain an entire
- * message (65536 bytes), or any excess data may be silently dropped.
+ * message (65536 bytes), or any excess data may be silently dropped. If
+ * #NiceAgent:reliable-messages is set, reliable mode behaves like non-reliable
+ * mode: each #NiceInputMessage receives exactly one message sent by the peer.
  *
  * For each received message, #NiceInputMessage::length will be set to the
  * number of valid bytes stored in the message’s buffers. The bytes are stored
@@ -1162,6 +1356,44 @@ nice_agent_recv_messages_nonblocking (
     GCancellable *cancellable,
     GError **error);
 
+/**
+ * nice_agent_create_recv_source:
+ * @agent: a #NiceAgent
+ * @stream_id: the ID of the stream to poll
+ * @component_id: the ID of the component to poll
+ * @cancellable: (allow-none): a #GCancellable to also dispatch the source on
+ * cancellation, or %NULL
+ *
+ * Create a #GSource which is dispatched whenever one of the sockets of the
+ * given stream/component combination on @agent is readable, without receiving
+ * anything from it. This lets a single thread wait on many components by
+ * attaching their sources to one #GMainContext, and then receive from the
+ * ready ones with nice_agent_recv_messages_nonblocking() straight into its own
+ * buffers, rather than having the data copied out of the agent's buffer as
+ * with nice_agent_attach_recv().
+ *
+ * The source follows the sockets as they are added to and removed from the
+ * component. A readable socket may only carry STUN packets, so receiving may
+ * then fail with %G_IO_ERROR_WOULD_BLOCK. Data already read ahead from an
+ * ICE-TCP socket or into the pseudo-TCP buffer does not make it readable
+ * again, so keep receiving until it would block.
+ *
+ * Connect a #GSourceFunc with g_source_set_callback(). As with
+ * nice_agent_recv_messages(), this must not be used in combination with
+ * nice_agent_attach_recv() on the same stream/component pair.
+ *
+ * Returns: (transfer full): a new #GSource; unref with g_source_unref(), or
+ * %NULL if the stream/component pair doesn't exist
+ *
+ * Since: 0.1.19
+ */
+GSource *
+nice_agent_create_recv_source (
+    NiceAgent *agent,
+    guint stream_id,
+    guint component_id,
+    GCancellable *cancellable);
+
 /**
  * nice_agent_set_selected_pair:
  * @agent: The #NiceAgent Object
@@ -1636,6 +1868,118 @@ nice_agent_get_component_state (NiceAgent *agent,
     guint stream_id,
     guint component_id);
 
+/**
+ * nice_agent_get_component_stats:
+ * @agent: The #NiceAgent Object
+ * @stream_id: The ID of the stream
+ * @component_id: The ID of the component
+ * @stats: (out caller-allocates): return location for the statistics
+ *
+ * Retrieves a snapshot of the transport statistics of a component. The
+ * counters are maintained as packets are sent and received, so this is cheap
+ * enough to poll periodically.
+ *
+ * Returns: %TRUE on success, %FALSE if the component could not be found
+ *
+ * Since: 0.1.19
+ */
+gboolean
+nice_agent_get_component_stats (NiceAgent *agent,
+    guint stream_id,
+    guint component_id,
+    NiceComponentStats *stats);
+
+/**
+ * nice_agent_get_candidate_pair_stats:
+ * @agent: The #NiceAgent Object
+ * @stream_id: The ID of the stream
+ * @component_id: The ID of the component
+ *
+ * Retrieves the statistics of every candidate pair of a component which is
+ * currently in the connectivity check list, in the order of the list.
+ *
+ * Returns: (element-type NiceCandidatePairStats) (transfer full): a #GSList of
+ * #NiceCandidatePairStats, to be freed with g_slist_free_full() and
+ * nice_candidate_pair_stats_free()
+ *
+ * Since: 0.1.19
+ */
+GSList *
+nice_agent_get_candidate_pair_stats (NiceAgent *agent,
+    guint stream_id,
+    guint component_id);
+
+/**
+ * nice_agent_get_component_timeline:
+ * @agent: The #NiceAgent Object
+ * @stream_id: The ID of the stream
+ * @component_id: The ID of the component
+ * @timeline: (out caller-allocates): return location for the timeline
+ *
+ * Retrieves the times at which a component reached each step of its
+ * establishment, to measure where connection setup time goes.
+ *
+ * Returns: %TRUE on success, %FALSE if the stream or component could not be
+ * found
+ *
+ * Since: 0.1.19
+ */
+gboolean
+nice_agent_get_component_timeline (NiceAgent *agent,
+    guint stream_id,
+    guint component_id,
+    NiceComponentTimeline *timeline);
+
+/**
+ * nice_agent_start_capture:
+ * @agent: The #NiceAgent Object
+ * @filename: the file to write the capture to
+ * @error: (allow-none): return location for a #GError, or %NULL
+ *
+ * Starts writing the UDP datagrams sent and received by the agent to
+ * @filename, in the pcapng format, for offline analysis. Each packet is
+ * annotated with the stream and component it belongs to; its candidate pair is
+ * given by its source and destination addresses. Data relayed through a TURN
+ * server is captured both as exchanged with the server, and as exchanged with
+ * the peer, between the relayed candidate and the peer, annotated as relayed.
+ *
+ * The file is written from a separate thread, and packets are dropped from
+ * the capture rather than delaying the agent if it cannot keep up. TCP
+ * traffic is not captured.
+ *
+ * Returns: %TRUE on success, %FALSE if the file could not be created or a
+ * capture is already running
+ *
+ * Since: 0.1.19
+ */
+gboolean
+nice_agent_start_capture (NiceAgent *agent,
+    const gchar *filename,
+    GError **error);
+
+/**
+ * nice_agent_stop_capture:
+ * @agent: The #NiceAgent Object
+ *
+ * Stops the capture started with nice_agent_start_capture(), once every
+ * packet already captured has been written, and closes the file.
+ *
+ * Since: 0.1.19
+ */
+void
+nice_agent_stop_capture (NiceAgent *agent);
+
+/**
+ * nice_candidate_pair_stats_free:
+ * @stats: (transfer full): a #NiceCandidatePairStats to free
+ *
+ * Frees a #NiceCandidatePairStats and the candidates it holds.
+ *
+ * Since: 0.1.19
+ */
+void
+nice_candidate_pair_stats_free (NiceCandidatePairStats *stats);
+
 /**
  * nice_agent_peer_candidate_gathering_done:
  * @agent: The #NiceAgent Object
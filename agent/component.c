@@ -87,6 +87,75 @@ nice_component_detach_socket (NiceComponent *component, NiceSocket *nicesock);
 static void
 nice_component_clear_selected_pair (NiceComponent *component);
 
+/* The remote candidates are indexed by address, with the IPv6 scope id left
+ * out of the key, as nice_address_equal() treats a zero one as a wildcard.
+ * Lookups must still compare each candidate of the list with
+ * nice_address_equal(). */
+static void
+priv_address_key (const NiceAddress *addr, NiceAddress *key)
+{
+  *key = *addr;
+  if (key->s.addr.sa_family == AF_INET6)
+    key->s.ip6.sin6_scope_id = 0;
+}
+
+static guint
+priv_address_key_hash (gconstpointer key)
+{
+  const NiceAddress *addr = key;
+  const guint32 *words;
+  guint hash;
+
+  if (addr->s.addr.sa_family == AF_INET)
+    return addr->s.ip4.sin_addr.s_addr ^ addr->s.ip4.sin_port;
+
+  words = (const guint32 *) &addr->s.ip6.sin6_addr;
+  hash = words[0] ^ words[1] ^ words[2] ^ words[3];
+
+  return hash ^ addr->s.ip6.sin6_port;
+}
+
+static gboolean
+priv_address_key_equal (gconstpointer a, gconstpointer b)
+{
+  return nice_address_equal (a, b);
+}
+
+static void
+priv_index_remote_candidate (NiceComponent *cmp, NiceCandidate *candidate,
+    gboolean add)
+{
+  NiceAddress lookup;
+  gpointer key, value;
+  GSList *candidates;
+
+  if (!nice_address_is_valid (&candidate->addr))
+    return;
+
+  priv_address_key (&candidate->addr, &lookup);
+
+  /* the list head may change, so take it out of the table and put the
+   * updated one back */
+  if (g_hash_table_lookup_extended (cmp->remote_candidates_by_addr, &lookup,
+          &key, &value)) {
+    g_hash_table_steal (cmp->remote_candidates_by_addr, &lookup);
+  } else {
+    key = nice_address_dup (&lookup);
+    value = NULL;
+  }
+
+  candidates = value;
+  if (add)
+    candidates = g_slist_append (candidates, candidate);
+  else
+    candidates = g_slist_remove (candidates, candidate);
+
+  if (candidates)
+    g_hash_table_insert (cmp->remote_candidates_by_addr, key, candidates);
+  else
+    nice_address_free (key);
+}
+
 
 void
 incoming_check_free (IncomingCheck *icheck)
@@ -201,6 +270,7 @@ nice_component_remove_socket (NiceAgent *agent, NiceComponent *cmp,
     nice_candidate_free ((NiceCandidate *) candidate);
 
     cmp->local_candidates = g_slist_delete_link (cmp->local_candidates, i);
+    nice_component_invalidate_credentials (cmp);
     i = next;
   }
 
@@ -225,9 +295,11 @@ nice_component_remove_socket (NiceAgent *agent, NiceComponent *cmp,
     if (stream)
       conn_check_prune_socket (agent, stream, cmp, candidate->sockptr);
 
+    priv_index_remote_candidate (cmp, (NiceCandidate *) candidate, FALSE);
     nice_candidate_free ((NiceCandidate *) candidate);
 
     cmp->remote_candidates = g_slist_delete_link (cmp->remote_candidates, i);
+    nice_component_invalidate_credentials (cmp);
     i = next;
   }
 
@@ -293,6 +365,7 @@ nice_component_clean_turn_servers (NiceAgent *agent, NiceComponent *cmp)
       relay_candidates = g_slist_append(relay_candidates, candidate);
     }
     cmp->local_candidates = g_slist_delete_link (cmp->local_candidates, i);
+    nice_component_invalidate_credentials (cmp);
     i = next;
   }
 
@@ -318,6 +391,12 @@ nice_component_clear_selected_pair (NiceComponent *component)
     component->selected_pair.keepalive.tick_source = NULL;
   }
 
+  if (component->selected_pair.keepalive.consent_source != NULL) {
+    g_source_destroy (component->selected_pair.keepalive.consent_source);
+    g_source_unref (component->selected_pair.keepalive.consent_source);
+    component->selected_pair.keepalive.consent_source = NULL;
+  }
+
   memset (&component->selected_pair, 0, sizeof(CandidatePair));
 }
 
@@ -359,9 +438,11 @@ nice_component_close (NiceAgent *agent, NiceComponent *cmp)
         cmp->local_candidates);
   }
 
+  g_hash_table_remove_all (cmp->remote_candidates_by_addr);
   g_slist_free_full (cmp->remote_candidates,
       (GDestroyNotify) nice_candidate_free);
   cmp->remote_candidates = NULL;
+  nice_component_invalidate_credentials (cmp);
   nice_component_free_socket_sources (cmp);
 
   while ((c = g_queue_pop_head (&cmp->incoming_checks)))
@@ -379,6 +460,10 @@ nice_component_close (NiceAgent *agent, NiceComponent *cmp)
     g_clear_object (&cmp->tcp_writable_cancellable);
   }
 
+  g_clear_pointer (&cmp->tcp_frame_buf, g_free);
+  cmp->tcp_frame_buf_len = 0;
+  cmp->tcp_frame_header_len = 0;
+
   while ((data = g_queue_pop_head (&cmp->pending_io_messages)) != NULL)
     io_callback_data_free (data);
 
@@ -454,8 +539,10 @@ nice_component_restart (NiceComponent *cmp)
     else 
       nice_candidate_free (candidate);
   }
+  g_hash_table_remove_all (cmp->remote_candidates_by_addr);
   g_slist_free (cmp->remote_candidates),
     cmp->remote_candidates = NULL;
+  nice_component_invalidate_credentials (cmp);
 
   while ((c = g_queue_pop_head (&cmp->incoming_checks)))
     incoming_check_free (c);
@@ -463,6 +550,14 @@ nice_component_restart (NiceComponent *cmp)
   /* Reset the priority to 0 to make sure we get a new pair */
   cmp->selected_pair.priority = 0;
 
+  /* Connectivity is established again, but the local candidates are kept */
+  cmp->timeline.first_check_sent = 0;
+  cmp->timeline.first_check_succeeded = 0;
+  cmp->timeline.nominated = 0;
+  cmp->timeline.connected = 0;
+  cmp->timeline.ready = 0;
+  cmp->timeline.failed = 0;
+
   /* note: component state managed by agent */
 }
 
@@ -520,7 +615,12 @@ nice_component_find_remote_candidate (NiceComponent *component, const NiceAddres
 {
   GSList *i;
 
-  for (i = component->remote_candidates; i; i = i->next) {
+  if (nice_address_is_valid (addr))
+    i = nice_component_find_remote_candidates_by_addr (component, addr);
+  else
+    i = component->remote_candidates;
+
+  for (; i; i = i->next) {
     NiceCandidate *candidate = i->data;
 
     if (nice_address_equal(&candidate->addr, addr) &&
@@ -532,6 +632,235 @@ nice_component_find_remote_candidate (NiceComponent *component, const NiceAddres
   return NULL;
 }
 
+/*
+ * Appends @candidate to the remote candidates of @component.
+ */
+void
+nice_component_add_remote_candidate (NiceComponent *component,
+    NiceCandidate *candidate)
+{
+  component->remote_candidates = g_slist_append (component->remote_candidates,
+      candidate);
+  priv_index_remote_candidate (component, candidate, TRUE);
+  nice_component_invalidate_credentials (component);
+}
+
+/*
+ * Returns the remote candidates of @component which may have the address
+ * @addr, in the order of the remote candidates list. The candidates still
+ * have to be compared with nice_address_equal(), as the IPv6 scope id is
+ * not taken into account.
+ */
+GSList *
+nice_component_find_remote_candidates_by_addr (NiceComponent *component,
+    const NiceAddress *addr)
+{
+  NiceAddress key;
+
+  if (!nice_address_is_valid (addr))
+    return NULL;
+
+  priv_address_key (addr, &key);
+
+  return g_hash_table_lookup (component->remote_candidates_by_addr, &key);
+}
+
+struct _CredentialsTable {
+  GHashTable *by_candidate; /* owned Credentials of each candidate */
+  GPtrArray *list;        /* Credentials, in candidate order, each ufrag
+                             only once */
+  GHashTable *by_ufrag;   /* Credentials of list, hashed by ufrag */
+};
+
+static void
+priv_credentials_free (gpointer data)
+{
+  Credentials *credentials = data;
+
+  g_free (credentials->ufrag);
+  g_free (credentials->password);
+  g_slice_free (Credentials, credentials);
+}
+
+static guint
+priv_credentials_hash (gconstpointer key)
+{
+  const Credentials *credentials = key;
+  guint hash = 5381;
+  gsize i;
+
+  for (i = 0; i < credentials->ufrag_len; i++)
+    hash = hash * 33 + credentials->ufrag[i];
+
+  return hash;
+}
+
+static gboolean
+priv_credentials_equal (gconstpointer a, gconstpointer b)
+{
+  const Credentials *ca = a;
+  const Credentials *cb = b;
+
+  return ca->ufrag_len == cb->ufrag_len &&
+      memcmp (ca->ufrag, cb->ufrag, ca->ufrag_len) == 0;
+}
+
+static void
+priv_credentials_table_free (CredentialsTable *table)
+{
+  g_hash_table_unref (table->by_ufrag);
+  g_ptr_array_unref (table->list);
+  g_hash_table_unref (table->by_candidate);
+  g_slice_free (CredentialsTable, table);
+}
+
+static CredentialsTable *
+priv_credentials_table_new (GSList *candidates, gboolean decode,
+    const gchar *default_ufrag, const gchar *default_password)
+{
+  CredentialsTable *table = g_slice_new (CredentialsTable);
+  GSList *i;
+
+  table->by_candidate = g_hash_table_new_full (NULL, NULL, NULL,
+      priv_credentials_free);
+  table->list = g_ptr_array_new ();
+  table->by_ufrag = g_hash_table_new (priv_credentials_hash,
+      priv_credentials_equal);
+
+  for (i = candidates; i; i = i->next) {
+    NiceCandidate *cand = i->data;
+    Credentials *credentials = g_slice_new0 (Credentials);
+    const gchar *ufrag, *pass = NULL;
+
+    ufrag = cand->username ? cand->username : default_ufrag;
+
+    if (cand->password)
+      pass = cand->password;
+    else if (default_password && default_password[0])
+      pass = default_password;
+
+    if (decode) {
+      credentials->ufrag = g_base64_decode (ufrag, &credentials->ufrag_len);
+      if (pass)
+        credentials->password = g_base64_decode (pass,
+            &credentials->password_len);
+    } else {
+      credentials->ufrag = (guint8 *) g_strdup (ufrag);
+      credentials->ufrag_len = strlen (ufrag);
+      if (pass) {
+        credentials->password = (guint8 *) g_strdup (pass);
+        credentials->password_len = strlen (pass);
+      }
+    }
+
+    g_hash_table_insert (table->by_candidate, cand, credentials);
+
+    /* a later candidate with the same ufrag would never be reached */
+    if (credentials->ufrag_len == 0 ||
+        g_hash_table_contains (table->by_ufrag, credentials))
+      continue;
+
+    g_ptr_array_add (table->list, credentials);
+    g_hash_table_add (table->by_ufrag, credentials);
+  }
+
+  return table;
+}
+
+static CredentialsTable *
+priv_get_credentials_table (NiceComponent *component, gboolean remote,
+    gboolean decode, const gchar *default_ufrag,
+    const gchar *default_password)
+{
+  CredentialsTable **table;
+
+  table = remote ? &component->remote_credentials :
+      &component->local_credentials;
+  if (*table == NULL)
+    *table = priv_credentials_table_new (remote ?
+        component->remote_candidates : component->local_candidates, decode,
+        default_ufrag, default_password);
+
+  return *table;
+}
+
+/*
+ * Returns the credentials of the first local (or @remote) candidate of
+ * @component whose ufrag starts @username, or NULL. Candidates without
+ * their own credentials use @default_ufrag and @default_password, and
+ * @decode tells whether they are base64-encoded.
+ *
+ * The credentials are resolved on first use, and remain valid until
+ * nice_component_invalidate_credentials() is called. This must happen
+ * whenever the candidates or the default credentials change.
+ */
+const Credentials *
+nice_component_find_credentials (NiceComponent *component, gboolean remote,
+    gboolean decode, const gchar *default_ufrag,
+    const gchar *default_password, const guint8 *username,
+    gsize username_len)
+{
+  CredentialsTable *table;
+  Credentials key;
+  const Credentials *credentials;
+  const guint8 *colon;
+  guint i;
+
+  table = priv_get_credentials_table (component, remote, decode,
+      default_ufrag, default_password);
+
+  if (username_len == 0)
+    return NULL;
+
+  /* the username is "ufrag:peer-ufrag" in RFC 5245 */
+  colon = memchr (username, ':', username_len);
+  if (colon) {
+    key.ufrag = (guint8 *) username;
+    key.ufrag_len = colon - username;
+    credentials = g_hash_table_lookup (table->by_ufrag, &key);
+    if (credentials)
+      return credentials;
+  }
+
+  /* in the other modes, the ufrags are only prefixes of the username */
+  for (i = 0; i < table->list->len; i++) {
+    credentials = g_ptr_array_index (table->list, i);
+
+    if (username_len >= credentials->ufrag_len &&
+        memcmp (username, credentials->ufrag, credentials->ufrag_len) == 0)
+      return credentials;
+  }
+
+  return NULL;
+}
+
+/*
+ * Returns the credentials of @candidate, a local (or @remote) candidate of
+ * @component, or NULL if it isn't one. The arguments are otherwise those of
+ * nice_component_find_credentials().
+ */
+const Credentials *
+nice_component_find_candidate_credentials (NiceComponent *component,
+    gboolean remote, gboolean decode, const gchar *default_ufrag,
+    const gchar *default_password, const NiceCandidate *candidate)
+{
+  CredentialsTable *table;
+
+  table = priv_get_credentials_table (component, remote, decode,
+      default_ufrag, default_password);
+
+  return g_hash_table_lookup (table->by_candidate, candidate);
+}
+
+void
+nice_component_invalidate_credentials (NiceComponent *component)
+{
+  g_clear_pointer (&component->local_credentials,
+      priv_credentials_table_free);
+  g_clear_pointer (&component->remote_credentials,
+      priv_credentials_table_free);
+}
+
 /*
  * Sets the desired remote candidate as the selected pair
  *
@@ -575,8 +904,7 @@ nice_component_set_selected_remote_candidate (NiceComponent *component,
 
   if (!remote) {
     remote = nice_candidate_copy (candidate);
-    component->remote_candidates = g_slist_append (component->remote_candidates,
-        remote);
+    nice_component_add_remote_candidate (component, remote);
     agent_signal_new_remote_candidate (agent, remote);
   }
 
@@ -636,6 +964,17 @@ nice_component_attach_socket (NiceComponent *component, NiceSocket *nicesock)
       component->socket_sources_age++;
   }
 
+  nicesock->capture_stream_id = component->stream_id;
+  nicesock->capture_component_id = component->id;
+  if (nicesock->capture == NULL) {
+    NiceAgent *agent = g_weak_ref_get (&component->agent_ref);
+
+    if (agent != NULL) {
+      nicesock->capture = agent->capture;
+      g_object_unref (agent);
+    }
+  }
+
   /* Create and attach a source */
   nice_debug ("Component %p: Attach source (stream %u).",
       component, component->stream_id);
@@ -1112,6 +1451,10 @@ nice_component_init (NiceComponent *component)
 
   g_queue_init (&component->queued_tcp_packets);
   g_queue_init (&component->incoming_checks);
+
+  component->remote_candidates_by_addr = g_hash_table_new_full (
+      priv_address_key_hash, priv_address_key_equal,
+      (GDestroyNotify) nice_address_free, (GDestroyNotify) g_slist_free);
 }
 
 static void
@@ -1218,6 +1561,8 @@ nice_component_finalize (GObject *obj)
 
   g_list_free_full (cmp->valid_candidates,
       (GDestroyNotify) nice_candidate_free);
+  g_hash_table_unref (cmp->remote_candidates_by_addr);
+  nice_component_invalidate_credentials (cmp);
 
   g_clear_object (&cmp->tcp);
   g_clear_object (&cmp->stop_cancellable);
@@ -1387,6 +1732,10 @@ component_source_dispatch (GSource *source, GSourceFunc callback,
   ComponentSource *component_source = (ComponentSource *) source;
   GPollableSourceFunc func = (GPollableSourceFunc) G_CALLBACK (callback);
 
+  /* Sources from nice_agent_create_recv_source() have no stream. */
+  if (component_source->pollable_stream == NULL)
+    return callback (user_data);
+
   return func (component_source->pollable_stream, user_data);
 }
 
@@ -1404,8 +1753,7 @@ component_source_finalize (GSource *source)
   g_slist_free_full (component_source->socket_sources, free_child_socket_source);
 
   g_weak_ref_clear (&component_source->agent_ref);
-  g_object_unref (component_source->pollable_stream);
-  component_source->pollable_stream = NULL;
+  g_clear_object (&component_source->pollable_stream);
 }
 
 static gboolean
@@ -1442,8 +1790,8 @@ static GSourceFuncs component_source_funcs = {
  * @agent: a #NiceAgent
  * @stream_id: The stream's id
  * @component_id: The component's number
- * @pollable_stream: a #GPollableInputStream or #GPollableOutputStream to pass
- * to dispatched callbacks
+ * @pollable_stream: (allow-none): a #GPollableInputStream or
+ * #GPollableOutputStream to pass to dispatched callbacks, or %NULL
  * @cancellable: (allow-none): a #GCancellable, or %NULL
  *
  * Create a new #ComponentSource, a type of #GSource which proxies poll events
@@ -1452,7 +1800,8 @@ static GSourceFuncs component_source_funcs = {
  * A callback function of type #GPollableSourceFunc must be connected to the
  * returned #GSource using g_source_set_callback(). @pollable_stream is passed
  * to all callbacks dispatched from the #GSource, and a reference is held on it
- * by the #GSource.
+ * by the #GSource. If @pollable_stream is %NULL, the callback is a plain
+ * #GSourceFunc instead.
  *
  * The #GSource will automatically update to poll sockets as they’re added to
  * the @component (e.g. during peer discovery).
@@ -1466,7 +1815,8 @@ nice_component_input_source_new (NiceAgent *agent, guint stream_id,
 {
   ComponentSource *component_source;
 
-  g_assert (G_IS_POLLABLE_INPUT_STREAM (pollable_istream));
+  g_assert (pollable_istream == NULL ||
+      G_IS_POLLABLE_INPUT_STREAM (pollable_istream));
 
   component_source =
       (ComponentSource *)
@@ -1474,7 +1824,8 @@ nice_component_input_source_new (NiceAgent *agent, guint stream_id,
   g_source_set_name ((GSource *) component_source, "ComponentSource");
 
   component_source->component_socket_sources_age = 0;
-  component_source->pollable_stream = g_object_ref (pollable_istream);
+  component_source->pollable_stream =
+      pollable_istream ? g_object_ref (pollable_istream) : NULL;
   g_weak_ref_init (&component_source->agent_ref, agent);
   component_source->stream_id = stream_id;
   component_source->component_id = component_id;
@@ -1641,3 +1992,28 @@ nice_component_get_sockets (NiceComponent *component)
 
   return array;
 }
+
+/* Stores the round-trip time @rtt, in microseconds, in @last and folds it
+ * into the exponentially weighted average @smoothed, with the gain of 1/8
+ * TCP uses. Shared by the component and check pair statistics. */
+void
+nice_rtt_add_sample (guint *last, guint *smoothed, gint64 rtt)
+{
+  guint sample = CLAMP (rtt, 1, G_MAXUINT);
+
+  *last = sample;
+  if (*smoothed == 0)
+    *smoothed = sample;
+  else
+    *smoothed = (7 * (guint64) *smoothed + sample) / 8;
+}
+
+/* Must be called with agent lock held */
+/* Records the round-trip time, in microseconds, of a STUN transaction which
+ * was answered without being retransmitted. */
+void
+nice_component_add_rtt_sample (NiceComponent *component, gint64 rtt)
+{
+  nice_rtt_add_sample (&component->stats.rtt, &component->stats.smoothed_rtt,
+      rtt);
+}
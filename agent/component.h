@@ -74,8 +74,13 @@ struct _CandidatePairKeepalive
   guint stream_id;
   guint component_id;
   StunTimer timer;
+  gint64 start_time;    /* monotonic time the request was first sent */
   uint8_t stun_buffer[STUN_MAX_MESSAGE_SIZE_IPV6];
   StunMessage stun_message;
+  gint64 last_media_sent; /* monotonic time media was last sent */
+  GSource *consent_source; /* timer of the next consent freshness check */
+  gint64 consent_time;  /* monotonic time consent was last granted */
+  gboolean consent_lost; /* consent expired, media may not be sent */
 };
 
 struct _CandidatePair
@@ -138,6 +143,18 @@ io_callback_data_new (const guint8 *buf, gsize buf_len);
 void
 io_callback_data_free (IOCallbackData *data);
 
+/* The username fragment and password of candidates, resolved once and
+ * base64-decoded in the MSN and OC2007 compatibility modes, to validate
+ * inbound STUN messages. See nice_component_find_credentials(). */
+typedef struct {
+  guint8 *ufrag;          /* owned, not nul-terminated */
+  gsize ufrag_len;
+  guint8 *password;       /* owned, not nul-terminated, NULL if none */
+  gsize password_len;
+} Credentials;
+
+typedef struct _CredentialsTable CredentialsTable;
+
 #define NICE_TYPE_COMPONENT nice_component_get_type()
 #define NICE_COMPONENT(obj) \
   (G_TYPE_CHECK_INSTANCE_CAST ((obj), NICE_TYPE_COMPONENT, NiceComponent))
@@ -159,6 +176,9 @@ struct _NiceComponent {
   NiceComponentState state;
   GSList *local_candidates;    /* list of NiceCandidate objs */
   GSList *remote_candidates;   /* list of NiceCandidate objs */
+  GHashTable *remote_candidates_by_addr; /* NiceAddress -> GSList of the
+                                            remote_candidates with that
+                                            address, in the same order */
   GList *valid_candidates;     /* list of owned remote NiceCandidates that are part of valid pairs */
   GSList *socket_sources;      /* list of SocketSource objs; must only grow monotonically */
   guint socket_sources_age;    /* incremented when socket_sources changes */
@@ -204,6 +224,10 @@ struct _NiceComponent {
   guint stream_id;
 
   StunAgent stun_agent; /* This stun agent is used to validate all stun requests */
+  CredentialsTable *local_credentials;  /* of local_candidates, built on
+                                           first use */
+  CredentialsTable *remote_credentials; /* of remote_candidates, built on
+                                           first use */
 
 
   GCancellable *stop_cancellable;
@@ -215,6 +239,13 @@ struct _NiceComponent {
   gboolean tcp_readable;
   GCancellable *tcp_writable_cancellable;
 
+  /* Framing state of the incoming pseudo-TCP stream, used only if the agent
+   * is in message-oriented reliable mode. */
+  guint8 tcp_frame_header[2];     /* RFC 4571 length of the next message */
+  guint tcp_frame_header_len;     /* header bytes received so far */
+  guint8 *tcp_frame_buf;          /* owned; partially received message */
+  gsize tcp_frame_buf_len;        /* valid bytes in tcp_frame_buf */
+
   GIOStream *iostream;
 
   guint min_port;
@@ -224,6 +255,15 @@ struct _NiceComponent {
    * ACKs on. The messages are dequeued to the pseudo-TCP socket once a selected
    * UDP socket is available. This is only used for reliable Components. */
   GQueue queued_tcp_packets;
+
+  /* Reported by nice_agent_get_component_stats(). The counters are updated
+   * on the send and receive paths, which already hold the agent lock; the
+   * pseudo-TCP fields are only filled in when the statistics are read. */
+  NiceComponentStats stats;
+
+  /* First time each milestone was reached, see
+   * agent_signal_component_milestone(). */
+  NiceComponentTimeline timeline;
 };
 
 typedef struct {
@@ -253,6 +293,28 @@ NiceCandidate *
 nice_component_find_remote_candidate (NiceComponent *component,
     const NiceAddress *addr, NiceCandidateTransport transport);
 
+void
+nice_component_add_remote_candidate (NiceComponent *component,
+    NiceCandidate *candidate);
+
+GSList *
+nice_component_find_remote_candidates_by_addr (NiceComponent *component,
+    const NiceAddress *addr);
+
+const Credentials *
+nice_component_find_credentials (NiceComponent *component, gboolean remote,
+    gboolean decode, const gchar *default_ufrag,
+    const gchar *default_password, const guint8 *username,
+    gsize username_len);
+
+const Credentials *
+nice_component_find_candidate_credentials (NiceComponent *component,
+    gboolean remote, gboolean decode, const gchar *default_ufrag,
+    const gchar *default_password, const NiceCandidate *candidate);
+
+void
+nice_component_invalidate_credentials (NiceComponent *component);
+
 NiceCandidateImpl *
 nice_component_set_selected_remote_candidate (NiceComponent *component,
     NiceAgent *agent, NiceCandidate *candidate);
@@ -313,6 +375,12 @@ nice_component_verify_remote_candidate (NiceComponent *component,
 GPtrArray *
 nice_component_get_sockets (NiceComponent *component);
 
+void
+nice_rtt_add_sample (guint *last, guint *smoothed, gint64 rtt);
+
+void
+nice_component_add_rtt_sample (NiceComponent *component, gint64 rtt);
+
 G_END_DECLS
 
 #endif /* _NICE_COMPONENT_H */
@@ -55,6 +55,7 @@
 
 #include "agent.h"
 #include "agent-priv.h"
+#include "trace.h"
 #include "conncheck.h"
 #include "discovery.h"
 #include "stun/stun5389.h"
@@ -75,6 +76,10 @@ static void candidate_check_pair_fail (NiceStream *stream,
     NiceAgent *agent, CandidateCheckPair *p);
 static void candidate_check_pair_free (NiceAgent *agent,
     CandidateCheckPair *pair);
+static void priv_check_list_index_state (NiceAgent *agent,
+    CandidateCheckPair *pair);
+static void priv_check_list_unindex_state (NiceAgent *agent,
+    CandidateCheckPair *pair);
 static CandidateCheckPair *priv_conn_check_add_for_candidate_pair_matched (
     NiceAgent *agent, guint stream_id, NiceComponent *component,
     NiceCandidate *local, NiceCandidate *remote, NiceCheckState initial_state);
@@ -133,11 +138,400 @@ priv_state_to_string (NiceCheckState state)
 
 #define SET_PAIR_STATE( a, p, s ) G_STMT_START{\
   g_assert (p); \
+  priv_check_list_unindex_state (a, p); \
   p->state = s; \
-  nice_debug ("Agent %p : pair %p state %s (%s)", \
-      a, p, priv_state_to_string (s), G_STRFUNC); \
+  priv_check_list_index_state (a, p); \
+  NICE_TRACE (pair_state, a, p, s); \
+  nice_log (NICE_LOG_CONNCHECK, NICE_LOG_DEBUG, NULL, \
+      "Agent %p : pair %p state %s (%s)", NICE_LOG_PTR (a), NICE_LOG_PTR (p), \
+      NICE_LOG_PTR (priv_state_to_string (s)), NICE_LOG_PTR (G_STRFUNC)); \
 }G_STMT_END
 
+/*
+ * The check lists are kept sorted by conn_check_compare(), which never
+ * finds two pairs of a check list equal, and the pairs in them are
+ * indexed so that scheduling does not have to walk the lists on every
+ * tick:
+ *  - the WAITING pairs of each stream, in check list order;
+ *  - the FROZEN pairs of each stream, in check list order, and the FAILED
+ *    ones, to enforce the max-connectivity-checks limit;
+ *  - the FROZEN pairs of each foundation, in stream and check list order;
+ *  - the number of SUCCEEDED pairs of each foundation;
+ *  - the pairs between each local and remote candidate;
+ *  - the pairs between each local socket and remote candidate.
+ *
+ * Once in a check list, the state of a pair must only be changed with
+ * SET_PAIR_STATE(), its foundation with conn_check_set_pair_foundation(),
+ * its priority with priv_set_pair_priority() and its socket with
+ * priv_set_pair_socket().
+ *
+ * After a role conflict, the priorities of the pairs of a stream are only
+ * recalculated the next time its check list is used, see
+ * conn_check_refresh_pair_priorities().
+ *
+ * The outstanding STUN requests of the pairs are also indexed by
+ * transaction id, see priv_index_stun_transaction().
+ */
+typedef struct {
+  gconstpointer local;    /* local candidate or socket */
+  gconstpointer remote;   /* remote candidate */
+} CheckPairKey;
+
+static guint
+priv_check_pair_key_hash (gconstpointer key)
+{
+  const CheckPairKey *k = key;
+
+  return g_direct_hash (k->local) * 31 + g_direct_hash (k->remote);
+}
+
+static gboolean
+priv_check_pair_key_equal (gconstpointer a, gconstpointer b)
+{
+  const CheckPairKey *ka = a;
+  const CheckPairKey *kb = b;
+
+  return ka->local == kb->local && ka->remote == kb->remote;
+}
+
+static void
+priv_check_pair_key_free (gpointer key)
+{
+  g_slice_free (CheckPairKey, key);
+}
+
+/* Transaction ids are random, so any four of their bytes make a hash. */
+static guint
+priv_stun_transaction_id_hash (gconstpointer key)
+{
+  guint32 hash;
+
+  memcpy (&hash, (const uint8_t *) key + sizeof (StunTransactionId) -
+      sizeof (hash), sizeof (hash));
+
+  return hash;
+}
+
+static gboolean
+priv_stun_transaction_id_equal (gconstpointer a, gconstpointer b)
+{
+  return memcmp (a, b, sizeof (StunTransactionId)) == 0;
+}
+
+void
+conn_check_init_indexes (NiceAgent *agent)
+{
+  agent->frozen_pairs = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_sequence_free);
+  agent->succeeded_foundations = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, NULL);
+  agent->check_pairs = g_hash_table_new_full (priv_check_pair_key_hash,
+      priv_check_pair_key_equal, priv_check_pair_key_free,
+      (GDestroyNotify) g_slist_free);
+  agent->socket_pairs = g_hash_table_new_full (priv_check_pair_key_hash,
+      priv_check_pair_key_equal, priv_check_pair_key_free,
+      (GDestroyNotify) g_slist_free);
+  agent->conncheck_transactions = g_hash_table_new (
+      priv_stun_transaction_id_hash, priv_stun_transaction_id_equal);
+}
+
+/* Must be called once all the check lists have been freed. */
+void
+conn_check_free_indexes (NiceAgent *agent)
+{
+  g_clear_pointer (&agent->frozen_pairs, g_hash_table_unref);
+  g_clear_pointer (&agent->succeeded_foundations, g_hash_table_unref);
+  g_clear_pointer (&agent->check_pairs, g_hash_table_unref);
+  g_clear_pointer (&agent->socket_pairs, g_hash_table_unref);
+  g_clear_pointer (&agent->conncheck_transactions, g_hash_table_unref);
+}
+
+static gint
+priv_compare_waiting_pairs (gconstpointer a, gconstpointer b,
+    gpointer user_data)
+{
+  return conn_check_compare (a, b);
+}
+
+static gint
+priv_compare_frozen_pairs (gconstpointer a, gconstpointer b,
+    gpointer user_data)
+{
+  const CandidateCheckPair *pa = a;
+  const CandidateCheckPair *pb = b;
+
+  if (pa->stream_id != pb->stream_id)
+    return (pa->stream_id < pb->stream_id) ? -1 : 1;
+
+  return conn_check_compare (pa, pb);
+}
+
+static void
+priv_check_list_index_state (NiceAgent *agent, CandidateCheckPair *pair)
+{
+  NiceStream *stream;
+  GSequence *frozen;
+  guint count;
+
+  if (!pair->in_check_list)
+    return;
+
+  switch (pair->state) {
+    case NICE_CHECK_WAITING:
+      stream = agent_find_stream (agent, pair->stream_id);
+      if (stream)
+        pair->state_iter = g_sequence_insert_sorted (stream->waiting_pairs,
+            pair, priv_compare_waiting_pairs, NULL);
+      break;
+    case NICE_CHECK_FROZEN:
+      stream = agent_find_stream (agent, pair->stream_id);
+      if (stream)
+        pair->prune_iter = g_sequence_insert_sorted (stream->frozen_pairs,
+            pair, priv_compare_waiting_pairs, NULL);
+      frozen = g_hash_table_lookup (agent->frozen_pairs, pair->foundation);
+      if (frozen == NULL) {
+        frozen = g_sequence_new (NULL);
+        g_hash_table_insert (agent->frozen_pairs, g_strdup (pair->foundation),
+            frozen);
+      }
+      pair->state_iter = g_sequence_insert_sorted (frozen, pair,
+          priv_compare_frozen_pairs, NULL);
+      break;
+    case NICE_CHECK_SUCCEEDED:
+      count = GPOINTER_TO_UINT (g_hash_table_lookup (
+          agent->succeeded_foundations, pair->foundation));
+      g_hash_table_replace (agent->succeeded_foundations,
+          g_strdup (pair->foundation), GUINT_TO_POINTER (count + 1));
+      break;
+    case NICE_CHECK_FAILED:
+      stream = agent_find_stream (agent, pair->stream_id);
+      if (stream)
+        pair->prune_iter = g_sequence_append (stream->failed_pairs, pair);
+      break;
+    default:
+      break;
+  }
+}
+
+static void
+priv_check_list_unindex_state (NiceAgent *agent, CandidateCheckPair *pair)
+{
+  GSequence *sequence;
+  guint count;
+
+  if (!pair->in_check_list)
+    return;
+
+  if (pair->prune_iter) {
+    g_sequence_remove (pair->prune_iter);
+    pair->prune_iter = NULL;
+  }
+
+  if (pair->state_iter) {
+    sequence = g_sequence_iter_get_sequence (pair->state_iter);
+    g_sequence_remove (pair->state_iter);
+    pair->state_iter = NULL;
+    if (pair->state == NICE_CHECK_FROZEN && g_sequence_is_empty (sequence))
+      g_hash_table_remove (agent->frozen_pairs, pair->foundation);
+  } else if (pair->state == NICE_CHECK_SUCCEEDED) {
+    count = GPOINTER_TO_UINT (g_hash_table_lookup (
+        agent->succeeded_foundations, pair->foundation));
+    if (count > 1)
+      g_hash_table_replace (agent->succeeded_foundations,
+          g_strdup (pair->foundation), GUINT_TO_POINTER (count - 1));
+    else
+      g_hash_table_remove (agent->succeeded_foundations, pair->foundation);
+  }
+}
+
+static void
+priv_check_pairs_update_table (GHashTable *table, gconstpointer local,
+    CandidateCheckPair *pair, gboolean add)
+{
+  CheckPairKey lookup = { local, pair->remote };
+  gpointer key, value;
+  GSList *pairs;
+
+  /* the list head may change, so take it out of the table and put the
+   * updated one back */
+  if (g_hash_table_lookup_extended (table, &lookup, &key, &value)) {
+    g_hash_table_steal (table, &lookup);
+  } else {
+    key = g_slice_dup (CheckPairKey, &lookup);
+    value = NULL;
+  }
+
+  pairs = value;
+  if (add)
+    pairs = g_slist_insert_sorted (pairs, pair,
+        (GCompareFunc) conn_check_compare);
+  else
+    pairs = g_slist_remove (pairs, pair);
+
+  if (pairs)
+    g_hash_table_insert (table, key, pairs);
+  else
+    priv_check_pair_key_free (key);
+}
+
+static void
+priv_check_pairs_update (NiceAgent *agent, CandidateCheckPair *pair,
+    gboolean add)
+{
+  priv_check_pairs_update_table (agent->check_pairs, pair->local, pair, add);
+  priv_check_pairs_update_table (agent->socket_pairs, pair->sockptr, pair,
+      add);
+}
+
+/*
+ * Returns the pairs between @local and @remote, in check list order.
+ */
+static GSList *
+priv_find_check_pairs (NiceAgent *agent, NiceCandidate *local,
+    NiceCandidate *remote)
+{
+  CheckPairKey key = { local, remote };
+
+  return g_hash_table_lookup (agent->check_pairs, &key);
+}
+
+/*
+ * Returns the pairs between @sock and @remote, in check list order.
+ */
+static GSList *
+priv_find_socket_pairs (NiceAgent *agent, NiceSocket *sock,
+    NiceCandidate *remote)
+{
+  CheckPairKey key = { sock, remote };
+
+  return g_hash_table_lookup (agent->socket_pairs, &key);
+}
+
+/*
+ * Adds @pair to the check list of @stream and indexes it.
+ */
+static void
+priv_check_list_insert (NiceAgent *agent, NiceStream *stream,
+    CandidateCheckPair *pair)
+{
+  pair->seq = agent->next_check_pair_seq++;
+  stream->conncheck_list = g_slist_insert_sorted (stream->conncheck_list, pair,
+      (GCompareFunc)conn_check_compare);
+  stream->n_check_pairs++;
+  pair->in_check_list = TRUE;
+  priv_check_list_index_state (agent, pair);
+  priv_check_pairs_update (agent, pair, TRUE);
+}
+
+/*
+ * Removes @pair from the indexes, before it is freed.
+ */
+static void
+priv_check_list_unindex (NiceAgent *agent, CandidateCheckPair *pair)
+{
+  NiceStream *stream;
+
+  if (!pair->in_check_list)
+    return;
+
+  priv_check_list_unindex_state (agent, pair);
+  priv_check_pairs_update (agent, pair, FALSE);
+  pair->in_check_list = FALSE;
+
+  stream = agent_find_stream (agent, pair->stream_id);
+  if (stream)
+    stream->n_check_pairs--;
+}
+
+/*
+ * Recalculates the priorities of the pairs of @stream if a role conflict
+ * made them stale, see recalculate_pair_priorities().
+ */
+void
+conn_check_refresh_pair_priorities (NiceAgent *agent, NiceStream *stream)
+{
+  GSList *i;
+
+  if (!stream->pair_priorities_stale)
+    return;
+
+  stream->pair_priorities_stale = FALSE;
+
+  /* the pairs are taken out of the indexes first, so that they are
+   * never searched with a mix of old and new priorities */
+  for (i = stream->conncheck_list; i; i = i->next) {
+    CandidateCheckPair *p = i->data;
+
+    priv_check_list_unindex_state (agent, p);
+    priv_check_pairs_update (agent, p, FALSE);
+  }
+
+  for (i = stream->conncheck_list; i; i = i->next) {
+    CandidateCheckPair *p = i->data;
+
+    p->priority = agent_candidate_pair_priority (agent, p->local, p->remote);
+  }
+  stream->conncheck_list = g_slist_sort (stream->conncheck_list,
+      (GCompareFunc)conn_check_compare);
+
+  for (i = stream->conncheck_list; i; i = i->next) {
+    CandidateCheckPair *p = i->data;
+
+    priv_check_list_index_state (agent, p);
+    priv_check_pairs_update (agent, p, TRUE);
+  }
+}
+
+/*
+ * Changes the priority of @pair, keeping it at its place in the indexes.
+ * The check list itself is not sorted again.
+ */
+static void
+priv_set_pair_priority (NiceAgent *agent, CandidateCheckPair *pair,
+    guint64 priority)
+{
+  gboolean in_check_list = pair->in_check_list;
+
+  if (in_check_list) {
+    priv_check_list_unindex_state (agent, pair);
+    priv_check_pairs_update (agent, pair, FALSE);
+  }
+
+  pair->priority = priority;
+
+  if (in_check_list) {
+    priv_check_list_index_state (agent, pair);
+    priv_check_pairs_update (agent, pair, TRUE);
+  }
+}
+
+/*
+ * Changes the socket @pair is checked from.
+ */
+static void
+priv_set_pair_socket (NiceAgent *agent, CandidateCheckPair *pair,
+    NiceSocket *sock)
+{
+  if (pair->in_check_list)
+    priv_check_pairs_update_table (agent->socket_pairs, pair->sockptr, pair,
+        FALSE);
+
+  pair->sockptr = sock;
+
+  if (pair->in_check_list)
+    priv_check_pairs_update_table (agent->socket_pairs, pair->sockptr, pair,
+        TRUE);
+}
+
+void
+conn_check_set_pair_foundation (NiceAgent *agent, CandidateCheckPair *pair,
+    const gchar *foundation)
+{
+  priv_check_list_unindex_state (agent, pair);
+  g_strlcpy (pair->foundation, foundation, NICE_CANDIDATE_PAIR_MAX_FOUNDATION);
+  priv_check_list_index_state (agent, pair);
+}
+
 static const gchar *
 priv_ice_return_to_string (StunUsageIceReturn ice_return)
 {
@@ -274,7 +668,7 @@ priv_print_conn_check_lists (NiceAgent *agent, const gchar *where, const gchar *
               pair->valid ? "V" : "",
               pair->nominated ? "N" : "",
               pair->use_candidate_on_next_check ? "C" : "",
-              g_slist_find (agent->triggered_check_queue, pair) ? "T" : "");
+              pair->in_triggered_check_queue ? "T" : "");
 
           for (l = pair->stun_transactions, m = 0; l; l = l->next, m++) {
             StunTransaction *stun = l->data;
@@ -302,9 +696,10 @@ priv_add_pair_to_triggered_check_queue (NiceAgent *agent, CandidateCheckPair *pa
 {
   g_assert (pair);
 
-  if (agent->triggered_check_queue == NULL ||
-      g_slist_find (agent->triggered_check_queue, pair) == NULL)
+  if (!pair->in_triggered_check_queue) {
     agent->triggered_check_queue = g_slist_append (agent->triggered_check_queue, pair);
+    pair->in_triggered_check_queue = TRUE;
+  }
 }
 
 /* Remove the pair from the triggered checks list
@@ -313,7 +708,11 @@ static void
 priv_remove_pair_from_triggered_check_queue (NiceAgent *agent, CandidateCheckPair *pair)
 {
   g_assert (pair);
-  agent->triggered_check_queue = g_slist_remove (agent->triggered_check_queue, pair);
+
+  if (pair->in_triggered_check_queue) {
+    agent->triggered_check_queue = g_slist_remove (agent->triggered_check_queue, pair);
+    pair->in_triggered_check_queue = FALSE;
+  }
 }
 
 /* Get the pair from the triggered checks list
@@ -333,19 +732,16 @@ priv_get_pair_from_triggered_check_queue (NiceAgent *agent)
 /*
  * Finds the next connectivity check in WAITING state.
  */
-static CandidateCheckPair *priv_conn_check_find_next_waiting (GSList *conn_check_list)
+static CandidateCheckPair *priv_conn_check_find_next_waiting (NiceStream *stream)
 {
-  GSList *i;
+  GSequenceIter *iter = g_sequence_get_begin_iter (stream->waiting_pairs);
 
-  /* note: list is sorted in priority order to first waiting check has
-   *       the highest priority */
-  for (i = conn_check_list; i ; i = i->next) {
-    CandidateCheckPair *p = i->data;
-    if (p->state == NICE_CHECK_WAITING)
-      return p;
-  }
+  /* note: the index is sorted in priority order so the first waiting check
+   *       has the highest priority */
+  if (g_sequence_iter_is_end (iter))
+    return NULL;
 
-  return NULL;
+  return g_sequence_get (iter);
 }
 
 /*
@@ -389,43 +785,38 @@ priv_conn_check_initiate (NiceAgent *agent, CandidateCheckPair *pair)
 static gboolean
 priv_conn_check_unfreeze_next (NiceAgent *agent)
 {
-  GSList *i, *j;
-  GSList *foundation_list = NULL;
+  GSList *i;
+  GSList *unfrozen = NULL;
+  GHashTableIter iter;
+  gpointer value;
   gboolean result = FALSE;
 
   /* While a pair in state waiting exists, we do nothing */
   for (i = agent->streams; i ; i = i->next) {
     NiceStream *s = i->data;
-    for (j = s->conncheck_list; j ; j = j->next) {
-      CandidateCheckPair *p = j->data;
 
-      if (p->state == NICE_CHECK_WAITING)
-        return TRUE;
-    }
+    if (!g_sequence_is_empty (s->waiting_pairs))
+      return TRUE;
   }
 
   /* When there are no more pairs in waiting state, we unfreeze some
-   * pairs, so that we get a single waiting pair per foundation.
+   * pairs, so that we get a single waiting pair per foundation: the
+   * first frozen one, in stream and check list order.
    */
-  for (i = agent->streams; i ; i = i->next) {
-    NiceStream *s = i->data;
-    for (j = s->conncheck_list; j ; j = j->next) {
-      CandidateCheckPair *p = j->data;
+  g_hash_table_iter_init (&iter, agent->frozen_pairs);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    unfrozen = g_slist_prepend (unfrozen,
+        g_sequence_get (g_sequence_get_begin_iter (value)));
 
-      if (g_slist_find_custom (foundation_list, p->foundation,
-          (GCompareFunc)strcmp))
-        continue;
+  for (i = unfrozen; i ; i = i->next) {
+    CandidateCheckPair *p = i->data;
 
-      if (p->state == NICE_CHECK_FROZEN) {
-        nice_debug ("Agent %p : Pair %p with s/c-id %u/%u (%s) unfrozen.",
-            agent, p, p->stream_id, p->component_id, p->foundation);
-        SET_PAIR_STATE (agent, p, NICE_CHECK_WAITING);
-        foundation_list = g_slist_prepend (foundation_list, p->foundation);
-        result = TRUE;
-      }
-    }
+    nice_debug ("Agent %p : Pair %p with s/c-id %u/%u (%s) unfrozen.",
+        agent, p, p->stream_id, p->component_id, p->foundation);
+    SET_PAIR_STATE (agent, p, NICE_CHECK_WAITING);
+    result = TRUE;
   }
-  g_slist_free (foundation_list);
+  g_slist_free (unfrozen);
 
   /* We dump the conncheck list when something interesting happened, ie
    * when we unfroze some pairs.
@@ -452,30 +843,35 @@ priv_conn_check_unfreeze_next (NiceAgent *agent)
 void
 conn_check_unfreeze_related (NiceAgent *agent, CandidateCheckPair *pair)
 {
-  GSList *i, *j;
+  GSequence *frozen;
+  GSequenceIter *iter;
+  GSList *i, *unfrozen = NULL;
   gboolean result = FALSE;
 
   g_assert (pair);
   g_assert (pair->state == NICE_CHECK_SUCCEEDED);
 
-  for (i = agent->streams; i ; i = i->next) {
-    NiceStream *s = i->data;
-    for (j = s->conncheck_list; j ; j = j->next) {
-      CandidateCheckPair *p = j->data;
-   
-      /* The states for all other Frozen candidates pairs in all
-       * checklists with the same foundation is set to waiting
-       */
-      if (p->state == NICE_CHECK_FROZEN &&
-          strncmp (p->foundation, pair->foundation,
-              NICE_CANDIDATE_PAIR_MAX_FOUNDATION) == 0) {
-        nice_debug ("Agent %p : Unfreezing check %p "
-            "(after successful check %p).", agent, p, pair);
-        SET_PAIR_STATE (agent, p, NICE_CHECK_WAITING);
-        result = TRUE;
-      }
-    }
+  /* The states for all other Frozen candidates pairs in all
+   * checklists with the same foundation is set to waiting. They
+   * are collected first, as unfreezing them empties their index.
+   */
+  frozen = g_hash_table_lookup (agent->frozen_pairs, pair->foundation);
+  if (frozen) {
+    for (iter = g_sequence_get_begin_iter (frozen);
+        !g_sequence_iter_is_end (iter); iter = g_sequence_iter_next (iter))
+      unfrozen = g_slist_prepend (unfrozen, g_sequence_get (iter));
+    unfrozen = g_slist_reverse (unfrozen);
+  }
+
+  for (i = unfrozen; i ; i = i->next) {
+    CandidateCheckPair *p = i->data;
+
+    nice_debug ("Agent %p : Unfreezing check %p "
+        "(after successful check %p).", agent, p, pair);
+    SET_PAIR_STATE (agent, p, NICE_CHECK_WAITING);
+    result = TRUE;
   }
+  g_slist_free (unfrozen);
   /* We dump the conncheck list when something interesting happened, ie
    * when we unfroze some pairs.
    */
@@ -496,32 +892,20 @@ conn_check_unfreeze_related (NiceAgent *agent, CandidateCheckPair *pair)
 static void
 priv_conn_check_unfreeze_maybe (NiceAgent *agent, CandidateCheckPair *pair)
 {
-  GSList *i, *j;
-  gboolean result = FALSE;
-
   g_assert (pair);
   g_assert (pair->state == NICE_CHECK_FROZEN);
 
-  for (i = agent->streams; i ; i = i->next) {
-    NiceStream *s = i->data;
-    for (j = s->conncheck_list; j ; j = j->next) {
-      CandidateCheckPair *p = j->data;
+  if (g_hash_table_contains (agent->succeeded_foundations, pair->foundation)) {
+    nice_debug ("Agent %p : Unfreezing check %p "
+        "(after successful check with foundation '%s').", agent, pair,
+        pair->foundation);
+    SET_PAIR_STATE (agent, pair, NICE_CHECK_WAITING);
 
-      if (p->state == NICE_CHECK_SUCCEEDED &&
-          strncmp (p->foundation, pair->foundation,
-              NICE_CANDIDATE_PAIR_MAX_FOUNDATION) == 0) {
-        nice_debug ("Agent %p : Unfreezing check %p "
-            "(after successful check %p).", agent, pair, p);
-        SET_PAIR_STATE (agent, pair, NICE_CHECK_WAITING);
-        result = TRUE;
-      }
-    }
-  }
-  /* We dump the conncheck list when something interesting happened, ie
-   * when we unfroze some pairs.
-   */
-  if (result)
+    /* We dump the conncheck list when something interesting happened, ie
+     * when we unfroze some pairs.
+     */
     priv_print_conn_check_lists (agent, G_STRFUNC, NULL);
+  }
 }
 
 guint
@@ -553,11 +937,31 @@ static StunTransaction *
 priv_add_stun_transaction (CandidateCheckPair *pair)
 {
   StunTransaction *stun = g_slice_new0 (StunTransaction);
+  stun->pair = pair;
   pair->stun_transactions = g_slist_prepend (pair->stun_transactions, stun);
   pair->retransmit = TRUE;
   return stun;
 }
 
+/*
+ * Indexes a STUN transaction by its id, once its request is built, so
+ * that responses can be matched to it, see
+ * priv_map_reply_to_conn_check_request().
+ */
+static void
+priv_index_stun_transaction (NiceAgent *agent, StunTransaction *stun)
+{
+  stun_message_id (&stun->message, stun->id);
+  g_hash_table_replace (agent->conncheck_transactions, stun->id, stun);
+}
+
+static void
+priv_unindex_stun_transaction (NiceAgent *agent, StunTransaction *stun)
+{
+  if (g_hash_table_lookup (agent->conncheck_transactions, stun->id) == stun)
+    g_hash_table_remove (agent->conncheck_transactions, stun->id);
+}
+
 /*
  * Forget a STUN transaction.
  *
@@ -593,9 +997,10 @@ priv_free_stun_transaction (gpointer data)
  * forget the stun transaction.
  */
 static void
-priv_remove_stun_transaction (CandidateCheckPair *pair,
+priv_remove_stun_transaction (NiceAgent *agent, CandidateCheckPair *pair,
   StunTransaction *stun, NiceComponent *component)
 {
+  priv_unindex_stun_transaction (agent, stun);
   priv_forget_stun_transaction (stun, component);
   pair->stun_transactions = g_slist_remove (pair->stun_transactions, stun);
   priv_free_stun_transaction (stun);
@@ -612,9 +1017,13 @@ priv_remove_stun_transaction (CandidateCheckPair *pair,
  * forget the stun transactions.
  */
 static void
-priv_free_all_stun_transactions (CandidateCheckPair *pair,
+priv_free_all_stun_transactions (NiceAgent *agent, CandidateCheckPair *pair,
   NiceComponent *component)
 {
+  GSList *i;
+
+  for (i = pair->stun_transactions; i; i = i->next)
+    priv_unindex_stun_transaction (agent, i->data);
   if (component)
     g_slist_foreach (pair->stun_transactions, priv_forget_stun_transaction, component);
   g_slist_free_full (pair->stun_transactions, priv_free_stun_transaction);
@@ -629,7 +1038,57 @@ candidate_check_pair_fail (NiceStream *stream, NiceAgent *agent, CandidateCheckP
 
   component = nice_stream_find_component_by_id (stream, p->component_id);
   SET_PAIR_STATE (agent, p, NICE_CHECK_FAILED);
-  priv_free_all_stun_transactions (p, component);
+  priv_free_all_stun_transactions (agent, p, component);
+}
+
+/*
+ * Returns the check pair the selected pair of @component was taken from, to
+ * account its keepalives, or NULL if it is not in the check list anymore.
+ */
+static CandidateCheckPair *
+priv_find_selected_check_pair (NiceAgent *agent, NiceComponent *component)
+{
+  GSList *pairs;
+
+  if (component->selected_pair.local == NULL ||
+      component->selected_pair.remote == NULL)
+    return NULL;
+
+  pairs = priv_find_check_pairs (agent,
+      (NiceCandidate *) component->selected_pair.local,
+      (NiceCandidate *) component->selected_pair.remote);
+
+  return pairs ? pairs->data : NULL;
+}
+
+/*
+ * Accounts a round-trip time sample, in microseconds, to @component and,
+ * if known, to the check pair it was measured on.
+ */
+static void
+priv_add_rtt_sample (NiceComponent *component, CandidateCheckPair *pair,
+    gint64 rtt)
+{
+  nice_component_add_rtt_sample (component, rtt);
+
+  if (pair != NULL)
+    nice_rtt_add_sample (&pair->rtt, &pair->smoothed_rtt, rtt);
+}
+
+/*
+ * Returns whether another stun request may be sent in this tick of the
+ * connectivity check timer: a single one, unless a pacing rate is set,
+ * see priv_refill_pacing_budget().
+ *
+ * @param stun_sent whether a stun request was already sent in this tick
+ */
+static gboolean
+priv_conn_check_may_send (NiceAgent *agent, gboolean stun_sent)
+{
+  if (!stun_sent)
+    return TRUE;
+
+  return agent->stun_pacing_rate > 0 && agent->stun_pacing_budget > 0;
 }
 
 /*
@@ -638,10 +1097,11 @@ candidate_check_pair_fail (NiceStream *stream, NiceAgent *agent, CandidateCheckP
  *
  * @param agent context pointer
  * @param stream which stream (of the agent)
- * @return will return TRUE if a new stun request has been sent
+ * @param stun_sent set to TRUE if a new stun request has been sent
  */
-static gboolean
-priv_conn_check_tick_stream (NiceAgent *agent, NiceStream *stream)
+static void
+priv_conn_check_tick_stream (NiceAgent *agent, NiceStream *stream,
+    gboolean *stun_sent)
 {
   gboolean pair_failed = FALSE;
   GSList *i, *j;
@@ -671,11 +1131,14 @@ priv_conn_check_tick_stream (NiceAgent *agent, NiceStream *stream)
 
       if (now < stun->next_tick)
         remaining++;
+      else if (!priv_conn_check_may_send (agent, *stun_sent))
+        /* note: the transaction is refreshed in a later tick */
+        remaining++;
       else
         switch (stun_timer_refresh (&stun->timer)) {
           case STUN_USAGE_TIMER_RETURN_TIMEOUT:
 timer_return_timeout:
-            priv_remove_stun_transaction (p, stun, component);
+            priv_remove_stun_transaction (agent, p, stun, component);
             break;
           case STUN_USAGE_TIMER_RETURN_RETRANSMIT:
             /* case: retransmission stopped, due to the nomination of
@@ -697,11 +1160,19 @@ timer_return_timeout:
             agent_socket_send (p->sockptr, &p->remote->addr,
                 stun_message_length (&stun->message),
                 (gchar *)stun->buffer);
+            agent->stun_pacing_budget -= stun_message_length (&stun->message);
+            component->stats.stun_requests_sent++;
+            component->stats.stun_retransmissions++;
+            NICE_TRACE (conncheck_send, agent, p, p->stream_id,
+                p->component_id);
+            p->requests_sent++;
+            p->last_request_sent = now;
 
             /* note: convert from milli to microseconds for g_time_val_add() */
             stun->next_tick = now + timeout * 1000;
-
-            return TRUE;
+            *stun_sent = TRUE;
+            remaining++;
+            break;
           case STUN_USAGE_TIMER_RETURN_SUCCESS:
             timeout = stun_timer_remainder (&stun->timer);
             /* note: convert from milli to microseconds for g_time_val_add() */
@@ -739,57 +1210,59 @@ timer_return_timeout:
 
   if (pair_failed)
     priv_print_conn_check_lists (agent, G_STRFUNC, ", retransmission failed");
-
-  return FALSE;
 }
 
-static gboolean
-priv_conn_check_ordinary_check (NiceAgent *agent, NiceStream *stream)
+static void
+priv_conn_check_ordinary_check (NiceAgent *agent, NiceStream *stream,
+    gboolean *stun_sent)
 {
   CandidateCheckPair *pair;
-  gboolean stun_sent = FALSE;
 
   /* step: perform an ordinary check, sec 6.1.4.2 point 3. (Performing
    * Connectivity Checks) of ICE spec (RFC8445)
    * note: This code is executed when the triggered checks list is
    * empty, and when no STUN message has been sent (pacing constraint)
    */
-  pair = priv_conn_check_find_next_waiting (stream->conncheck_list);
-  if (pair == NULL) {
-    /* step: there is no candidate in waiting state, try to unfreeze
-     * some pairs and retry, sect 6.1.4.2 point 2. (Performing Connectivity
-     * Checks) of ICE spec (RFC8445)
-     */
-    priv_conn_check_unfreeze_next (agent);
-    pair = priv_conn_check_find_next_waiting (stream->conncheck_list);
-  }
+  while (priv_conn_check_may_send (agent, *stun_sent)) {
+    pair = priv_conn_check_find_next_waiting (stream);
+    if (pair == NULL) {
+      /* step: there is no candidate in waiting state, try to unfreeze
+       * some pairs and retry, sect 6.1.4.2 point 2. (Performing
+       * Connectivity Checks) of ICE spec (RFC8445)
+       */
+      priv_conn_check_unfreeze_next (agent);
+      pair = priv_conn_check_find_next_waiting (stream);
+    }
 
-  if (pair) {
-    stun_sent = priv_conn_check_initiate (agent, pair);
+    if (pair == NULL)
+      break;
+
+    if (priv_conn_check_initiate (agent, pair))
+      *stun_sent = TRUE;
     priv_print_conn_check_lists (agent, G_STRFUNC,
         ", initiated an ordinary connection check");
   }
-  return stun_sent;
 }
 
-static gboolean
-priv_conn_check_triggered_check (NiceAgent *agent, NiceStream *stream)
+static void
+priv_conn_check_triggered_check (NiceAgent *agent, gboolean *stun_sent)
 {
   CandidateCheckPair *pair;
-  gboolean stun_sent = FALSE;
 
   /* step: perform a test from the triggered checks list,
    * sect 6.1.4.2 point 1. (Performing Connectivity Checks) of ICE
    * spec (RFC8445)
    */
-  pair = priv_get_pair_from_triggered_check_queue (agent);
+  while (priv_conn_check_may_send (agent, *stun_sent)) {
+    pair = priv_get_pair_from_triggered_check_queue (agent);
+    if (pair == NULL)
+      break;
 
-  if (pair) {
-    stun_sent = priv_conn_check_initiate (agent, pair);
+    if (priv_conn_check_initiate (agent, pair))
+      *stun_sent = TRUE;
     priv_print_conn_check_lists (agent, G_STRFUNC,
         ", initiated a connection check from triggered check list");
   }
-  return stun_sent;
 }
 
 
@@ -1141,6 +1614,32 @@ conn_check_stop (NiceAgent *agent)
 }
 
 
+/*
+ * Adds to the pacing budget the bytes that the checks may use since it
+ * was last refilled, up to one tick worth of them, see
+ * NiceAgent:stun-pacing-rate.
+ */
+static void
+priv_refill_pacing_budget (NiceAgent *agent)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 tick = (gint64) agent->timer_ta * 1000;
+  gint64 elapsed;
+
+  if (agent->stun_pacing_rate == 0) {
+    agent->stun_pacing_budget = 0;
+    return;
+  }
+
+  elapsed = (agent->stun_pacing_time > 0) ?
+      MIN (now - agent->stun_pacing_time, tick) : tick;
+
+  agent->stun_pacing_budget = MIN (agent->stun_pacing_budget +
+      agent->stun_pacing_rate * elapsed / G_USEC_PER_SEC,
+      agent->stun_pacing_rate * tick / G_USEC_PER_SEC);
+  agent->stun_pacing_time = now;
+}
+
 /*
  * Timer callback that handles initiating and managing connectivity
  * checks (paced by the Ta timer).
@@ -1156,32 +1655,28 @@ static gboolean priv_conn_check_tick_agent_locked (NiceAgent *agent,
   gboolean stun_sent = FALSE;
   GSList *i;
 
-  /* step: process triggered checks
-   * these steps are ordered by priority, since a single stun request
-   * is sent per callback, we process the important steps first.
+  for (i = agent->streams; i; i = i->next)
+    conn_check_refresh_pair_priorities (agent, i->data);
+
+  /* step: send the pending stun requests
    *
-   * perform a single stun request per timer callback,
-   * to respect stun pacing
+   * a single one is sent per timer callback, to respect stun pacing,
+   * unless a pacing rate is set: then they are sent until this tick's
+   * share of the rate is used, and at least one. These steps are
+   * ordered by priority, we process the important steps first.
    */
-  for (i = agent->streams; i && !stun_sent; i = i->next) {
-    NiceStream *stream = i->data;
+  priv_refill_pacing_budget (agent);
 
-    stun_sent = priv_conn_check_triggered_check (agent, stream);
-  }
+  /* step: process triggered checks */
+  priv_conn_check_triggered_check (agent, &stun_sent);
 
   /* step: process ongoing STUN transactions */
-  for (i = agent->streams; i && !stun_sent; i = i->next) {
-    NiceStream *stream = i->data;
-
-    stun_sent = priv_conn_check_tick_stream (agent, stream);
-  }
+  for (i = agent->streams; i; i = i->next)
+    priv_conn_check_tick_stream (agent, i->data, &stun_sent);
 
   /* step: process ordinary checks */
-  for (i = agent->streams; i && !stun_sent; i = i->next) {
-    NiceStream *stream = i->data;
-
-    stun_sent = priv_conn_check_ordinary_check (agent, stream);
-  }
+  for (i = agent->streams; i; i = i->next)
+    priv_conn_check_ordinary_check (agent, i->data, &stun_sent);
 
   if (stun_sent)
     keep_timer_going = TRUE;
@@ -1238,6 +1733,7 @@ static gboolean priv_conn_keepalive_retransmissions_tick_agent_locked (
     NiceAgent *agent, gpointer pointer)
 {
   CandidatePair *pair = (CandidatePair *) pointer;
+  NiceComponent *component;
 
   g_source_destroy (pair->keepalive.tick_source);
   g_source_unref (pair->keepalive.tick_source);
@@ -1248,7 +1744,6 @@ static gboolean priv_conn_keepalive_retransmissions_tick_agent_locked (
       {
         /* Time out */
         StunTransactionId id;
-        NiceComponent *component;
 
         if (!agent_find_component (agent,
                 pair->keepalive.stream_id, pair->keepalive.component_id,
@@ -1281,6 +1776,19 @@ static gboolean priv_conn_keepalive_retransmissions_tick_agent_locked (
           stun_message_length (&pair->keepalive.stun_message),
           (gchar *)pair->keepalive.stun_buffer);
 
+      if (agent_find_component (agent, pair->keepalive.stream_id,
+              pair->keepalive.component_id, NULL, &component)) {
+        CandidateCheckPair *p = priv_find_selected_check_pair (agent,
+            component);
+
+        component->stats.stun_requests_sent++;
+        component->stats.stun_retransmissions++;
+        if (p) {
+          p->requests_sent++;
+          p->last_request_sent = g_get_monotonic_time ();
+        }
+      }
+
       nice_debug ("Agent %p : Retransmitting keepalive conncheck",
           agent);
 
@@ -1382,6 +1890,149 @@ static void ms_ice2_legacy_conncheck_send(StunMessage *msg, NiceSocket *sock,
   memcpy (fingerprint_attr, &fingerprint_orig, sizeof (fingerprint_orig));
 }
 
+static gboolean priv_conn_consent_tick_agent_locked (NiceAgent *agent,
+    gpointer pointer);
+
+/*
+ * Schedules the next consent freshness check of the selected pair @pair,
+ * at a random interval of 0.8 to 1.2 times the consent interval, 5 seconds
+ * as in RFC 7675 section 5.1, or when consent expires if that comes first.
+ */
+static void priv_conn_consent_schedule (NiceAgent *agent, CandidatePair *pair)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 expiry = pair->keepalive.consent_time +
+      1000 * (gint64) agent->consent_timeout;
+  guint interval;
+
+  interval = nice_rng_generate_int (agent->rng,
+      agent->consent_interval * 4 / 5,
+      agent->consent_interval * 6 / 5 + 1);
+  if (now + 1000 * (gint64) interval > expiry)
+    interval = MAX (expiry - now, 0) / 1000;
+
+  agent_timeout_add_with_context (agent, &pair->keepalive.consent_source,
+      "Pair consent freshness", interval,
+      priv_conn_consent_tick_agent_locked, pair);
+}
+
+/*
+ * Starts verifying the consent of the peer on the selected pair of
+ * @component, unless this is already done or consent was lost.
+ */
+static void priv_conn_consent_start (NiceAgent *agent, NiceStream *stream,
+    NiceComponent *component)
+{
+  CandidatePair *p = &component->selected_pair;
+
+  if (p->keepalive.consent_source != NULL || p->keepalive.consent_lost)
+    return;
+
+  /* the pair was just selected after a successful check */
+  if (p->keepalive.consent_time == 0)
+    p->keepalive.consent_time = g_get_monotonic_time ();
+
+  p->keepalive.stream_id = stream->id;
+  p->keepalive.component_id = component->id;
+  priv_conn_consent_schedule (agent, p);
+}
+
+/*
+ * Sends a consent freshness check on the selected pair of @component.
+ * These are not retransmitted: an unanswered check is forgotten when the
+ * next one is sent, and consent only expires after several of them.
+ */
+static void priv_conn_consent_send (NiceAgent *agent, NiceStream *stream,
+    NiceComponent *component)
+{
+  CandidatePair *p = &component->selected_pair;
+  CandidateCheckPair *check_pair;
+  uint8_t uname[NICE_STREAM_MAX_UNAME];
+  size_t uname_len;
+  uint8_t *password = NULL;
+  size_t password_len;
+  size_t buf_len;
+
+  uname_len = priv_create_username (agent, stream, component->id,
+      (NiceCandidate *) p->remote, (NiceCandidate *) p->local, uname,
+      sizeof (uname), FALSE);
+  password_len = priv_get_password (agent, stream,
+      (NiceCandidate *) p->remote, &password);
+  if (uname_len == 0)
+    return;
+
+  if (p->keepalive.stun_message.buffer != NULL) {
+    StunTransactionId id;
+
+    stun_message_id (&p->keepalive.stun_message, id);
+    stun_agent_forget_transaction (&component->stun_agent, id);
+    p->keepalive.stun_message.buffer = NULL;
+  }
+
+  buf_len = stun_usage_ice_conncheck_create (&component->stun_agent,
+      &p->keepalive.stun_message, p->keepalive.stun_buffer,
+      sizeof(p->keepalive.stun_buffer),
+      uname, uname_len, password, password_len,
+      agent->controlling_mode, agent->controlling_mode,
+      p->stun_priority,
+      agent->tie_breaker,
+      NULL,
+      agent_to_ice_compatibility (agent));
+  if (buf_len == 0)
+    return;
+
+  nice_debug ("Agent %p : s%u:%u: sending consent freshness check",
+      agent, stream->id, component->id);
+
+  stun_timer_start (&p->keepalive.timer, agent->stun_initial_timeout, 0);
+  p->keepalive.start_time = g_get_monotonic_time ();
+
+  agent_socket_send (p->local->sockptr, &p->remote->c.addr,
+      buf_len, (gchar *)p->keepalive.stun_buffer);
+  component->stats.stun_requests_sent++;
+  check_pair = priv_find_selected_check_pair (agent, component);
+  if (check_pair) {
+    check_pair->requests_sent++;
+    check_pair->last_request_sent = p->keepalive.start_time;
+  }
+}
+
+/*
+ * Timer callback of the consent freshness checks of a selected pair:
+ * either sends the next check, or fails the component if consent
+ * expired (RFC 7675 section 5.1).
+ */
+static gboolean priv_conn_consent_tick_agent_locked (NiceAgent *agent,
+    gpointer pointer)
+{
+  CandidatePair *pair = pointer;
+  NiceStream *stream;
+  NiceComponent *component;
+
+  g_source_destroy (pair->keepalive.consent_source);
+  g_source_unref (pair->keepalive.consent_source);
+  pair->keepalive.consent_source = NULL;
+
+  if (!agent_find_component (agent, pair->keepalive.stream_id,
+          pair->keepalive.component_id, &stream, &component))
+    return G_SOURCE_REMOVE;
+
+  if (g_get_monotonic_time () - pair->keepalive.consent_time >=
+      1000 * (gint64) agent->consent_timeout) {
+    nice_debug ("Agent %p : s%u:%u: consent to send expired", agent,
+        stream->id, component->id);
+    pair->keepalive.consent_lost = TRUE;
+    agent_signal_component_state_change (agent, stream->id, component->id,
+        NICE_COMPONENT_STATE_FAILED);
+    return G_SOURCE_REMOVE;
+  }
+
+  priv_conn_consent_send (agent, stream, component);
+  priv_conn_consent_schedule (agent, pair);
+
+  return G_SOURCE_REMOVE;
+}
+
 /*
  * Timer callback that handles initiating and managing connectivity
  * checks (paced by the Ta timer).
@@ -1404,8 +2055,11 @@ static gboolean priv_conn_keepalive_tick_unlocked (NiceAgent *agent)
 
   /* case 1: session established and media flowing
    *         (ref ICE sect 11 "Keepalives" RFC-8445)
-   * TODO: keepalives should be send only when no packet has been sent
-   * on that pair in the last Tr seconds, and not unconditionally.
+   * binding indications are only sent when no media has been sent on the
+   * pair in the last Tr seconds, while keepalive conncheck requests are
+   * always sent, as their responses tell whether the peer is still there.
+   * With consent freshness, the checks of RFC 7675 replace them and run
+   * on a timer of their own per pair.
    */
   for (i = agent->streams; i; i = i->next) {
 
@@ -1415,6 +2069,12 @@ static gboolean priv_conn_keepalive_tick_unlocked (NiceAgent *agent)
       if (component->selected_pair.local != NULL) {
 	CandidatePair *p = &component->selected_pair;
 
+        if (agent->consent_freshness &&
+            agent->compatibility == NICE_COMPATIBILITY_RFC5245) {
+          priv_conn_consent_start (agent, stream, component);
+          continue;
+        }
+
         /* Disable keepalive checks on TCP candidates unless explicitly enabled */
         if (p->local->c.transport != NICE_CANDIDATE_TRANSPORT_UDP &&
             !agent->keepalive_conncheck)
@@ -1438,6 +2098,7 @@ static gboolean priv_conn_keepalive_tick_unlocked (NiceAgent *agent)
           size_t password_len = priv_get_password (agent,
               agent_find_stream (agent, stream->id),
               (NiceCandidate *) p->remote, &password);
+          CandidateCheckPair *check_pair;
 
           if (p->keepalive.stun_message.buffer != NULL) {
             nice_debug ("Agent %p: Keepalive for s%u:c%u still"
@@ -1475,12 +2136,19 @@ static gboolean priv_conn_keepalive_tick_unlocked (NiceAgent *agent)
               stun_timer_start (&p->keepalive.timer,
                   agent->stun_initial_timeout,
                   agent->stun_max_retransmissions);
+              p->keepalive.start_time = now;
 
               agent->media_after_tick = FALSE;
 
               /* send the conncheck */
               agent_socket_send (p->local->sockptr, &p->remote->c.addr,
                   buf_len, (gchar *)p->keepalive.stun_buffer);
+              component->stats.stun_requests_sent++;
+              check_pair = priv_find_selected_check_pair (agent, component);
+              if (check_pair) {
+                check_pair->requests_sent++;
+                check_pair->last_request_sent = now;
+              }
 
               p->keepalive.stream_id = stream->id;
               p->keepalive.component_id = component->id;
@@ -1498,6 +2166,17 @@ static gboolean priv_conn_keepalive_tick_unlocked (NiceAgent *agent)
             }
           }
         } else {
+          /* media sent on the pair keeps the bindings alive as well */
+          if (p->keepalive.last_media_sent > 0 &&
+              now < p->keepalive.last_media_sent +
+                  1000 * NICE_AGENT_TIMER_TR_DEFAULT) {
+            p->keepalive.next_tick = p->keepalive.last_media_sent +
+                1000 * NICE_AGENT_TIMER_TR_DEFAULT;
+            if (p->keepalive.next_tick < min_next_tick)
+              min_next_tick = p->keepalive.next_tick;
+            continue;
+          }
+
           buf_len = stun_usage_bind_keepalive (&component->stun_agent,
               &p->keepalive.stun_message, p->keepalive.stun_buffer,
               sizeof(p->keepalive.stun_buffer));
@@ -1769,7 +2448,8 @@ void conn_check_schedule_next (NiceAgent *agent)
 /*
  * Compares two connectivity check items. Checkpairs are sorted
  * in descending priority order, with highest priority item at
- * the start of the list.
+ * the start of the list. Pairs of equal priority are sorted the
+ * last added first, where g_slist_insert_sorted() puts them.
  */
 gint conn_check_compare (const CandidateCheckPair *a, const CandidateCheckPair *b)
 {
@@ -1777,6 +2457,10 @@ gint conn_check_compare (const CandidateCheckPair *a, const CandidateCheckPair *
     return -1;
   else if (a->priority < b->priority)
     return 1;
+  else if (a->seq > b->seq)
+    return -1;
+  else if (a->seq < b->seq)
+    return 1;
   return 0;
 }
 
@@ -2014,44 +2698,65 @@ void conn_check_remote_credentials_set(NiceAgent *agent, NiceStream *stream)
 static gboolean priv_limit_conn_check_list_size (NiceAgent *agent,
     NiceStream *stream, CandidateCheckPair *pair)
 {
-  guint valid = 0;
   guint cancelled = 0;
   gboolean deleted = FALSE;
-  GSList *item = stream->conncheck_list;
-
-  while (item) {
-    CandidateCheckPair *p = item->data;
-    GSList *next = item->next;
-
-    valid++;
-    /* We remove lower-priority pairs, but only the ones that can be
-     * safely discarded without breaking an ongoing conncheck process.
-     * This only includes pairs that are in the frozen state (those
-     * initially added when remote candidates are received) or in failed
-     * state. Pairs in any other state play a role in the conncheck, and
-     * there removal may lead to a failing conncheck that would succeed
-     * otherwise.
-     *
-     * We also remove failed pairs from the list unconditionally.
-     */
-    if ((valid > agent->max_conn_checks && p->state == NICE_CHECK_FROZEN) ||
-        p->state == NICE_CHECK_FAILED) {
+
+  /* We remove lower-priority pairs, but only the ones that can be
+   * safely discarded without breaking an ongoing conncheck process.
+   * This only includes pairs that are in the frozen state (those
+   * initially added when remote candidates are received) or in failed
+   * state. Pairs in any other state play a role in the conncheck, and
+   * there removal may lead to a failing conncheck that would succeed
+   * otherwise.
+   *
+   * We also remove failed pairs from the list unconditionally. Frozen
+   * pairs are only removed if they rank after the first max_conn_checks
+   * pairs of the list.
+   *
+   * Both kinds of pairs are indexed per stream, the frozen ones in check
+   * list order, so this only walks the head of the check list.
+   */
+  while (!g_sequence_is_empty (stream->failed_pairs)) {
+    CandidateCheckPair *p =
+        g_sequence_get (g_sequence_get_begin_iter (stream->failed_pairs));
+
+    if (p == pair)
+      deleted = TRUE;
+    nice_debug ("Agent %p : pair %p removed.", agent, p);
+    stream->conncheck_list = g_slist_remove (stream->conncheck_list, p);
+    candidate_check_pair_free (agent, p);
+    cancelled++;
+  }
+
+  if (stream->n_check_pairs > agent->max_conn_checks) {
+    CandidateCheckPair *last = NULL;
+
+    /* The pairs up to this one are kept whatever their state. */
+    if (agent->max_conn_checks > 0)
+      last = g_slist_nth_data (stream->conncheck_list,
+          agent->max_conn_checks - 1);
+
+    while (!g_sequence_is_empty (stream->frozen_pairs)) {
+      CandidateCheckPair *p = g_sequence_get (g_sequence_iter_prev (
+              g_sequence_get_end_iter (stream->frozen_pairs)));
+
+      if (last != NULL && conn_check_compare (p, last) <= 0)
+        break;
+
       if (p == pair)
         deleted = TRUE;
       nice_debug ("Agent %p : pair %p removed.", agent, p);
+      stream->conncheck_list = g_slist_remove (stream->conncheck_list, p);
       candidate_check_pair_free (agent, p);
-      stream->conncheck_list = g_slist_delete_link (stream->conncheck_list,
-          item);
       cancelled++;
     }
-    item = next;
   }
 
   if (cancelled > 0)
     nice_debug ("Agent %p : Pruned %d pairs. "
         "Conncheck list has %d elements left. "
         "Maximum connchecks allowed : %d", agent, cancelled,
-        valid - cancelled, agent->max_conn_checks);
+        stream->n_check_pairs, agent->max_conn_checks);
 
   return deleted;
 }
@@ -2084,6 +2789,8 @@ conn_check_update_selected_pair (NiceAgent *agent, NiceComponent *component,
     cpair.stun_priority = pair->stun_priority;
 
     nice_component_update_selected_pair (agent, component, &cpair);
+    agent_signal_component_milestone (agent, component,
+        NICE_COMPONENT_MILESTONE_NOMINATED);
 
     priv_conn_keepalive_tick_unlocked (agent);
 
@@ -2255,7 +2962,7 @@ static void priv_mark_pair_nominated (NiceAgent *agent, NiceStream *stream, Nice
        * of the pair to true
        */
       if (NICE_AGENT_IS_COMPATIBLE_WITH_RFC5245_OR_OC2007R2 (agent)) {
-        if (g_slist_find (agent->triggered_check_queue, pair) ||
+        if (pair->in_triggered_check_queue ||
             pair->state == NICE_CHECK_IN_PROGRESS) {
 
         /* This pair is not always in the triggered check list, for
@@ -2330,6 +3037,7 @@ static CandidateCheckPair *priv_add_new_check_pair (NiceAgent *agent,
   }
 
   stream = agent_find_stream (agent, stream_id);
+  conn_check_refresh_pair_priorities (agent, stream);
   pair = g_slice_new0 (CandidateCheckPair);
 
   pair->stream_id = stream_id;
@@ -2362,8 +3070,7 @@ static CandidateCheckPair *priv_add_new_check_pair (NiceAgent *agent,
   }
   pair->stun_priority = stun_request_priority (agent, (NiceCandidate *) local);
 
-  stream->conncheck_list = g_slist_insert_sorted (stream->conncheck_list, pair,
-      (GCompareFunc)conn_check_compare);
+  priv_check_list_insert (agent, stream, pair);
 
   nice_debug ("Agent %p : added a new pair %p with foundation '%s' and "
       "transport %s:%s to stream %u component %u",
@@ -2561,8 +3268,9 @@ int conn_check_add_for_local_candidate (NiceAgent *agent, guint stream_id, NiceC
 static void candidate_check_pair_free (NiceAgent *agent,
     CandidateCheckPair *pair)
 {
+  priv_check_list_unindex (agent, pair);
   priv_remove_pair_from_triggered_check_queue (agent, pair);
-  priv_free_all_stun_transactions (pair, NULL);
+  priv_free_all_stun_transactions (agent, pair, NULL);
   g_slice_free (CandidateCheckPair, pair);
 }
 
@@ -2933,10 +3641,12 @@ int conn_check_send (NiceAgent *agent, CandidateCheckPair *pair)
 
   if (buffer_len == 0) {
     nice_debug ("Agent %p: buffer is empty, cancelling conncheck", agent);
-    priv_remove_stun_transaction (pair, stun, component);
+    priv_remove_stun_transaction (agent, pair, stun, component);
     return -1;
   }
 
+  priv_index_stun_transaction (agent, stun);
+
   if (nice_socket_is_reliable(pair->sockptr)) {
     timeout = agent->stun_reliable_timeout;
     stun_timer_start_reliable(&stun->timer, timeout);
@@ -2945,7 +3655,8 @@ int conn_check_send (NiceAgent *agent, CandidateCheckPair *pair)
     stun_timer_start (&stun->timer, timeout, agent->stun_max_retransmissions);
   }
 
-  stun->next_tick = g_get_monotonic_time () + timeout * 1000;
+  stun->start_time = g_get_monotonic_time ();
+  stun->next_tick = stun->start_time + timeout * 1000;
 
   /* TCP-ACTIVE candidate must create a new socket before sending
    * by connecting to the peer. The new socket is stored in the candidate
@@ -2965,7 +3676,7 @@ int conn_check_send (NiceAgent *agent, CandidateCheckPair *pair)
         nice_debug ("Agent %p: add to tcp-act socket %p a new "
             "tcp connect socket %p on pair %p in s/c %d/%d",
             agent, pair->sockptr, new_socket, pair, stream->id, component->id);
-        pair->sockptr = new_socket;
+        priv_set_pair_socket (agent, pair, new_socket);
         _priv_set_socket_tos (agent, pair->sockptr, stream2->tos);
 
         nice_socket_set_writable_callback (pair->sockptr, _tcp_sock_is_writable,
@@ -2978,6 +3689,14 @@ int conn_check_send (NiceAgent *agent, CandidateCheckPair *pair)
   /* send the conncheck */
   agent_socket_send (pair->sockptr, &pair->remote->addr,
       buffer_len, (gchar *)stun->buffer);
+  agent->stun_pacing_budget -= buffer_len;
+  component->stats.stun_requests_sent++;
+  NICE_TRACE (conncheck_send, agent, pair, pair->stream_id,
+      pair->component_id);
+  agent_signal_component_milestone (agent, component,
+      NICE_COMPONENT_MILESTONE_FIRST_CHECK_SENT);
+  pair->requests_sent++;
+  pair->last_request_sent = stun->start_time;
 
   if (agent->compatibility == NICE_COMPATIBILITY_OC2007R2)
     ms_ice2_legacy_conncheck_send (&stun->message, pair->sockptr,
@@ -3027,7 +3746,7 @@ static guint priv_prune_pending_checks (NiceAgent *agent, NiceStream *stream, Ni
      * use-candidate flag set, and the peer agent may already have
      * selected such one.
      */
-    if (g_slist_find (agent->triggered_check_queue, p) &&
+    if (p->in_triggered_check_queue &&
         p->state != NICE_CHECK_IN_PROGRESS) {
       if (p->priority < priority) {
         nice_debug ("Agent %p : pair %p removed.", agent, p);
@@ -3095,11 +3814,10 @@ static gboolean priv_schedule_triggered_check (NiceAgent *agent, NiceStream *str
   nice_debug ("Agent %p : scheduling triggered check with socket=%p "
       "and remote cand=%p.", agent, local_socket, remote_cand);
 
-  for (i = stream->conncheck_list; i ; i = i->next) {
+  for (i = priv_find_socket_pairs (agent, local_socket, remote_cand); i ;
+      i = i->next) {
       p = i->data;
-      if (p->component_id == component->id &&
-	  p->remote == remote_cand &&
-          p->sockptr == local_socket) {
+      if (p->component_id == component->id) {
         /* If we match with a peer-reflexive discovered pair, we
          * use the parent succeeded pair instead */
 
@@ -3108,6 +3826,11 @@ static gboolean priv_schedule_triggered_check (NiceAgent *agent, NiceStream *str
           p = p->succeeded_pair;
         }
 
+        /* The request has been answered before getting here. */
+        p->requests_received++;
+        p->responses_sent++;
+        p->last_request_received = g_get_monotonic_time ();
+
 	nice_debug ("Agent %p : Found a matching pair %p (%s) (%s) ...",
             agent, p, p->foundation, priv_state_to_string (p->state));
 	
@@ -3184,8 +3907,12 @@ static gboolean priv_schedule_triggered_check (NiceAgent *agent, NiceStream *str
     nice_debug ("Agent %p : Adding a triggered check to conn.check list (local=%p).", agent, local);
     p = priv_conn_check_add_for_candidate_pair_matched (agent, stream->id,
         component, local, remote_cand, NICE_CHECK_WAITING);
-    if (p)
+    if (p) {
+      p->requests_received++;
+      p->responses_sent++;
+      p->last_request_received = g_get_monotonic_time ();
       priv_add_pair_to_triggered_check_queue (agent, p);
+    }
     return TRUE;
   }
   else {
@@ -3233,6 +3960,7 @@ static void priv_reply_to_conn_check (NiceAgent *agent, NiceStream *stream,
   }
 
   agent_socket_send (sockptr, toaddr, rbuf_len, (const gchar*)msg->buffer);
+  component->stats.stun_responses_sent++;
   if (agent->compatibility == NICE_COMPATIBILITY_OC2007R2) {
     ms_ice2_legacy_conncheck_send(msg, sockptr, toaddr);
   }
@@ -3316,6 +4044,7 @@ static CandidateCheckPair *priv_add_peer_reflexive_pair (NiceAgent *agent, guint
   g_snprintf (pair->foundation, NICE_CANDIDATE_PAIR_MAX_FOUNDATION, "%s:%s",
       local_cand->c.foundation, parent_pair->remote->foundation);
 
+  conn_check_refresh_pair_priorities (agent, stream);
   if (agent->controlling_mode == TRUE)
     pair->priority = nice_candidate_pair_priority (pair->local->priority,
         pair->remote->priority);
@@ -3337,8 +4066,7 @@ static CandidateCheckPair *priv_add_peer_reflexive_pair (NiceAgent *agent, guint
       nice_candidate_transport_to_string (pair->remote->transport),
       stream_id, component->id);
 
-  stream->conncheck_list = g_slist_insert_sorted (stream->conncheck_list, pair,
-      (GCompareFunc)conn_check_compare);
+  priv_check_list_insert (agent, stream, pair);
 
   return pair;
 }
@@ -3346,28 +4074,69 @@ static CandidateCheckPair *priv_add_peer_reflexive_pair (NiceAgent *agent, guint
 /*
  * Recalculates priorities of all candidate pairs. This
  * is required after a conflict in ICE roles.
+ *
+ * This is done lazily: the check list of each stream is sorted again
+ * the next time it is used, see conn_check_refresh_pair_priorities(), so that
+ * several role conflicts in a row only cost one recalculation.
  */
 void recalculate_pair_priorities (NiceAgent *agent)
 {
-  GSList *i, *j;
+  GSList *i;
 
   for (i = agent->streams; i; i = i->next) {
     NiceStream *stream = i->data;
-    for (j = stream->conncheck_list; j; j = j->next) {
-      CandidateCheckPair *p = j->data;
-      p->priority = agent_candidate_pair_priority (agent, p->local, p->remote);
+
+    stream->pair_priorities_stale = TRUE;
+  }
+}
+
+/*
+ * Recalculates the priorities of the pairs of @stream with the remote
+ * candidate @remote, after its type or priority changed. The other pairs
+ * keep their place in the check list.
+ */
+void conn_check_recalculate_candidate_pair_priorities (NiceAgent *agent,
+    NiceStream *stream, NiceCandidate *remote)
+{
+  GSList *i, *moved = NULL;
+
+  conn_check_refresh_pair_priorities (agent, stream);
+
+  i = stream->conncheck_list;
+  while (i) {
+    CandidateCheckPair *p = i->data;
+    GSList *next = i->next;
+
+    if (p->remote == remote) {
+      guint64 priority = agent_candidate_pair_priority (agent, p->local,
+          p->remote);
+
+      if (priority != p->priority) {
+        priv_set_pair_priority (agent, p, priority);
+        stream->conncheck_list = g_slist_delete_link (stream->conncheck_list,
+            i);
+        moved = g_slist_prepend (moved, p);
+      }
     }
-    stream->conncheck_list = g_slist_sort (stream->conncheck_list,
-        (GCompareFunc)conn_check_compare);
+    i = next;
   }
+
+  for (i = moved; i; i = i->next)
+    stream->conncheck_list = g_slist_insert_sorted (stream->conncheck_list,
+        i->data, (GCompareFunc)conn_check_compare);
+  g_slist_free (moved);
 }
 
 /*
  * Change the agent role if different from 'control'. Can be
  * initiated both by handling of incoming connectivity checks,
  * and by processing the responses to checks sent by us.
+ *
+ * The pairs of @stream, whose check is being handled, get their
+ * new priorities right away, the other streams on their next use.
  */
-static void priv_check_for_role_conflict (NiceAgent *agent, gboolean control)
+static void priv_check_for_role_conflict (NiceAgent *agent,
+    NiceStream *stream, gboolean control)
 {
   /* role conflict, change mode; wait for a new conn. check */
   if (control != agent->controlling_mode) {
@@ -3377,6 +4146,7 @@ static void priv_check_for_role_conflict (NiceAgent *agent, gboolean control)
     /* the pair priorities depend on the roles, so recalculation
      * is needed */
     recalculate_pair_priorities (agent);
+    conn_check_refresh_pair_priorities (agent, stream);
   }
   else 
     nice_debug ("Agent %p : Role conflict, staying with role \"%s\".",
@@ -3426,13 +4196,9 @@ static CandidateCheckPair *priv_process_response_check_for_reflexive(NiceAgent *
    * conncheck on this pair *always* leads to the creation of a
    * discovered peer-reflexive tcp-act local candidate.
    */
-  for (i = stream->conncheck_list; i; i = i->next) {
-    CandidateCheckPair *pair = i->data;
-    if (local_cand == pair->local && remote_candidate == pair->remote) {
-      new_pair = pair;
-      break;
-    }
-  }
+  i = priv_find_check_pairs (agent, local_cand, remote_candidate);
+  if (i)
+    new_pair = i->data;
 
   if (new_pair) {
     /* note: when new_pair is distinct from p, it means new_pair is a
@@ -3444,7 +4210,7 @@ static CandidateCheckPair *priv_process_response_check_for_reflexive(NiceAgent *
       p->valid = TRUE;
     SET_PAIR_STATE (agent, p, NICE_CHECK_SUCCEEDED);
     priv_remove_pair_from_triggered_check_queue (agent, p);
-    priv_free_all_stun_transactions (p, component);
+    priv_free_all_stun_transactions (agent, p, component);
     nice_component_add_valid_candidate (agent, component, remote_candidate);
   }
   else {
@@ -3482,7 +4248,7 @@ static CandidateCheckPair *priv_process_response_check_for_reflexive(NiceAgent *
      */
     SET_PAIR_STATE (agent, p, NICE_CHECK_SUCCEEDED);
     priv_remove_pair_from_triggered_check_queue (agent, p);
-    priv_free_all_stun_transactions (p, component);
+    priv_free_all_stun_transactions (agent, p, component);
   }
 
   if (new_pair && new_pair->valid)
@@ -3492,6 +4258,23 @@ static CandidateCheckPair *priv_process_response_check_for_reflexive(NiceAgent *
   return new_pair;
 }
 
+/*
+ * Finds the pair of @stream with an outstanding connectivity check
+ * request of transaction id @id.
+ */
+static CandidateCheckPair *
+priv_find_conncheck_pair (NiceAgent *agent, NiceStream *stream,
+    const StunTransactionId id)
+{
+  StunTransaction *stun;
+
+  stun = g_hash_table_lookup (agent->conncheck_transactions, id);
+  if (stun == NULL || stun->pair->stream_id != stream->id)
+    return NULL;
+
+  return stun->pair;
+}
+
 /*
  * Tries to match STUN reply in 'buf' to an existing STUN connectivity
  * check transaction. If found, the reply is processed. Implements
@@ -3506,16 +4289,16 @@ static gboolean priv_map_reply_to_conn_check_request (NiceAgent *agent, NiceStre
     struct sockaddr addr;
   } sockaddr;
   socklen_t socklen = sizeof (sockaddr);
-  GSList *i, *j;
+  CandidateCheckPair *p;
+  GSList *j;
   guint k;
   StunUsageIceReturn res;
   StunTransactionId discovery_id;
   StunTransactionId response_id;
   stun_message_id (resp, response_id);
 
-  for (i = stream->conncheck_list; i; i = i->next) {
-    CandidateCheckPair *p = i->data;
-
+  p = priv_find_conncheck_pair (agent, stream, response_id);
+  if (p != NULL) {
     for (j = p->stun_transactions, k = 0; j; j = j->next, k++) {
       StunTransaction *stun = j->data;
 
@@ -3540,7 +4323,20 @@ static gboolean priv_map_reply_to_conn_check_request (NiceAgent *agent, NiceStre
 	CandidateCheckPair *ok_pair = NULL;
 
 	nice_debug ("Agent %p : pair %p MATCHED.", agent, p);
-	priv_remove_stun_transaction (p, stun, component);
+
+	p->responses_received++;
+	p->last_response_received = g_get_monotonic_time ();
+	NICE_TRACE (conncheck_response, agent, p,
+	    stun->timer.retransmissions == 1 ?
+	    p->last_response_received - stun->start_time : -1);
+
+	/* A response to a retransmitted request is ambiguous, so, as in
+	 * Karn's algorithm, only requests sent once are timed. */
+	if (stun->timer.retransmissions == 1)
+	  priv_add_rtt_sample (component, p,
+	      p->last_response_received - stun->start_time);
+
+	priv_remove_stun_transaction (agent, p, stun, component);
 
 	/* step: verify that response came from the same IP address we
 	 *       sent the original request to (see 7.1.2.1. "Failure
@@ -3576,6 +4372,9 @@ static gboolean priv_map_reply_to_conn_check_request (NiceAgent *agent, NiceStre
 
 	/* note: CONNECTED but not yet READY, see docs */
 
+	agent_signal_component_milestone (agent, component,
+	    NICE_COMPONENT_MILESTONE_FIRST_CHECK_SUCCEEDED);
+
 	/* step: handle the possible case of a peer-reflexive
 	 *       candidate where the mapped-address in response does
 	 *       not match any local candidate, see 7.1.2.2.1
@@ -3706,8 +4505,8 @@ static gboolean priv_map_reply_to_conn_check_request (NiceAgent *agent, NiceStre
             STUN_ATTRIBUTE_ICE_CONTROLLED, &tie) ==
             STUN_MESSAGE_RETURN_SUCCESS);
 
-        priv_check_for_role_conflict (agent, controlled_mode);
-	priv_remove_stun_transaction (p, stun, component);
+        priv_check_for_role_conflict (agent, stream, controlled_mode);
+	priv_remove_stun_transaction (agent, p, stun, component);
         priv_add_pair_to_triggered_check_queue (agent, p);
       } else {
 	/* case: STUN error, the check STUN context was freed */
@@ -4290,8 +5089,21 @@ static gboolean priv_map_reply_to_keepalive_conncheck (NiceAgent *agent,
       stun_message_id (&component->selected_pair.keepalive.stun_message,
           conncheck_id);
       if (memcmp (conncheck_id, response_id, sizeof(StunTransactionId)) == 0) {
+        CandidateCheckPair *p = priv_find_selected_check_pair (agent,
+            component);
+        gint64 now = g_get_monotonic_time ();
+
         nice_debug ("Agent %p : Keepalive for selected pair received.",
             agent);
+        if (stun_message_get_class (resp) == STUN_RESPONSE)
+          component->selected_pair.keepalive.consent_time = now;
+        if (p) {
+          p->responses_received++;
+          p->last_response_received = now;
+        }
+        if (component->selected_pair.keepalive.timer.retransmissions == 1)
+          priv_add_rtt_sample (component, p,
+              now - component->selected_pair.keepalive.start_time);
         if (component->selected_pair.keepalive.tick_source) {
           g_source_destroy (component->selected_pair.keepalive.tick_source);
           g_source_unref (component->selected_pair.keepalive.tick_source);
@@ -4310,83 +5122,45 @@ typedef struct {
   NiceAgent *agent;
   NiceStream *stream;
   NiceComponent *component;
-  uint8_t *password;
 } conncheck_validater_data;
 
+/*
+ * Finds the password of the candidate whose ufrag starts @username. The
+ * credentials of the candidates are resolved once per component, see
+ * nice_component_find_credentials().
+ */
 static bool conncheck_stun_validater (StunAgent *agent,
     StunMessage *message, uint8_t *username, uint16_t username_len,
     uint8_t **password, size_t *password_len, void *user_data)
 {
   conncheck_validater_data *data = (conncheck_validater_data*) user_data;
-  GSList *i;
-  gchar *ufrag = NULL;
-  gsize ufrag_len;
+  const Credentials *credentials;
+  gboolean remote;
 
   gboolean msn_msoc_nice_compatibility =
       data->agent->compatibility == NICE_COMPATIBILITY_MSN ||
       data->agent->compatibility == NICE_COMPATIBILITY_OC2007;
 
-  if (data->agent->compatibility == NICE_COMPATIBILITY_OC2007 &&
-      stun_message_get_class (message) == STUN_RESPONSE)
-    i = data->component->remote_candidates;
-  else
-    i = data->component->local_candidates;
-
-  for (; i; i = i->next) {
-    NiceCandidate *cand = i->data;
-
-    ufrag = NULL;
-    if (cand->username)
-      ufrag = cand->username;
-    else
-      ufrag = data->stream->local_ufrag;
-    ufrag_len = ufrag? strlen (ufrag) : 0;
+  remote = data->agent->compatibility == NICE_COMPATIBILITY_OC2007 &&
+      stun_message_get_class (message) == STUN_RESPONSE;
 
-    if (ufrag && msn_msoc_nice_compatibility)
-      ufrag = (gchar *)g_base64_decode (ufrag, &ufrag_len);
+  credentials = nice_component_find_credentials (data->component, remote,
+      msn_msoc_nice_compatibility, data->stream->local_ufrag,
+      data->stream->local_password, username, username_len);
 
-    if (ufrag == NULL)
-      continue;
+  stun_debug_bytes ("  username: ", username, username_len);
 
-    stun_debug ("Comparing username/ufrag of len %d and %" G_GSIZE_FORMAT ", equal=%d",
-        username_len, ufrag_len, username_len >= ufrag_len ?
-        memcmp (username, ufrag, ufrag_len) : 0);
-    stun_debug_bytes ("  username: ", username, username_len);
-    stun_debug_bytes ("  ufrag:    ", ufrag, ufrag_len);
-    if (ufrag_len > 0 && username_len >= ufrag_len &&
-        memcmp (username, ufrag, ufrag_len) == 0) {
-      gchar *pass = NULL;
-
-      if (cand->password)
-        pass = cand->password;
-      else if (data->stream && data->stream->local_password[0])
-        pass = data->stream->local_password;
-
-      if (pass) {
-        *password = (uint8_t *) pass;
-        *password_len = strlen (pass);
-
-        if (msn_msoc_nice_compatibility) {
-          gsize pass_len;
-
-          data->password = g_base64_decode (pass, &pass_len);
-          *password = data->password;
-          *password_len = pass_len;
-        }
-      }
-
-      if (msn_msoc_nice_compatibility)
-        g_free (ufrag);
-
-      stun_debug ("Found valid username, returning password: '%s'", *password);
-      return TRUE;
-    }
+  if (credentials == NULL)
+    return FALSE;
 
-    if (msn_msoc_nice_compatibility)
-      g_free (ufrag);
+  if (credentials->password) {
+    *password = credentials->password;
+    *password_len = credentials->password_len;
   }
 
-  return FALSE;
+  stun_debug ("Found valid username, with a password of %" G_GSIZE_FORMAT
+      " bytes", credentials->password_len);
+  return TRUE;
 }
 
 /*
@@ -4430,13 +5204,12 @@ static gboolean conn_check_handle_renomination (NiceAgent *agent, NiceStream *st
     if (component->selected_pair.priority &&
         component->selected_pair.remote && component->selected_pair.remote != (NiceCandidateImpl *) remote_candidate &&
         component->selected_pair.local && component->selected_pair.local != (NiceCandidateImpl *) local_candidate) {
-      for (lst = stream->conncheck_list; lst; lst = lst->next) {
+      lst = priv_find_check_pairs (agent, local_candidate, remote_candidate);
+      if (lst) {
         CandidateCheckPair *pair = lst->data;
-        if (pair->local == local_candidate && pair->remote == remote_candidate) {
-          if (pair->valid) {
-            pair->priority = component->selected_pair.priority + 1;
-          }
-          break;
+        if (pair->valid) {
+          priv_set_pair_priority (agent, pair,
+              component->selected_pair.priority + 1);
         }
       }
     }
@@ -4480,7 +5253,7 @@ gboolean conn_check_handle_inbound_stun (NiceAgent *agent, NiceStream *stream,
   StunMessage req;
   StunMessage msg;
   StunValidationStatus valid;
-  conncheck_validater_data validater_data = {agent, stream, component, NULL};
+  conncheck_validater_data validater_data = {agent, stream, component};
   GSList *i, *j;
   NiceCandidate *remote_candidate = NULL;
   NiceCandidate *remote_candidate2 = NULL;
@@ -4545,8 +5318,6 @@ gboolean conn_check_handle_inbound_stun (NiceAgent *agent, NiceStream *stream,
     }
   }
 
-  g_free (validater_data.password);
-
   if (valid == STUN_VALIDATION_NOT_STUN ||
       valid == STUN_VALIDATION_INCOMPLETE_STUN ||
       valid == STUN_VALIDATION_BAD_REQUEST)
@@ -4563,8 +5334,10 @@ gboolean conn_check_handle_inbound_stun (NiceAgent *agent, NiceStream *stream,
         agent->compatibility != NICE_COMPATIBILITY_OC2007) {
       rbuf_len = stun_agent_build_unknown_attributes_error (&component->stun_agent,
           &msg, rbuf, rbuf_len, &req);
-      if (rbuf_len != 0)
+      if (rbuf_len != 0) {
         agent_socket_send (nicesock, from, rbuf_len, (const gchar*)rbuf);
+        component->stats.stun_responses_sent++;
+      }
     }
     return TRUE;
   }
@@ -4576,8 +5349,10 @@ gboolean conn_check_handle_inbound_stun (NiceAgent *agent, NiceStream *stream,
             &req, STUN_ERROR_UNAUTHORIZED)) {
       rbuf_len = stun_agent_finish_message (&component->stun_agent, &msg, NULL, 0);
       if (rbuf_len > 0 && agent->compatibility != NICE_COMPATIBILITY_MSN &&
-          agent->compatibility != NICE_COMPATIBILITY_OC2007)
+          agent->compatibility != NICE_COMPATIBILITY_OC2007) {
         agent_socket_send (nicesock, from, rbuf_len, (const gchar*)rbuf);
+        component->stats.stun_responses_sent++;
+      }
     }
     return TRUE;
   }
@@ -4587,8 +5362,10 @@ gboolean conn_check_handle_inbound_stun (NiceAgent *agent, NiceStream *stream,
             &req, STUN_ERROR_BAD_REQUEST)) {
       rbuf_len = stun_agent_finish_message (&component->stun_agent, &msg, NULL, 0);
       if (rbuf_len > 0 && agent->compatibility != NICE_COMPATIBILITY_MSN &&
-	  agent->compatibility != NICE_COMPATIBILITY_OC2007)
+	  agent->compatibility != NICE_COMPATIBILITY_OC2007) {
         agent_socket_send (nicesock, from, rbuf_len, (const gchar*)rbuf);
+        component->stats.stun_responses_sent++;
+      }
     }
     return TRUE;
   }
@@ -4612,7 +5389,8 @@ gboolean conn_check_handle_inbound_stun (NiceAgent *agent, NiceStream *stream,
     }
   }
 
-  for (i = component->remote_candidates; i; i = i->next) {
+  for (i = nice_component_find_remote_candidates_by_addr (component, from);
+      i; i = i->next) {
     NiceCandidate *cand = i->data;
     if (nice_address_equal (from, &cand->addr) &&
         remote_candidate_and_socket_compatible (agent, local_candidate,
@@ -4695,11 +5473,20 @@ gboolean conn_check_handle_inbound_stun (NiceAgent *agent, NiceStream *stream,
 
   agent->media_after_tick = TRUE;
 
+  NICE_TRACE (stun_recv, agent, stream->id, component->id,
+      stun_message_get_class (&req), stun_message_get_method (&req));
+
+  if (stun_message_get_class (&req) == STUN_REQUEST)
+    component->stats.stun_requests_received++;
+  else if (stun_message_get_class (&req) == STUN_RESPONSE ||
+      stun_message_get_class (&req) == STUN_ERROR)
+    component->stats.stun_responses_received++;
+
   if (stun_message_get_class (&req) == STUN_REQUEST) {
     if (   agent->compatibility == NICE_COMPATIBILITY_MSN
         || agent->compatibility == NICE_COMPATIBILITY_OC2007) {
       if (local_candidate && remote_candidate2) {
-        gsize key_len;
+        const Credentials *credentials;
 
 	if (agent->compatibility == NICE_COMPATIBILITY_MSN) {
           username = (uint8_t *) stun_message_find (&req,
@@ -4709,14 +5496,20 @@ gboolean conn_check_handle_inbound_stun (NiceAgent *agent, NiceStream *stream,
 	      uname, sizeof (uname), FALSE);
 	  memcpy (username, uname, MIN (uname_len, username_len));
 
-	  req.key = g_base64_decode ((gchar *) remote_candidate2->password,
-              &key_len);
-          req.key_len = key_len;
-	} else if (agent->compatibility == NICE_COMPATIBILITY_OC2007) {
-          req.key = g_base64_decode ((gchar *) local_candidate->password,
-              &key_len);
-          req.key_len = key_len;
+          credentials = nice_component_find_candidate_credentials (component,
+              TRUE, TRUE, stream->local_ufrag, stream->local_password,
+              remote_candidate2);
+	} else {
+          credentials = nice_component_find_candidate_credentials (component,
+              FALSE, TRUE, stream->local_ufrag, stream->local_password,
+              local_candidate);
 	}
+
+        /* the passwords are already decoded, and owned by the component */
+        if (credentials && credentials->password) {
+          req.key = credentials->password;
+          req.key_len = credentials->password_len;
+        }
       } else {
         nice_debug ("Agent %p : received MSN incoming check from unknown remote candidate. "
             "Ignoring request", agent);
@@ -4730,13 +5523,8 @@ gboolean conn_check_handle_inbound_stun (NiceAgent *agent, NiceStream *stream,
         &control, agent->tie_breaker,
         agent_to_ice_compatibility (agent));
 
-    if (   agent->compatibility == NICE_COMPATIBILITY_MSN
-        || agent->compatibility == NICE_COMPATIBILITY_OC2007) {
-      g_free (req.key);
-    }
-
     if (res == STUN_USAGE_ICE_RETURN_ROLE_CONFLICT)
-      priv_check_for_role_conflict (agent, control);
+      priv_check_for_role_conflict (agent, stream, control);
 
     if (res == STUN_USAGE_ICE_RETURN_SUCCESS ||
         res == STUN_USAGE_ICE_RETURN_ROLE_CONFLICT) {
@@ -75,7 +75,10 @@ typedef struct _StunTransaction StunTransaction;
 
 struct _StunTransaction
 {
+  CandidateCheckPair *pair; /* pair the request is sent on */
+  StunTransactionId id;   /* id of the request, once built */
   gint64 next_tick;       /* next tick timestamp */
+  gint64 start_time;      /* monotonic time the request was first sent */
   StunTimer timer;
   uint8_t buffer[STUN_MAX_MESSAGE_SIZE_IPV6];
   StunMessage message;
@@ -98,8 +101,26 @@ struct _CandidateCheckPair
   CandidateCheckPair *discovered_pair;
   CandidateCheckPair *succeeded_pair;
   guint64 priority;
+  guint64 seq;          /* check list insertion order, to break ties */
   guint32 stun_priority;
   GSList *stun_transactions; /* a list of ongoing stun requests */
+  gboolean in_check_list;     /* if indexed, see priv_check_list_insert() */
+  GSequenceIter *state_iter;  /* position in the WAITING or FROZEN index */
+  GSequenceIter *prune_iter;  /* position in the FROZEN or FAILED pairs of
+                                 the stream */
+  gboolean in_triggered_check_queue;
+
+  /* Statistics, see nice_agent_get_candidate_pair_stats(). The RTTs are in
+   * microseconds and the times are monotonic, 0 meaning never. */
+  guint rtt;
+  guint smoothed_rtt;
+  guint64 requests_sent;
+  guint64 requests_received;
+  guint64 responses_sent;
+  guint64 responses_received;
+  gint64 last_request_sent;
+  gint64 last_request_received;
+  gint64 last_response_received;
 };
 
 int conn_check_add_for_candidate (NiceAgent *agent, guint stream_id, NiceComponent *component, NiceCandidate *remote);
@@ -119,11 +140,18 @@ conn_check_prune_socket (NiceAgent *agent, NiceStream *stream, NiceComponent *co
     NiceSocket *sock);
 
 void recalculate_pair_priorities (NiceAgent *agent);
+void conn_check_refresh_pair_priorities (NiceAgent *agent, NiceStream *stream);
+void conn_check_recalculate_candidate_pair_priorities (NiceAgent *agent,
+    NiceStream *stream, NiceCandidate *remote);
 void conn_check_update_selected_pair (NiceAgent *agent,
     NiceComponent *component, CandidateCheckPair *pair);
 void conn_check_update_check_list_state_for_ready (NiceAgent *agent,
     NiceStream *stream, NiceComponent *component);
 void conn_check_unfreeze_related (NiceAgent *agent, CandidateCheckPair *pair);
+void conn_check_set_pair_foundation (NiceAgent *agent,
+    CandidateCheckPair *pair, const gchar *foundation);
+void conn_check_init_indexes (NiceAgent *agent);
+void conn_check_free_indexes (NiceAgent *agent);
 guint conn_check_stun_transactions_count (NiceAgent *agent);
 
 
@@ -50,6 +50,35 @@
 static int debug_enabled = 0;
 static int debug_verbose_enabled = 0;
 
+gint nice_log_flags[NICE_LOG_N_CATEGORIES];
+
+/* A nice_log() message as recorded in the ring buffer, to be formatted when
+ * it is dumped. */
+typedef struct {
+  gint64 time;
+  NiceLogCategory category;
+  const gchar *format;
+  guint64 values[4];
+  gboolean has_addr;
+  NiceAddress addr;
+} NiceLogRecord;
+
+static GMutex ring_mutex;
+static NiceLogRecord *ring = NULL;
+static guint ring_size = 0;
+static guint64 ring_count = 0;  /* messages recorded since the start */
+static gint ring_levels[NICE_LOG_N_CATEGORIES];
+
+static const gchar *const log_category_names[NICE_LOG_N_CATEGORIES] = {
+  "agent",
+  "conncheck",
+};
+
+static const GDebugKey log_category_keys[] = {
+  { (gchar *)"agent",  1 << NICE_LOG_AGENT },
+  { (gchar *)"conncheck",  1 << NICE_LOG_CONNCHECK },
+};
+
 #define NICE_DEBUG_STUN 1
 #define NICE_DEBUG_NICE 2
 #define NICE_DEBUG_PSEUDOTCP 4
@@ -81,6 +110,27 @@ stun_handler (const char *format, va_list ap)
   g_logv ("libnice-stun", G_LOG_LEVEL_DEBUG, format, ap);
 }
 
+/* Publishes which categories and levels nice_log() has to do anything for,
+ * as debug output or in the ring buffer. */
+static void
+priv_update_log_flags (void)
+{
+  gint text = 0;
+  guint i;
+
+  if (debug_enabled) {
+    text |= NICE_LOG_DEBUG;
+    if (debug_verbose_enabled)
+      text |= NICE_LOG_VERBOSE;
+  }
+
+  g_mutex_lock (&ring_mutex);
+  for (i = 0; i < NICE_LOG_N_CATEGORIES; i++)
+    g_atomic_int_set (&nice_log_flags[i],
+        text | (ring_levels[i] << NICE_LOG_RING_SHIFT));
+  g_mutex_unlock (&ring_mutex);
+}
+
 void nice_debug_init (void)
 {
   static gboolean debug_initialized = FALSE;
@@ -121,6 +171,8 @@ void nice_debug_init (void)
       pseudo_tcp_set_debug_level (PSEUDO_TCP_DEBUG_VERBOSE);
     else if (flags & NICE_DEBUG_PSEUDOTCP)
       pseudo_tcp_set_debug_level (PSEUDO_TCP_DEBUG_NORMAL);
+
+    priv_update_log_flags ();
   }
 }
 
@@ -143,6 +195,7 @@ void nice_debug_enable (gboolean with_stun)
   debug_enabled = 1;
   if (with_stun)
     stun_debug_enable ();
+  priv_update_log_flags ();
 }
 void nice_debug_disable (gboolean with_stun)
 {
@@ -150,6 +203,7 @@ void nice_debug_disable (gboolean with_stun)
   debug_enabled = 0;
   if (with_stun)
     stun_debug_disable ();
+  priv_update_log_flags ();
 }
 
 #ifndef NDEBUG
@@ -174,3 +228,171 @@ void nice_debug_verbose (const char *fmt, ...)
 #else
 /* Defined in agent-priv.h. */
 #endif
+
+static void
+priv_log_format (GString *out, const gchar *format, const NiceAddress *addr,
+    const guint64 *values)
+{
+  const gchar *p;
+  guint n = 0;
+
+  for (p = format; *p != '\0'; p++) {
+    guint64 value;
+
+    if (*p != '%' || p[1] == '\0') {
+      g_string_append_c (out, *p);
+      continue;
+    }
+
+    p++;
+    if (*p == '%') {
+      g_string_append_c (out, '%');
+      continue;
+    }
+
+    if (*p == 'a') {
+      if (addr != NULL) {
+        gchar tmpbuf[NICE_ADDRESS_STRING_LEN];
+
+        nice_address_to_string (addr, tmpbuf);
+        g_string_append_printf (out, "[%s]:%u", tmpbuf,
+            nice_address_get_port (addr));
+      } else {
+        g_string_append (out, "(none)");
+      }
+      continue;
+    }
+
+    value = (n < 4) ? values[n++] : 0;
+
+    switch (*p) {
+      case 'p':
+        g_string_append_printf (out, "%p", (gpointer) (guintptr) value);
+        break;
+      case 'u':
+        g_string_append_printf (out, "%" G_GUINT64_FORMAT, value);
+        break;
+      case 'd':
+        g_string_append_printf (out, "%" G_GINT64_FORMAT, (gint64) value);
+        break;
+      case 'x':
+        g_string_append_printf (out, "%" G_GINT64_MODIFIER "x", value);
+        break;
+      case 's':
+        g_string_append (out, value ? (const gchar *) (guintptr) value :
+            "(null)");
+        break;
+      default:
+        g_string_append_c (out, '%');
+        g_string_append_c (out, *p);
+        break;
+    }
+  }
+}
+
+void
+nice_log_record (NiceLogCategory category, gint level,
+    const NiceAddress *addr, const gchar *format,
+    guint64 v0, guint64 v1, guint64 v2, guint64 v3)
+{
+  gint flags = g_atomic_int_get (&nice_log_flags[category]);
+  guint64 values[4] = { v0, v1, v2, v3 };
+
+  if (flags & level) {
+    GString *out = g_string_sized_new (128);
+
+    priv_log_format (out, format, addr, values);
+    g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "%s", out->str);
+    g_string_free (out, TRUE);
+  }
+
+  if (flags & (level << NICE_LOG_RING_SHIFT)) {
+    NiceLogRecord *record;
+
+    g_mutex_lock (&ring_mutex);
+    /* The ring may have been stopped since the flags were read. */
+    if (ring != NULL) {
+      record = &ring[ring_count % ring_size];
+      record->time = g_get_monotonic_time ();
+      record->category = category;
+      record->format = format;
+      memcpy (record->values, values, sizeof (values));
+      record->has_addr = (addr != NULL);
+      if (addr != NULL)
+        record->addr = *addr;
+      ring_count++;
+    }
+    g_mutex_unlock (&ring_mutex);
+  }
+}
+
+void
+nice_debug_ring_start (guint n_records, const gchar *categories,
+    gboolean verbose)
+{
+  guint mask, i;
+
+  g_return_if_fail (n_records > 0);
+
+  nice_debug_init ();
+
+  if (categories != NULL)
+    mask = g_parse_debug_string (categories, log_category_keys,
+        G_N_ELEMENTS (log_category_keys));
+  else
+    mask = (1 << NICE_LOG_N_CATEGORIES) - 1;
+
+  g_mutex_lock (&ring_mutex);
+  g_free (ring);
+  ring = g_new0 (NiceLogRecord, n_records);
+  ring_size = n_records;
+  ring_count = 0;
+  for (i = 0; i < NICE_LOG_N_CATEGORIES; i++) {
+    ring_levels[i] = 0;
+    if (mask & (1 << i))
+      ring_levels[i] = NICE_LOG_DEBUG | (verbose ? NICE_LOG_VERBOSE : 0);
+  }
+  g_mutex_unlock (&ring_mutex);
+
+  priv_update_log_flags ();
+}
+
+void
+nice_debug_ring_stop (void)
+{
+  guint i;
+
+  g_mutex_lock (&ring_mutex);
+  g_clear_pointer (&ring, g_free);
+  ring_size = 0;
+  ring_count = 0;
+  for (i = 0; i < NICE_LOG_N_CATEGORIES; i++)
+    ring_levels[i] = 0;
+  g_mutex_unlock (&ring_mutex);
+
+  priv_update_log_flags ();
+}
+
+gchar *
+nice_debug_ring_dump (void)
+{
+  GString *out = g_string_new (NULL);
+  guint64 first, i;
+
+  g_mutex_lock (&ring_mutex);
+
+  first = (ring_count > ring_size) ? ring_count - ring_size : 0;
+  for (i = first; i < ring_count; i++) {
+    NiceLogRecord *record = &ring[i % ring_size];
+
+    g_string_append_printf (out, "%" G_GINT64_FORMAT " %s ", record->time,
+        log_category_names[record->category]);
+    priv_log_format (out, record->format,
+        record->has_addr ? &record->addr : NULL, record->values);
+    g_string_append_c (out, '\n');
+  }
+
+  g_mutex_unlock (&ring_mutex);
+
+  return g_string_free (out, FALSE);
+}
@@ -99,6 +99,52 @@ void nice_debug_enable (gboolean with_stun);
  */
 void nice_debug_disable (gboolean with_stun);
 
+/**
+ * nice_debug_ring_start:
+ * @n_records: the number of messages to keep
+ * @categories: (nullable): a comma separated list of the categories of
+ * messages to record, among "agent" and "conncheck", or "all". %NULL
+ * records all of them.
+ * @verbose: whether to also record verbose messages, such as one per packet
+ *
+ * Starts recording libnice debug messages into an in-memory ring buffer,
+ * which keeps the last @n_records of them. Unlike the debug output, the
+ * messages are not formatted until they are retrieved with
+ * nice_debug_ring_dump(), so recording can be left on in production to have
+ * a trace of what happened when something goes wrong.
+ *
+ * Only the messages of the hot paths are recorded for now.
+ *
+ * Calling it again discards what was recorded so far.
+ *
+ * Since: 0.1.19
+ */
+void nice_debug_ring_start (guint n_records, const gchar *categories,
+    gboolean verbose);
+
+/**
+ * nice_debug_ring_stop:
+ *
+ * Stops recording debug messages started with nice_debug_ring_start(), and
+ * discards what was recorded.
+ *
+ * Since: 0.1.19
+ */
+void nice_debug_ring_stop (void);
+
+/**
+ * nice_debug_ring_dump:
+ *
+ * Formats the messages currently in the ring buffer, oldest first, one per
+ * line, each prefixed by its monotonic time in microseconds and category.
+ *
+ * Returns: (transfer full): a newly allocated string, empty if nothing was
+ * recorded
+ *
+ * Since: 0.1.19
+ */
+gchar *nice_debug_ring_dump (void);
+
 G_END_DECLS
 
 #endif /* __LIBNICE_DEBUG_H__ */
@@ -430,6 +430,7 @@ static gboolean priv_add_local_candidate_pruned (NiceAgent *agent, guint stream_
 
   component->local_candidates = g_slist_append (component->local_candidates,
       candidate);
+  nice_component_invalidate_credentials (component);
   conn_check_add_for_local_candidate(agent, stream_id, component, candidate);
 
   return TRUE;
@@ -1143,8 +1144,7 @@ NiceCandidate *discovery_learn_remote_peer_reflexive_candidate (
   /* note: candidate username and password are left NULL as stream 
      level ufrag/password are used */
 
-  component->remote_candidates = g_slist_append (component->remote_candidates,
-      candidate);
+  nice_component_add_remote_candidate (component, candidate);
 
   agent_signal_new_remote_candidate (agent, candidate);
 
@@ -76,6 +76,7 @@
 
 #include "pseudotcp.h"
 #include "agent-priv.h"
+#include "trace.h"
 
 struct _PseudoTcpSocketClass {
     GObjectClass parent_class;
@@ -170,6 +171,13 @@ const guint16 PACKET_MAXIMUMS[] = {
 #define MAX_RTO    60000 /* 60 seconds */
 #define DEFAULT_ACK_DELAY    100 /* 100 milliseconds */
 #define DEFAULT_NO_DELAY     FALSE
+#define DEFAULT_PACING       FALSE
+#define DEFAULT_RACK         FALSE
+
+/* Pacing gains, in percent of cwnd per smoothed RTT. As in Linux, pace faster
+ * during slow start so the window can still double every round trip. */
+#define PACING_SS_GAIN 200
+#define PACING_CA_GAIN 120
 
 #define DEFAULT_RCV_BUF_SIZE (60 * 1024)
 #define DEFAULT_SND_BUF_SIZE (90 * 1024)
@@ -445,6 +453,7 @@ typedef struct {
   guint32 seq, len;
   guint8 xmit;
   TcpFlags flags;
+  guint32 xmit_time;  /* time of the most recent (re)transmission */
 } SSegment;
 
 typedef struct {
@@ -505,10 +514,13 @@ struct _PseudoTcpSocketPrivate {
 
   // Round-trip calculation
   guint32 rx_rttvar, rx_srtt, rx_rto;
+  guint32 rx_min_rtt;  /* smallest RTT sample seen; 0 if none yet */
+  guint32 min_rto;  /* lower bound of rx_rto */
 
   // Congestion avoidance, Fast retransmit/recovery, Delayed ACKs
   guint32 ssthresh, cwnd;
   guint8 dup_acks;
+  guint64 n_retransmissions;  /* segments sent again, for statistics */
   guint32 recover;
   gboolean fast_recovery;
   guint32 t_ack;  /* time a delayed ack was scheduled; 0 if no acks scheduled */
@@ -517,6 +529,20 @@ struct _PseudoTcpSocketPrivate {
   gboolean use_nagling;
   guint32 ack_delay;
 
+  /* Sender pacing: earliest time the next data segment may leave, and the
+   * sub-millisecond part of the inter-segment gap carried over. */
+  gboolean use_pacing;
+  guint32 pace_next;
+  guint32 pace_remainder_us;
+
+  /* Time-based loss detection (RACK) and tail loss probes (TLP), RFC 8985.
+   * The timeouts are 0 when not armed. */
+  gboolean use_rack;
+  guint32 rack_timeout;
+  guint32 tlp_timeout;
+  gboolean tlp_outstanding;
+  guint32 tlp_high_seq;  /* snd_nxt when the outstanding probe was sent */
+
   // This is used by unit tests to test backward compatibility of
   // PseudoTcp implementations that don't support window scaling.
   gboolean support_wnd_scale;
@@ -547,6 +573,11 @@ enum
   PROP_RCV_BUF,
   PROP_SND_BUF,
   PROP_SUPPORT_FIN_ACK,
+  PROP_PACING,
+  PROP_MIN_RTO,
+  PROP_RACK,
+  PROP_CWND,
+  PROP_RETRANSMISSIONS,
   LAST_PROPERTY
 };
 
@@ -569,6 +600,11 @@ static gboolean parse (PseudoTcpSocket *self,
 static gboolean process(PseudoTcpSocket *self, Segment *seg);
 static int transmit(PseudoTcpSocket *self, SSegment *sseg, guint32 now);
 static void attempt_send(PseudoTcpSocket *self, SendFlags sflags);
+static gboolean pacing_is_blocked (PseudoTcpSocket *self, guint32 now);
+static int enter_recovery (PseudoTcpSocket *self, guint32 now);
+static int rack_detect_loss (PseudoTcpSocket *self, guint32 now);
+static void tlp_arm (PseudoTcpSocket *self, guint32 now);
+static int tlp_send_probe (PseudoTcpSocket *self, guint32 now);
 static void closedown (PseudoTcpSocket *self, guint32 err,
     ClosedownSource source);
 static void adjustMTU(PseudoTcpSocket *self);
@@ -683,6 +719,96 @@ pseudo_tcp_socket_class_init (PseudoTcpSocketClass *cls)
           "Whether to enable the optional FIN–ACK support.",
           TRUE,
           G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:pacing:
+   *
+   * Whether to pace outgoing data segments instead of sending everything the
+   * congestion and receive windows allow in a single burst. When enabled, and
+   * once a round-trip time sample is available, segments are spread across
+   * the smoothed RTT at a rate derived from the congestion window. This avoids
+   * self-inflicted loss on relays and shallow-buffered NATs.
+   *
+   * Paced segments are released from pseudo_tcp_socket_notify_clock(), so the
+   * caller must honour the timeout returned by
+   * pseudo_tcp_socket_get_next_clock().
+   *
+   * Pacing is disabled by default.
+   *
+   * Since: 0.1.19
+   */
+  g_object_class_install_property (object_class, PROP_PACING,
+      g_param_spec_boolean ("pacing", "Pacing",
+          "Spread data segments across the round-trip time",
+          DEFAULT_PACING,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:min-rto:
+   *
+   * Lower bound of the retransmission timeout, in milliseconds. RFC 6298
+   * recommends one second, which is the default, but interactive traffic on
+   * paths with a known short RTT can recover from loss much faster with a
+   * lower floor. The initial timeout, before any RTT sample is available, is
+   * not affected.
+   *
+   * Since: 0.1.19
+   */
+  g_object_class_install_property (object_class, PROP_MIN_RTO,
+      g_param_spec_uint ("min-rto", "Minimum RTO",
+          "Lower bound of the retransmission timeout (in milliseconds)",
+          1, MAX_RTO, MIN_RTO,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:rack:
+   *
+   * Whether to use time-based loss detection and tail loss probes, as
+   * described in RFC 8985 (RACK-TLP). A segment is considered lost once a
+   * duplicate ACK shows that later data arrived and it has been outstanding
+   * for longer than the smoothed RTT plus a reordering window, without
+   * waiting for three duplicate ACKs. If no ACK arrives for about two RTTs, a
+   * probe segment is sent to trigger loss detection, rather than waiting for
+   * the retransmission timeout. Together, these let short messages recover
+   * from loss in about one RTT.
+   *
+   * This is disabled by default.
+   *
+   * Since: 0.1.19
+   */
+  g_object_class_install_property (object_class, PROP_RACK,
+      g_param_spec_boolean ("rack", "RACK-TLP",
+          "Use time-based loss detection and tail loss probes",
+          DEFAULT_RACK,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:cwnd:
+   *
+   * The current congestion window, in bytes.
+   *
+   * Since: 0.1.19
+   */
+  g_object_class_install_property (object_class, PROP_CWND,
+      g_param_spec_uint ("cwnd", "Congestion window",
+          "Current congestion window in bytes",
+          0, G_MAXUINT, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * PseudoTcpSocket:retransmissions:
+   *
+   * The number of segments which have been sent more than once, whether
+   * because of a retransmission timeout, fast retransmit, RACK or a tail
+   * loss probe.
+   *
+   * Since: 0.1.19
+   */
+  g_object_class_install_property (object_class, PROP_RETRANSMISSIONS,
+      g_param_spec_uint64 ("retransmissions", "Retransmissions",
+          "Number of segments retransmitted",
+          0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 
@@ -719,6 +845,21 @@ pseudo_tcp_socket_get_property (GObject *object,
     case PROP_SUPPORT_FIN_ACK:
       g_value_set_boolean (value, self->priv->support_fin_ack);
       break;
+    case PROP_PACING:
+      g_value_set_boolean (value, self->priv->use_pacing);
+      break;
+    case PROP_MIN_RTO:
+      g_value_set_uint (value, self->priv->min_rto);
+      break;
+    case PROP_RACK:
+      g_value_set_boolean (value, self->priv->use_rack);
+      break;
+    case PROP_CWND:
+      g_value_set_uint (value, self->priv->cwnd);
+      break;
+    case PROP_RETRANSMISSIONS:
+      g_value_set_uint64 (value, self->priv->n_retransmissions);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -760,6 +901,19 @@ pseudo_tcp_socket_set_property (GObject *object,
     case PROP_SUPPORT_FIN_ACK:
       self->priv->support_fin_ack = g_value_get_boolean (value);
       break;
+    case PROP_PACING:
+      self->priv->use_pacing = g_value_get_boolean (value);
+      break;
+    case PROP_MIN_RTO:
+      self->priv->min_rto = g_value_get_uint (value);
+      break;
+    case PROP_RACK:
+      self->priv->use_rack = g_value_get_boolean (value);
+      if (!self->priv->use_rack) {
+        self->priv->rack_timeout = 0;
+        self->priv->tlp_timeout = 0;
+      }
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -851,10 +1005,21 @@ pseudo_tcp_socket_init (PseudoTcpSocket *obj)
 
   priv->rx_rto = DEF_RTO;
   priv->rx_srtt = priv->rx_rttvar = 0;
+  priv->rx_min_rtt = 0;
+  priv->min_rto = MIN_RTO;
 
   priv->ack_delay = DEFAULT_ACK_DELAY;
   priv->use_nagling = !DEFAULT_NO_DELAY;
 
+  priv->use_pacing = DEFAULT_PACING;
+  priv->pace_next = 0;
+  priv->pace_remainder_us = 0;
+
+  priv->use_rack = DEFAULT_RACK;
+  priv->rack_timeout = priv->tlp_timeout = 0;
+  priv->tlp_outstanding = FALSE;
+  priv->tlp_high_seq = 0;
+
   priv->support_wnd_scale = TRUE;
   priv->support_fin_ack = TRUE;
 }
@@ -970,6 +1135,30 @@ pseudo_tcp_socket_notify_clock(PseudoTcpSocket *self)
     attempt_send (self, sfFin);
   }
 
+  // Check if a segment is overdue now that later data has been ACKed (RACK)
+  if (priv->rack_timeout && (time_diff(priv->rack_timeout, now) <= 0)) {
+    int transmit_status = rack_detect_loss (self, now);
+
+    if (transmit_status != 0) {
+      DEBUG (PSEUDO_TCP_DEBUG_NORMAL,
+          "Error transmitting RACK retransmit segment. Closing down.");
+      closedown (self, transmit_status, CLOSEDOWN_LOCAL);
+      return;
+    }
+  }
+
+  // Check if it's time to send a tail loss probe
+  if (priv->tlp_timeout && (time_diff(priv->tlp_timeout, now) <= 0)) {
+    int transmit_status = tlp_send_probe (self, now);
+
+    if (transmit_status != 0) {
+      DEBUG (PSEUDO_TCP_DEBUG_NORMAL,
+          "Error transmitting tail loss probe. Closing down.");
+      closedown (self, transmit_status, CLOSEDOWN_LOCAL);
+      return;
+    }
+  }
+
   // Check if it's time to retransmit a segment
   if (priv->rto_base &&
       (time_diff(priv->rto_base + priv->rx_rto, now) <= 0)) {
@@ -1012,6 +1201,9 @@ pseudo_tcp_socket_notify_clock(PseudoTcpSocket *self)
         priv->fast_recovery = FALSE;
         DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "exit recovery on timeout");
       }
+
+      priv->rack_timeout = priv->tlp_timeout = 0;
+      priv->tlp_outstanding = FALSE;
     }
   }
 
@@ -1037,6 +1229,12 @@ pseudo_tcp_socket_notify_clock(PseudoTcpSocket *self)
     packet(self, priv->snd_nxt, 0, 0, 0, now);
   }
 
+  // Release data segments held back by the pacer
+  if (priv->use_pacing && priv->state != PSEUDO_TCP_CLOSED &&
+      g_queue_get_length (&priv->unsent_slist) > 0 &&
+      !pacing_is_blocked (self, now)) {
+    attempt_send (self, sfNone);
+  }
 }
 
 gboolean
@@ -1173,6 +1371,16 @@ pseudo_tcp_socket_get_next_clock(PseudoTcpSocket *self, guint64 *timeout)
   if (priv->snd_wnd == 0) {
     *timeout = min(*timeout, priv->lastsend + priv->rx_rto);
   }
+  if (priv->use_pacing && g_queue_get_length (&priv->unsent_slist) > 0 &&
+      time_diff (priv->pace_next, now) > 0) {
+    *timeout = min(*timeout, priv->pace_next);
+  }
+  if (priv->rack_timeout) {
+    *timeout = min(*timeout, priv->rack_timeout);
+  }
+  if (priv->tlp_timeout) {
+    *timeout = min(*timeout, priv->tlp_timeout);
+  }
 
   return TRUE;
 }
@@ -1679,7 +1887,9 @@ process(PseudoTcpSocket *self, Segment *seg)
               labs((long)(rtt - priv->rx_srtt))) / 4;
           priv->rx_srtt = (7 * priv->rx_srtt + rtt) / 8;
         }
-        priv->rx_rto = bound(MIN_RTO,
+        if (priv->rx_min_rtt == 0 || (guint32) rtt < priv->rx_min_rtt)
+          priv->rx_min_rtt = rtt;
+        priv->rx_rto = bound(priv->min_rto,
             priv->rx_srtt + max(1LU, 4 * priv->rx_rttvar), MAX_RTO);
 
         DEBUG (PSEUDO_TCP_DEBUG_VERBOSE, "rtt: %ld srtt: %u rttvar: %u rto: %u",
@@ -1696,9 +1906,16 @@ process(PseudoTcpSocket *self, Segment *seg)
 
     nAcked = seg->ack - priv->snd_una;
     priv->snd_una = seg->ack;
+    NICE_TRACE (pseudotcp_ack, self, seg->ack, nAcked);
 
     priv->rto_base = (priv->snd_una == priv->snd_nxt) ? 0 : now;
 
+    priv->rack_timeout = 0;
+    if (priv->tlp_outstanding &&
+        LARGER_OR_EQUAL (priv->snd_una, priv->tlp_high_seq)) {
+      priv->tlp_outstanding = FALSE;
+    }
+
     /* ACKs for FIN segments give an increment on nAcked, but there is no
      * corresponding byte to read because the FIN segment is empty (it just has
      * a sequence number). */
@@ -1762,6 +1979,8 @@ process(PseudoTcpSocket *self, Segment *seg)
         priv->cwnd += max(1LU, priv->mss * priv->mss / priv->cwnd);
       }
     }
+
+    tlp_arm (self, now);
   } else if (is_duplicate_ack) {
     /* !?! Note, tcp says don't do this... but otherwise how does a
        closed window become open? */
@@ -1771,23 +1990,16 @@ process(PseudoTcpSocket *self, Segment *seg)
     if (seg->len > 0) {
       // it's a dup ack, but with a data payload, so don't modify priv->dup_acks
     } else if (priv->snd_una != priv->snd_nxt) {
-      guint32 nInFlight;
+      int transmit_status;
 
       priv->dup_acks += 1;
       DEBUG (PSEUDO_TCP_DEBUG_VERBOSE, "Received dup ack (dups: %u)",
           priv->dup_acks);
       if (priv->dup_acks == 3) { // (Fast Retransmit)
-        int transmit_status;
-
-
         if (LARGER_OR_EQUAL (priv->snd_una, priv->recover) ||
             seg->tsecr == priv->last_acked_ts) { /* NewReno */
           /* Invoke fast retransmit  RFC3782 section 3 step 1A*/
-          DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "enter recovery");
-          DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "recovery retransmit");
-
-          transmit_status = transmit(self, g_queue_peek_head (&priv->slist),
-              now);
+          transmit_status = enter_recovery (self, now);
           if (transmit_status != 0) {
             DEBUG (PSEUDO_TCP_DEBUG_NORMAL,
                 "Error transmitting recovery retransmit segment. Closing down.");
@@ -1795,14 +2007,6 @@ process(PseudoTcpSocket *self, Segment *seg)
             closedown (self, transmit_status, CLOSEDOWN_LOCAL);
             return FALSE;
           }
-          priv->recover = priv->snd_nxt;
-          nInFlight = priv->snd_nxt - priv->snd_una;
-          priv->ssthresh = max(nInFlight / 2, 2 * priv->mss);
-          DEBUG (PSEUDO_TCP_DEBUG_NORMAL,
-              "ssthresh: %u = max((nInFlight: %u / 2), 2 * mss: %u)",
-              priv->ssthresh, nInFlight, priv->mss);
-          priv->cwnd = priv->ssthresh + 3 * priv->mss;
-          priv->fast_recovery = TRUE;
         } else {
           DEBUG (PSEUDO_TCP_DEBUG_VERBOSE,
               "Skipping fast recovery: recover: %u snd_una: %u", priv->recover,
@@ -1811,6 +2015,17 @@ process(PseudoTcpSocket *self, Segment *seg)
       } else if (priv->dup_acks > 3) {
         if (priv->fast_recovery)
           priv->cwnd += priv->mss;
+      } else if (priv->use_rack) {
+        /* Later data arrived: don’t wait for the third duplicate ACK if the
+         * oldest segment is already overdue. */
+        transmit_status = rack_detect_loss (self, now);
+        if (transmit_status != 0) {
+          DEBUG (PSEUDO_TCP_DEBUG_NORMAL,
+              "Error transmitting RACK retransmit segment. Closing down.");
+
+          closedown (self, transmit_status, CLOSEDOWN_LOCAL);
+          return FALSE;
+        }
       }
     } else {
       priv->dup_acks = 0;
@@ -2119,6 +2334,7 @@ transmit(PseudoTcpSocket *self, SSegment *segment, guint32 now)
     subseg->len = segment->len - nTransmit;
     subseg->flags = segment->flags;
     subseg->xmit = segment->xmit;
+    subseg->xmit_time = now;
 
     DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "mss reduced to %u", priv->mss);
 
@@ -2138,8 +2354,13 @@ transmit(PseudoTcpSocket *self, SSegment *segment, guint32 now)
     /* FIN flags require acknowledgement. */
     if (segment->len == 0 && segment->flags & FLAG_FIN)
       priv->snd_nxt++;
+  } else {
+    priv->n_retransmissions++;
   }
   segment->xmit += 1;
+  segment->xmit_time = now;
+  NICE_TRACE (pseudotcp_transmit, self, segment->seq, nTransmit,
+      segment->xmit);
 
   if (priv->rto_base == 0) {
     priv->rto_base = now;
@@ -2148,6 +2369,189 @@ transmit(PseudoTcpSocket *self, SSegment *segment, guint32 now)
   return 0;
 }
 
+/* Whether the pacer is currently holding back new data segments. Pacing only
+ * kicks in once an RTT sample is available. */
+static gboolean
+pacing_is_blocked (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+
+  return (priv->use_pacing && priv->rx_srtt != 0 &&
+      time_diff (priv->pace_next, now) > 0);
+}
+
+/* Push back the departure time of the next data segment by the time it takes
+ * to send @len bytes at the current pacing rate, which is a multiple of
+ * cwnd / srtt. */
+static void
+pacing_consume (PseudoTcpSocket *self, guint32 len, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint64 gain;
+  guint64 gap_us;
+
+  if (!priv->use_pacing || priv->rx_srtt == 0 || len == 0)
+    return;
+
+  gain = (priv->cwnd < priv->ssthresh) ? PACING_SS_GAIN : PACING_CA_GAIN;
+  gap_us = (guint64) len * min (priv->rx_srtt, MAX_RTO) * 1000 * 100 /
+      (max (priv->cwnd, 1) * gain);
+
+  /* Don’t bank sending credit while idle; restart the schedule from now. */
+  if (time_diff (priv->pace_next, now) < 0) {
+    priv->pace_next = now;
+    priv->pace_remainder_us = 0;
+  }
+
+  gap_us += priv->pace_remainder_us;
+  priv->pace_next += gap_us / 1000;
+  priv->pace_remainder_us = gap_us % 1000;
+
+  DEBUG (PSEUDO_TCP_DEBUG_VERBOSE, "paced %u bytes, next departure at %u",
+      len, priv->pace_next);
+}
+
+/* Fast retransmit the oldest unacknowledged segment and enter fast recovery
+ * (RFC 3782, section 3, step 1). */
+static int
+enter_recovery (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 nInFlight;
+  int transmit_status;
+
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "enter recovery");
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "recovery retransmit");
+
+  transmit_status = transmit(self, g_queue_peek_head (&priv->slist), now);
+  if (transmit_status != 0)
+    return transmit_status;
+
+  priv->recover = priv->snd_nxt;
+  nInFlight = priv->snd_nxt - priv->snd_una;
+  priv->ssthresh = max(nInFlight / 2, 2 * priv->mss);
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL,
+      "ssthresh: %u = max((nInFlight: %u / 2), 2 * mss: %u)",
+      priv->ssthresh, nInFlight, priv->mss);
+  priv->cwnd = priv->ssthresh + priv->dup_acks * priv->mss;
+  priv->fast_recovery = TRUE;
+  priv->rack_timeout = priv->tlp_timeout = 0;
+
+  return 0;
+}
+
+/* RACK: once a duplicate ACK has shown that data sent after the oldest
+ * outstanding segment was delivered, consider that segment lost if it has been
+ * outstanding for longer than srtt plus a reordering window of min_rtt / 4.
+ * Otherwise, arm a timer for the moment it would be. (RFC 8985, section 6.2.)
+ *
+ * Returns a transmit() error code. */
+static int
+rack_detect_loss (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  SSegment *head;
+  guint32 deadline;
+  int transmit_status;
+
+  priv->rack_timeout = 0;
+
+  head = g_queue_peek_head (&priv->slist);
+  if (!priv->use_rack || head == NULL || head->xmit == 0 ||
+      priv->rx_srtt == 0 || priv->fast_recovery || priv->dup_acks == 0 ||
+      SMALLER (priv->snd_una, priv->recover))
+    return 0;
+
+  deadline = head->xmit_time + priv->rx_srtt + priv->rx_min_rtt / 4;
+  if (time_diff (deadline, now) > 0) {
+    priv->rack_timeout = deadline;
+    return 0;
+  }
+
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "RACK: segment %u outstanding for %ld ms",
+      head->seq, time_diff (now, head->xmit_time));
+
+  /* Account for the loss as if three duplicate ACKs had been received, so
+   * that the ACK processing exits recovery in the usual way. */
+  priv->dup_acks = 3;
+  transmit_status = enter_recovery (self, now);
+
+  return transmit_status;
+}
+
+/* Arm the tail loss probe timer: if the last segments of a flight are lost,
+ * no duplicate ACKs will come back, and only the (much longer) RTO would
+ * recover them. (RFC 8985, section 7.2.) */
+static void
+tlp_arm (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  guint32 nInFlight = priv->snd_nxt - priv->snd_una;
+  guint32 pto;
+
+  priv->tlp_timeout = 0;
+
+  if (!priv->use_rack || priv->rx_srtt == 0 || nInFlight == 0 ||
+      priv->fast_recovery || priv->tlp_outstanding ||
+      priv->state != PSEUDO_TCP_ESTABLISHED)
+    return;
+
+  /* Leave room for a delayed ACK if only one segment is in flight. */
+  pto = 2 * priv->rx_srtt;
+  if (nInFlight <= priv->mss)
+    pto += DEFAULT_ACK_DELAY;
+
+  if (priv->rto_base &&
+      time_diff (priv->rto_base + priv->rx_rto, now + pto) <= 0)
+    return;
+
+  priv->tlp_timeout = now + pto;
+}
+
+/* Send a tail loss probe: new data if the receive window allows it, otherwise
+ * a retransmission of the most recently sent segment. Either way, the ACK it
+ * elicits lets RACK or fast retransmit recover the tail.
+ *
+ * Returns a transmit() error code. */
+static int
+tlp_send_probe (PseudoTcpSocket *self, guint32 now)
+{
+  PseudoTcpSocketPrivate *priv = self->priv;
+  GList *unsent;
+  SSegment *sseg = NULL;
+  guint32 nInFlight = priv->snd_nxt - priv->snd_una;
+  int transmit_status;
+
+  priv->tlp_timeout = 0;
+
+  if (nInFlight == 0 || priv->fast_recovery || priv->tlp_outstanding)
+    return 0;
+
+  unsent = g_queue_peek_head_link (&priv->unsent_slist);
+  if (unsent != NULL) {
+    SSegment *next = unsent->data;
+
+    if (nInFlight + min (next->len, priv->mss) <= priv->snd_wnd)
+      sseg = next;
+    else
+      sseg = g_queue_find (&priv->slist, next)->prev->data;
+  } else {
+    sseg = g_queue_peek_tail (&priv->slist);
+  }
+
+  DEBUG (PSEUDO_TCP_DEBUG_NORMAL, "TLP: probing with segment %u (%s)",
+      sseg->seq, (sseg->xmit == 0) ? "new" : "retransmit");
+
+  transmit_status = transmit (self, sseg, now);
+  if (transmit_status != 0)
+    return transmit_status;
+
+  priv->tlp_high_seq = priv->snd_nxt;
+  priv->tlp_outstanding = TRUE;
+
+  return 0;
+}
+
 static void
 attempt_send(PseudoTcpSocket *self, SendFlags sflags)
 {
@@ -2195,6 +2599,12 @@ attempt_send(PseudoTcpSocket *self, SendFlags sflags)
       }
     }
 
+    // Pacing: new data has to wait for its departure time
+    if (nAvailable > 0 && sflags != sfFin && sflags != sfRst &&
+        pacing_is_blocked (self, now)) {
+      nAvailable = 0;
+    }
+
     if (bFirst) {
       gsize available_space = pseudo_tcp_fifo_get_write_remaining (&priv->sbuf);
 
@@ -2264,6 +2674,9 @@ attempt_send(PseudoTcpSocket *self, SendFlags sflags)
       return;
     }
 
+    pacing_consume (self, sseg->len, now);
+    tlp_arm (self, now);
+
     if (sflags == sfImmediateAck || sflags == sfDelayedAck)
       sflags = sfNone;
   }
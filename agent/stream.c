@@ -113,10 +113,15 @@ nice_stream_find_component_by_id (NiceStream *stream, guint id)
 void
 nice_stream_initialize_credentials (NiceStream *stream, NiceRNG *rng)
 {
+  GSList *i;
+
   /* note: generate ufrag/pwd for the stream (see ICE 15.4.
    *       '"ice-ufrag" and "ice-pwd" Attributes', ID-19) */
   nice_rng_generate_bytes_print (rng, NICE_STREAM_DEF_UFRAG - 1, stream->local_ufrag);
   nice_rng_generate_bytes_print (rng, NICE_STREAM_DEF_PWD - 1, stream->local_password);
+
+  for (i = stream->components; i; i = i->next)
+    nice_component_invalidate_credentials (i->data);
 }
 
 /*
@@ -159,6 +164,9 @@ nice_stream_init (NiceStream *stream)
 
   stream->n_components = 0;
   stream->initial_binding_request_received = FALSE;
+  stream->waiting_pairs = g_sequence_new (NULL);
+  stream->frozen_pairs = g_sequence_new (NULL);
+  stream->failed_pairs = g_sequence_new (NULL);
 }
 
 /* Must be called with the agent lock released as it could dispose of
@@ -171,6 +179,9 @@ nice_stream_finalize (GObject *obj)
   stream = NICE_STREAM (obj);
 
   g_free (stream->name);
+  g_sequence_free (stream->waiting_pairs);
+  g_sequence_free (stream->frozen_pairs);
+  g_sequence_free (stream->failed_pairs);
   g_slist_free_full (stream->components, (GDestroyNotify) g_object_unref);
 
   g_atomic_int_inc (&n_streams_destroyed);
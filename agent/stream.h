@@ -81,6 +81,14 @@ struct _NiceStream {
   gboolean initial_binding_request_received;
   GSList *components; /* list of 'NiceComponent' objects */
   GSList *conncheck_list;         /* list of CandidateCheckPair items */
+  GSequence *waiting_pairs;       /* WAITING pairs of conncheck_list, in the
+                                     same order */
+  GSequence *frozen_pairs;        /* FROZEN pairs of conncheck_list, in the
+                                     same order */
+  GSequence *failed_pairs;        /* FAILED pairs of conncheck_list */
+  guint n_check_pairs;            /* length of conncheck_list */
+  gboolean pair_priorities_stale; /* the pair priorities must be
+                                     recalculated before use */
   gchar local_ufrag[NICE_STREAM_MAX_UFRAG];
   gchar local_password[NICE_STREAM_MAX_PWD];
   gchar remote_ufrag[NICE_STREAM_MAX_UFRAG];
@@ -0,0 +1,86 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifndef __LIBNICE_TRACE_H__
+#define __LIBNICE_TRACE_H__
+
+/*
+ * Static tracepoints, for perf, bpftrace or SystemTap to attach to at run
+ * time. They are only built in when configured with -Dtracing=enabled, and
+ * then cost a single nop each until something attaches to them, unlike
+ * nice_debug() which formats its message whenever debugging is on. Their
+ * arguments must therefore be cheap to evaluate: integers and pointers only.
+ *
+ * All of them belong to the "libnice" provider, for example:
+ *
+ *   bpftrace -e 'usdt:/usr/lib/libnice.so.10:libnice:pair_state
+ *       { printf("%p %d\n", arg1, arg2); }'
+ *
+ * The probes and their arguments are:
+ *
+ *   recv (agent, stream_id, component_id, len): a datagram or a chunk of a
+ *       reliable stream was received on a component socket, before demux
+ *   stun_recv (agent, stream_id, component_id, class, method): the
+ *       datagram was a STUN message, see #StunClass and #StunMethod
+ *   conncheck_send (agent, pair, stream_id, component_id): a connectivity
+ *       check request was sent on a pair, retransmissions included
+ *   conncheck_response (agent, pair, rtt): a response to a connectivity
+ *       check on a pair was received, rtt in microseconds or -1 if the
+ *       request had been retransmitted
+ *   pair_state (agent, pair, state): a pair changed to the #NiceCheckState
+ *   selected_pair (agent, stream_id, component_id, local, remote): the
+ *       selected pair of a component changed to the given candidates
+ *   turn_send (sock, len): data is being sent through a TURN relay, len
+ *       being that of the message wrapping it
+ *   turn_recv (sock, len): a message was received from a TURN relay, len
+ *       being that of the payload once unwrapped, or 0 for TURN control
+ *       messages
+ *   pseudotcp_transmit (tcp, seq, len, xmit): a pseudo-TCP segment was
+ *       sent, xmit being 1 for the first transmission
+ *   pseudotcp_ack (tcp, ack, bytes): a pseudo-TCP ack acknowledged bytes
+ */
+
+#ifdef ENABLE_TRACING
+
+#include <sys/sdt.h>
+
+#define NICE_TRACE(...) STAP_PROBEV (libnice, __VA_ARGS__)
+
+#else
+
+#define NICE_TRACE(...) G_STMT_START { } G_STMT_END
+
+#endif
+
+#endif /* __LIBNICE_TRACE_H__ */
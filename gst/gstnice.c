@@ -40,6 +40,8 @@
 
 #include "gstnicesrc.h"
 #include "gstnicesink.h"
+#include "gstnicemultisrc.h"
+#include "gstnicemultisink.h"
 
 static gboolean
 plugin_init (GstPlugin *plugin)
@@ -52,6 +54,14 @@ plugin_init (GstPlugin *plugin)
         GST_RANK_NONE, GST_TYPE_NICE_SINK))
     return FALSE;
 
+  if (!gst_element_register (plugin, "nicemultisrc",
+        GST_RANK_NONE, GST_TYPE_NICE_MULTI_SRC))
+    return FALSE;
+
+  if (!gst_element_register (plugin, "nicemultisink",
+        GST_RANK_NONE, GST_TYPE_NICE_MULTI_SINK))
+    return FALSE;
+
   return TRUE;
 }
 
@@ -0,0 +1,619 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+
+#include "gstnicemultisink.h"
+#include "gstniceutils.h"
+
+GST_DEBUG_CATEGORY_STATIC (nicemultisink_debug);
+#define GST_CAT_DEFAULT nicemultisink_debug
+
+static GstPad *
+gst_nice_multi_sink_request_new_pad (
+    GstElement *element,
+    GstPadTemplate *templ,
+    const gchar *name,
+    const GstCaps *caps);
+
+static void
+gst_nice_multi_sink_release_pad (
+    GstElement *element,
+    GstPad *pad);
+
+static void
+_reliable_transport_writable (
+    NiceAgent *agent,
+    guint stream_id,
+    guint component_id,
+    GstNiceMultiSink *sink);
+
+static void
+gst_nice_multi_sink_set_property (
+  GObject *object,
+  guint prop_id,
+  const GValue *value,
+  GParamSpec *pspec);
+
+static void
+gst_nice_multi_sink_get_property (
+  GObject *object,
+  guint prop_id,
+  GValue *value,
+  GParamSpec *pspec);
+
+static void
+gst_nice_multi_sink_dispose (GObject *object);
+
+static void
+gst_nice_multi_sink_finalize (GObject *object);
+
+static GstStateChangeReturn
+gst_nice_multi_sink_change_state (
+    GstElement * element,
+    GstStateChange transition);
+
+static GstStaticPadTemplate gst_nice_multi_sink_sink_template =
+GST_STATIC_PAD_TEMPLATE (
+    "sink_%u_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS_ANY);
+
+G_DEFINE_TYPE (GstNiceMultiSinkPad, gst_nice_multi_sink_pad, GST_TYPE_PAD);
+G_DEFINE_TYPE (GstNiceMultiSink, gst_nice_multi_sink, GST_TYPE_ELEMENT);
+
+enum
+{
+  PROP_AGENT = 1
+};
+
+enum
+{
+  PROP_PAD_STREAM = 1,
+  PROP_PAD_COMPONENT
+};
+
+static void
+gst_nice_multi_sink_pad_get_property (GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+  GstNiceMultiSinkPad *pad = GST_NICE_MULTI_SINK_PAD (object);
+
+  switch (prop_id)
+    {
+    case PROP_PAD_STREAM:
+      g_value_set_uint (value, pad->stream_id);
+      break;
+
+    case PROP_PAD_COMPONENT:
+      g_value_set_uint (value, pad->component_id);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+gst_nice_multi_sink_pad_finalize (GObject *object)
+{
+  GstNiceMultiSinkPad *pad = GST_NICE_MULTI_SINK_PAD (object);
+
+  g_free (pad->vecs);
+  pad->vecs = NULL;
+  pad->n_vecs = 0;
+  g_free (pad->maps);
+  pad->maps = NULL;
+  pad->n_maps = 0;
+  g_free (pad->messages);
+  pad->messages = NULL;
+  pad->n_messages = 0;
+
+  G_OBJECT_CLASS (gst_nice_multi_sink_pad_parent_class)->finalize (object);
+}
+
+static void
+gst_nice_multi_sink_pad_class_init (GstNiceMultiSinkPadClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->get_property = gst_nice_multi_sink_pad_get_property;
+  gobject_class->finalize = gst_nice_multi_sink_pad_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_PAD_STREAM,
+      g_param_spec_uint (
+         "stream",
+         "Stream ID",
+         "The ID of the stream this pad sends to",
+         0,
+         G_MAXUINT,
+         0,
+         G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_PAD_COMPONENT,
+      g_param_spec_uint (
+         "component",
+         "Component ID",
+         "The ID of the component this pad sends to",
+         0,
+         G_MAXUINT,
+         0,
+         G_PARAM_READABLE));
+}
+
+static void
+gst_nice_multi_sink_pad_init (GstNiceMultiSinkPad *pad)
+{
+  guint max_mem = gst_buffer_get_max_memory ();
+
+  pad->n_vecs = max_mem;
+  pad->vecs = g_new (GOutputVector, pad->n_vecs);
+
+  pad->n_maps = max_mem;
+  pad->maps = g_new (GstMapInfo, pad->n_maps);
+
+  pad->n_messages = 1;
+  pad->messages = g_new (NiceOutputMessage, pad->n_messages);
+}
+
+static void
+gst_nice_multi_sink_class_init (GstNiceMultiSinkClass *klass)
+{
+  GstElementClass *gstelement_class;
+  GObjectClass *gobject_class;
+
+  GST_DEBUG_CATEGORY_INIT (nicemultisink_debug, "nicemultisink",
+      0, "libnice multi-component sink");
+
+  gobject_class = (GObjectClass *) klass;
+  gobject_class->set_property = gst_nice_multi_sink_set_property;
+  gobject_class->get_property = gst_nice_multi_sink_get_property;
+  gobject_class->dispose = gst_nice_multi_sink_dispose;
+  gobject_class->finalize = gst_nice_multi_sink_finalize;
+
+  gstelement_class = (GstElementClass *) klass;
+  gstelement_class->change_state = gst_nice_multi_sink_change_state;
+  gstelement_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_nice_multi_sink_request_new_pad);
+  gstelement_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_nice_multi_sink_release_pad);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&gst_nice_multi_sink_sink_template));
+  gst_element_class_set_metadata (gstelement_class,
+      "ICE multi-component sink",
+      "Sink",
+      "Interactive UDP connectivity establishment, sending to many "
+      "components of one agent",
+      "Kurento <info@kurento.org>");
+
+  g_object_class_install_property (gobject_class, PROP_AGENT,
+      g_param_spec_object (
+         "agent",
+         "Agent",
+         "The NiceAgent this sink is bound to",
+         NICE_TYPE_AGENT,
+         G_PARAM_READWRITE));
+}
+
+static void
+gst_nice_multi_sink_init (GstNiceMultiSink *sink)
+{
+  GST_OBJECT_FLAG_SET (sink, GST_ELEMENT_FLAG_SINK);
+
+  g_cond_init (&sink->writable_cond);
+}
+
+static void
+_reliable_transport_writable (NiceAgent *agent, guint stream_id,
+    guint component_id, GstNiceMultiSink *sink)
+{
+  /* Every pad waiting checks again whether its own component can send. */
+  GST_OBJECT_LOCK (sink);
+  g_cond_broadcast (&sink->writable_cond);
+  GST_OBJECT_UNLOCK (sink);
+}
+
+/* As gst_nice_sink_render_buffers(), for the component of @pad. Called from
+ * the streaming thread of @pad, which owns the scrap space. */
+static GstFlowReturn
+gst_nice_multi_sink_send_buffers (GstNiceMultiSink * sink,
+    GstNiceMultiSinkPad * pad, GstBuffer ** buffers, guint num_buffers,
+    guint8 * mem_nums, guint total_mem_num)
+{
+  NiceOutputMessage *msgs;
+  GOutputVector *vecs;
+  GstMapInfo *map_infos;
+  guint i, mem;
+  guint written = 0;
+  gint ret;
+  GstFlowReturn flow_ret = GST_FLOW_OK;
+
+  GST_LOG_OBJECT (pad, "%u buffers, %u memories -> to be sent",
+      num_buffers, total_mem_num);
+
+  if (pad->n_vecs < total_mem_num) {
+    pad->n_vecs = GST_ROUND_UP_16 (total_mem_num);
+    g_free (pad->vecs);
+    pad->vecs = g_new (GOutputVector, pad->n_vecs);
+  }
+  vecs = pad->vecs;
+
+  if (pad->n_maps < total_mem_num) {
+    pad->n_maps = GST_ROUND_UP_16 (total_mem_num);
+    g_free (pad->maps);
+    pad->maps = g_new (GstMapInfo, pad->n_maps);
+  }
+  map_infos = pad->maps;
+
+  if (pad->n_messages < num_buffers) {
+    pad->n_messages = GST_ROUND_UP_16 (num_buffers);
+    g_free (pad->messages);
+    pad->messages = g_new (NiceOutputMessage, pad->n_messages);
+  }
+  msgs = pad->messages;
+
+  for (i = 0, mem = 0; i < num_buffers; ++i) {
+    gst_nice_fill_vectors (&vecs[mem], &map_infos[mem], mem_nums[i],
+        buffers[i]);
+    msgs[i].buffers = &vecs[mem];
+    msgs[i].n_buffers = mem_nums[i];
+    mem += mem_nums[i];
+  }
+
+  GST_OBJECT_LOCK (sink);
+  do {
+    ret = nice_agent_send_messages_nonblocking (sink->agent, pad->stream_id,
+        pad->component_id, msgs + written, num_buffers - written, NULL, NULL);
+
+    if (ret > 0)
+      written += ret;
+
+    if (sink->reliable && written < num_buffers && !pad->flushing)
+      g_cond_wait (&sink->writable_cond, GST_OBJECT_GET_LOCK (sink));
+
+    if (pad->flushing) {
+      flow_ret = GST_FLOW_FLUSHING;
+      break;
+    }
+  } while (sink->reliable && written < num_buffers);
+  GST_OBJECT_UNLOCK (sink);
+
+  for (i = 0; i < mem; ++i)
+    gst_memory_unmap (map_infos[i].memory, &map_infos[i]);
+
+  return flow_ret;
+}
+
+static GstFlowReturn
+gst_nice_multi_sink_chain (GstPad *pad, GstObject *parent, GstBuffer *buffer)
+{
+  GstNiceMultiSink *sink = GST_NICE_MULTI_SINK (parent);
+  GstFlowReturn flow_ret = GST_FLOW_OK;
+  guint8 n_mem;
+
+  n_mem = gst_buffer_n_memory (buffer);
+
+  if (n_mem > 0) {
+    flow_ret = gst_nice_multi_sink_send_buffers (sink,
+        GST_NICE_MULTI_SINK_PAD (pad), &buffer, 1, &n_mem, n_mem);
+  }
+
+  gst_buffer_unref (buffer);
+
+  return flow_ret;
+}
+
+static GstFlowReturn
+gst_nice_multi_sink_chain_list (GstPad *pad, GstObject *parent,
+    GstBufferList *buffer_list)
+{
+  GstNiceMultiSink *sink = GST_NICE_MULTI_SINK (parent);
+  GstBuffer **buffers;
+  GstFlowReturn flow_ret = GST_FLOW_OK;
+  guint8 *mem_nums;
+  guint total_mems;
+  guint i, num_buffers;
+
+  num_buffers = gst_buffer_list_length (buffer_list);
+  if (num_buffers == 0) {
+    GST_LOG_OBJECT (pad, "empty buffer list");
+    goto done;
+  }
+
+  buffers = g_newa (GstBuffer *, num_buffers);
+  mem_nums = g_newa (guint8, num_buffers);
+  for (i = 0, total_mems = 0; i < num_buffers; ++i) {
+    buffers[i] = gst_buffer_list_get (buffer_list, i);
+    mem_nums[i] = gst_buffer_n_memory (buffers[i]);
+    total_mems += mem_nums[i];
+  }
+
+  flow_ret = gst_nice_multi_sink_send_buffers (sink,
+      GST_NICE_MULTI_SINK_PAD (pad), buffers, num_buffers, mem_nums,
+      total_mems);
+
+done:
+  gst_buffer_list_unref (buffer_list);
+
+  return flow_ret;
+}
+
+/* Called with the object lock held. */
+static gboolean
+gst_nice_multi_sink_all_eos (GstNiceMultiSink *sink)
+{
+  GList *l;
+
+  for (l = GST_ELEMENT (sink)->sinkpads; l != NULL; l = l->next) {
+    if (!GST_NICE_MULTI_SINK_PAD (l->data)->eos)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_nice_multi_sink_pad_event (GstPad *pad, GstObject *parent, GstEvent *event)
+{
+  GstNiceMultiSink *sink = GST_NICE_MULTI_SINK (parent);
+  GstNiceMultiSinkPad *mpad = GST_NICE_MULTI_SINK_PAD (pad);
+  gboolean post_eos = FALSE;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      GST_OBJECT_LOCK (sink);
+      mpad->flushing = TRUE;
+      g_cond_broadcast (&sink->writable_cond);
+      GST_OBJECT_UNLOCK (sink);
+      break;
+
+    case GST_EVENT_FLUSH_STOP:
+      GST_OBJECT_LOCK (sink);
+      mpad->flushing = FALSE;
+      mpad->eos = FALSE;
+      GST_OBJECT_UNLOCK (sink);
+      break;
+
+    case GST_EVENT_EOS:
+      GST_OBJECT_LOCK (sink);
+      mpad->eos = TRUE;
+      post_eos = gst_nice_multi_sink_all_eos (sink);
+      GST_OBJECT_UNLOCK (sink);
+      break;
+
+    default:
+      break;
+  }
+
+  /* Like any other sink, the element is done once all its pads are. */
+  if (post_eos) {
+    GstMessage *message = gst_message_new_eos (GST_OBJECT (sink));
+
+    gst_message_set_seqnum (message, gst_event_get_seqnum (event));
+    gst_element_post_message (GST_ELEMENT (sink), message);
+  }
+
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+static GstPad *
+gst_nice_multi_sink_request_new_pad (GstElement *element, GstPadTemplate *templ,
+    const gchar *name, const GstCaps *caps)
+{
+  GstNiceMultiSink *sink = GST_NICE_MULTI_SINK (element);
+  GstNiceMultiSinkPad *pad;
+  guint stream_id, component_id;
+
+  if (sink->agent == NULL) {
+    GST_ERROR_OBJECT (element, "Requesting a pad without an agent set");
+    return NULL;
+  }
+
+  if (name == NULL ||
+      sscanf (name, "sink_%u_%u", &stream_id, &component_id) != 2 ||
+      stream_id == 0 || component_id == 0) {
+    GST_ERROR_OBJECT (element, "Pads must be requested by name, as "
+        "sink_<stream>_<component>; got %s", GST_STR_NULL (name));
+    return NULL;
+  }
+
+  pad = g_object_new (GST_TYPE_NICE_MULTI_SINK_PAD, "name", name,
+      "direction", GST_PAD_SINK, "template", templ, NULL);
+  pad->stream_id = stream_id;
+  pad->component_id = component_id;
+
+  gst_pad_set_chain_function (GST_PAD (pad), gst_nice_multi_sink_chain);
+  gst_pad_set_chain_list_function (GST_PAD (pad),
+      gst_nice_multi_sink_chain_list);
+  gst_pad_set_event_function (GST_PAD (pad), gst_nice_multi_sink_pad_event);
+
+  if (GST_STATE (element) > GST_STATE_READY)
+    gst_pad_set_active (GST_PAD (pad), TRUE);
+
+  if (!gst_element_add_pad (element, GST_PAD (pad))) {
+    GST_ERROR_OBJECT (element, "Pad %s already exists", name);
+    gst_object_unref (pad);
+    return NULL;
+  }
+
+  return GST_PAD (pad);
+}
+
+static void
+gst_nice_multi_sink_release_pad (GstElement *element, GstPad *pad)
+{
+  GstNiceMultiSink *sink = GST_NICE_MULTI_SINK (element);
+
+  /* Wake up a send waiting for the transport, or deactivating the pad would
+   * wait for it forever. */
+  GST_OBJECT_LOCK (sink);
+  GST_NICE_MULTI_SINK_PAD (pad)->flushing = TRUE;
+  g_cond_broadcast (&sink->writable_cond);
+  GST_OBJECT_UNLOCK (sink);
+
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+}
+
+/* Called with the object lock held. */
+static void
+gst_nice_multi_sink_set_flushing (GstNiceMultiSink *sink, gboolean flushing)
+{
+  GList *l;
+
+  for (l = GST_ELEMENT (sink)->sinkpads; l != NULL; l = l->next) {
+    GstNiceMultiSinkPad *pad = l->data;
+
+    pad->flushing = flushing;
+    pad->eos = FALSE;
+  }
+  g_cond_broadcast (&sink->writable_cond);
+}
+
+static void
+gst_nice_multi_sink_dispose (GObject *object)
+{
+  GstNiceMultiSink *sink = GST_NICE_MULTI_SINK (object);
+
+  if (sink->agent && sink->writable_id)
+    g_signal_handler_disconnect (sink->agent, sink->writable_id);
+  sink->writable_id = 0;
+  g_clear_object (&sink->agent);
+
+  G_OBJECT_CLASS (gst_nice_multi_sink_parent_class)->dispose (object);
+}
+
+static void
+gst_nice_multi_sink_finalize (GObject *object)
+{
+  GstNiceMultiSink *sink = GST_NICE_MULTI_SINK (object);
+
+  g_cond_clear (&sink->writable_cond);
+
+  G_OBJECT_CLASS (gst_nice_multi_sink_parent_class)->finalize (object);
+}
+
+static void
+gst_nice_multi_sink_set_property (
+  GObject *object,
+  guint prop_id,
+  const GValue *value,
+  GParamSpec *pspec)
+{
+  GstNiceMultiSink *sink = GST_NICE_MULTI_SINK (object);
+
+  switch (prop_id)
+    {
+    case PROP_AGENT:
+      if (sink->agent) {
+        GST_ERROR_OBJECT (object,
+            "Changing the agent on a nice multi sink not allowed");
+      } else {
+        sink->agent = g_value_dup_object (value);
+        g_object_get (sink->agent, "reliable", &sink->reliable, NULL);
+        if (sink->reliable)
+          sink->writable_id = g_signal_connect (sink->agent,
+              "reliable-transport-writable",
+              (GCallback) _reliable_transport_writable, sink);
+      }
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+gst_nice_multi_sink_get_property (
+  GObject *object,
+  guint prop_id,
+  GValue *value,
+  GParamSpec *pspec)
+{
+  GstNiceMultiSink *sink = GST_NICE_MULTI_SINK (object);
+
+  switch (prop_id)
+    {
+    case PROP_AGENT:
+      g_value_set_object (value, sink->agent);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static GstStateChangeReturn
+gst_nice_multi_sink_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstNiceMultiSink *sink = GST_NICE_MULTI_SINK (element);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      if (sink->agent == NULL)
+        {
+          GST_ERROR_OBJECT (element,
+              "Trying to start Nice multi sink without an agent set");
+          return GST_STATE_CHANGE_FAILURE;
+        }
+      break;
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      GST_OBJECT_LOCK (sink);
+      gst_nice_multi_sink_set_flushing (sink, FALSE);
+      GST_OBJECT_UNLOCK (sink);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      /* Unblock the pads before the parent deactivates them. */
+      GST_OBJECT_LOCK (sink);
+      gst_nice_multi_sink_set_flushing (sink, TRUE);
+      GST_OBJECT_UNLOCK (sink);
+      break;
+    default:
+      break;
+  }
+
+  return GST_ELEMENT_CLASS (gst_nice_multi_sink_parent_class)->change_state (
+      element, transition);
+}
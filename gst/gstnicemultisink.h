@@ -0,0 +1,113 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+#ifndef _GSTNICEMULTISINK_H
+#define _GSTNICEMULTISINK_H
+
+#include <gst/gst.h>
+
+#include <nice/nice.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_NICE_MULTI_SINK \
+  (gst_nice_multi_sink_get_type())
+#define GST_NICE_MULTI_SINK(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_NICE_MULTI_SINK,GstNiceMultiSink))
+#define GST_NICE_MULTI_SINK_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_NICE_MULTI_SINK,GstNiceMultiSinkClass))
+#define GST_IS_NICE_MULTI_SINK(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_NICE_MULTI_SINK))
+#define GST_IS_NICE_MULTI_SINK_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_NICE_MULTI_SINK))
+
+#define GST_TYPE_NICE_MULTI_SINK_PAD \
+  (gst_nice_multi_sink_pad_get_type())
+#define GST_NICE_MULTI_SINK_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_NICE_MULTI_SINK_PAD,GstNiceMultiSinkPad))
+#define GST_IS_NICE_MULTI_SINK_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_NICE_MULTI_SINK_PAD))
+
+typedef struct _GstNiceMultiSink GstNiceMultiSink;
+typedef struct _GstNiceMultiSinkPad GstNiceMultiSinkPad;
+
+/* One request pad per stream/component pair of the agent, named
+ * sink_<stream>_<component>. */
+struct _GstNiceMultiSinkPad
+{
+  GstPad parent;
+  guint stream_id;
+  guint component_id;
+  /* protected by the element's object lock */
+  gboolean flushing;
+  gboolean eos;
+
+  /* pre-allocated scrap space for the chain functions, which may run
+   * concurrently on different pads */
+  GOutputVector *vecs;
+  guint n_vecs;
+  GstMapInfo *maps;
+  guint n_maps;
+  NiceOutputMessage *messages;
+  guint n_messages;
+};
+
+struct _GstNiceMultiSink
+{
+  GstElement parent;
+  NiceAgent *agent;
+  gboolean reliable;
+  GCond writable_cond;
+  gulong writable_id;
+};
+
+typedef struct _GstNiceMultiSinkClass GstNiceMultiSinkClass;
+
+struct _GstNiceMultiSinkClass
+{
+  GstElementClass parent_class;
+};
+
+typedef struct _GstNiceMultiSinkPadClass GstNiceMultiSinkPadClass;
+
+struct _GstNiceMultiSinkPadClass
+{
+  GstPadClass parent_class;
+};
+
+GType gst_nice_multi_sink_get_type (void);
+GType gst_nice_multi_sink_pad_get_type (void);
+
+G_END_DECLS
+
+#endif // _GSTNICEMULTISINK_H
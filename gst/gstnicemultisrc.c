@@ -0,0 +1,799 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+
+#include "gstnicemultisrc.h"
+
+GST_DEBUG_CATEGORY_STATIC (nicemultisrc_debug);
+#define GST_CAT_DEFAULT nicemultisrc_debug
+
+/* Size of the pooled buffers received into, enough for any datagram. */
+#define BUFFER_SIZE (65536)
+
+/* Most datagrams received per pad in one go. */
+#define MAX_RECV_MESSAGES 16
+
+static GstPad *
+gst_nice_multi_src_request_new_pad (
+    GstElement *element,
+    GstPadTemplate *templ,
+    const gchar *name,
+    const GstCaps *caps);
+
+static void
+gst_nice_multi_src_release_pad (
+    GstElement *element,
+    GstPad *pad);
+
+static void
+gst_nice_multi_src_set_property (
+  GObject *object,
+  guint prop_id,
+  const GValue *value,
+  GParamSpec *pspec);
+
+static void
+gst_nice_multi_src_get_property (
+  GObject *object,
+  guint prop_id,
+  GValue *value,
+  GParamSpec *pspec);
+
+static void
+gst_nice_multi_src_dispose (GObject *object);
+
+static void
+gst_nice_multi_src_finalize (GObject *object);
+
+static GstStateChangeReturn
+gst_nice_multi_src_change_state (
+    GstElement * element,
+    GstStateChange transition);
+
+static GstStaticPadTemplate gst_nice_multi_src_src_template =
+GST_STATIC_PAD_TEMPLATE (
+    "src_%u_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS_ANY);
+
+G_DEFINE_TYPE (GstNiceMultiSrcPad, gst_nice_multi_src_pad, GST_TYPE_PAD);
+G_DEFINE_TYPE (GstNiceMultiSrc, gst_nice_multi_src, GST_TYPE_ELEMENT);
+
+enum
+{
+  PROP_AGENT = 1
+};
+
+enum
+{
+  PROP_PAD_STREAM = 1,
+  PROP_PAD_COMPONENT,
+  PROP_PAD_CAPS
+};
+
+static void
+gst_nice_multi_src_pad_set_property (GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+  GstNiceMultiSrcPad *pad = GST_NICE_MULTI_SRC_PAD (object);
+
+  switch (prop_id)
+    {
+    case PROP_PAD_CAPS:
+      GST_OBJECT_LOCK (pad);
+      gst_caps_replace (&pad->caps, g_value_get_boxed (value));
+      pad->need_events = TRUE;
+      GST_OBJECT_UNLOCK (pad);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+gst_nice_multi_src_pad_get_property (GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+  GstNiceMultiSrcPad *pad = GST_NICE_MULTI_SRC_PAD (object);
+
+  switch (prop_id)
+    {
+    case PROP_PAD_STREAM:
+      g_value_set_uint (value, pad->stream_id);
+      break;
+
+    case PROP_PAD_COMPONENT:
+      g_value_set_uint (value, pad->component_id);
+      break;
+
+    case PROP_PAD_CAPS:
+      GST_OBJECT_LOCK (pad);
+      g_value_set_boxed (value, pad->caps);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+gst_nice_multi_src_pad_finalize (GObject *object)
+{
+  GstNiceMultiSrcPad *pad = GST_NICE_MULTI_SRC_PAD (object);
+
+  gst_caps_replace (&pad->caps, NULL);
+  if (pad->buffers)
+    gst_buffer_list_unref (pad->buffers);
+  pad->buffers = NULL;
+
+  G_OBJECT_CLASS (gst_nice_multi_src_pad_parent_class)->finalize (object);
+}
+
+static void
+gst_nice_multi_src_pad_class_init (GstNiceMultiSrcPadClass *klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->set_property = gst_nice_multi_src_pad_set_property;
+  gobject_class->get_property = gst_nice_multi_src_pad_get_property;
+  gobject_class->finalize = gst_nice_multi_src_pad_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_PAD_STREAM,
+      g_param_spec_uint (
+         "stream",
+         "Stream ID",
+         "The ID of the stream this pad reads from",
+         0,
+         G_MAXUINT,
+         0,
+         G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_PAD_COMPONENT,
+      g_param_spec_uint (
+         "component",
+         "Component ID",
+         "The ID of the component this pad reads from",
+         0,
+         G_MAXUINT,
+         0,
+         G_PARAM_READABLE));
+
+  g_object_class_install_property (gobject_class, PROP_PAD_CAPS,
+      g_param_spec_boxed (
+         "caps",
+         "Caps",
+         "The caps of the data received on this pad, or NULL for none",
+         GST_TYPE_CAPS,
+         G_PARAM_READWRITE));
+}
+
+static void
+gst_nice_multi_src_pad_init (GstNiceMultiSrcPad *pad)
+{
+  pad->need_events = TRUE;
+}
+
+static void
+gst_nice_multi_src_class_init (GstNiceMultiSrcClass *klass)
+{
+  GstElementClass *gstelement_class;
+  GObjectClass *gobject_class;
+
+  GST_DEBUG_CATEGORY_INIT (nicemultisrc_debug, "nicemultisrc",
+      0, "libnice multi-component source");
+
+  gobject_class = (GObjectClass *) klass;
+  gobject_class->set_property = gst_nice_multi_src_set_property;
+  gobject_class->get_property = gst_nice_multi_src_get_property;
+  gobject_class->dispose = gst_nice_multi_src_dispose;
+  gobject_class->finalize = gst_nice_multi_src_finalize;
+
+  gstelement_class = (GstElementClass *) klass;
+  gstelement_class->change_state = gst_nice_multi_src_change_state;
+  gstelement_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_nice_multi_src_request_new_pad);
+  gstelement_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_nice_multi_src_release_pad);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&gst_nice_multi_src_src_template));
+  gst_element_class_set_metadata (gstelement_class,
+      "ICE multi-component source",
+      "Source",
+      "Interactive UDP connectivity establishment, receiving from many "
+      "components of one agent on a single streaming thread",
+      "Kurento <info@kurento.org>");
+
+  g_object_class_install_property (gobject_class, PROP_AGENT,
+      g_param_spec_object (
+         "agent",
+         "Agent",
+         "The NiceAgent this source is bound to",
+         NICE_TYPE_AGENT,
+         G_PARAM_READWRITE));
+}
+
+static void gst_nice_multi_src_loop (GstNiceMultiSrc *src);
+
+static void
+gst_nice_multi_src_init (GstNiceMultiSrc *src)
+{
+  GstStructure *config;
+
+  GST_OBJECT_FLAG_SET (src, GST_ELEMENT_FLAG_SOURCE);
+
+  src->agent = NULL;
+  src->mainctx = g_main_context_new ();
+  g_rec_mutex_init (&src->task_lock);
+  src->task = gst_task_new ((GstTaskFunction) gst_nice_multi_src_loop, src,
+      NULL);
+  gst_task_set_lock (src->task, &src->task_lock);
+  src->ready_pads = NULL;
+  src->task_thread = NULL;
+  src->released_pads = NULL;
+
+  src->pool = gst_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (src->pool);
+  gst_buffer_pool_config_set_params (config, NULL, BUFFER_SIZE, 0, 0);
+  gst_buffer_pool_set_config (src->pool, config);
+}
+
+/* Runs on the streaming thread, from within gst_nice_multi_src_loop(), when
+ * a socket of the component of @user_data is readable. Nothing is received
+ * here: the loop does it once the wakeup is over, into pooled buffers. */
+static gboolean
+gst_nice_multi_src_readable (gpointer user_data)
+{
+  GstNiceMultiSrcPad *pad = user_data;
+  GstNiceMultiSrc *src = GST_NICE_MULTI_SRC (GST_PAD_PARENT (pad));
+
+  if (pad->buffers == NULL) {
+    pad->buffers = gst_buffer_list_new ();
+    src->ready_pads = g_slist_prepend (src->ready_pads, pad);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Receive everything the component of @pad has queued straight into pooled
+ * buffers, appending them to the pad's list. Data read ahead by the agent
+ * does not make the sockets readable again, so go on until a receive comes
+ * back short. */
+static void
+gst_nice_multi_src_pad_recv (GstNiceMultiSrc *src, GstNiceMultiSrcPad *pad)
+{
+  GstBuffer *bufs[MAX_RECV_MESSAGES];
+  GstMapInfo maps[MAX_RECV_MESSAGES];
+  GInputVector vecs[MAX_RECV_MESSAGES];
+  NiceInputMessage messages[MAX_RECV_MESSAGES];
+  guint n_bufs, i;
+  gint n_valid;
+
+  do {
+    for (n_bufs = 0; n_bufs < MAX_RECV_MESSAGES; n_bufs++) {
+      if (gst_buffer_pool_acquire_buffer (src->pool, &bufs[n_bufs], NULL) !=
+          GST_FLOW_OK)
+        break;
+
+      if (!gst_buffer_map (bufs[n_bufs], &maps[n_bufs], GST_MAP_WRITE)) {
+        gst_buffer_unref (bufs[n_bufs]);
+        break;
+      }
+
+      vecs[n_bufs].buffer = maps[n_bufs].data;
+      vecs[n_bufs].size = maps[n_bufs].size;
+      messages[n_bufs].buffers = &vecs[n_bufs];
+      messages[n_bufs].n_buffers = 1;
+      messages[n_bufs].from = NULL;
+      messages[n_bufs].length = 0;
+    }
+
+    if (n_bufs == 0) {
+      GST_WARNING_OBJECT (pad, "Could not get a buffer to receive into");
+      return;
+    }
+
+    /* Errors, including would-block after STUN only, show up as nothing
+     * received; the agent deals with failing sockets itself. */
+    n_valid = nice_agent_recv_messages_nonblocking (src->agent,
+        pad->stream_id, pad->component_id, messages, n_bufs, NULL, NULL);
+
+    for (i = 0; i < n_bufs; i++) {
+      gst_buffer_unmap (bufs[i], &maps[i]);
+
+      if ((gint) i < n_valid) {
+        gst_buffer_resize (bufs[i], 0, messages[i].length);
+        gst_buffer_list_add (pad->buffers, bufs[i]);
+      } else {
+        gst_buffer_unref (bufs[i]);
+      }
+    }
+  } while (n_valid == (gint) n_bufs);
+}
+
+static gboolean
+gst_nice_multi_src_set_dts (GstBuffer **buffer, guint idx, gpointer user_data)
+{
+  GST_BUFFER_DTS (*buffer) = *(GstClockTime *) user_data;
+
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_nice_multi_src_pad_push (GstNiceMultiSrc *src, GstNiceMultiSrcPad *pad,
+    GstBufferList *buffers)
+{
+  GstCaps *caps = NULL;
+  gboolean need_events;
+
+  GST_OBJECT_LOCK (pad);
+  need_events = pad->need_events;
+  pad->need_events = FALSE;
+  if (need_events && pad->caps)
+    caps = gst_caps_ref (pad->caps);
+  GST_OBJECT_UNLOCK (pad);
+
+  if (need_events) {
+    GstEvent *stream_start;
+    GstSegment segment;
+    gchar *stream_id;
+
+    /* Only the caps change when they are set again on a running pad. */
+    stream_start = gst_pad_get_sticky_event (GST_PAD (pad),
+        GST_EVENT_STREAM_START, 0);
+    if (stream_start != NULL) {
+      gst_event_unref (stream_start);
+    } else {
+      stream_id = gst_pad_create_stream_id_printf (GST_PAD (pad),
+          GST_ELEMENT (src), "%u_%u", pad->stream_id, pad->component_id);
+      gst_pad_push_event (GST_PAD (pad), gst_event_new_stream_start (stream_id));
+      g_free (stream_id);
+
+      gst_segment_init (&segment, GST_FORMAT_TIME);
+      gst_pad_push_event (GST_PAD (pad), gst_event_new_segment (&segment));
+    }
+
+    if (caps) {
+      gst_pad_push_event (GST_PAD (pad), gst_event_new_caps (caps));
+      gst_caps_unref (caps);
+    }
+  }
+
+  GST_LOG_OBJECT (pad, "Pushing %u buffers", gst_buffer_list_length (buffers));
+
+  return gst_pad_push_list (GST_PAD (pad), buffers);
+}
+
+/* Stop receiving from the component of @pad and drop what it has received.
+ * Called with the task lock held. */
+static void
+gst_nice_multi_src_pad_clear (GstNiceMultiSrc *src, GstNiceMultiSrcPad *pad)
+{
+  g_source_destroy (pad->recv_source);
+  g_source_unref (pad->recv_source);
+  pad->recv_source = NULL;
+
+  src->ready_pads = g_slist_remove (src->ready_pads, pad);
+  if (pad->buffers)
+    gst_buffer_list_unref (pad->buffers);
+  pad->buffers = NULL;
+}
+
+static void
+gst_nice_multi_src_remove_pad (GstNiceMultiSrc *src, GstPad *pad)
+{
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (GST_ELEMENT (src), pad);
+}
+
+/* Each wakeup finds out which components are readable, receives from each
+ * of them, and then pushes one list per pad. */
+static void
+gst_nice_multi_src_loop (GstNiceMultiSrc *src)
+{
+  GstClockTime dts = GST_CLOCK_TIME_NONE;
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstClock *clock;
+  GSList *pads, *l;
+
+  g_main_context_iteration (src->mainctx, TRUE);
+
+  if (src->ready_pads == NULL)
+    return;
+
+  /* Downstream may release any pad while one is pushed to, so hold on to
+   * them until the end of the iteration. */
+  pads = src->ready_pads;
+  src->ready_pads = NULL;
+  for (l = pads; l != NULL; l = l->next)
+    gst_object_ref (l->data);
+
+  g_atomic_pointer_set (&src->task_thread, g_thread_self ());
+
+  for (l = pads; l != NULL; l = l->next)
+    gst_nice_multi_src_pad_recv (src, l->data);
+
+  if ((clock = gst_element_get_clock (GST_ELEMENT (src))) != NULL) {
+    dts = gst_clock_get_time (clock) -
+        gst_element_get_base_time (GST_ELEMENT (src));
+    gst_object_unref (clock);
+  }
+
+  for (l = pads; l != NULL; l = l->next) {
+    GstNiceMultiSrcPad *pad = l->data;
+    GstBufferList *buffers = pad->buffers;
+    GstFlowReturn pad_ret;
+
+    /* Released by downstream while another pad was pushed to. */
+    if (pad->recv_source == NULL)
+      continue;
+
+    pad->buffers = NULL;
+    if (gst_buffer_list_length (buffers) == 0) {
+      gst_buffer_list_unref (buffers);
+      continue;
+    }
+    gst_buffer_list_foreach (buffers, gst_nice_multi_src_set_dts, &dts);
+
+    /* Unlinked or finished pads just drop their data. */
+    pad_ret = gst_nice_multi_src_pad_push (src, pad, buffers);
+    if (pad_ret == GST_FLOW_FLUSHING || pad_ret < GST_FLOW_EOS)
+      ret = pad_ret;
+  }
+
+  g_atomic_pointer_set (&src->task_thread, NULL);
+
+  while (src->released_pads != NULL) {
+    GstPad *pad = src->released_pads->data;
+
+    src->released_pads = g_slist_delete_link (src->released_pads,
+        src->released_pads);
+    gst_nice_multi_src_remove_pad (src, pad);
+    gst_object_unref (pad);
+  }
+
+  g_slist_free_full (pads, gst_object_unref);
+
+  if (ret == GST_FLOW_FLUSHING) {
+    GST_DEBUG_OBJECT (src, "Flushing, pausing task");
+    gst_task_pause (src->task);
+  } else if (ret < GST_FLOW_EOS) {
+    GST_ELEMENT_ERROR (src, STREAM, FAILED, ("Internal data flow error."),
+        ("streaming task paused, reason %s (%d)", gst_flow_get_name (ret),
+            ret));
+    gst_task_pause (src->task);
+  }
+}
+
+static gboolean
+gst_nice_multi_src_pad_query (GstPad *pad, GstObject *parent, GstQuery *query)
+{
+  GstNiceMultiSrcPad *mpad = GST_NICE_MULTI_SRC_PAD (pad);
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_LATENCY:
+      /* Live, and packets are pushed as soon as they arrive. */
+      gst_query_set_latency (query, TRUE, 0, GST_CLOCK_TIME_NONE);
+      return TRUE;
+
+    case GST_QUERY_CAPS:
+      {
+        GstCaps *filter, *caps;
+
+        gst_query_parse_caps (query, &filter);
+
+        GST_OBJECT_LOCK (mpad);
+        caps = mpad->caps ? gst_caps_ref (mpad->caps) : gst_caps_new_any ();
+        GST_OBJECT_UNLOCK (mpad);
+
+        if (filter) {
+          GstCaps *tmp = gst_caps_intersect_full (filter, caps,
+              GST_CAPS_INTERSECT_FIRST);
+          gst_caps_unref (caps);
+          caps = tmp;
+        }
+
+        gst_query_set_caps_result (query, caps);
+        gst_caps_unref (caps);
+        return TRUE;
+      }
+
+    default:
+      return gst_pad_query_default (pad, parent, query);
+  }
+}
+
+static GstPad *
+gst_nice_multi_src_request_new_pad (GstElement *element, GstPadTemplate *templ,
+    const gchar *name, const GstCaps *caps)
+{
+  GstNiceMultiSrc *src = GST_NICE_MULTI_SRC (element);
+  GstNiceMultiSrcPad *pad;
+  guint stream_id, component_id;
+
+  if (src->agent == NULL) {
+    GST_ERROR_OBJECT (element, "Requesting a pad without an agent set");
+    return NULL;
+  }
+
+  if (name == NULL ||
+      sscanf (name, "src_%u_%u", &stream_id, &component_id) != 2 ||
+      stream_id == 0 || component_id == 0) {
+    GST_ERROR_OBJECT (element, "Pads must be requested by name, as "
+        "src_<stream>_<component>; got %s", GST_STR_NULL (name));
+    return NULL;
+  }
+
+  pad = g_object_new (GST_TYPE_NICE_MULTI_SRC_PAD, "name", name,
+      "direction", GST_PAD_SRC, "template", templ, NULL);
+  pad->stream_id = stream_id;
+  pad->component_id = component_id;
+  if (caps)
+    pad->caps = gst_caps_copy (caps);
+
+  gst_pad_set_query_function (GST_PAD (pad), gst_nice_multi_src_pad_query);
+
+  if (GST_STATE (element) > GST_STATE_READY)
+    gst_pad_set_active (GST_PAD (pad), TRUE);
+
+  if (!gst_element_add_pad (element, GST_PAD (pad))) {
+    GST_ERROR_OBJECT (element, "Pad %s already exists", name);
+    gst_object_unref (pad);
+    return NULL;
+  }
+
+  /* From now on the component is received by the streaming thread. As with
+   * nicesrc, the application must not attach a receive callback to it. */
+  pad->recv_source = nice_agent_create_recv_source (src->agent, stream_id,
+      component_id, NULL);
+  if (pad->recv_source == NULL) {
+    GST_ERROR_OBJECT (element, "No component %u in stream %u", component_id,
+        stream_id);
+    gst_element_remove_pad (element, GST_PAD (pad));
+    return NULL;
+  }
+  g_source_set_callback (pad->recv_source, gst_nice_multi_src_readable, pad,
+      NULL);
+  g_source_attach (pad->recv_source, src->mainctx);
+
+  return GST_PAD (pad);
+}
+
+static void
+gst_nice_multi_src_release_pad (GstElement *element, GstPad *pad)
+{
+  GstNiceMultiSrc *src = GST_NICE_MULTI_SRC (element);
+  GstNiceMultiSrcPad *mpad = GST_NICE_MULTI_SRC_PAD (pad);
+  gboolean running;
+
+  /* Released by downstream from the task itself, which holds the task lock
+   * and still has the pad in its list. The state lock may be held by a
+   * thread waiting for the task, so leave it alone and have the task remove
+   * the pad at the end of the iteration. */
+  if (g_atomic_pointer_get (&src->task_thread) == g_thread_self ()) {
+    gst_nice_multi_src_pad_clear (src, mpad);
+    src->released_pads = g_slist_prepend (src->released_pads,
+        gst_object_ref (pad));
+    return;
+  }
+
+  GST_STATE_LOCK (element);
+
+  /* Wait for the streaming thread to be done with the pad. A running task
+   * holds its lock across iterations, so pause it first: it lets go of the
+   * lock once woken up, at the end of the current iteration. */
+  running = gst_task_get_state (src->task) == GST_TASK_STARTED;
+  if (running)
+    gst_task_pause (src->task);
+  g_main_context_wakeup (src->mainctx);
+
+  g_rec_mutex_lock (&src->task_lock);
+  gst_nice_multi_src_pad_clear (src, mpad);
+  g_rec_mutex_unlock (&src->task_lock);
+
+  if (running)
+    gst_task_start (src->task);
+
+  GST_STATE_UNLOCK (element);
+
+  gst_nice_multi_src_remove_pad (src, pad);
+}
+
+static void
+gst_nice_multi_src_stop_task (GstNiceMultiSrc *src)
+{
+  gst_task_stop (src->task);
+  g_main_context_wakeup (src->mainctx);
+  gst_task_join (src->task);
+}
+
+static void
+gst_nice_multi_src_dispose (GObject *object)
+{
+  GstNiceMultiSrc *src = GST_NICE_MULTI_SRC (object);
+
+  if (src->task)
+    gst_nice_multi_src_stop_task (src);
+
+  G_OBJECT_CLASS (gst_nice_multi_src_parent_class)->dispose (object);
+
+  /* Released pads destroyed their sources, so the agent is safe to drop. */
+  g_clear_object (&src->agent);
+}
+
+static void
+gst_nice_multi_src_finalize (GObject *object)
+{
+  GstNiceMultiSrc *src = GST_NICE_MULTI_SRC (object);
+
+  gst_object_unref (src->task);
+  gst_object_unref (src->pool);
+  g_rec_mutex_clear (&src->task_lock);
+  g_main_context_unref (src->mainctx);
+
+  G_OBJECT_CLASS (gst_nice_multi_src_parent_class)->finalize (object);
+}
+
+static void
+gst_nice_multi_src_set_property (
+  GObject *object,
+  guint prop_id,
+  const GValue *value,
+  GParamSpec *pspec)
+{
+  GstNiceMultiSrc *src = GST_NICE_MULTI_SRC (object);
+
+  switch (prop_id)
+    {
+    case PROP_AGENT:
+      if (src->agent)
+        GST_ERROR_OBJECT (object,
+            "Changing the agent on a nice multi src not allowed");
+      else
+        src->agent = g_value_dup_object (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+gst_nice_multi_src_get_property (
+  GObject *object,
+  guint prop_id,
+  GValue *value,
+  GParamSpec *pspec)
+{
+  GstNiceMultiSrc *src = GST_NICE_MULTI_SRC (object);
+
+  switch (prop_id)
+    {
+    case PROP_AGENT:
+      g_value_set_object (value, src->agent);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static GstStateChangeReturn
+gst_nice_multi_src_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstNiceMultiSrc *src = GST_NICE_MULTI_SRC (element);
+  GstStateChangeReturn ret;
+  GList *l;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      if (src->agent == NULL)
+        {
+          GST_ERROR_OBJECT (element,
+              "Trying to start Nice multi source without an agent set");
+          return GST_STATE_CHANGE_FAILURE;
+        }
+      break;
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      if (!gst_buffer_pool_set_active (src->pool, TRUE))
+        {
+          GST_ERROR_OBJECT (element, "Could not activate the buffer pool");
+          return GST_STATE_CHANGE_FAILURE;
+        }
+      break;
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      gst_task_pause (src->task);
+      g_main_context_wakeup (src->mainctx);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_nice_multi_src_stop_task (src);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (gst_nice_multi_src_parent_class)->change_state (
+      element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    return ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      /* Live: nothing is produced until PLAYING. */
+      ret = GST_STATE_CHANGE_NO_PREROLL;
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+      gst_task_start (src->task);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      /* Deactivating the pads dropped their sticky events. Whatever the
+       * stopped task had not pushed yet is stale by now. */
+      g_slist_free (src->ready_pads);
+      src->ready_pads = NULL;
+
+      GST_OBJECT_LOCK (src);
+      for (l = element->srcpads; l != NULL; l = l->next) {
+        GstNiceMultiSrcPad *pad = l->data;
+
+        if (pad->buffers)
+          gst_buffer_list_unref (pad->buffers);
+        pad->buffers = NULL;
+
+        GST_OBJECT_LOCK (pad);
+        pad->need_events = TRUE;
+        GST_OBJECT_UNLOCK (pad);
+      }
+      GST_OBJECT_UNLOCK (src);
+
+      gst_buffer_pool_set_active (src->pool, FALSE);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
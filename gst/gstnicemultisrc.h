@@ -0,0 +1,116 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifndef _GSTNICEMULTISRC_H
+#define _GSTNICEMULTISRC_H
+
+#include <gst/gst.h>
+
+#include <nice/nice.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_NICE_MULTI_SRC \
+  (gst_nice_multi_src_get_type())
+#define GST_NICE_MULTI_SRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_NICE_MULTI_SRC,GstNiceMultiSrc))
+#define GST_NICE_MULTI_SRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_NICE_MULTI_SRC,GstNiceMultiSrcClass))
+#define GST_IS_NICE_MULTI_SRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_NICE_MULTI_SRC))
+#define GST_IS_NICE_MULTI_SRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_NICE_MULTI_SRC))
+
+#define GST_TYPE_NICE_MULTI_SRC_PAD \
+  (gst_nice_multi_src_pad_get_type())
+#define GST_NICE_MULTI_SRC_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_NICE_MULTI_SRC_PAD,GstNiceMultiSrcPad))
+#define GST_IS_NICE_MULTI_SRC_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_NICE_MULTI_SRC_PAD))
+
+typedef struct _GstNiceMultiSrc GstNiceMultiSrc;
+typedef struct _GstNiceMultiSrcPad GstNiceMultiSrcPad;
+
+/* One request pad per stream/component pair of the agent, named
+ * src_<stream>_<component>. */
+struct _GstNiceMultiSrcPad
+{
+  GstPad parent;
+  guint stream_id;
+  guint component_id;
+  GstCaps *caps;
+  gboolean need_events;
+  /* dispatched when the component is readable, from the task's context */
+  GSource *recv_source;
+  /* received during the current wakeup, pushed once it is over */
+  GstBufferList *buffers;
+};
+
+struct _GstNiceMultiSrc
+{
+  GstElement parent;
+  NiceAgent *agent;
+  GMainContext *mainctx;
+  GstTask *task;
+  GRecMutex task_lock;
+  /* buffers received into, recycled once pushed downstream */
+  GstBufferPool *pool;
+  /* readable pads, only used from the task */
+  GSList *ready_pads;
+  /* thread running the task while it iterates */
+  GThread *task_thread;
+  /* released from the task while it pushed, removed once it is done */
+  GSList *released_pads;
+};
+
+typedef struct _GstNiceMultiSrcClass GstNiceMultiSrcClass;
+
+struct _GstNiceMultiSrcClass
+{
+  GstElementClass parent_class;
+};
+
+typedef struct _GstNiceMultiSrcPadClass GstNiceMultiSrcPadClass;
+
+struct _GstNiceMultiSrcPadClass
+{
+  GstPadClass parent_class;
+};
+
+GType gst_nice_multi_src_get_type (void);
+GType gst_nice_multi_src_pad_get_type (void);
+
+G_END_DECLS
+
+#endif // _GSTNICEMULTISRC_H
@@ -40,6 +40,7 @@
 #endif
 
 #include "gstnicesink.h"
+#include "gstniceutils.h"
 
 
 GST_DEBUG_CATEGORY_STATIC (nicesink_debug);
@@ -69,6 +70,11 @@ _reliable_transport_writable (
     guint component_id,
     GstNiceSink *sink);
 
+#if GST_CHECK_VERSION (1,0,0)
+static void
+gst_nice_sink_send_pending (GstNiceSink *sink);
+#endif
+
 static void
 gst_nice_sink_set_property (
   GObject *object,
@@ -108,7 +114,8 @@ enum
 {
   PROP_AGENT = 1,
   PROP_STREAM,
-  PROP_COMPONENT
+  PROP_COMPONENT,
+  PROP_MAX_PENDING_BYTES
 };
 
 static void
@@ -180,6 +187,18 @@ gst_nice_sink_class_init (GstNiceSinkClass *klass)
          G_MAXUINT,
          0,
          G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_PENDING_BYTES,
+      g_param_spec_uint (
+         "max-pending-bytes",
+         "Maximum pending bytes",
+         "With a reliable agent, queue up to this many bytes that cannot be "
+         "sent yet instead of blocking, then send QoS upstream and block; "
+         "nothing is dropped (0 = block until sent, ignored when unreliable)",
+         0,
+         G_MAXUINT,
+         0,
+         G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY));
 }
 
 static void
@@ -190,6 +209,7 @@ gst_nice_sink_init (GstNiceSink *sink)
 #endif
 
   g_cond_init (&sink->writable_cond);
+  g_queue_init (&sink->pending_bufs);
 
 #if GST_CHECK_VERSION (1,0,0)
   /* pre-allocate OutputVector, MapInfo and OutputMessage arrays
@@ -207,41 +227,159 @@ gst_nice_sink_init (GstNiceSink *sink)
 #endif
 }
 
+static void
+gst_nice_sink_clear_pending (GstNiceSink *sink)
+{
+  GstBuffer *buf;
+
+  while ((buf = g_queue_pop_head (&sink->pending_bufs)) != NULL)
+    gst_buffer_unref (buf);
+  sink->pending_bytes = 0;
+}
+
 static void
 _reliable_transport_writable (NiceAgent *agent, guint stream_id,
     guint component_id, GstNiceSink *sink)
 {
   GST_OBJECT_LOCK (sink);
   if (stream_id == sink->stream_id && component_id == sink->component_id) {
+#if GST_CHECK_VERSION (1,0,0)
+    if (!g_queue_is_empty (&sink->pending_bufs) && !sink->flushing)
+      gst_nice_sink_send_pending (sink);
+#endif
     g_cond_broadcast (&sink->writable_cond);
   }
   GST_OBJECT_UNLOCK (sink);
 }
 
 #if GST_CHECK_VERSION (1,0,0)
-static gsize
-fill_vectors (GOutputVector * vecs, GstMapInfo * maps, guint n, GstBuffer * buf)
+/* Send as much of the pending queue as the agent takes. Called with the
+ * object lock held. */
+static void
+gst_nice_sink_send_pending (GstNiceSink *sink)
 {
-  GstMemory *mem;
-  gsize size = 0;
+  guint max_mem = gst_buffer_get_max_memory ();
+  GOutputVector *vecs = g_newa (GOutputVector, max_mem);
+  GstMapInfo *maps = g_newa (GstMapInfo, max_mem);
+  GstBuffer *buf;
+
+  while ((buf = g_queue_peek_head (&sink->pending_bufs)) != NULL) {
+    NiceOutputMessage message;
+    guint i, n_mem;
+    gint ret;
+
+    n_mem = gst_buffer_n_memory (buf);
+    gst_nice_fill_vectors (vecs, maps, n_mem, buf);
+    message.buffers = vecs;
+    message.n_buffers = n_mem;
+
+    ret = nice_agent_send_messages_nonblocking (sink->agent, sink->stream_id,
+        sink->component_id, &message, 1, NULL, NULL);
+
+    for (i = 0; i < n_mem; i++)
+      gst_memory_unmap (maps[i].memory, &maps[i]);
+
+    if (ret <= 0)
+      break;
+
+    g_queue_pop_head (&sink->pending_bufs);
+    sink->pending_bytes -= gst_buffer_get_size (buf);
+    gst_buffer_unref (buf);
+  }
+
+  GST_LOG_OBJECT (sink, "%u buffers, %" G_GUINT64_FORMAT " bytes pending",
+      g_queue_get_length (&sink->pending_bufs), sink->pending_bytes);
+}
+
+typedef struct {
+  gboolean blocked;
+  gdouble proportion;
+  GstClockTime timestamp;
+  GstClockTime running_time;
+  GstClockTime stream_time;
+} GstNiceSinkQos;
+
+/* Tell upstream it is producing faster than the agent sends, and the
+ * application that the sink is about to block. Called with the object lock
+ * held, which is released while the event travels upstream. */
+static void
+gst_nice_sink_post_qos (GstNiceSink * sink, GstNiceSinkQos * qos)
+{
+  GstMessage *message;
+  guint64 processed = sink->processed;
+
+  GST_DEBUG_OBJECT (sink, "Over the pending budget of %u bytes, blocking",
+      sink->max_pending_bytes);
+
+  GST_OBJECT_UNLOCK (sink);
+
+  if (GST_CLOCK_TIME_IS_VALID (qos->running_time))
+    gst_pad_push_event (GST_BASE_SINK_PAD (sink),
+        gst_event_new_qos (GST_QOS_TYPE_OVERFLOW, qos->proportion, 0,
+            qos->running_time));
+
+  message = gst_message_new_qos (GST_OBJECT (sink), FALSE, qos->running_time,
+      qos->stream_time, qos->timestamp, GST_CLOCK_TIME_NONE);
+  gst_message_set_qos_values (message, 0, qos->proportion, 1000000);
+  gst_message_set_qos_stats (message, GST_FORMAT_BUFFERS, processed, 0);
+  gst_element_post_message (GST_ELEMENT (sink), message);
+
+  GST_OBJECT_LOCK (sink);
+}
+
+/* Queue the buffers the agent did not take, without copying them. A reliable
+ * stream must not lose data, so nothing is ever dropped here: once the queue
+ * holds the whole budget, wait for reliable-transport-writable to drain it,
+ * and tell upstream the first time this happens in a render. A buffer larger
+ * than the budget is admitted alone into an empty queue.
+ * Called with the object lock held; returns FALSE if the sink started
+ * flushing while waiting. */
+static gboolean
+gst_nice_sink_queue_buffers (GstNiceSink * sink, GstBuffer ** buffers,
+    guint num_buffers, GstNiceSinkQos * qos)
+{
+  GstSegment *segment = &GST_BASE_SINK (sink)->segment;
   guint i;
 
-  g_assert_cmpuint (gst_buffer_n_memory (buf), ==, n);
-
-  for (i = 0; i < n; ++i) {
-    mem = gst_buffer_peek_memory (buf, i);
-    if (gst_memory_map (mem, &maps[i], GST_MAP_READ)) {
-      vecs[i].buffer = maps[i].data;
-      vecs[i].size = maps[i].size;
-    } else {
-      GST_WARNING ("Failed to map memory %p for reading", mem);
-      vecs[i].buffer = "";
-      vecs[i].size = 0;
+  for (i = 0; i < num_buffers; i++) {
+    gsize size = gst_buffer_get_size (buffers[i]);
+
+    while (!sink->flushing && !g_queue_is_empty (&sink->pending_bufs) &&
+        sink->pending_bytes + size > sink->max_pending_bytes) {
+      if (!qos->blocked) {
+        qos->blocked = TRUE;
+        qos->proportion =
+            (gdouble) (sink->pending_bytes + size) / sink->max_pending_bytes;
+        qos->timestamp = GST_BUFFER_PTS_IS_VALID (buffers[i]) ?
+            GST_BUFFER_PTS (buffers[i]) : GST_BUFFER_DTS (buffers[i]);
+        qos->running_time = qos->stream_time = GST_CLOCK_TIME_NONE;
+        if (GST_CLOCK_TIME_IS_VALID (qos->timestamp) &&
+            segment->format == GST_FORMAT_TIME) {
+          qos->running_time = gst_segment_to_running_time (segment,
+              GST_FORMAT_TIME, qos->timestamp);
+          qos->stream_time = gst_segment_to_stream_time (segment,
+              GST_FORMAT_TIME, qos->timestamp);
+        }
+        gst_nice_sink_post_qos (sink, qos);
+        continue;
+      }
+
+      g_cond_wait (&sink->writable_cond, GST_OBJECT_GET_LOCK (sink));
     }
-    size += vecs[i].size;
+
+    if (sink->flushing)
+      return FALSE;
+
+    g_queue_push_tail (&sink->pending_bufs, gst_buffer_ref (buffers[i]));
+    sink->pending_bytes += size;
   }
 
-  return size;
+  /* The writable handler may have emptied the queue while this render waited,
+   * in which case no further signal is due for what was queued since. */
+  if (qos->blocked)
+    gst_nice_sink_send_pending (sink);
+
+  return TRUE;
 }
 
 /* Buffer list code written by
@@ -260,6 +398,7 @@ gst_nice_sink_render_buffers (GstNiceSink * sink, GstBuffer ** buffers,
   guint written = 0;
   gint ret;
   GstFlowReturn flow_ret = GST_FLOW_OK;
+  GstNiceSinkQos qos = { 0, };
 
   GST_LOG_OBJECT (sink, "%u buffers, %u memories -> to be sent",
       num_buffers, total_mem_num);
@@ -286,28 +425,52 @@ gst_nice_sink_render_buffers (GstNiceSink * sink, GstBuffer ** buffers,
   msgs = sink->messages;
 
   for (i = 0, mem = 0; i < num_buffers; ++i) {
-    fill_vectors (&vecs[mem], &map_infos[mem], mem_nums[i], buffers[i]);
+    gst_nice_fill_vectors (&vecs[mem], &map_infos[mem], mem_nums[i],
+        buffers[i]);
     msgs[i].buffers = &vecs[mem];
     msgs[i].n_buffers = mem_nums[i];
     mem += mem_nums[i];
   }
 
   GST_OBJECT_LOCK (sink);
-  do {
-    ret = nice_agent_send_messages_nonblocking(sink->agent, sink->stream_id,
-        sink->component_id, msgs + written, num_buffers - written, NULL, NULL);
-
-    if (ret > 0)
-      written += ret;
-
-    if (sink->reliable && written < num_buffers)
-      g_cond_wait (&sink->writable_cond, GST_OBJECT_GET_LOCK (sink));
+  if (sink->reliable && sink->max_pending_bytes > 0) {
+    sink->processed += num_buffers;
+
+    /* Anything still pending goes out first, to keep the stream in order. */
+    if (!g_queue_is_empty (&sink->pending_bufs))
+      gst_nice_sink_send_pending (sink);
+
+    if (g_queue_is_empty (&sink->pending_bufs)) {
+      ret = nice_agent_send_messages_nonblocking (sink->agent,
+          sink->stream_id, sink->component_id, msgs, num_buffers, NULL, NULL);
+      if (ret > 0)
+        written = ret;
+    }
 
-    if (sink->flushing) {
+    if (!gst_nice_sink_queue_buffers (sink, buffers + written,
+            num_buffers - written, &qos))
       flow_ret = GST_FLOW_FLUSHING;
-      break;
-    }
-  } while (sink->reliable && written < num_buffers);
+  } else {
+    /* Without a budget a reliable sink waits here until the agent has taken
+     * everything. An unreliable agent is never waited on: whatever the socket
+     * does not take right away is dropped, as any datagram may be. */
+    do {
+      ret = nice_agent_send_messages_nonblocking(sink->agent, sink->stream_id,
+          sink->component_id, msgs + written, num_buffers - written, NULL,
+          NULL);
+
+      if (ret > 0)
+        written += ret;
+
+      if (sink->reliable && written < num_buffers)
+        g_cond_wait (&sink->writable_cond, GST_OBJECT_GET_LOCK (sink));
+
+      if (sink->flushing) {
+        flow_ret = GST_FLOW_FLUSHING;
+        break;
+      }
+    } while (sink->reliable && written < num_buffers);
+  }
   GST_OBJECT_UNLOCK (sink);
 
   for (i = 0; i < mem; ++i)
@@ -417,6 +580,7 @@ static gboolean gst_nice_sink_unlock_stop (GstBaseSink *basesink)
 
   GST_OBJECT_LOCK (nicesink);
   nicesink->flushing = FALSE;
+  gst_nice_sink_clear_pending (nicesink);
   GST_OBJECT_UNLOCK (nicesink);
 
   return TRUE;
@@ -432,6 +596,7 @@ gst_nice_sink_dispose (GObject *object)
   sink->writable_id = 0;
   g_clear_object (&sink->agent);
 
+  gst_nice_sink_clear_pending (sink);
   g_cond_clear (&sink->writable_cond);
 
   G_OBJECT_CLASS (gst_nice_sink_parent_class)->dispose (object);
@@ -500,6 +665,12 @@ gst_nice_sink_set_property (
       }
       break;
 
+    case PROP_MAX_PENDING_BYTES:
+      GST_OBJECT_LOCK (sink);
+      sink->max_pending_bytes = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (sink);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -533,6 +704,12 @@ gst_nice_sink_get_property (
       GST_OBJECT_UNLOCK (sink);
       break;
 
+    case PROP_MAX_PENDING_BYTES:
+      GST_OBJECT_LOCK (sink);
+      g_value_set_uint (value, sink->max_pending_bytes);
+      GST_OBJECT_UNLOCK (sink);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -580,5 +757,15 @@ gst_nice_sink_change_state (GstElement * element, GstStateChange transition)
   ret = GST_ELEMENT_CLASS (gst_nice_sink_parent_class)->change_state (element,
       transition);
 
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      GST_OBJECT_LOCK (sink);
+      gst_nice_sink_clear_pending (sink);
+      GST_OBJECT_UNLOCK (sink);
+      break;
+    default:
+      break;
+  }
+
   return ret;
 }
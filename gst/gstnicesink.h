@@ -70,6 +70,14 @@ struct _GstNiceSink
   gulong writable_id;
   gboolean flushing;
 
+  /* Reliable mode: buffers that could not be sent yet, sent from
+   * reliable-transport-writable; render only waits once they fill the
+   * budget */
+  guint max_pending_bytes;
+  GQueue pending_bufs;
+  guint64 pending_bytes;
+  guint64 processed;
+
 #if GST_CHECK_VERSION (1,0,0)
   /* pre-allocated scrap space for render function */
   GOutputVector *vecs;
@@ -48,6 +48,9 @@ GST_DEBUG_CATEGORY_STATIC (nicesrc_debug);
 
 #define BUFFER_SIZE (65536)
 
+/* Most datagrams received per wakeup. */
+#define MAX_RECV_MESSAGES 16
+
 static GstFlowReturn
 gst_nice_src_create (
   GstPushSrc *basesrc,
@@ -61,6 +64,11 @@ static gboolean
 gst_nice_src_unlock_stop (
     GstBaseSrc *basesrc);
 
+static gboolean
+gst_nice_src_decide_allocation (
+    GstBaseSrc *basesrc,
+    GstQuery *query);
+
 static void
 gst_nice_src_set_property (
   GObject *object,
@@ -118,6 +126,8 @@ gst_nice_src_class_init (GstNiceSrcClass *klass)
   gstbasesrc_class = (GstBaseSrcClass *) klass;
   gstbasesrc_class->unlock = GST_DEBUG_FUNCPTR (gst_nice_src_unlock);
   gstbasesrc_class->unlock_stop = GST_DEBUG_FUNCPTR (gst_nice_src_unlock_stop);
+  gstbasesrc_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_nice_src_decide_allocation);
 
   gobject_class = (GObjectClass *) klass;
   gobject_class->set_property = gst_nice_src_set_property;
@@ -174,60 +184,95 @@ gst_nice_src_init (GstNiceSrc *src)
   gst_base_src_set_live (GST_BASE_SRC (src), TRUE);
   gst_base_src_set_format (GST_BASE_SRC (src), GST_FORMAT_TIME);
   gst_base_src_set_do_timestamp (GST_BASE_SRC (src), TRUE);
+  /* Size of the pooled buffers received into, enough for any datagram. */
+  gst_base_src_set_blocksize (GST_BASE_SRC (src), BUFFER_SIZE);
   src->agent = NULL;
   src->stream_id = 0;
   src->component_id = 0;
-  src->mainctx = g_main_context_new ();
-  src->mainloop = g_main_loop_new (src->mainctx, FALSE);
-  src->unlocked = FALSE;
-  src->idle_source = NULL;
+  src->cancellable = g_cancellable_new ();
+  src->bytestream = FALSE;
   src->outbufs = g_queue_new ();
 }
 
-static void
-gst_nice_src_read_callback (NiceAgent *agent,
-    guint stream_id,
-    guint component_id,
-    guint len,
-    gchar *buf,
-    gpointer data)
+static gboolean
+gst_nice_src_set_pool_config (
+  GstBufferPool *pool,
+  GstCaps *caps,
+  guint size,
+  guint min,
+  guint max,
+  GstAllocator *allocator,
+  GstAllocationParams *params)
 {
-  GstBaseSrc *basesrc = GST_BASE_SRC (data);
-  GstNiceSrc *nicesrc = GST_NICE_SRC (basesrc);
-  GstBuffer *buffer = NULL;
+  GstStructure *config;
 
-  GST_LOG_OBJECT (agent, "Got buffer, getting out of the main loop");
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size, min, max);
+  gst_buffer_pool_config_set_allocator (config, allocator, params);
 
-#if GST_CHECK_VERSION (1,0,0)
-  buffer = gst_buffer_new_allocate (NULL, len, NULL);
-  gst_buffer_fill (buffer, 0, buf, len);
-#else
-  buffer = gst_buffer_new_and_alloc (len);
-  memcpy (GST_BUFFER_DATA (buffer), buf, len);
-#endif
-  GST_OBJECT_LOCK (nicesrc);
-  g_queue_push_tail (nicesrc->outbufs, buffer);
-  g_main_loop_quit (nicesrc->mainloop);
-  GST_OBJECT_UNLOCK (nicesrc);
+  return gst_buffer_pool_set_config (pool, config);
 }
 
+/* Every buffer must be able to hold a whole datagram, so a downstream pool is
+ * only used if it accepts buffers of at least the blocksize. Otherwise we use a
+ * plain pool of our own. */
 static gboolean
-gst_nice_src_unlock_idler (gpointer data)
+gst_nice_src_decide_allocation (GstBaseSrc *basesrc, GstQuery *query)
 {
-  GstNiceSrc *nicesrc = GST_NICE_SRC (data);
-
-  GST_OBJECT_LOCK (nicesrc);
-  if (nicesrc->unlocked)
-    g_main_loop_quit (nicesrc->mainloop);
+  GstBufferPool *pool = NULL;
+  GstAllocator *allocator = NULL;
+  GstAllocationParams params;
+  GstCaps *caps;
+  guint size = 0, min = 0, max = 0;
+  gboolean ret = TRUE;
+
+  gst_query_parse_allocation (query, &caps, NULL);
+
+  if (gst_query_get_n_allocation_params (query) > 0)
+    gst_query_parse_nth_allocation_param (query, 0, &allocator, &params);
+  else
+    gst_allocation_params_init (&params);
+
+  if (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+
+  size = MAX (size, gst_base_src_get_blocksize (basesrc));
+
+  if (pool != NULL &&
+      !gst_nice_src_set_pool_config (pool, caps, size, min, max, allocator,
+          &params)) {
+    GST_DEBUG_OBJECT (basesrc, "Downstream pool %" GST_PTR_FORMAT
+        " rejected buffers of %u bytes, using our own", pool, size);
+    gst_object_unref (pool);
+    pool = NULL;
+  }
 
-  if (nicesrc->idle_source) {
-    g_source_destroy (nicesrc->idle_source);
-    g_source_unref (nicesrc->idle_source);
-    nicesrc->idle_source = NULL;
+  if (pool == NULL) {
+    pool = gst_buffer_pool_new ();
+    min = max = 0;
+    ret = gst_nice_src_set_pool_config (pool, caps, size, min, max,
+        allocator, &params);
   }
-  GST_OBJECT_UNLOCK (nicesrc);
 
-  return FALSE;
+  if (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+  else
+    gst_query_add_allocation_pool (query, pool, size, min, max);
+
+  gst_object_unref (pool);
+  if (allocator)
+    gst_object_unref (allocator);
+
+  return ret;
+}
+
+static void
+gst_nice_src_clear_outbufs (GstNiceSrc *nicesrc)
+{
+  GstBuffer *buf;
+
+  while ((buf = g_queue_pop_head (nicesrc->outbufs)) != NULL)
+    gst_buffer_unref (buf);
 }
 
 static gboolean
@@ -235,17 +280,10 @@ gst_nice_src_unlock (GstBaseSrc *src)
 {
   GstNiceSrc *nicesrc = GST_NICE_SRC (src);
 
-  GST_OBJECT_LOCK (src);
-  nicesrc->unlocked = TRUE;
+  GST_LOG_OBJECT (src, "Unlocking");
 
-  g_main_loop_quit (nicesrc->mainloop);
-
-  if (!nicesrc->idle_source) {
-    nicesrc->idle_source = g_idle_source_new ();
-    g_source_set_priority (nicesrc->idle_source, G_PRIORITY_HIGH);
-    g_source_set_callback (nicesrc->idle_source, gst_nice_src_unlock_idler, src, NULL);
-    g_source_attach (nicesrc->idle_source, g_main_loop_get_context (nicesrc->mainloop));
-  }
+  GST_OBJECT_LOCK (src);
+  g_cancellable_cancel (nicesrc->cancellable);
   GST_OBJECT_UNLOCK (src);
 
   return TRUE;
@@ -257,56 +295,233 @@ gst_nice_src_unlock_stop (GstBaseSrc *src)
   GstNiceSrc *nicesrc = GST_NICE_SRC (src);
 
   GST_OBJECT_LOCK (src);
-  nicesrc->unlocked = FALSE;
-  if (nicesrc->idle_source) {
-    g_source_destroy (nicesrc->idle_source);
-    g_source_unref(nicesrc->idle_source);
-  }
-  nicesrc->idle_source = NULL;
+  g_object_unref (nicesrc->cancellable);
+  nicesrc->cancellable = g_cancellable_new ();
   GST_OBJECT_UNLOCK (src);
 
+  /* Called with the streaming thread stopped. */
+  gst_nice_src_clear_outbufs (nicesrc);
+
   return TRUE;
 }
 
+/* Receive into @messages, polling the agent only if nothing has arrived
+ * already: a blocking receive sets up a cancellable source and iterates the
+ * context on every call, which is wasted when datagrams are already queued.
+ *
+ * Once something arrives, take the rest of what is queued without blocking
+ * again. In reliable mode there are no message boundaries and a blocking
+ * receive only returns once the whole buffer is full, so only block for its
+ * first byte. */
+static gint
+gst_nice_src_recv_messages (
+  GstNiceSrc *nicesrc,
+  NiceInputMessage *messages,
+  guint n_messages,
+  GError **error)
+{
+  GInputVector first, rest;
+  NiceInputMessage first_message = { &first, 1, NULL, 0 };
+  NiceInputMessage rest_message = { &rest, 1, NULL, 0 };
+  GError *child_error = NULL;
+  gint n, more;
+
+  n = nice_agent_recv_messages_nonblocking (nicesrc->agent,
+      nicesrc->stream_id, nicesrc->component_id, messages, n_messages, NULL,
+      &child_error);
+  if (!g_error_matches (child_error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+    if (child_error != NULL)
+      g_propagate_error (error, child_error);
+    return n;
+  }
+  g_clear_error (&child_error);
+
+  if (nicesrc->bytestream) {
+    g_assert (n_messages == 1 && messages[0].n_buffers == 1);
+
+    first.buffer = messages[0].buffers[0].buffer;
+    first.size = 1;
+    n = nice_agent_recv_messages (nicesrc->agent, nicesrc->stream_id,
+        nicesrc->component_id, &first_message, 1, nicesrc->cancellable, error);
+    if (n <= 0)
+      return n;
+
+    /* Any error shows up again on the next receive. */
+    rest.buffer = (guint8 *) first.buffer + 1;
+    rest.size = messages[0].buffers[0].size - 1;
+    if (rest.size > 0)
+      nice_agent_recv_messages_nonblocking (nicesrc->agent,
+          nicesrc->stream_id, nicesrc->component_id, &rest_message, 1, NULL,
+          NULL);
+
+    messages[0].length = first_message.length + rest_message.length;
+    return 1;
+  }
+
+  n = nice_agent_recv_messages (nicesrc->agent, nicesrc->stream_id,
+      nicesrc->component_id, messages, 1, nicesrc->cancellable, error);
+  if (n <= 0 || n_messages == 1)
+    return n;
+
+  more = nice_agent_recv_messages_nonblocking (nicesrc->agent,
+      nicesrc->stream_id, nicesrc->component_id, messages + 1, n_messages - 1,
+      NULL, NULL);
+
+  return (more > 0) ? n + more : n;
+}
+
+/* Receive everything available on this wakeup, up to MAX_RECV_MESSAGES
+ * datagrams, into pooled buffers queued on @outbufs. */
+static GstFlowReturn
+gst_nice_src_recv_buffers (GstNiceSrc *nicesrc)
+{
+  GstBaseSrc *src = GST_BASE_SRC (nicesrc);
+  GstBufferPool *pool;
+  GstBuffer *bufs[MAX_RECV_MESSAGES];
+  GstMapInfo maps[MAX_RECV_MESSAGES];
+  GInputVector vecs[MAX_RECV_MESSAGES];
+  NiceInputMessage messages[MAX_RECV_MESSAGES];
+  GstBufferPoolAcquireParams params = { 0, };
+  GstFlowReturn ret;
+  GError *error = NULL;
+  guint n_bufs, n_mapped, i;
+  gint n_valid;
+
+  /* The first buffer may wait for the pool; further ones are only taken if
+   * the pool has them to spare. */
+  ret = GST_BASE_SRC_GET_CLASS (src)->alloc (src, -1,
+      gst_base_src_get_blocksize (src), &bufs[0]);
+  if (ret != GST_FLOW_OK)
+    return ret;
+  n_bufs = 1;
+
+  pool = gst_base_src_get_buffer_pool (src);
+  params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+  while (pool != NULL && !nicesrc->bytestream &&
+      n_bufs < MAX_RECV_MESSAGES &&
+      gst_buffer_pool_acquire_buffer (pool, &bufs[n_bufs], &params) ==
+          GST_FLOW_OK)
+    n_bufs++;
+  if (pool != NULL)
+    gst_object_unref (pool);
+
+  for (i = 0; i < n_bufs; i++) {
+    if (!gst_buffer_map (bufs[i], &maps[i], GST_MAP_WRITE))
+      break;
+
+    vecs[i].buffer = maps[i].data;
+    vecs[i].size = maps[i].size;
+    messages[i].buffers = &vecs[i];
+    messages[i].n_buffers = 1;
+    messages[i].from = NULL;
+    messages[i].length = 0;
+  }
+
+  n_mapped = i;
+
+  if (n_mapped == 0) {
+    n_valid = -1;
+    g_set_error_literal (&error, G_IO_ERROR, G_IO_ERROR_FAILED,
+        "Could not map the receive buffer");
+  } else {
+    n_valid = gst_nice_src_recv_messages (nicesrc, messages, n_mapped,
+        &error);
+  }
+
+  for (i = 0; i < n_bufs; i++) {
+    if (i < n_mapped)
+      gst_buffer_unmap (bufs[i], &maps[i]);
+
+    if ((gint) i < n_valid) {
+      gst_buffer_resize (bufs[i], 0, messages[i].length);
+      g_queue_push_tail (nicesrc->outbufs, bufs[i]);
+    } else {
+      gst_buffer_unref (bufs[i]);
+    }
+  }
+
+  GST_LOG_OBJECT (nicesrc, "Received %d buffers in one wakeup", n_valid);
+
+  if (n_valid > 0) {
+    return GST_FLOW_OK;
+  } else if (n_valid == 0) {
+    GST_DEBUG_OBJECT (nicesrc, "Stream closed by the peer");
+    return GST_FLOW_EOS;
+  } else if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    GST_LOG_OBJECT (nicesrc, "Got interrupting, returning flushing");
+    g_error_free (error);
+    return GST_FLOW_FLUSHING;
+  } else {
+    GST_ELEMENT_ERROR (nicesrc, RESOURCE, READ, (NULL),
+        ("Could not receive from the agent: %s", error->message));
+    g_error_free (error);
+    return GST_FLOW_ERROR;
+  }
+}
+
+#if GST_CHECK_VERSION (1,14,0)
+/* Push everything the last wakeup received downstream in one go, the way
+ * nicesink takes lists on the send side. Only the first buffer would get a
+ * timestamp from the base class, so stamp the rest the same. */
+static void
+gst_nice_src_submit_outbufs (GstNiceSrc *nicesrc)
+{
+  GstBaseSrc *src = GST_BASE_SRC (nicesrc);
+  GstBufferList *list;
+  GstBuffer *buf;
+  GstClock *clock;
+  GstClockTime dts = GST_CLOCK_TIME_NONE;
+
+  if (gst_base_src_get_do_timestamp (src) &&
+      (clock = gst_element_get_clock (GST_ELEMENT (src))) != NULL) {
+    dts = gst_clock_get_time (clock) -
+        gst_element_get_base_time (GST_ELEMENT (src));
+    gst_object_unref (clock);
+  }
+
+  list = gst_buffer_list_new_sized (g_queue_get_length (nicesrc->outbufs));
+
+  while ((buf = g_queue_pop_head (nicesrc->outbufs)) != NULL) {
+    if (!GST_BUFFER_DTS_IS_VALID (buf))
+      GST_BUFFER_DTS (buf) = dts;
+    gst_buffer_list_add (list, buf);
+  }
+
+  GST_LOG_OBJECT (nicesrc, "Got %u buffers, pushing as a list",
+      gst_buffer_list_length (list));
+  gst_base_src_submit_buffer_list (src, list);
+}
+#endif
+
 static GstFlowReturn
 gst_nice_src_create (
   GstPushSrc *basesrc,
   GstBuffer **buffer)
 {
   GstNiceSrc *nicesrc = GST_NICE_SRC (basesrc);
+  GstFlowReturn ret = GST_FLOW_OK;
 
   GST_LOG_OBJECT (nicesrc, "create called");
 
-  GST_OBJECT_LOCK (basesrc);
-  if (nicesrc->unlocked) {
-    GST_OBJECT_UNLOCK (basesrc);
-#if GST_CHECK_VERSION (1,0,0)
-    return GST_FLOW_FLUSHING;
-#else
-    return GST_FLOW_WRONG_STATE;
-#endif
-  }
-  if (g_queue_is_empty (nicesrc->outbufs)) {
-    GST_OBJECT_UNLOCK (basesrc);
-    g_main_loop_run (nicesrc->mainloop);
-    GST_OBJECT_LOCK (basesrc);
-  }
+  /* Hand out what the last wakeup received before polling again. */
+  if (g_queue_is_empty (nicesrc->outbufs))
+    ret = gst_nice_src_recv_buffers (nicesrc);
 
-  *buffer = g_queue_pop_head (nicesrc->outbufs);
-  GST_OBJECT_UNLOCK (basesrc);
+  if (ret != GST_FLOW_OK)
+    return ret;
 
-  if (*buffer != NULL) {
-    GST_LOG_OBJECT (nicesrc, "Got buffer, pushing");
+#if GST_CHECK_VERSION (1,14,0)
+  if (g_queue_get_length (nicesrc->outbufs) > 1) {
+    gst_nice_src_submit_outbufs (nicesrc);
+    *buffer = NULL;
     return GST_FLOW_OK;
-  } else {
-    GST_LOG_OBJECT (nicesrc, "Got interrupting, returning wrong-state");
-#if GST_CHECK_VERSION (1,0,0)
-    return GST_FLOW_FLUSHING;
-#else
-    return GST_FLOW_WRONG_STATE;
-#endif
   }
+#endif
 
+  *buffer = g_queue_pop_head (nicesrc->outbufs);
+  GST_LOG_OBJECT (nicesrc, "Got buffer, pushing");
+
+  return GST_FLOW_OK;
 }
 
 static void
@@ -318,25 +533,15 @@ gst_nice_src_dispose (GObject *object)
     g_object_unref (src->agent);
   src->agent = NULL;
 
-  if (src->mainloop)
-    g_main_loop_unref (src->mainloop);
-  src->mainloop = NULL;
-
-  if (src->mainctx)
-    g_main_context_unref (src->mainctx);
-  src->mainctx = NULL;
+  if (src->cancellable)
+    g_object_unref (src->cancellable);
+  src->cancellable = NULL;
 
   if (src->outbufs) {
     g_queue_free_full (src->outbufs, (GDestroyNotify) gst_buffer_unref);
   }
   src->outbufs = NULL;
 
-  if (src->idle_source) {
-    g_source_destroy (src->idle_source);
-    g_source_unref(src->idle_source);
-  }
-  src->idle_source = NULL;
-
   G_OBJECT_CLASS (gst_nice_src_parent_class)->dispose (object);
 }
 
@@ -430,16 +635,23 @@ gst_nice_src_change_state (GstElement * element, GstStateChange transition)
                 "Trying to start Nice source without a component set");
             return GST_STATE_CHANGE_FAILURE;
           }
+      else
+          {
+            gboolean reliable, reliable_messages;
+
+            g_object_get (src->agent, "reliable", &reliable,
+                "reliable-messages", &reliable_messages, NULL);
+            src->bytestream = reliable && !reliable_messages;
+          }
       break;
-    case GST_STATE_CHANGE_PAUSED_TO_READY:
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      /* nice_agent_recv_messages() polls the component’s sockets in the
+       * component’s own context, so take them back from wherever a receive
+       * callback attached them, and detach the callback. */
       nice_agent_attach_recv (src->agent, src->stream_id, src->component_id,
-          src->mainctx, NULL, NULL);
-      GST_OBJECT_LOCK (src);
-      g_list_free_full (src->outbufs->head, (GDestroyNotify) gst_buffer_unref);
-      g_queue_init (src->outbufs);
-      GST_OBJECT_UNLOCK (src);
+          NULL, NULL, NULL);
       break;
-    case GST_STATE_CHANGE_READY_TO_PAUSED:
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
     case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
     case GST_STATE_CHANGE_READY_TO_NULL:
@@ -450,20 +662,6 @@ gst_nice_src_change_state (GstElement * element, GstStateChange transition)
   ret = GST_ELEMENT_CLASS (gst_nice_src_parent_class)->change_state (element,
       transition);
 
-  switch (transition) {
-    case GST_STATE_CHANGE_READY_TO_PAUSED:
-      nice_agent_attach_recv (src->agent, src->stream_id, src->component_id,
-          src->mainctx, gst_nice_src_read_callback, (gpointer) src);
-      break;
-    case GST_STATE_CHANGE_NULL_TO_READY:
-    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
-    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
-    case GST_STATE_CHANGE_PAUSED_TO_READY:
-    case GST_STATE_CHANGE_READY_TO_NULL:
-    default:
-      break;
-  }
-
   return ret;
 }
 
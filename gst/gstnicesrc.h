@@ -65,11 +65,9 @@ struct _GstNiceSrc
   NiceAgent *agent;
   guint stream_id;
   guint component_id;
-  GMainContext *mainctx;
-  GMainLoop *mainloop;
+  GCancellable *cancellable;
+  gboolean bytestream;
   GQueue *outbufs;
-  gboolean unlocked;
-  GSource *idle_source;
 };
 
 typedef struct _GstNiceSrcClass GstNiceSrcClass;
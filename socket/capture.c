@@ -0,0 +1,571 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+/*
+ * pcapng capture of the datagrams sent and received by an agent's sockets.
+ * See capture.h.
+ */
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include <glib/gstdio.h>
+
+#include "capture.h"
+#include "agent-priv.h"
+
+/* Maximum number of packets waiting for the writer thread before further
+ * packets are dropped from the capture. */
+#define NICE_CAPTURE_MAX_QUEUED 4096
+
+/* Largest payload that fits in a synthetic IPv6 UDP packet. */
+#define NICE_CAPTURE_MAX_PAYLOAD (G_MAXUINT16 - 8)
+
+/* pcapng block types, option codes and link type, see
+ * draft-ietf-opsawg-pcapng. */
+#define PCAPNG_BLOCK_SHB 0x0A0D0D0A
+#define PCAPNG_BLOCK_IDB 0x00000001
+#define PCAPNG_BLOCK_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_OPT_ENDOFOPT 0
+#define PCAPNG_OPT_COMMENT 1
+#define PCAPNG_OPT_EPB_FLAGS 2
+#define PCAPNG_EPB_FLAGS_INBOUND 1
+#define PCAPNG_EPB_FLAGS_OUTBOUND 2
+#define PCAPNG_LINKTYPE_RAW 101
+
+typedef struct {
+  guint generation;             /* capture the record was taken for */
+  gint64 time;                  /* wall clock time, in microseconds */
+  gboolean inbound;             /* received rather than sent */
+  gboolean relayed;             /* decapsulated from or for a TURN server */
+  guint stream_id;              /* stream of the socket */
+  guint component_id;           /* component of the socket */
+  NiceAddress local;            /* address of the socket */
+  NiceAddress remote;           /* address of the peer */
+  gsize length;                 /* length of @data */
+  guint8 *data;                 /* copy of the payload, allocated along with
+                                   the record */
+} NiceCaptureRecord;
+
+struct _NiceCapture {
+  gint active;                  /* packets are only queued while set */
+  gint n_recording;             /* threads recording a packet, counted before
+                                   they check @active */
+  guint generation;             /* bumped by each start; records of an
+                                   earlier one are dropped by the writer */
+  gint n_queued;                /* packets waiting for the writer thread */
+  gint n_dropped;               /* packets dropped since the start */
+  GAsyncQueue *queue;           /* NiceCaptureRecord queued for the writer */
+  GThread *thread;              /* writer thread */
+  FILE *file;                   /* capture file, owned by the writer thread
+                                   while it runs */
+};
+
+/* Pushed to the queue to stop the writer thread. */
+static NiceCaptureRecord stop_record;
+
+static void
+priv_append_u16 (GByteArray *buf, guint16 value)
+{
+  g_byte_array_append (buf, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+priv_append_u32 (GByteArray *buf, guint32 value)
+{
+  g_byte_array_append (buf, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+priv_append_padding (GByteArray *buf)
+{
+  static const guint8 zeroes[4] = { 0, };
+
+  g_byte_array_append (buf, zeroes, (4 - buf->len % 4) % 4);
+}
+
+static void
+priv_append_be16 (GByteArray *buf, guint16 value)
+{
+  priv_append_u16 (buf, g_htons (value));
+}
+
+/* Ones’ complement sum of @len bytes of @data, as used by the IP and UDP
+ * checksums. */
+static guint32
+priv_checksum_add (guint32 sum, const guint8 *data, gsize len)
+{
+  gsize i;
+
+  for (i = 0; i + 1 < len; i += 2)
+    sum += (data[i] << 8) | data[i + 1];
+  if (len % 2)
+    sum += data[len - 1] << 8;
+
+  return sum;
+}
+
+static guint16
+priv_checksum_fold (guint32 sum)
+{
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+
+  return ~sum & 0xffff;
+}
+
+/* Append the IP and UDP headers of @record, followed by its payload. */
+static void
+priv_append_packet (GByteArray *buf, const NiceCaptureRecord *record)
+{
+  const NiceAddress *src, *dst;
+  const guint8 *src_ip, *dst_ip;
+  guint8 *ip_header;
+  guint ip_header_offset, udp_offset, ip_len;
+  guint16 udp_len = record->length + 8;
+  guint32 sum;
+
+  if (record->inbound) {
+    src = &record->remote;
+    dst = &record->local;
+  } else {
+    src = &record->local;
+    dst = &record->remote;
+  }
+
+  ip_header_offset = buf->len;
+
+  if (src->s.addr.sa_family == AF_INET) {
+    src_ip = (const guint8 *) &src->s.ip4.sin_addr;
+    dst_ip = (const guint8 *) &dst->s.ip4.sin_addr;
+    ip_len = 4;
+
+    priv_append_be16 (buf, 0x4500);             /* version, IHL, DSCP */
+    priv_append_be16 (buf, 20 + udp_len);       /* total length */
+    priv_append_be16 (buf, 0);                  /* identification */
+    priv_append_be16 (buf, 0x4000);             /* don’t fragment */
+    priv_append_be16 (buf, (64 << 8) | 17);     /* TTL, protocol: UDP */
+    priv_append_be16 (buf, 0);                  /* header checksum */
+    g_byte_array_append (buf, src_ip, ip_len);
+    g_byte_array_append (buf, dst_ip, ip_len);
+
+    ip_header = buf->data + ip_header_offset;
+    sum = priv_checksum_fold (priv_checksum_add (0, ip_header, 20));
+    ip_header[10] = sum >> 8;
+    ip_header[11] = sum & 0xff;
+  } else {
+    src_ip = (const guint8 *) &src->s.ip6.sin6_addr;
+    dst_ip = (const guint8 *) &dst->s.ip6.sin6_addr;
+    ip_len = 16;
+
+    priv_append_be16 (buf, 0x6000);             /* version, traffic class */
+    priv_append_be16 (buf, 0);                  /* flow label */
+    priv_append_be16 (buf, udp_len);            /* payload length */
+    priv_append_be16 (buf, (17 << 8) | 64);     /* next header: UDP, hops */
+    g_byte_array_append (buf, src_ip, ip_len);
+    g_byte_array_append (buf, dst_ip, ip_len);
+  }
+
+  udp_offset = buf->len;
+  priv_append_be16 (buf, nice_address_get_port (src));
+  priv_append_be16 (buf, nice_address_get_port (dst));
+  priv_append_be16 (buf, udp_len);
+  priv_append_be16 (buf, 0);                    /* checksum */
+  g_byte_array_append (buf, record->data, record->length);
+
+  /* The UDP checksum is optional over IPv4 but not over IPv6, compute it in
+   * both cases so that the capture doesn’t show errors. */
+  sum = priv_checksum_add (0, src_ip, ip_len);
+  sum = priv_checksum_add (sum, dst_ip, ip_len);
+  sum += 17 + udp_len;
+  sum = priv_checksum_fold (priv_checksum_add (sum, buf->data + udp_offset,
+          udp_len));
+  if (sum == 0)
+    sum = 0xffff;
+  buf->data[udp_offset + 6] = sum >> 8;
+  buf->data[udp_offset + 7] = sum & 0xff;
+}
+
+/* Append an Enhanced Packet Block for @record. */
+static void
+priv_append_epb (GByteArray *buf, const NiceCaptureRecord *record)
+{
+  gchar comment[64];
+  guint block_offset, packet_offset, packet_len;
+  guint32 block_len;
+  gint comment_len;
+
+  block_offset = buf->len;
+
+  priv_append_u32 (buf, PCAPNG_BLOCK_EPB);
+  priv_append_u32 (buf, 0);                     /* block length, set below */
+  priv_append_u32 (buf, 0);                     /* interface */
+  priv_append_u32 (buf, (guint64) record->time >> 32);
+  priv_append_u32 (buf, (guint64) record->time & 0xffffffff);
+  priv_append_u32 (buf, 0);                     /* lengths, set below */
+  priv_append_u32 (buf, 0);
+
+  packet_offset = buf->len;
+  priv_append_packet (buf, record);
+  packet_len = buf->len - packet_offset;
+  memcpy (buf->data + packet_offset - 8, &packet_len, sizeof (guint32));
+  memcpy (buf->data + packet_offset - 4, &packet_len, sizeof (guint32));
+  priv_append_padding (buf);
+
+  priv_append_u16 (buf, PCAPNG_OPT_EPB_FLAGS);
+  priv_append_u16 (buf, sizeof (guint32));
+  priv_append_u32 (buf, record->inbound ?
+      PCAPNG_EPB_FLAGS_INBOUND : PCAPNG_EPB_FLAGS_OUTBOUND);
+
+  /* Which component the packet belongs to isn’t otherwise visible in the
+   * capture. */
+  comment_len = g_snprintf (comment, sizeof (comment), "s%u c%u%s",
+      record->stream_id, record->component_id,
+      record->relayed ? " relayed" : "");
+  priv_append_u16 (buf, PCAPNG_OPT_COMMENT);
+  priv_append_u16 (buf, comment_len);
+  g_byte_array_append (buf, (const guint8 *) comment, comment_len);
+  priv_append_padding (buf);
+
+  priv_append_u16 (buf, PCAPNG_OPT_ENDOFOPT);
+  priv_append_u16 (buf, 0);
+
+  block_len = buf->len - block_offset + sizeof (guint32);
+  priv_append_u32 (buf, block_len);
+  memcpy (buf->data + block_offset + 4, &block_len, sizeof (guint32));
+}
+
+/* Append the Section Header Block and the Interface Description Block which
+ * start the file. */
+static void
+priv_append_file_header (GByteArray *buf)
+{
+  priv_append_u32 (buf, PCAPNG_BLOCK_SHB);
+  priv_append_u32 (buf, 28);
+  priv_append_u32 (buf, PCAPNG_BYTE_ORDER_MAGIC);
+  priv_append_u16 (buf, 1);                     /* major version */
+  priv_append_u16 (buf, 0);                     /* minor version */
+  priv_append_u32 (buf, G_MAXUINT32);           /* section length: unknown */
+  priv_append_u32 (buf, G_MAXUINT32);
+  priv_append_u32 (buf, 28);
+
+  /* Timestamps are in microseconds, the default resolution. */
+  priv_append_u32 (buf, PCAPNG_BLOCK_IDB);
+  priv_append_u32 (buf, 20);
+  priv_append_u16 (buf, PCAPNG_LINKTYPE_RAW);
+  priv_append_u16 (buf, 0);                     /* reserved */
+  priv_append_u32 (buf, 0);                     /* snap length: none */
+  priv_append_u32 (buf, 20);
+}
+
+static gpointer
+priv_writer_thread (gpointer user_data)
+{
+  NiceCapture *capture = user_data;
+  NiceCaptureRecord *record;
+  GByteArray *buf;
+  guint generation = capture->generation;
+  gboolean failed = FALSE;
+
+  buf = g_byte_array_sized_new (2048);
+
+  while ((record = g_async_queue_pop (capture->queue)) != &stop_record) {
+    g_atomic_int_add (&capture->n_queued, -1);
+
+    if (record->generation != generation) {
+      g_free (record);
+      continue;
+    }
+
+    g_byte_array_set_size (buf, 0);
+    priv_append_epb (buf, record);
+    g_free (record);
+
+    if (!failed && fwrite (buf->data, buf->len, 1, capture->file) != 1) {
+      nice_debug ("Capture %p: Failed to write to the capture file: %s",
+          capture, g_strerror (errno));
+      failed = TRUE;
+    }
+  }
+
+  g_byte_array_unref (buf);
+
+  return NULL;
+}
+
+NiceCapture *
+nice_capture_new (void)
+{
+  NiceCapture *capture = g_slice_new0 (NiceCapture);
+
+  capture->queue = g_async_queue_new_full (g_free);
+
+  return capture;
+}
+
+void
+nice_capture_free (NiceCapture *capture)
+{
+  nice_capture_stop (capture);
+  g_async_queue_unref (capture->queue);
+  g_slice_free (NiceCapture, capture);
+}
+
+gboolean
+nice_capture_start (NiceCapture *capture, const gchar *filename,
+    GError **error)
+{
+  GByteArray *buf;
+  gboolean ret;
+
+  if (capture->thread != NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_BUSY,
+        "A capture is already running");
+    return FALSE;
+  }
+
+  capture->file = g_fopen (filename, "wb");
+  if (capture->file == NULL) {
+    int errsv = errno;
+
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+        "Could not open ‘%s’: %s", filename, g_strerror (errsv));
+    return FALSE;
+  }
+
+  buf = g_byte_array_new ();
+  priv_append_file_header (buf);
+  ret = fwrite (buf->data, buf->len, 1, capture->file) == 1;
+  g_byte_array_unref (buf);
+
+  if (!ret) {
+    int errsv = errno;
+
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+        "Could not write to ‘%s’: %s", filename, g_strerror (errsv));
+    fclose (capture->file);
+    capture->file = NULL;
+    return FALSE;
+  }
+
+  g_atomic_int_set (&capture->n_dropped, 0);
+  capture->generation++;
+  capture->thread = g_thread_new ("nice-capture", priv_writer_thread,
+      capture);
+  g_atomic_int_set (&capture->active, TRUE);
+
+  return TRUE;
+}
+
+void
+nice_capture_stop (NiceCapture *capture)
+{
+  if (capture->thread == NULL)
+    return;
+
+  g_atomic_int_set (&capture->active, FALSE);
+
+  /* Threads which saw the capture active are about to queue their packet;
+   * any other one sees it stopped. Those are short, so just wait for them. */
+  while (g_atomic_int_get (&capture->n_recording) > 0)
+    g_thread_yield ();
+
+  /* Everything queued before the stop record is still written out. */
+  g_async_queue_push (capture->queue, &stop_record);
+  g_thread_join (capture->thread);
+  capture->thread = NULL;
+
+  fclose (capture->file);
+  capture->file = NULL;
+
+  if (g_atomic_int_get (&capture->n_dropped) > 0)
+    nice_debug ("Capture %p: %d packets were dropped from the capture",
+        capture, g_atomic_int_get (&capture->n_dropped));
+}
+
+static void
+priv_release_capture (NiceCapture *capture)
+{
+  g_atomic_int_add (&capture->n_recording, -1);
+}
+
+/* Whether packets on @sock should be captured, and to where. The capture
+ * can’t be stopped until priv_release_capture() is called. */
+static NiceCapture *
+priv_get_capture (NiceSocket *sock)
+{
+  NiceCapture *capture = sock->capture;
+
+  if (capture == NULL)
+    return NULL;
+
+  /* The synthetic UDP headers would make no sense for streams. */
+  if ((sock->type != NICE_SOCKET_TYPE_UDP_BSD &&
+       sock->type != NICE_SOCKET_TYPE_UDP_TURN) ||
+      nice_socket_is_reliable (sock))
+    return NULL;
+
+  /* Counted before @active is checked, so that nice_capture_stop() either
+   * waits for this thread or is seen by it. */
+  g_atomic_int_inc (&capture->n_recording);
+
+  if (!g_atomic_int_get (&capture->active)) {
+    priv_release_capture (capture);
+    return NULL;
+  }
+
+  return capture;
+}
+
+/* Allocate a record for a packet of @length bytes on @sock, to be filled with
+ * priv_record_append() and queued, or returns %NULL if the packet isn’t to be
+ * captured. */
+static NiceCaptureRecord *
+priv_record_new (NiceCapture *capture, NiceSocket *sock, gboolean inbound,
+    const NiceAddress *remote, gsize length)
+{
+  NiceCaptureRecord *record;
+
+  if (remote == NULL ||
+      remote->s.addr.sa_family != sock->addr.s.addr.sa_family)
+    return NULL;
+
+  if (g_atomic_int_add (&capture->n_queued, 1) >= NICE_CAPTURE_MAX_QUEUED) {
+    g_atomic_int_add (&capture->n_queued, -1);
+    g_atomic_int_inc (&capture->n_dropped);
+    return NULL;
+  }
+
+  length = MIN (length, NICE_CAPTURE_MAX_PAYLOAD);
+
+  record = g_malloc (sizeof (NiceCaptureRecord) + length);
+  record->generation = capture->generation;
+  record->time = g_get_real_time ();
+  record->inbound = inbound;
+  record->relayed = sock->type == NICE_SOCKET_TYPE_UDP_TURN;
+  record->stream_id = sock->capture_stream_id;
+  record->component_id = sock->capture_component_id;
+  record->local = sock->addr;
+  record->remote = *remote;
+  record->length = length;
+  record->data = (guint8 *) (record + 1);
+
+  return record;
+}
+
+/* Copy as much of @buffer as still fits at @offset in the payload of @record.
+ * Returns the offset following it. */
+static gsize
+priv_record_append (NiceCaptureRecord *record, gsize offset,
+    gconstpointer buffer, gsize size)
+{
+  gsize len = MIN (record->length - offset, size);
+
+  memcpy (record->data + offset, buffer, len);
+
+  return offset + len;
+}
+
+void
+nice_capture_record_sent (NiceSocket *sock, const NiceAddress *to,
+    const NiceOutputMessage *messages, guint n_messages)
+{
+  NiceCapture *capture = priv_get_capture (sock);
+  guint i, j;
+
+  if (capture == NULL)
+    return;
+
+  for (i = 0; i < n_messages; i++) {
+    const NiceOutputMessage *message = &messages[i];
+    NiceCaptureRecord *record;
+    gsize offset = 0;
+
+    record = priv_record_new (capture, sock, FALSE, to,
+        output_message_get_size (message));
+    if (record == NULL)
+      continue;
+
+    for (j = 0;
+         offset < record->length &&
+         ((message->n_buffers >= 0 && j < (guint) message->n_buffers) ||
+          (message->n_buffers < 0 && message->buffers[j].buffer != NULL));
+         j++)
+      offset = priv_record_append (record, offset,
+          message->buffers[j].buffer, message->buffers[j].size);
+
+    g_async_queue_push (capture->queue, record);
+  }
+
+  priv_release_capture (capture);
+}
+
+void
+nice_capture_record_received (NiceSocket *sock,
+    const NiceInputMessage *messages, guint n_messages)
+{
+  NiceCapture *capture = priv_get_capture (sock);
+  guint i, j;
+
+  if (capture == NULL)
+    return;
+
+  for (i = 0; i < n_messages; i++) {
+    const NiceInputMessage *message = &messages[i];
+    NiceCaptureRecord *record;
+    gsize offset = 0;
+
+    record = priv_record_new (capture, sock, TRUE, message->from,
+        message->length);
+    if (record == NULL)
+      continue;
+
+    for (j = 0;
+         offset < record->length &&
+         ((message->n_buffers >= 0 && j < (guint) message->n_buffers) ||
+          (message->n_buffers < 0 && message->buffers[j].buffer != NULL));
+         j++)
+      offset = priv_record_append (record, offset,
+          message->buffers[j].buffer, message->buffers[j].size);
+
+    g_async_queue_push (capture->queue, record);
+  }
+
+  priv_release_capture (capture);
+}
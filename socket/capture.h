@@ -0,0 +1,84 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include "socket.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Packet capture of an agent's traffic, written as pcapng.
+ *
+ * Datagrams are recorded where they cross the #NiceSocket layer and handed to
+ * a writer thread through a bounded queue, so the send and receive paths only
+ * pay for a copy of the payload. When the queue is full, further packets are
+ * dropped from the capture rather than blocking the caller.
+ *
+ * Only datagram sockets are recorded, each datagram as a synthetic IPv4 or
+ * IPv6 UDP packet between the local and remote addresses. Data relayed through
+ * a TURN server shows up twice: once as sent to or received from the server,
+ * and once decapsulated, between the relay and the peer addresses.
+ *
+ * Packets are tagged with the stream and component of their socket, which is
+ * all the socket layer knows of. The candidate pair isn’t tagged: it is given
+ * by the addresses of the synthetic packet, those of the local candidate base
+ * and the remote candidate, or of the relayed candidate and the peer.
+ */
+
+NiceCapture *
+nice_capture_new (void);
+
+void
+nice_capture_free (NiceCapture *capture);
+
+gboolean
+nice_capture_start (NiceCapture *capture, const gchar *filename,
+    GError **error);
+
+void
+nice_capture_stop (NiceCapture *capture);
+
+void
+nice_capture_record_sent (NiceSocket *sock, const NiceAddress *to,
+    const NiceOutputMessage *messages, guint n_messages);
+
+void
+nice_capture_record_received (NiceSocket *sock,
+    const NiceInputMessage *messages, guint n_messages);
+
+G_END_DECLS
+
+#endif /* _CAPTURE_H */
@@ -42,6 +42,7 @@
 
 #include "socket.h"
 #include "socket-priv.h"
+#include "capture.h"
 #include "agent-priv.h"
 
 #include <string.h>
@@ -55,9 +56,13 @@ typedef struct _NiceSocketQueuedSend NiceSocketQueuedSend;
 struct _NiceSocketQueuedSend {
   guint8 *buf;  /* owned */
   gsize length;
+  gsize offset;  /* bytes of @buf already sent */
   NiceAddress to;
 };
 
+/* Maximum number of queued buffers written with a single vectored send. */
+#define MAX_FLUSH_VECTORS 16
+
 /**
  * nice_socket_recv_messages:
  * @sock: a #NiceSocket
@@ -102,10 +107,17 @@ gint
 nice_socket_recv_messages (NiceSocket *sock,
     NiceInputMessage *recv_messages, guint n_recv_messages)
 {
+  gint ret;
+
   g_return_val_if_fail (sock != NULL, -1);
   g_return_val_if_fail (n_recv_messages == 0 || recv_messages != NULL, -1);
 
-  return sock->recv_messages (sock, recv_messages, n_recv_messages);
+  ret = sock->recv_messages (sock, recv_messages, n_recv_messages);
+
+  if (G_UNLIKELY (sock->capture != NULL) && ret > 0)
+    nice_capture_record_received (sock, recv_messages, ret);
+
+  return ret;
 }
 
 /**
@@ -147,10 +159,17 @@ gint
 nice_socket_send_messages (NiceSocket *sock, const NiceAddress *to,
     const NiceOutputMessage *messages, guint n_messages)
 {
+  gint ret;
+
   g_return_val_if_fail (sock != NULL, -1);
   g_return_val_if_fail (n_messages == 0 || messages != NULL, -1);
 
-  return sock->send_messages (sock, to, messages, n_messages);
+  ret = sock->send_messages (sock, to, messages, n_messages);
+
+  if (G_UNLIKELY (sock->capture != NULL) && ret > 0)
+    nice_capture_record_sent (sock, to, messages, ret);
+
+  return ret;
 }
 
 /**
@@ -206,7 +225,7 @@ nice_socket_recv (NiceSocket *sock, NiceAddress *from, gsize len,
   NiceInputMessage local_message = { &local_buf, 1, from, 0};
   gint ret;
 
-  ret = sock->recv_messages (sock, &local_message, 1);
+  ret = nice_socket_recv_messages (sock, &local_message, 1);
   if (ret == 1)
     return local_message.length;
   return ret;
@@ -223,7 +242,7 @@ nice_socket_send (NiceSocket *sock, const NiceAddress *to, gsize len,
   NiceOutputMessage local_message = { &local_buf, 1};
   gint ret;
 
-  ret = sock->send_messages (sock, to, &local_message, 1);
+  ret = nice_socket_send_messages (sock, to, &local_message, 1);
   if (ret == 1)
     return len;
   return ret;
@@ -400,7 +419,7 @@ void nice_socket_flush_send_queue (NiceSocket *base_socket, GQueue *send_queue)
 
     /* We only queue reliable data */
     nice_socket_send_reliable (base_socket, to,
-        tbs->length, (const gchar *) tbs->buf);
+        tbs->length - tbs->offset, (const gchar *) tbs->buf + tbs->offset);
     nice_socket_free_queued_send (tbs);
   }
 }
@@ -408,40 +427,55 @@ void nice_socket_flush_send_queue (NiceSocket *base_socket, GQueue *send_queue)
 gboolean nice_socket_flush_send_queue_to_socket (GSocket *gsock,
     GQueue *send_queue)
 {
-  NiceSocketQueuedSend *tbs;
-  GError *gerr = NULL;
-
-
-  while ((tbs = g_queue_pop_head (send_queue)) != NULL) {
-    int ret;
+  while (!g_queue_is_empty (send_queue)) {
+    GOutputVector local_bufs[MAX_FLUSH_VECTORS];
+    guint n_bufs = 0;
+    GError *gerr = NULL;
+    GList *l;
+    gssize ret;
+
+    /* Write as many queued buffers as possible at once. They are owned by the
+     * queue, so the unsent part of one is kept in place, rather than being
+     * copied into a new buffer. */
+    for (l = send_queue->head; l != NULL && n_bufs < MAX_FLUSH_VECTORS;
+         l = l->next) {
+      NiceSocketQueuedSend *tbs = l->data;
+
+      local_bufs[n_bufs].buffer = tbs->buf + tbs->offset;
+      local_bufs[n_bufs].size = tbs->length - tbs->offset;
+      n_bufs++;
+    }
 
-    GOutputVector local_bufs = { tbs->buf, tbs->length };
-    ret = g_socket_send_message (gsock, NULL, &local_bufs, 1, NULL, 0,
+    ret = g_socket_send_message (gsock, NULL, local_bufs, n_bufs, NULL, 0,
         G_SOCKET_MSG_NONE, NULL, &gerr);
 
     if (ret < 0) {
       if (g_error_matches (gerr, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
-        GOutputVector local_buf = { tbs->buf, tbs->length };
-        NiceOutputMessage local_message = {&local_buf, 1};
-
-        nice_socket_queue_send_with_callback (send_queue, &local_message,
-            0, local_buf.size, TRUE, NULL, NULL, NULL, NULL, NULL);
-        nice_socket_free_queued_send (tbs);
         g_error_free (gerr);
         return FALSE;
       }
       g_clear_error (&gerr);
-    } else if (ret < (int) tbs->length) {
-      GOutputVector local_buf = { tbs->buf + ret, tbs->length - ret };
-      NiceOutputMessage local_message = {&local_buf, 1};
 
-      nice_socket_queue_send_with_callback (send_queue, &local_message,
-          0, local_buf.size, TRUE, NULL, NULL, NULL, NULL, NULL);
-      nice_socket_free_queued_send (tbs);
+      /* Drop the buffer which couldn’t be sent. */
+      nice_socket_free_queued_send (g_queue_pop_head (send_queue));
+      continue;
+    } else if (ret == 0) {
       return FALSE;
     }
 
-    nice_socket_free_queued_send (tbs);
+    /* Free what was sent, and remember how much of the rest was. */
+    while (ret > 0) {
+      NiceSocketQueuedSend *tbs = g_queue_peek_head (send_queue);
+      gsize remaining = tbs->length - tbs->offset;
+
+      if ((gsize) ret < remaining) {
+        tbs->offset += ret;
+        return FALSE;
+      }
+
+      ret -= remaining;
+      nice_socket_free_queued_send (g_queue_pop_head (send_queue));
+    }
   }
 
   return TRUE;
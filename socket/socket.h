@@ -54,6 +54,7 @@
 G_BEGIN_DECLS
 
 typedef struct _NiceSocket NiceSocket;
+typedef struct _NiceCapture NiceCapture;
 
 typedef enum {
   NICE_SOCKET_TYPE_UDP_BSD,
@@ -91,6 +92,11 @@ struct _NiceSocket
   gboolean (*is_based_on) (NiceSocket *sock, NiceSocket *other);
   void (*close) (NiceSocket *sock);
   void *priv;
+  /* Set while the socket is attached to a component of an agent which has
+   * been capturing at some point, see capture.h */
+  NiceCapture *capture;
+  guint capture_stream_id;
+  guint capture_component_id;
 };
 
 
@@ -74,10 +74,27 @@ typedef struct {
   NiceSocketWritableCb writable_cb;
   gpointer writable_data;
   NiceSocket *passive_parent;
+
+  /* RFC 4571 read-ahead, see nice_tcp_bsd_socket_recv_framed(). Undecoded
+   * bytes are recv_buf[recv_buf_offset..recv_buf_len). */
+  guint8 *recv_buf;
+  gsize recv_buf_offset;
+  gsize recv_buf_len;
+  /* In bytestream mode, payload bytes of the current data frame which haven't
+   * been received yet. */
+  gsize data_remaining;
 } TcpPriv;
 
 #define MAX_QUEUE_LENGTH 20
 
+/* Large enough for the biggest RFC 4571 frame and its length header. */
+#define RECV_BUF_SIZE (G_MAXUINT16 + 1 + sizeof (guint16))
+
+/* In bytestream mode, read ahead at most this much (unless more is needed to
+ * complete a frame header), so that the bulk of large data frames is read
+ * straight into the caller's buffers. */
+#define BYTESTREAM_READ_AHEAD 1500
+
 static void socket_close (NiceSocket *sock);
 static gint socket_recv_messages (NiceSocket *sock,
     NiceInputMessage *recv_messages, guint n_recv_messages);
@@ -236,6 +253,8 @@ socket_close (NiceSocket *sock)
 
   nice_socket_free_send_queue (&priv->send_queue);
 
+  g_free (priv->recv_buf);
+
   if (priv->context)
     g_main_context_unref (priv->context);
 
@@ -486,3 +505,340 @@ nice_tcp_bsd_socket_get_passive_parent (NiceSocket *sock)
 
   return priv->passive_parent;
 }
+
+/* Returns the payload length of the frame at the start of the read-ahead
+ * buffer, or -1 if the buffer doesn't hold its header yet. */
+static gssize
+buffered_frame_length (TcpPriv *priv)
+{
+  guint16 frame_len;
+
+  if (priv->recv_buf_len - priv->recv_buf_offset < sizeof (guint16))
+    return -1;
+
+  memcpy (&frame_len, priv->recv_buf + priv->recv_buf_offset,
+      sizeof (guint16));
+
+  return ntohs (frame_len);
+}
+
+/* Returns the number of bytes still needed in the read-ahead buffer before it
+ * holds the header of the next frame and at least @want bytes of its payload,
+ * or all of its payload if that's shorter. */
+static gsize
+buffered_frame_missing (TcpPriv *priv, gsize want)
+{
+  gsize buffered = priv->recv_buf_len - priv->recv_buf_offset;
+  gssize frame_len = buffered_frame_length (priv);
+  gsize needed;
+
+  if (frame_len < 0)
+    return sizeof (guint16) - buffered;
+
+  needed = sizeof (guint16) + MIN (want, (gsize) frame_len);
+
+  return (buffered < needed) ? needed - buffered : 0;
+}
+
+/* Read from the socket until the read-ahead buffer holds the header of the
+ * next frame and at least @want bytes of its payload. Each read is limited to
+ * @read_limit bytes, unless more are missing; 0 means no limit.
+ *
+ * Returns: 1 if the data is buffered, 0 if the socket would block first, or
+ * -1 on error */
+static gint
+fill_recv_buf (NiceSocket *sock, gsize want, gsize read_limit)
+{
+  TcpPriv *priv = sock->priv;
+  gsize missing;
+
+  if (priv->recv_buf == NULL)
+    priv->recv_buf = g_malloc (RECV_BUF_SIZE);
+
+  while ((missing = buffered_frame_missing (priv, want)) > 0) {
+    GInputVector local_buf;
+    NiceInputMessage local_message = { &local_buf, 1, NULL, 0 };
+    gint ret;
+
+    /* Move the partial frame to the start of the buffer to make room for the
+     * rest of it. */
+    if (priv->recv_buf_offset > 0) {
+      memmove (priv->recv_buf, priv->recv_buf + priv->recv_buf_offset,
+          priv->recv_buf_len - priv->recv_buf_offset);
+      priv->recv_buf_len -= priv->recv_buf_offset;
+      priv->recv_buf_offset = 0;
+    }
+
+    local_buf.buffer = priv->recv_buf + priv->recv_buf_len;
+    local_buf.size = RECV_BUF_SIZE - priv->recv_buf_len;
+    if (read_limit > 0)
+      local_buf.size = MIN (local_buf.size, MAX (read_limit, missing));
+
+    ret = socket_recv_messages (sock, &local_message, 1);
+    if (ret <= 0)
+      return ret;
+
+    priv->recv_buf_len += local_message.length;
+
+    /* A short read means that the kernel has nothing more for now; don't
+     * waste a syscall to find out. */
+    if (local_message.length < local_buf.size &&
+        buffered_frame_missing (priv, want) > 0)
+      return 0;
+  }
+
+  return 1;
+}
+
+/* Drop the frame at the start of the read-ahead buffer, which must hold all
+ * of it. */
+static void
+consume_frame (TcpPriv *priv, gsize frame_len)
+{
+  priv->recv_buf_offset += sizeof (guint16) + frame_len;
+  if (priv->recv_buf_offset == priv->recv_buf_len)
+    priv->recv_buf_offset = priv->recv_buf_len = 0;
+}
+
+/*
+ * nice_tcp_bsd_socket_recv_framed:
+ * @sock: a TCP BSD #NiceSocket
+ * @message: the message to receive into
+ *
+ * Receive a single RFC 4571 frame. The socket reads as much of the bytestream
+ * as is available into a per-socket buffer, so that a single read can deliver
+ * several frames to subsequent calls, and keeps the state of partially
+ * received frames across calls.
+ *
+ * As frames already read ahead don't make the underlying socket readable
+ * again, callers must keep calling this until it returns 0, or check
+ * nice_tcp_bsd_socket_has_pending_data() before polling the socket.
+ *
+ * Returns: 1 if a frame was received, in which case @message contains its
+ * payload, 0 if no complete frame is available yet, or -1 on error or if the
+ * peer closed the connection
+ */
+gint
+nice_tcp_bsd_socket_recv_framed (NiceSocket *sock, NiceInputMessage *message)
+{
+  TcpPriv *priv = sock->priv;
+  gssize frame_len;
+  gint ret;
+
+  /* Make sure socket has not been freed: */
+  g_assert (sock->priv != NULL);
+
+  if (sock->type != NICE_SOCKET_TYPE_TCP_BSD)
+    return -1;
+
+  /* Can't find the next frame before the current data frame has been
+   * received in bytestream mode. */
+  g_return_val_if_fail (priv->data_remaining == 0, -1);
+
+  ret = fill_recv_buf (sock, G_MAXUINT16, 0);
+  if (ret <= 0)
+    return ret;
+
+  frame_len = buffered_frame_length (priv);
+  memcpy_buffer_to_input_message (message,
+      priv->recv_buf + priv->recv_buf_offset + sizeof (guint16), frame_len);
+  if (message->from)
+    *message->from = priv->remote_addr;
+
+  consume_frame (priv, frame_len);
+
+  return 1;
+}
+
+/*
+ * nice_tcp_bsd_socket_peek_frame:
+ * @sock: a TCP BSD #NiceSocket
+ * @want: how many bytes of the frame's payload are needed
+ * @frame_len: (out): return location for the length of the frame's payload
+ * @payload: (out): return location for the buffered part of the payload
+ * @payload_len: (out): return location for the length of @payload
+ * @from: (out) (nullable): return location for the peer's address
+ *
+ * Bytestream mode: look at the next frame, reading until at least @want bytes
+ * of its payload (or all of it, if it's shorter) are buffered. The frame must
+ * then either be dropped with nice_tcp_bsd_socket_skip_frame(), which needs
+ * all of its payload to be buffered, or its payload be received as data with
+ * nice_tcp_bsd_socket_begin_data_frame() and
+ * nice_tcp_bsd_socket_recv_data().
+ *
+ * Returns: 1 if the frame is available, 0 if the socket would block first, or
+ * -1 on error or if the peer closed the connection
+ */
+gint
+nice_tcp_bsd_socket_peek_frame (NiceSocket *sock, gsize want,
+    guint16 *frame_len, guint8 **payload, gsize *payload_len, NiceAddress *from)
+{
+  TcpPriv *priv = sock->priv;
+  gint ret;
+
+  g_assert (sock->priv != NULL);
+  g_return_val_if_fail (sock->type == NICE_SOCKET_TYPE_TCP_BSD, -1);
+  g_return_val_if_fail (priv->data_remaining == 0, -1);
+
+  ret = fill_recv_buf (sock, want, BYTESTREAM_READ_AHEAD);
+  if (ret <= 0)
+    return ret;
+
+  *frame_len = buffered_frame_length (priv);
+  *payload = priv->recv_buf + priv->recv_buf_offset + sizeof (guint16);
+  *payload_len = MIN (*frame_len,
+      priv->recv_buf_len - priv->recv_buf_offset - sizeof (guint16));
+  if (from)
+    *from = priv->remote_addr;
+
+  return 1;
+}
+
+void
+nice_tcp_bsd_socket_skip_frame (NiceSocket *sock)
+{
+  TcpPriv *priv = sock->priv;
+  gssize frame_len = buffered_frame_length (priv);
+
+  g_return_if_fail (frame_len >= 0 &&
+      buffered_frame_missing (priv, G_MAXUINT16) == 0);
+
+  consume_frame (priv, frame_len);
+}
+
+void
+nice_tcp_bsd_socket_begin_data_frame (NiceSocket *sock)
+{
+  TcpPriv *priv = sock->priv;
+  gssize frame_len = buffered_frame_length (priv);
+
+  g_return_if_fail (frame_len >= 0 && priv->data_remaining == 0);
+
+  priv->recv_buf_offset += sizeof (guint16);
+  priv->data_remaining = frame_len;
+}
+
+gsize
+nice_tcp_bsd_socket_get_data_remaining (NiceSocket *sock)
+{
+  TcpPriv *priv = sock->priv;
+
+  if (sock->type != NICE_SOCKET_TYPE_TCP_BSD)
+    return 0;
+
+  return priv->data_remaining;
+}
+
+/*
+ * nice_tcp_bsd_socket_recv_data:
+ * @sock: a TCP BSD #NiceSocket
+ * @buffers: the buffers to receive into
+ * @n_buffers: the number of @buffers
+ *
+ * Bytestream mode: receive payload of the current data frame into @buffers.
+ * Whatever was read ahead is copied first; the rest of the frame is read
+ * straight from the socket into @buffers with a single vectored read.
+ *
+ * Returns: the number of bytes received, 0 if the socket would block or the
+ * frame has been fully received, or -1 on error or if the peer closed the
+ * connection
+ */
+gssize
+nice_tcp_bsd_socket_recv_data (NiceSocket *sock, GInputVector *buffers,
+    guint n_buffers)
+{
+  TcpPriv *priv = sock->priv;
+  GInputVector *local_bufs;
+  gsize buffered, total = 0, remaining;
+  guint i = 0, n_local_bufs;
+
+  g_assert (sock->priv != NULL);
+
+  if (priv->error)
+    return -1;
+
+  local_bufs = g_alloca (n_buffers * sizeof (GInputVector));
+  memcpy (local_bufs, buffers, n_buffers * sizeof (GInputVector));
+
+  /* First, what was read ahead. */
+  buffered = MIN (priv->recv_buf_len - priv->recv_buf_offset,
+      priv->data_remaining);
+
+  while (buffered > 0 && i < n_buffers) {
+    gsize len = MIN (buffered, local_bufs[i].size);
+
+    memcpy (local_bufs[i].buffer, priv->recv_buf + priv->recv_buf_offset, len);
+    priv->recv_buf_offset += len;
+    priv->data_remaining -= len;
+    buffered -= len;
+    total += len;
+
+    local_bufs[i].buffer = (guint8 *) local_bufs[i].buffer + len;
+    local_bufs[i].size -= len;
+    if (local_bufs[i].size == 0)
+      i++;
+  }
+
+  if (priv->recv_buf_offset == priv->recv_buf_len)
+    priv->recv_buf_offset = priv->recv_buf_len = 0;
+
+  /* Then the rest of the frame, which can't have been read ahead if there is
+   * still room in @buffers, straight from the socket. Only read up to the end
+   * of the frame, so that the next header stays in the socket. */
+  if (priv->data_remaining == 0 || i == n_buffers)
+    return total;
+
+  remaining = priv->data_remaining;
+  for (n_local_bufs = 0; i + n_local_bufs < n_buffers && remaining > 0;
+       n_local_bufs++) {
+    GInputVector *buf = &local_bufs[i + n_local_bufs];
+
+    buf->size = MIN (buf->size, remaining);
+    remaining -= buf->size;
+  }
+
+  if (n_local_bufs > 0) {
+    gint flags = G_SOCKET_MSG_NONE;
+    GError *gerr = NULL;
+    gssize len;
+
+    len = g_socket_receive_message (sock->fileno, NULL, &local_bufs[i],
+        n_local_bufs, NULL, NULL, &flags, NULL, &gerr);
+
+    if (len == 0) {
+      /* The peer performed a shutdown. */
+      priv->error = TRUE;
+      return (total > 0) ? (gssize) total : -1;
+    } else if (len < 0) {
+      gboolean would_block =
+          g_error_matches (gerr, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
+
+      g_error_free (gerr);
+      if (would_block || total > 0)
+        return total;
+      return -1;
+    }
+
+    priv->data_remaining -= len;
+    total += len;
+  }
+
+  return total;
+}
+
+/* Whether data which was read ahead can be received without reading from the
+ * socket: either a complete frame, or, in bytestream mode, payload of the
+ * current data frame. */
+gboolean
+nice_tcp_bsd_socket_has_pending_data (NiceSocket *sock)
+{
+  TcpPriv *priv = sock->priv;
+
+  if (sock->type != NICE_SOCKET_TYPE_TCP_BSD || priv->recv_buf == NULL)
+    return FALSE;
+
+  if (priv->data_remaining > 0)
+    return priv->recv_buf_len > priv->recv_buf_offset;
+
+  return buffered_frame_missing (priv, G_MAXUINT16) == 0;
+}
@@ -55,6 +55,30 @@ nice_tcp_bsd_socket_set_passive_parent (NiceSocket *socket, NiceSocket *passive_
 NiceSocket *
 nice_tcp_bsd_socket_get_passive_parent (NiceSocket *socket);
 
+gint
+nice_tcp_bsd_socket_recv_framed (NiceSocket *socket, NiceInputMessage *message);
+
+gint
+nice_tcp_bsd_socket_peek_frame (NiceSocket *socket, gsize want,
+    guint16 *frame_len, guint8 **payload, gsize *payload_len,
+    NiceAddress *from);
+
+void
+nice_tcp_bsd_socket_skip_frame (NiceSocket *socket);
+
+void
+nice_tcp_bsd_socket_begin_data_frame (NiceSocket *socket);
+
+gsize
+nice_tcp_bsd_socket_get_data_remaining (NiceSocket *socket);
+
+gssize
+nice_tcp_bsd_socket_recv_data (NiceSocket *socket, GInputVector *buffers,
+    guint n_buffers);
+
+gboolean
+nice_tcp_bsd_socket_has_pending_data (NiceSocket *socket);
+
 G_END_DECLS
 
 #endif /* _TCP_BSD_H */
@@ -50,6 +50,7 @@
 #include "stun/stunagent.h"
 #include "stun/usages/timer.h"
 #include "agent-priv.h"
+#include "trace.h"
 
 #define STUN_END_TIMEOUT 8000
 #define STUN_MAX_MS_REALM_LEN 128 // as defined in [MS-TURN]
@@ -938,6 +939,8 @@ socket_send_message (NiceSocket *sock, const NiceAddress *to,
   }
 
   if (msg_len > 0) {
+    NICE_TRACE (turn_send, sock, msg_len);
+
     if (priv->compatibility == NICE_TURN_SOCKET_COMPATIBILITY_RFC5766 &&
         !priv_has_permission_for_peer (priv, to)) {
       if (!priv_has_sent_permission_for_peer (priv, to)) {
@@ -1289,6 +1292,7 @@ nice_udp_turn_socket_parse_recv_message (NiceSocket *sock, NiceSocket **from_soc
     g_assert_cmpuint (len, <=, message->length);
 
     message->length = len;
+    NICE_TRACE (turn_recv, sock, len);
 
     return (len > 0) ? 1 : 0;
   }
@@ -1302,6 +1306,7 @@ nice_udp_turn_socket_parse_recv_message (NiceSocket *sock, NiceSocket **from_soc
       message->from, buf, buf_len);
   len = memcpy_buffer_to_input_message (message, buf, len);
   g_free (buf);
+  NICE_TRACE (turn_recv, sock, len);
 
   return (len > 0) ? 1 : 0;
 }
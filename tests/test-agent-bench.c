@@ -0,0 +1,562 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <locale.h>
+#include <string.h>
+#include <time.h>
+
+#include <gio/gio.h>
+
+#include "agent.h"
+#include "test-agent-common.h"
+
+
+/**
+ * An end-to-end benchmark of two agents connected over the loopback
+ * interface. It drives the public send and receive APIs the way an
+ * application would, so it covers the whole path: framing, the socket layer,
+ * TURN encapsulation and pseudo-TCP, depending on the mode.
+ *
+ * The modes are:
+ *  • udp: host candidates over UDP;
+ *  • tcp: host candidates over ICE-TCP;
+ *  • turn: relayed candidates only, through a TURN server started locally,
+ *    skipped if rfc5766-turn-server is not installed;
+ *  • reliable: pseudo-TCP over UDP, with message boundaries preserved.
+ *
+ * The left agent sends batches of --batch messages of --message-size bytes
+ * with nice_agent_send_messages_nonblocking(). The right agent receives them
+ * with nice_agent_recv_messages_nonblocking(), and the next batch is only sent
+ * once the previous one has arrived, or has been given up as lost. Each
+ * message carries the time at which it was sent, which gives its latency.
+ *
+ * Both agents run in this process, on the same thread, so the CPU time per
+ * packet covers both sending and receiving it.
+ *
+ * For each mode, one line of space-separated key=value pairs is printed, to
+ * make it easy to track the results from run to run.
+ */
+
+
+/* How long to wait for the messages of a batch before counting the missing
+ * ones as lost, in µs. */
+#define BATCH_TIMEOUT (200 * 1000)
+
+/* How long connecting may take, in µs. */
+#define CONNECT_TIMEOUT (30 * G_USEC_PER_SEC)
+
+#define TURN_USER "toto"
+#define TURN_PASS "password"
+
+typedef enum {
+  MODE_UDP,
+  MODE_TCP,
+  MODE_TURN,
+  MODE_RELIABLE,
+} Mode;
+
+static const gchar *mode_names[] = { "udp", "tcp", "turn", "reliable" };
+
+typedef struct {
+  Mode mode;
+  TestAgents agents;
+  gboolean connected;
+
+  guint64 messages_sent;
+  guint64 messages_received;
+  guint64 bytes_received;
+  GArray *latencies;     /* gdouble, µs */
+} Run;
+
+/* Configuration options. */
+gchar *modes = NULL;
+guint message_size = 1200;    /* bytes */
+guint batch = 16;             /* messages */
+guint duration = 5;           /* s */
+
+guint turn_port = 0;          /* 0 if no TURN server is running */
+
+static void
+cb_component_state_changed (NiceAgent *agent, guint stream_id,
+    guint component_id, guint state, gpointer user_data)
+{
+  Run *run = user_data;
+
+  if (state == NICE_COMPONENT_STATE_READY)
+    run->connected = TRUE;
+}
+
+static void
+cb_reliable_transport_writable (NiceAgent *agent, guint stream_id,
+    guint component_id, gpointer user_data)
+{
+  Run *run = user_data;
+
+  run->connected = TRUE;
+}
+
+/* Nothing is sent to the left agent but connectivity checks and pseudo-TCP
+ * acknowledgements, which are handled before this is called. */
+static void
+cb_nice_recv (NiceAgent *agent, guint stream_id, guint component_id,
+    guint len, gchar *buf, gpointer user_data)
+{
+}
+
+static NiceAgent *
+create_agent (Run *run, gboolean controlling)
+{
+  NiceAgent *agent;
+  NiceAgentOption options = 0;
+
+  if (run->mode == MODE_RELIABLE)
+    options = NICE_AGENT_OPTION_RELIABLE | NICE_AGENT_OPTION_RELIABLE_MESSAGES;
+
+  agent = create_test_agent (&run->agents, controlling, options);
+  g_object_set (agent,
+      "ice-udp", run->mode != MODE_TCP,
+      "ice-tcp", run->mode == MODE_TCP,
+      "force-relay", run->mode == MODE_TURN,
+      NULL);
+
+  return agent;
+}
+
+/* Only there to wake the main context up when data arrives for the right
+ * agent, which is then received by receive_pending(). */
+static gboolean
+cb_socket_readable (GSocket *socket, GIOCondition condition,
+    gpointer user_data)
+{
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+cb_timeout (gpointer user_data)
+{
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+connect_agents (Run *run)
+{
+  TestAgents *agents = &run->agents;
+  gint64 deadline;
+
+  agents->context = g_main_context_new ();
+  agents->lagent = create_agent (run, TRUE);
+  agents->ragent = create_agent (run, FALSE);
+
+  if (run->mode == MODE_RELIABLE)
+    g_signal_connect (agents->lagent, "reliable-transport-writable",
+        G_CALLBACK (cb_reliable_transport_writable), run);
+  else
+    g_signal_connect (agents->lagent, "component-state-changed",
+        G_CALLBACK (cb_component_state_changed), run);
+
+  agents->ls_id = nice_agent_add_stream (agents->lagent, 1);
+  agents->rs_id = nice_agent_add_stream (agents->ragent, 1);
+
+  if (run->mode == MODE_TURN) {
+    nice_agent_set_relay_info (agents->lagent, agents->ls_id, 1,
+        "127.0.0.1", turn_port, TURN_USER, TURN_PASS, NICE_RELAY_TYPE_TURN_UDP);
+    nice_agent_set_relay_info (agents->ragent, agents->rs_id, 1,
+        "127.0.0.1", turn_port, TURN_USER, TURN_PASS, NICE_RELAY_TYPE_TURN_UDP);
+  }
+
+  /* The right agent is only read from nice_agent_recv_messages_nonblocking(),
+   * as an application polling for data would. */
+  nice_agent_attach_recv (agents->lagent, agents->ls_id, 1, agents->context,
+      cb_nice_recv, run);
+
+  if (!nice_agent_gather_candidates (agents->lagent, agents->ls_id) ||
+      !nice_agent_gather_candidates (agents->ragent, agents->rs_id))
+    return FALSE;
+
+  deadline = g_get_monotonic_time () + CONNECT_TIMEOUT;
+
+  while (agents->gathering_done < 2) {
+    if (g_get_monotonic_time () > deadline)
+      return FALSE;
+    iterate_test_agents (agents);
+  }
+
+  set_credentials_and_candidates (agents->lagent, agents->ls_id,
+      agents->ragent, agents->rs_id);
+  set_credentials_and_candidates (agents->ragent, agents->rs_id,
+      agents->lagent, agents->ls_id);
+
+  while (!run->connected) {
+    if (g_get_monotonic_time () > deadline)
+      return FALSE;
+    iterate_test_agents (agents);
+  }
+
+  return TRUE;
+}
+
+/* Receive whatever has arrived on the right agent. */
+static void
+receive_pending (Run *run, NiceInputMessage *messages, guint8 *buffers)
+{
+  GError *error = NULL;
+  gint n, i;
+
+  for (;;) {
+    for (i = 0; i < (gint) batch; i++) {
+      messages[i].buffers->buffer = buffers + (gsize) i * message_size;
+      messages[i].buffers->size = message_size;
+      messages[i].length = 0;
+    }
+
+    n = nice_agent_recv_messages_nonblocking (run->agents.ragent,
+        run->agents.rs_id, 1, messages, batch, NULL, &error);
+    if (n <= 0) {
+      g_clear_error (&error);
+      return;
+    }
+
+    for (i = 0; i < n; i++) {
+      gint64 sent_time;
+      gdouble latency;
+
+      if (messages[i].length < sizeof (sent_time))
+        continue;
+
+      memcpy (&sent_time, messages[i].buffers->buffer, sizeof (sent_time));
+      latency = g_get_monotonic_time () - sent_time;
+      g_array_append_val (run->latencies, latency);
+
+      run->messages_received++;
+      run->bytes_received += messages[i].length;
+    }
+  }
+}
+
+static void
+run_benchmark (Run *run)
+{
+  NiceOutputMessage *out_messages;
+  GOutputVector *out_vectors;
+  NiceInputMessage *in_messages;
+  GInputVector *in_vectors;
+  guint8 *out_buffers, *in_buffers;
+  GPtrArray *sockets;
+  GSList *sources = NULL, *l;
+  GSource *source;
+  gint64 end;
+  guint i;
+
+  out_messages = g_new0 (NiceOutputMessage, batch);
+  out_vectors = g_new0 (GOutputVector, batch);
+  out_buffers = g_malloc0 ((gsize) batch * message_size);
+  in_messages = g_new0 (NiceInputMessage, batch);
+  in_vectors = g_new0 (GInputVector, batch);
+  in_buffers = g_malloc0 ((gsize) batch * message_size);
+
+  for (i = 0; i < batch; i++) {
+    out_vectors[i].buffer = out_buffers + (gsize) i * message_size;
+    out_vectors[i].size = message_size;
+    out_messages[i].buffers = &out_vectors[i];
+    out_messages[i].n_buffers = 1;
+    in_messages[i].buffers = &in_vectors[i];
+    in_messages[i].n_buffers = 1;
+  }
+
+  /* Block in the main context rather than spinning, so that the CPU time is
+   * spent on the packets. The timeout bounds the wait for lost ones. */
+  sockets = nice_agent_get_sockets (run->agents.ragent, run->agents.rs_id, 1);
+  for (i = 0; i < sockets->len; i++) {
+    source = g_socket_create_source (g_ptr_array_index (sockets, i), G_IO_IN,
+        NULL);
+    g_source_set_callback (source, (GSourceFunc) G_CALLBACK (cb_socket_readable),
+        NULL, NULL);
+    g_source_attach (source, run->agents.context);
+    sources = g_slist_prepend (sources, source);
+  }
+  g_ptr_array_unref (sockets);
+
+  source = g_timeout_source_new (10);
+  g_source_set_callback (source, cb_timeout, NULL, NULL);
+  g_source_attach (source, run->agents.context);
+  sources = g_slist_prepend (sources, source);
+
+  end = g_get_monotonic_time () + (gint64) duration * G_USEC_PER_SEC;
+
+  while (g_get_monotonic_time () < end) {
+    guint64 target = run->messages_received + batch;
+    gint64 batch_deadline;
+    guint n_sent = 0;
+
+    batch_deadline = g_get_monotonic_time () + BATCH_TIMEOUT;
+
+    while (run->messages_received < target &&
+        g_get_monotonic_time () < batch_deadline) {
+      /* What the agent did not take yet, typically while the pseudo-TCP
+       * window is full, is sent again on the next round. */
+      if (n_sent < batch) {
+        gint64 now = g_get_monotonic_time ();
+        gint n;
+
+        for (i = n_sent; i < batch; i++)
+          memcpy ((guint8 *) out_vectors[i].buffer, &now, sizeof (now));
+
+        n = nice_agent_send_messages_nonblocking (run->agents.lagent,
+            run->agents.ls_id, 1, out_messages + n_sent, batch - n_sent, NULL,
+            NULL);
+        if (n > 0)
+          n_sent += n;
+      }
+
+      receive_pending (run, in_messages, in_buffers);
+      if (run->messages_received < target)
+        g_main_context_iteration (run->agents.context, TRUE);
+    }
+
+    /* Whatever is late is counted as lost, and not waited for again. */
+    run->messages_sent += n_sent;
+  }
+
+  for (l = sources; l; l = l->next) {
+    g_source_destroy (l->data);
+    g_source_unref (l->data);
+  }
+  g_slist_free (sources);
+
+  g_free (out_messages);
+  g_free (out_vectors);
+  g_free (out_buffers);
+  g_free (in_messages);
+  g_free (in_vectors);
+  g_free (in_buffers);
+}
+
+static gint
+compare_doubles (gconstpointer a, gconstpointer b)
+{
+  gdouble x = *(const gdouble *) a, y = *(const gdouble *) b;
+
+  return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of the sorted @latencies. */
+static gdouble
+percentile (GArray *latencies, gdouble p)
+{
+  guint rank;
+
+  if (latencies->len == 0)
+    return 0.0;
+
+  rank = (guint) (p / 100.0 * latencies->len + 0.999999);
+  rank = CLAMP (rank, 1, latencies->len);
+
+  return g_array_index (latencies, gdouble, rank - 1);
+}
+
+static void
+report (Run *run, gdouble elapsed, gdouble cpu)
+{
+  g_array_sort (run->latencies, compare_doubles);
+
+  g_print ("mode=%s message_size=%u batch=%u sent=%" G_GUINT64_FORMAT
+      " received=%" G_GUINT64_FORMAT " packets_per_s=%.0f bytes_per_s=%.0f"
+      " cpu_us_per_packet=%.3f latency_us_p50=%.0f latency_us_p90=%.0f"
+      " latency_us_p99=%.0f latency_us_max=%.0f\n",
+      mode_names[run->mode], message_size, batch, run->messages_sent,
+      run->messages_received, run->messages_received / elapsed,
+      run->bytes_received / elapsed,
+      run->messages_received ? cpu * G_USEC_PER_SEC / run->messages_received :
+      0.0,
+      percentile (run->latencies, 50.0), percentile (run->latencies, 90.0),
+      percentile (run->latencies, 99.0), percentile (run->latencies, 100.0));
+}
+
+/* Returns whether the mode delivered anything. */
+static gboolean
+bench_mode (Mode mode)
+{
+  Run run = { 0, };
+  gint64 start;
+  clock_t start_cpu;
+  gboolean ret = FALSE;
+
+  run.mode = mode;
+  run.latencies = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+  if (mode == MODE_TURN && turn_port == 0) {
+    g_print ("mode=%s skipped: rfc5766-turn-server not installed\n",
+        mode_names[mode]);
+    ret = TRUE;
+  } else if (!connect_agents (&run)) {
+    g_printerr ("mode=%s failed to connect\n", mode_names[mode]);
+  } else {
+    start = g_get_monotonic_time ();
+    start_cpu = clock ();
+
+    run_benchmark (&run);
+
+    report (&run, (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC,
+        (gdouble) (clock () - start_cpu) / CLOCKS_PER_SEC);
+    ret = run.messages_received > 0;
+  }
+
+  g_clear_object (&run.agents.lagent);
+  g_clear_object (&run.agents.ragent);
+  if (run.agents.context)
+    g_main_context_unref (run.agents.context);
+  g_array_unref (run.latencies);
+
+  return ret;
+}
+
+static GSubprocess *
+start_turn_server (void)
+{
+  GSubprocess *sp;
+  gchar *err_str = NULL;
+  gchar portstr[10];
+  gboolean found;
+
+  found = g_spawn_command_line_sync ("turnserver --help", NULL, &err_str,
+      NULL, NULL) && err_str && strstr (err_str, "--user");
+  g_free (err_str);
+  if (!found)
+    return NULL;
+
+  turn_port = g_random_int_range (10000, 60000);
+  g_snprintf (portstr, sizeof (portstr), "%u", turn_port);
+
+  sp = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_SILENCE, NULL,
+      "turnserver",
+      "--user", "toto:0xaae440b3348d50265b63703117c7bfd5",
+      "--realm", "realm",
+      "--listening-port", portstr,
+      NULL);
+  if (sp == NULL)
+    turn_port = 0;
+
+  return sp;
+}
+
+static GOptionEntry entries[] = {
+  { "mode", 'M', 0, G_OPTION_ARG_STRING, &modes,
+    "Comma-separated modes to run, among udp, tcp, turn and reliable; "
+    "all by default", "MODES" },
+  { "message-size", 'm', 0, G_OPTION_ARG_INT, &message_size,
+    "Size of the messages sent", "BYTES" },
+  { "batch", 'b', 0, G_OPTION_ARG_INT, &batch,
+    "Number of messages sent per call", "N" },
+  { "duration", 't', 0, G_OPTION_ARG_INT, &duration,
+    "Duration of the run of each mode", "S" },
+  { NULL }
+};
+
+int main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GSubprocess *turn_server = NULL;
+  gchar **mode_list;
+  gboolean selected[G_N_ELEMENTS (mode_names)] = { FALSE, };
+  gboolean ret = TRUE;
+  guint i, j;
+
+  setlocale (LC_ALL, "");
+
+  /* Configuration. */
+  context = g_option_context_new ("— benchmark two agents over loopback");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("Option parsing failed: %s\n", error->message);
+    goto context_error;
+  }
+
+  /* Every message carries its sending time. */
+  if (message_size < sizeof (gint64) || message_size > 65535 ||
+      batch == 0 || duration == 0) {
+    g_printerr ("Option parsing failed: %s\n",
+        "Message size must be between 8 and 65535 bytes, batch size and "
+        "duration must be positive.");
+    goto context_error;
+  }
+
+  mode_list = g_strsplit (modes ? modes : "udp,tcp,turn,reliable", ",", -1);
+  for (i = 0; mode_list[i]; i++) {
+    for (j = 0; j < G_N_ELEMENTS (mode_names); j++) {
+      if (g_strcmp0 (mode_list[i], mode_names[j]) == 0)
+        break;
+    }
+
+    if (j == G_N_ELEMENTS (mode_names)) {
+      g_printerr ("Option parsing failed: Unknown mode ‘%s’.\n", mode_list[i]);
+      g_strfreev (mode_list);
+      goto context_error;
+    }
+
+    selected[j] = TRUE;
+  }
+  g_strfreev (mode_list);
+
+  g_option_context_free (context);
+
+  if (selected[MODE_TURN])
+    turn_server = start_turn_server ();
+
+  for (i = 0; i < G_N_ELEMENTS (mode_names); i++) {
+    if (selected[i] && !bench_mode (i))
+      ret = FALSE;
+  }
+
+  if (turn_server) {
+    g_subprocess_force_exit (turn_server);
+    g_subprocess_wait (turn_server, NULL, NULL);
+    g_object_unref (turn_server);
+  }
+
+  g_free (modes);
+
+  /* A mode which delivers nothing on loopback is broken. */
+  return ret ? 0 : 1;
+
+context_error:
+  g_printerr ("\n%s\n", g_option_context_get_help (context, TRUE, NULL));
+  g_option_context_free (context);
+
+  return 1;
+}
@@ -0,0 +1,101 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "agent.h"
+#include "test-agent-common.h"
+
+static void
+cb_candidate_gathering_done (NiceAgent *agent, guint stream_id,
+    gpointer user_data)
+{
+  TestAgents *agents = user_data;
+
+  agents->gathering_done++;
+}
+
+/* Creates an agent with UDP host candidates on 127.0.0.1 only, which counts
+ * in @agents->gathering_done when it is done gathering. Callers change the
+ * transport properties afterwards if they need others. */
+NiceAgent *
+create_test_agent (TestAgents *agents, gboolean controlling,
+    NiceAgentOption options)
+{
+  NiceAgent *agent;
+  NiceAddress addr;
+
+  agent = nice_agent_new_full (agents->context, NICE_COMPATIBILITY_RFC5245,
+      options);
+  g_object_set (agent,
+      "controlling-mode", controlling,
+      "ice-tcp", FALSE,
+      "upnp", FALSE,
+      NULL);
+
+  g_assert (nice_address_set_from_string (&addr, "127.0.0.1"));
+  nice_agent_add_local_address (agent, &addr);
+
+  g_signal_connect (agent, "candidate-gathering-done",
+      G_CALLBACK (cb_candidate_gathering_done), agents);
+
+  return agent;
+}
+
+void
+iterate_test_agents (TestAgents *agents)
+{
+  if (!g_main_context_iteration (agents->context, FALSE))
+    g_usleep (1000);
+}
+
+/* Passes the credentials and the candidates of component 1 of @from_stream to
+ * the other agent. */
+void
+set_credentials_and_candidates (NiceAgent *from, guint from_stream,
+    NiceAgent *to, guint to_stream)
+{
+  gchar *ufrag = NULL, *password = NULL;
+  GSList *cands;
+
+  nice_agent_get_local_credentials (from, from_stream, &ufrag, &password);
+  nice_agent_set_remote_credentials (to, to_stream, ufrag, password);
+  g_free (ufrag);
+  g_free (password);
+
+  cands = nice_agent_get_local_candidates (from, from_stream, 1);
+  nice_agent_set_remote_candidates (to, to_stream, 1, cands);
+  g_slist_free_full (cands, (GDestroyNotify) nice_candidate_free);
+}
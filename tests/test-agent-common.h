@@ -0,0 +1,54 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "agent.h"
+
+/* Two agents connected over the loopback interface, one stream each, driven
+ * from a single main context. Embedded in the data of tests that need no more
+ * than that to get a pair connected. */
+typedef struct {
+  GMainContext *context;
+  NiceAgent *lagent, *ragent;
+  guint ls_id, rs_id;
+  guint gathering_done;
+} TestAgents;
+
+NiceAgent *create_test_agent (TestAgents *agents, gboolean controlling,
+    NiceAgentOption options);
+void iterate_test_agents (TestAgents *agents);
+void set_credentials_and_candidates (NiceAgent *from, guint from_stream,
+    NiceAgent *to, guint to_stream);
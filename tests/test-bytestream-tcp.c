@@ -0,0 +1,286 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+/* Check that a reliable agent with #NiceAgent:bytestream-tcp set receives the
+ * data sent over ICE-TCP as a stream, without regard for how it was split into
+ * messages by the sender, both through the receive callback and through
+ * nice_agent_recv_messages(). */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "agent.h"
+#include "test-agent-common.h"
+
+#include <string.h>
+
+/* Larger than the RFC 4571 frames the agent splits messages into, and than
+ * what the socket reads ahead. */
+#define SEND_CHUNK_SIZE 100000
+#define TOTAL_SIZE (8 * SEND_CHUNK_SIZE + 1234)
+
+typedef struct {
+  TestAgents agents;
+  gboolean writable;
+  gsize n_sent;
+  gsize n_received;
+
+  /* Only used when receiving with nice_agent_recv_messages_nonblocking(). */
+  gboolean use_recv_messages;
+} TestData;
+
+static guint8
+data_byte (gsize offset)
+{
+  return (guint8) (offset % 251);
+}
+
+static void
+check_data (TestData *data, const guint8 *buf, gsize len)
+{
+  gsize i;
+
+  g_assert_cmpuint (data->n_received + len, <=, TOTAL_SIZE);
+
+  for (i = 0; i < len; i++)
+    g_assert_cmpuint (buf[i], ==, data_byte (data->n_received + i));
+
+  data->n_received += len;
+}
+
+static void
+cb_nice_recv (NiceAgent *agent, guint stream_id, guint component_id,
+    guint len, gchar *buf, gpointer user_data)
+{
+  TestData *data = user_data;
+
+  g_assert (agent == data->agents.ragent);
+
+  check_data (data, (const guint8 *) buf, len);
+}
+
+static void
+cb_reliable_transport_writable (NiceAgent *agent, guint stream_id,
+    guint component_id, gpointer user_data)
+{
+  TestData *data = user_data;
+
+  data->writable = TRUE;
+}
+
+/* Receive whatever is pending on the right agent into oddly sized buffers, so
+ * that they don’t line up with the frames. */
+static void
+recv_pending_data (TestData *data)
+{
+  guint8 buf0[7], buf1[1000], buf2[30000];
+  GInputVector buffers[] = {
+    { buf0, sizeof (buf0) },
+    { buf1, sizeof (buf1) },
+    { buf2, sizeof (buf2) },
+  };
+  NiceInputMessage message = { buffers, G_N_ELEMENTS (buffers), NULL, 0 };
+  GError *error = NULL;
+  gsize len, i;
+  gint n_valid;
+
+  n_valid = nice_agent_recv_messages_nonblocking (data->agents.ragent,
+      data->agents.rs_id, 1, &message, 1, NULL, &error);
+
+  if (n_valid < 0) {
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
+    g_clear_error (&error);
+    return;
+  }
+
+  g_assert_no_error (error);
+
+  len = message.length;
+  for (i = 0; i < G_N_ELEMENTS (buffers) && len > 0; i++) {
+    gsize n = MIN (len, buffers[i].size);
+
+    check_data (data, buffers[i].buffer, n);
+    len -= n;
+  }
+}
+
+/* Without a receive callback, the right agent’s sockets are only polled from
+ * nice_agent_recv_messages_nonblocking(), so call it on every iteration. */
+static void
+iterate (TestData *data)
+{
+  iterate_test_agents (&data->agents);
+
+  if (data->use_recv_messages && data->n_received < TOTAL_SIZE)
+    recv_pending_data (data);
+}
+
+/* Reliable, over ICE-TCP only. */
+static NiceAgent *
+create_agent (TestData *data, gboolean controlling)
+{
+  NiceAgent *agent;
+  gboolean bytestream;
+
+  agent = create_test_agent (&data->agents, controlling,
+      NICE_AGENT_OPTION_RELIABLE);
+  g_object_set (agent,
+      "ice-udp", FALSE,
+      "ice-tcp", TRUE,
+      "bytestream-tcp", TRUE,
+      NULL);
+
+  g_object_get (agent, "bytestream-tcp", &bytestream, NULL);
+  g_assert (bytestream);
+
+  return agent;
+}
+
+/* Connect the agents, stream all the data from the left one to the right
+ * one, and wait until it has all been received. */
+static void
+run_test (TestData *data, gboolean use_callback)
+{
+  TestAgents *agents = &data->agents;
+  guint8 *payload;
+  gint64 deadline;
+  gsize i;
+
+  agents->context = g_main_context_new ();
+  agents->lagent = create_agent (data, TRUE);
+  agents->ragent = create_agent (data, FALSE);
+  data->use_recv_messages = !use_callback;
+  g_signal_connect (agents->lagent, "reliable-transport-writable",
+      G_CALLBACK (cb_reliable_transport_writable), data);
+
+  agents->ls_id = nice_agent_add_stream (agents->lagent, 1);
+  agents->rs_id = nice_agent_add_stream (agents->ragent, 1);
+  g_assert_cmpuint (agents->ls_id, >, 0);
+  g_assert_cmpuint (agents->rs_id, >, 0);
+
+  nice_agent_attach_recv (agents->lagent, agents->ls_id, 1, agents->context,
+      cb_nice_recv, data);
+  if (use_callback)
+    nice_agent_attach_recv (agents->ragent, agents->rs_id, 1, agents->context,
+        cb_nice_recv, data);
+
+  g_assert (nice_agent_gather_candidates (agents->lagent, agents->ls_id));
+  g_assert (nice_agent_gather_candidates (agents->ragent, agents->rs_id));
+
+  deadline = g_get_monotonic_time () + 30 * G_USEC_PER_SEC;
+
+  while (agents->gathering_done < 2) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate (data);
+  }
+
+  set_credentials_and_candidates (agents->lagent, agents->ls_id,
+      agents->ragent, agents->rs_id);
+  set_credentials_and_candidates (agents->ragent, agents->rs_id,
+      agents->lagent, agents->ls_id);
+
+  while (!data->writable) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate (data);
+  }
+
+  payload = g_malloc (TOTAL_SIZE);
+  for (i = 0; i < TOTAL_SIZE; i++)
+    payload[i] = data_byte (i);
+
+  while (data->n_received < TOTAL_SIZE) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+
+    if (data->n_sent < TOTAL_SIZE) {
+      gint len;
+
+      len = nice_agent_send (agents->lagent, agents->ls_id, 1,
+          MIN (SEND_CHUNK_SIZE, TOTAL_SIZE - data->n_sent),
+          (const gchar *) payload + data->n_sent);
+      if (len > 0)
+        data->n_sent += len;
+    }
+
+    iterate (data);
+  }
+
+  g_assert_cmpuint (data->n_received, ==, TOTAL_SIZE);
+  g_free (payload);
+
+  g_object_unref (agents->lagent);
+  g_object_unref (agents->ragent);
+  g_main_context_unref (agents->context);
+}
+
+static void
+test_recv_callback (void)
+{
+  TestData data = { 0, };
+
+  run_test (&data, TRUE);
+}
+
+static void
+test_recv_messages (void)
+{
+  TestData data = { 0, };
+
+  run_test (&data, FALSE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+
+#ifdef G_OS_WIN32
+  WSADATA w;
+
+  WSAStartup (0x0202, &w);
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/bytestream-tcp/recv-callback", test_recv_callback);
+  g_test_add_func ("/bytestream-tcp/recv-messages", test_recv_messages);
+
+  ret = g_test_run ();
+
+#ifdef G_OS_WIN32
+  WSACleanup ();
+#endif
+
+  return ret;
+}
@@ -0,0 +1,320 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+/* Check that nice_agent_start_capture() writes a pcapng file with the
+ * connectivity checks and the data exchanged by two connected agents,
+ * annotated with their direction and component. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "agent.h"
+#include "test-agent-common.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#define N_MESSAGES 10
+#define MESSAGE_SIZE 100
+
+typedef struct {
+  TestAgents agents;
+  gboolean connected;
+  gsize bytes_received;
+} TestData;
+
+typedef struct {
+  guint n_blocks;
+  guint n_inbound;
+  guint n_outbound;
+  guint n_data;
+} CaptureContents;
+
+static void
+cb_nice_recv (NiceAgent *agent, guint stream_id, guint component_id,
+    guint len, gchar *buf, gpointer user_data)
+{
+  TestData *data = user_data;
+
+  if (agent == data->agents.ragent)
+    data->bytes_received += len;
+}
+
+static void
+cb_component_state_changed (NiceAgent *agent, guint stream_id,
+    guint component_id, guint state, gpointer user_data)
+{
+  TestData *data = user_data;
+
+  if (agent == data->agents.lagent && state == NICE_COMPONENT_STATE_READY)
+    data->connected = TRUE;
+}
+
+static guint32
+read_u32 (const guint8 *p)
+{
+  guint32 value;
+
+  memcpy (&value, p, sizeof (value));
+  return value;
+}
+
+static guint16
+read_u16 (const guint8 *p)
+{
+  guint16 value;
+
+  memcpy (&value, p, sizeof (value));
+  return value;
+}
+
+/* Check an Enhanced Packet Block, which must hold an IPv4 UDP packet. */
+static void
+check_epb (const guint8 *block, guint32 block_len, CaptureContents *contents)
+{
+  const guint8 *packet, *option, *end;
+  guint32 captured_len, flags = 0;
+  gboolean has_comment = FALSE;
+  guint16 udp_len;
+
+  captured_len = read_u32 (block + 20);
+  g_assert_cmpuint (read_u32 (block + 24), ==, captured_len);
+  g_assert_cmpuint (28 + captured_len + 4, <=, block_len);
+
+  packet = block + 28;
+  g_assert_cmpuint (captured_len, >=, 28);
+  g_assert_cmpuint (packet[0], ==, 0x45);
+  g_assert_cmpuint (packet[9], ==, 17);
+  g_assert_cmpuint ((packet[2] << 8) | packet[3], ==, captured_len);
+  udp_len = (packet[24] << 8) | packet[25];
+  g_assert_cmpuint (udp_len, ==, captured_len - 20);
+
+  if (udp_len - 8 == MESSAGE_SIZE && packet[28] == 0xab)
+    contents->n_data++;
+
+  option = block + 28 + ((captured_len + 3) & ~3);
+  end = block + block_len - 4;
+  while (option < end) {
+    guint16 code = read_u16 (option);
+    guint16 len = read_u16 (option + 2);
+
+    if (code == 0)
+      break;
+    if (code == 2) {
+      g_assert_cmpuint (len, ==, 4);
+      flags = read_u32 (option + 4);
+    } else if (code == 1) {
+      g_assert (len >= 5 && memcmp (option + 4, "s1 c1", 5) == 0);
+      has_comment = TRUE;
+    }
+    option += 4 + ((len + 3) & ~3);
+  }
+
+  g_assert (has_comment);
+  if (flags == 1)
+    contents->n_inbound++;
+  else if (flags == 2)
+    contents->n_outbound++;
+  else
+    g_assert_not_reached ();
+}
+
+static void
+read_capture (const gchar *filename, CaptureContents *contents)
+{
+  GError *error = NULL;
+  gchar *buf;
+  gsize len, offset;
+
+  g_assert (g_file_get_contents (filename, &buf, &len, &error));
+  g_assert_no_error (error);
+
+  /* Section header, then the interface with the raw IP link type. */
+  g_assert_cmpuint (len, >=, 48);
+  g_assert_cmpuint (read_u32 ((guint8 *) buf), ==, 0x0A0D0D0A);
+  g_assert_cmpuint (read_u32 ((guint8 *) buf + 8), ==, 0x1A2B3C4D);
+  g_assert_cmpuint (read_u32 ((guint8 *) buf + 28), ==, 1);
+  g_assert_cmpuint (read_u16 ((guint8 *) buf + 36), ==, 101);
+
+  for (offset = 48; offset < len;) {
+    const guint8 *block = (guint8 *) buf + offset;
+    guint32 block_len;
+
+    g_assert_cmpuint (len - offset, >=, 12);
+    g_assert_cmpuint (read_u32 (block), ==, 6);
+    block_len = read_u32 (block + 4);
+    g_assert_cmpuint (block_len % 4, ==, 0);
+    g_assert_cmpuint (block_len, <=, len - offset);
+    g_assert_cmpuint (read_u32 (block + block_len - 4), ==, block_len);
+
+    check_epb (block, block_len, contents);
+    contents->n_blocks++;
+    offset += block_len;
+  }
+
+  g_free (buf);
+}
+
+static void
+test_capture (void)
+{
+  TestData data = { 0, };
+  TestAgents *agents = &data.agents;
+  CaptureContents contents = { 0, };
+  guint8 payload[MESSAGE_SIZE];
+  GError *error = NULL;
+  gchar *filename;
+  gint64 deadline;
+  gint fd;
+  guint i;
+
+  fd = g_file_open_tmp ("nice-capture-XXXXXX.pcapng", &filename, &error);
+  g_assert_no_error (error);
+  g_close (fd, NULL);
+
+  agents->context = g_main_context_new ();
+  agents->lagent = create_test_agent (agents, TRUE, 0);
+  agents->ragent = create_test_agent (agents, FALSE, 0);
+  g_signal_connect (agents->lagent, "component-state-changed",
+      G_CALLBACK (cb_component_state_changed), &data);
+
+  agents->ls_id = nice_agent_add_stream (agents->lagent, 1);
+  agents->rs_id = nice_agent_add_stream (agents->ragent, 1);
+  g_assert_cmpuint (agents->ls_id, ==, 1);
+
+  /* Sockets created after the start are captured too. */
+  g_assert (nice_agent_start_capture (agents->lagent, filename, &error));
+  g_assert_no_error (error);
+
+  g_assert (!nice_agent_start_capture (agents->lagent, filename, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_BUSY);
+  g_clear_error (&error);
+
+  nice_agent_attach_recv (agents->lagent, agents->ls_id, 1, agents->context,
+      cb_nice_recv, &data);
+  nice_agent_attach_recv (agents->ragent, agents->rs_id, 1, agents->context,
+      cb_nice_recv, &data);
+
+  g_assert (nice_agent_gather_candidates (agents->lagent, agents->ls_id));
+  g_assert (nice_agent_gather_candidates (agents->ragent, agents->rs_id));
+
+  deadline = g_get_monotonic_time () + 30 * G_USEC_PER_SEC;
+
+  while (agents->gathering_done < 2) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate_test_agents (agents);
+  }
+
+  set_credentials_and_candidates (agents->lagent, agents->ls_id,
+      agents->ragent, agents->rs_id);
+  set_credentials_and_candidates (agents->ragent, agents->rs_id,
+      agents->lagent, agents->ls_id);
+
+  while (!data.connected) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate_test_agents (agents);
+  }
+
+  memset (payload, 0xab, sizeof (payload));
+  for (i = 0; i < N_MESSAGES; i++)
+    g_assert_cmpint (nice_agent_send (agents->lagent, agents->ls_id, 1,
+            sizeof (payload), (const gchar *) payload), ==, sizeof (payload));
+
+  while (data.bytes_received < N_MESSAGES * MESSAGE_SIZE) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate_test_agents (agents);
+  }
+
+  nice_agent_stop_capture (agents->lagent);
+
+  read_capture (filename, &contents);
+
+  g_assert_cmpuint (contents.n_data, ==, N_MESSAGES);
+  g_assert_cmpuint (contents.n_inbound, >, 0);
+  g_assert_cmpuint (contents.n_outbound, >=, N_MESSAGES);
+  g_assert_cmpuint (contents.n_blocks, ==,
+      contents.n_inbound + contents.n_outbound);
+
+  g_object_unref (agents->lagent);
+  g_object_unref (agents->ragent);
+  g_main_context_unref (agents->context);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static void
+test_capture_invalid_file (void)
+{
+  NiceAgent *agent;
+  GError *error = NULL;
+
+  agent = nice_agent_new (NULL, NICE_COMPATIBILITY_RFC5245);
+
+  g_assert (!nice_agent_start_capture (agent,
+          "/nonexistent/directory/capture.pcapng", &error));
+  g_assert (error != NULL);
+  g_clear_error (&error);
+
+  /* Stopping without a capture running is harmless. */
+  nice_agent_stop_capture (agent);
+
+  g_object_unref (agent);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+
+#ifdef G_OS_WIN32
+  WSADATA w;
+
+  WSAStartup (0x0202, &w);
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/capture/connected", test_capture);
+  g_test_add_func ("/capture/invalid-file", test_capture_invalid_file);
+
+  ret = g_test_run ();
+
+#ifdef G_OS_WIN32
+  WSACleanup ();
+#endif
+
+  return ret;
+}
@@ -0,0 +1,342 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+/* Check that nice_agent_get_component_stats() counts the data and the STUN
+ * transactions exchanged by two connected agents, in both the datagram and
+ * the pseudo-TCP modes, that nice_agent_get_candidate_pair_stats()
+ * accounts the checks to the selected pair, and that the establishment
+ * milestones are recorded and signalled in order. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "agent.h"
+#include "test-agent-common.h"
+
+#include <string.h>
+
+#define N_MESSAGES 10
+#define MESSAGE_SIZE 100
+
+typedef struct {
+  TestAgents agents;
+  gboolean connected;
+  gsize bytes_received;
+  gint64 milestones[NICE_COMPONENT_MILESTONE_LAST];
+} TestData;
+
+static void
+cb_nice_recv (NiceAgent *agent, guint stream_id, guint component_id,
+    guint len, gchar *buf, gpointer user_data)
+{
+  TestData *data = user_data;
+
+  if (agent == data->agents.ragent)
+    data->bytes_received += len;
+}
+
+static void
+cb_component_state_changed (NiceAgent *agent, guint stream_id,
+    guint component_id, guint state, gpointer user_data)
+{
+  TestData *data = user_data;
+
+  if (agent == data->agents.lagent && state == NICE_COMPONENT_STATE_READY)
+    data->connected = TRUE;
+}
+
+static void
+cb_reliable_transport_writable (NiceAgent *agent, guint stream_id,
+    guint component_id, gpointer user_data)
+{
+  TestData *data = user_data;
+
+  data->connected = TRUE;
+}
+
+static void
+cb_component_milestone (NiceAgent *agent, guint stream_id,
+    guint component_id, guint milestone, gint64 time, gpointer user_data)
+{
+  TestData *data = user_data;
+
+  g_assert_cmpuint (milestone, <, NICE_COMPONENT_MILESTONE_LAST);
+  g_assert_cmpint (time, >, 0);
+
+  /* Each milestone is only signalled once. */
+  g_assert_cmpint (data->milestones[milestone], ==, 0);
+  data->milestones[milestone] = time;
+}
+
+/* Returns the statistics of the selected pair among those of every pair. */
+static NiceCandidatePairStats *
+find_selected_pair_stats (GSList *pairs)
+{
+  NiceCandidatePairStats *selected = NULL;
+  GSList *i;
+
+  for (i = pairs; i; i = i->next) {
+    NiceCandidatePairStats *stats = i->data;
+
+    g_assert (stats->local != NULL);
+    g_assert (stats->remote != NULL);
+
+    if (stats->selected) {
+      g_assert (selected == NULL);
+      selected = stats;
+    }
+  }
+
+  g_assert (selected != NULL);
+
+  return selected;
+}
+
+static void
+check_pair_stats (TestData *data)
+{
+  GSList *lpairs, *rpairs, *i;
+  NiceCandidatePairStats *lpair;
+  guint64 requests_received = 0;
+
+  lpairs = nice_agent_get_candidate_pair_stats (data->agents.lagent,
+      data->agents.ls_id, 1);
+  lpair = find_selected_pair_stats (lpairs);
+
+  g_assert (lpair->valid);
+  g_assert_cmpuint (lpair->requests_sent, >, 0);
+  g_assert_cmpuint (lpair->responses_received, >, 0);
+  g_assert_cmpuint (lpair->requests_sent, >=, lpair->responses_received);
+  g_assert_cmpint (lpair->last_request_sent, >, 0);
+  g_assert_cmpint (lpair->last_response_received, >, 0);
+
+  /* The right agent may not have selected a pair yet, but it answered the
+   * checks of the left one. */
+  rpairs = nice_agent_get_candidate_pair_stats (data->agents.ragent,
+      data->agents.rs_id, 1);
+  g_assert (rpairs != NULL);
+  for (i = rpairs; i; i = i->next) {
+    NiceCandidatePairStats *stats = i->data;
+
+    g_assert_cmpuint (stats->responses_sent, ==, stats->requests_received);
+    if (stats->requests_received > 0)
+      g_assert_cmpint (stats->last_request_received, >, 0);
+    requests_received += stats->requests_received;
+  }
+  g_assert_cmpuint (requests_received, >, 0);
+
+  g_slist_free_full (lpairs, (GDestroyNotify) nice_candidate_pair_stats_free);
+  g_slist_free_full (rpairs, (GDestroyNotify) nice_candidate_pair_stats_free);
+}
+
+static void
+check_timeline (TestData *data)
+{
+  NiceComponentTimeline timeline;
+
+  g_assert (nice_agent_get_component_timeline (data->agents.lagent,
+          data->agents.ls_id, 1, &timeline));
+
+  g_assert_cmpint (timeline.gathering_started, >, 0);
+  g_assert_cmpint (timeline.gathering_done, >=, timeline.gathering_started);
+  g_assert_cmpint (timeline.first_check_sent, >=, timeline.gathering_done);
+  g_assert_cmpint (timeline.first_check_succeeded, >=,
+      timeline.first_check_sent);
+  g_assert_cmpint (timeline.nominated, >=, timeline.first_check_succeeded);
+  g_assert_cmpint (timeline.connected, >=, timeline.first_check_succeeded);
+  g_assert_cmpint (timeline.failed, ==, 0);
+
+  g_assert_cmpint (data->milestones[NICE_COMPONENT_MILESTONE_GATHERING_STARTED],
+      ==, timeline.gathering_started);
+  g_assert_cmpint (data->milestones[NICE_COMPONENT_MILESTONE_GATHERING_DONE],
+      ==, timeline.gathering_done);
+  g_assert_cmpint (data->milestones[NICE_COMPONENT_MILESTONE_FIRST_CHECK_SENT],
+      ==, timeline.first_check_sent);
+  g_assert_cmpint (
+      data->milestones[NICE_COMPONENT_MILESTONE_FIRST_CHECK_SUCCEEDED],
+      ==, timeline.first_check_succeeded);
+  g_assert_cmpint (data->milestones[NICE_COMPONENT_MILESTONE_NOMINATED],
+      ==, timeline.nominated);
+  g_assert_cmpint (data->milestones[NICE_COMPONENT_MILESTONE_CONNECTED],
+      ==, timeline.connected);
+
+  g_assert (!nice_agent_get_component_timeline (data->agents.lagent,
+          data->agents.ls_id, 2, &timeline));
+}
+
+static void
+run_test (gboolean reliable)
+{
+  TestData data = { 0, };
+  TestAgents *agents = &data.agents;
+  NiceComponentStats lstats, rstats;
+  guint8 payload[MESSAGE_SIZE];
+  gint64 deadline;
+  guint i;
+
+  agents->context = g_main_context_new ();
+  agents->lagent = create_test_agent (agents, TRUE,
+      reliable ? NICE_AGENT_OPTION_RELIABLE : 0);
+  agents->ragent = create_test_agent (agents, FALSE,
+      reliable ? NICE_AGENT_OPTION_RELIABLE : 0);
+
+  if (reliable)
+    g_signal_connect (agents->lagent, "reliable-transport-writable",
+        G_CALLBACK (cb_reliable_transport_writable), &data);
+  else
+    g_signal_connect (agents->lagent, "component-state-changed",
+        G_CALLBACK (cb_component_state_changed), &data);
+
+  g_signal_connect (agents->lagent, "component-milestone",
+      G_CALLBACK (cb_component_milestone), &data);
+
+  agents->ls_id = nice_agent_add_stream (agents->lagent, 1);
+  agents->rs_id = nice_agent_add_stream (agents->ragent, 1);
+
+  /* Nothing has happened yet, and unknown components are rejected. */
+  g_assert (nice_agent_get_component_stats (agents->lagent, agents->ls_id, 1,
+          &lstats));
+  g_assert_cmpuint (lstats.packets_sent, ==, 0);
+  g_assert_cmpuint (lstats.stun_requests_sent, ==, 0);
+  g_assert_cmpuint (lstats.rtt, ==, 0);
+  g_assert (!nice_agent_get_component_stats (agents->lagent, agents->ls_id, 2,
+          &lstats));
+
+  nice_agent_attach_recv (agents->lagent, agents->ls_id, 1, agents->context,
+      cb_nice_recv, &data);
+  nice_agent_attach_recv (agents->ragent, agents->rs_id, 1, agents->context,
+      cb_nice_recv, &data);
+
+  g_assert (nice_agent_gather_candidates (agents->lagent, agents->ls_id));
+  g_assert (nice_agent_gather_candidates (agents->ragent, agents->rs_id));
+
+  deadline = g_get_monotonic_time () + 30 * G_USEC_PER_SEC;
+
+  while (agents->gathering_done < 2) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate_test_agents (agents);
+  }
+
+  set_credentials_and_candidates (agents->lagent, agents->ls_id,
+      agents->ragent, agents->rs_id);
+  set_credentials_and_candidates (agents->ragent, agents->rs_id,
+      agents->lagent, agents->ls_id);
+
+  while (!data.connected) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate_test_agents (agents);
+  }
+
+  memset (payload, 0xab, sizeof (payload));
+  for (i = 0; i < N_MESSAGES; i++)
+    g_assert_cmpint (nice_agent_send (agents->lagent, agents->ls_id, 1,
+            sizeof (payload), (const gchar *) payload), ==, sizeof (payload));
+
+  while (data.bytes_received < N_MESSAGES * MESSAGE_SIZE) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate_test_agents (agents);
+  }
+
+  g_assert (nice_agent_get_component_stats (agents->lagent, agents->ls_id, 1,
+          &lstats));
+  g_assert (nice_agent_get_component_stats (agents->ragent, agents->rs_id, 1,
+          &rstats));
+
+  /* Pseudo-TCP adds headers, ACKs and its handshake to the data. */
+  if (reliable) {
+    g_assert_cmpuint (lstats.bytes_sent, >, N_MESSAGES * MESSAGE_SIZE);
+    g_assert_cmpuint (rstats.bytes_received, >, N_MESSAGES * MESSAGE_SIZE);
+    g_assert_cmpuint (lstats.tcp_cwnd, >, 0);
+  } else {
+    g_assert_cmpuint (lstats.packets_sent, ==, N_MESSAGES);
+    g_assert_cmpuint (lstats.bytes_sent, ==, N_MESSAGES * MESSAGE_SIZE);
+    g_assert_cmpuint (rstats.packets_received, ==, N_MESSAGES);
+    g_assert_cmpuint (rstats.bytes_received, ==, N_MESSAGES * MESSAGE_SIZE);
+    g_assert_cmpuint (lstats.tcp_cwnd, ==, 0);
+  }
+
+  /* Both sides ran connectivity checks, and the left one got answers. */
+  g_assert_cmpuint (lstats.stun_requests_sent, >, 0);
+  g_assert_cmpuint (lstats.stun_responses_received, >, 0);
+  g_assert_cmpuint (rstats.stun_requests_received, >, 0);
+  g_assert_cmpuint (rstats.stun_responses_sent, >, 0);
+  g_assert_cmpuint (lstats.rtt, >, 0);
+  g_assert_cmpuint (lstats.smoothed_rtt, >, 0);
+  g_assert_cmpuint (lstats.packets_dropped, ==, 0);
+
+  check_pair_stats (&data);
+  check_timeline (&data);
+
+  g_object_unref (agents->lagent);
+  g_object_unref (agents->ragent);
+  g_main_context_unref (agents->context);
+}
+
+static void
+test_datagram (void)
+{
+  run_test (FALSE);
+}
+
+static void
+test_reliable (void)
+{
+  run_test (TRUE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+
+#ifdef G_OS_WIN32
+  WSADATA w;
+
+  WSAStartup (0x0202, &w);
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/component-stats/datagram", test_datagram);
+  g_test_add_func ("/component-stats/reliable", test_reliable);
+
+  ret = g_test_run ();
+
+#ifdef G_OS_WIN32
+  WSACleanup ();
+#endif
+
+  return ret;
+}
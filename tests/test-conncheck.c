@@ -0,0 +1,808 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+/* Check the scheduling of connectivity checks against a peer faked with plain
+ * sockets, so that the test decides which checks are answered, and when and
+ * from where the peer sends its own. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "agent.h"
+#include "agent-priv.h"
+#include "stun/usages/ice.h"
+#include "test-agent-common.h"
+
+#include <string.h>
+
+#define MAX_CANDIDATES 8
+
+#define PEER_UFRAG "peerufrag"
+#define PEER_PASSWORD "peerpassword0123456789"
+
+typedef struct _TestData TestData;
+
+typedef struct _FakeCandidate FakeCandidate;
+
+struct _FakeCandidate {
+  GSocket *socket;
+  NiceAddress addr;
+  guint32 priority;
+  gchar foundation[NICE_CANDIDATE_MAX_FOUNDATION];
+  gboolean respond;             /* answer the checks of the agent */
+  FakeCandidate *reply_via;     /* candidate to answer from, if not this one */
+  gboolean duplicate;           /* send each answer twice */
+  guint n_checks;               /* checks received from the agent */
+  gint rank;                    /* order of the first of them, or -1 */
+};
+
+struct _TestData {
+  TestAgents agents;            /* only the left agent, the peer is faked */
+  NiceAgentOption options;      /* of the agent, set before setup() */
+  StunAgent stun;
+  StunDefaultValidaterData validater[2];
+  gchar *ufrag, *password;      /* credentials of the agent */
+  NiceAddress agent_addr;       /* host candidate of the agent */
+  gboolean peer_controlling;
+  FakeCandidate cands[MAX_CANDIDATES];
+  guint n_cands;
+  guint n_checked;              /* candidates which received a check */
+  guint n_selected;             /* new-selected-pair emissions */
+
+  /* Called on the first check received by each candidate. */
+  void (*first_check) (TestData *data, FakeCandidate *cand);
+};
+
+static void
+cb_new_selected_pair (NiceAgent *agent, guint stream_id, guint component_id,
+    gchar *lfoundation, gchar *rfoundation, gpointer user_data)
+{
+  TestData *data = user_data;
+
+  data->n_selected++;
+}
+
+static GSocketAddress *
+socket_address_new (const NiceAddress *addr)
+{
+  struct sockaddr_storage ss;
+
+  nice_address_copy_to_sockaddr (addr, (struct sockaddr *) &ss);
+
+  return g_socket_address_new_from_native (&ss, sizeof (struct sockaddr_in));
+}
+
+/* Creates an agent with a single host candidate and @n_cands fake remote
+ * candidates, in decreasing order of priority, each with its own
+ * foundation. The checks start with start_checks(). */
+static void
+setup (TestData *data, gboolean controlling, guint ta, guint n_cands)
+{
+  NiceAgent *agent;
+  GSList *cands;
+  gchar *username;
+  guint i;
+
+  g_assert_cmpuint (n_cands, <=, MAX_CANDIDATES);
+
+  data->agents.context = g_main_context_new ();
+  agent = data->agents.lagent = create_test_agent (&data->agents, controlling,
+      data->options);
+  g_object_set (agent, "stun-pacing-timer", ta, NULL);
+  g_signal_connect (agent, "new-selected-pair",
+      G_CALLBACK (cb_new_selected_pair), data);
+  data->peer_controlling = !controlling;
+
+  data->agents.ls_id = nice_agent_add_stream (agent, 1);
+  g_assert (nice_agent_gather_candidates (agent, data->agents.ls_id));
+
+  while (data->agents.gathering_done < 1)
+    iterate_test_agents (&data->agents);
+
+  cands = nice_agent_get_local_candidates (agent, data->agents.ls_id, 1);
+  g_assert_cmpuint (g_slist_length (cands), ==, 1);
+  data->agent_addr = ((NiceCandidate *) cands->data)->addr;
+  g_slist_free_full (cands, (GDestroyNotify) nice_candidate_free);
+
+  nice_agent_get_local_credentials (agent, data->agents.ls_id, &data->ufrag,
+      &data->password);
+
+  /* The checks of the agent are signed with the password of the peer. */
+  username = g_strdup_printf ("%s:%s", PEER_UFRAG, data->ufrag);
+  data->validater[0].username = (uint8_t *) username;
+  data->validater[0].username_len = strlen (username);
+  data->validater[0].password = (uint8_t *) PEER_PASSWORD;
+  data->validater[0].password_len = strlen (PEER_PASSWORD);
+
+  stun_agent_init (&data->stun, STUN_ALL_KNOWN_ATTRIBUTES,
+      STUN_COMPATIBILITY_RFC5389,
+      STUN_AGENT_USAGE_SHORT_TERM_CREDENTIALS |
+      STUN_AGENT_USAGE_USE_FINGERPRINT);
+
+  for (i = 0; i < n_cands; i++) {
+    FakeCandidate *cand = &data->cands[i];
+    GSocketAddress *addr;
+    struct sockaddr_storage ss;
+    GError *error = NULL;
+
+    cand->socket = g_socket_new (G_SOCKET_FAMILY_IPV4,
+        G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, &error);
+    g_assert_no_error (error);
+    g_socket_set_blocking (cand->socket, FALSE);
+
+    addr = g_inet_socket_address_new_from_string ("127.0.0.1", 0);
+    g_assert (g_socket_bind (cand->socket, addr, FALSE, &error));
+    g_assert_no_error (error);
+    g_object_unref (addr);
+
+    addr = g_socket_get_local_address (cand->socket, &error);
+    g_assert_no_error (error);
+    g_assert (g_socket_address_to_native (addr, &ss, sizeof (ss), &error));
+    g_assert_no_error (error);
+    nice_address_set_from_sockaddr (&cand->addr, (struct sockaddr *) &ss);
+    g_object_unref (addr);
+
+    cand->priority = 1000 * (n_cands - i);
+    g_snprintf (cand->foundation, sizeof (cand->foundation), "%u", i + 1);
+    cand->rank = -1;
+  }
+  data->n_cands = n_cands;
+}
+
+static void
+teardown (TestData *data)
+{
+  guint i;
+
+  for (i = 0; i < data->n_cands; i++)
+    g_object_unref (data->cands[i].socket);
+
+  g_free ((gchar *) data->validater[0].username);
+  g_free (data->ufrag);
+  g_free (data->password);
+  g_object_unref (data->agents.lagent);
+  g_main_context_unref (data->agents.context);
+}
+
+/* Gives the fake candidates to the agent, which starts checking them. */
+static void
+start_checks (TestData *data)
+{
+  GSList *cands = NULL;
+  guint i;
+
+  g_assert (nice_agent_set_remote_credentials (data->agents.lagent,
+          data->agents.ls_id, PEER_UFRAG, PEER_PASSWORD));
+
+  for (i = 0; i < data->n_cands; i++) {
+    NiceCandidate *cand = nice_candidate_new (NICE_CANDIDATE_TYPE_HOST);
+
+    cand->transport = NICE_CANDIDATE_TRANSPORT_UDP;
+    cand->component_id = 1;
+    cand->stream_id = data->agents.ls_id;
+    cand->addr = data->cands[i].addr;
+    cand->base_addr = data->cands[i].addr;
+    cand->priority = data->cands[i].priority;
+    g_strlcpy (cand->foundation, data->cands[i].foundation,
+        NICE_CANDIDATE_MAX_FOUNDATION);
+    cands = g_slist_append (cands, cand);
+  }
+
+  g_assert_cmpint (nice_agent_set_remote_candidates (data->agents.lagent,
+          data->agents.ls_id, 1, cands), ==, data->n_cands);
+  g_slist_free_full (cands, (GDestroyNotify) nice_candidate_free);
+}
+
+static void
+send_to_agent (TestData *data, FakeCandidate *cand, const uint8_t *buf,
+    gsize len)
+{
+  GSocketAddress *addr = socket_address_new (&data->agent_addr);
+  GError *error = NULL;
+
+  g_assert_cmpint (g_socket_send_to (cand->socket, addr, (const gchar *) buf,
+          len, NULL, &error), ==, len);
+  g_assert_no_error (error);
+  g_object_unref (addr);
+}
+
+/* Sends a check to the agent from @cand, as the peer would. */
+static void
+send_check (TestData *data, FakeCandidate *cand, gboolean use_candidate,
+    guint64 tie_breaker)
+{
+  gchar *username = g_strdup_printf ("%s:%s", data->ufrag, PEER_UFRAG);
+  uint8_t buf[STUN_MAX_MESSAGE_SIZE_IPV4];
+  StunMessage msg;
+  gsize len;
+
+  len = stun_usage_ice_conncheck_create (&data->stun, &msg, buf, sizeof (buf),
+      (uint8_t *) username, strlen (username),
+      (uint8_t *) data->password, strlen (data->password),
+      use_candidate, data->peer_controlling, cand->priority, tie_breaker,
+      NULL, STUN_USAGE_ICE_COMPATIBILITY_RFC5245);
+  g_assert_cmpuint (len, >, 0);
+
+  send_to_agent (data, cand, buf, len);
+  g_free (username);
+}
+
+/* Answers the check @req of the agent received on @cand. */
+static void
+reply_to_check (TestData *data, FakeCandidate *cand, StunMessage *req,
+    GSocketAddress *from)
+{
+  uint8_t buf[STUN_MAX_MESSAGE_SIZE_IPV4];
+  struct sockaddr_storage ss;
+  StunMessage resp;
+  bool control = data->peer_controlling;
+  size_t len = sizeof (buf);
+
+  g_assert (g_socket_address_to_native (from, &ss, sizeof (ss), NULL));
+  g_assert_cmpint (stun_usage_ice_conncheck_create_reply (&data->stun, req,
+          &resp, buf, &len, &ss, g_socket_address_get_native_size (from),
+          &control, 0, STUN_USAGE_ICE_COMPATIBILITY_RFC5245), ==,
+      STUN_USAGE_ICE_RETURN_SUCCESS);
+
+  send_to_agent (data, cand->reply_via ? cand->reply_via : cand, buf, len);
+  if (cand->duplicate)
+    send_to_agent (data, cand, buf, len);
+}
+
+/* Handles what the agent sent to @cand. Returns FALSE once there is
+ * nothing left to read. */
+static gboolean
+receive_on_candidate (TestData *data, FakeCandidate *cand)
+{
+  uint8_t buf[STUN_MAX_MESSAGE_SIZE_IPV6];
+  GSocketAddress *from = NULL;
+  GError *error = NULL;
+  StunMessage msg;
+  gssize len;
+
+  len = g_socket_receive_from (cand->socket, &from, (gchar *) buf,
+      sizeof (buf), NULL, &error);
+  if (len < 0) {
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
+    g_clear_error (&error);
+    return FALSE;
+  }
+
+  /* Responses to the checks of the peer need no handling. */
+  if (stun_agent_validate (&data->stun, &msg, buf, len,
+          stun_agent_default_validater, data->validater) ==
+      STUN_VALIDATION_SUCCESS &&
+      stun_message_get_class (&msg) == STUN_REQUEST &&
+      stun_message_get_method (&msg) == STUN_BINDING) {
+    if (cand->n_checks++ == 0) {
+      cand->rank = data->n_checked++;
+      if (data->first_check)
+        data->first_check (data, cand);
+    }
+    if (cand->respond)
+      reply_to_check (data, cand, &msg, from);
+  }
+
+  g_object_unref (from);
+  return TRUE;
+}
+
+static void
+iterate (TestData *data)
+{
+  guint i;
+
+  iterate_test_agents (&data->agents);
+
+  for (i = 0; i < data->n_cands; i++)
+    while (receive_on_candidate (data, &data->cands[i]));
+}
+
+static void
+iterate_for (TestData *data, guint ms)
+{
+  gint64 end = g_get_monotonic_time () + ms * 1000;
+
+  while (g_get_monotonic_time () < end)
+    iterate (data);
+}
+
+static void
+wait_for_checks (TestData *data, guint n_checked)
+{
+  gint64 deadline = g_get_monotonic_time () + 10 * G_USEC_PER_SEC;
+
+  while (data->n_checked < n_checked) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate (data);
+  }
+}
+
+static void
+wait_for_selected_pair (TestData *data)
+{
+  gint64 deadline = g_get_monotonic_time () + 10 * G_USEC_PER_SEC;
+
+  while (data->n_selected == 0) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate (data);
+  }
+}
+
+/* Returns the statistics of the pair with @cand, or NULL if it is not in
+ * the check list. */
+static NiceCandidatePairStats *
+find_pair_stats (GSList *pairs, FakeCandidate *cand)
+{
+  GSList *i;
+
+  for (i = pairs; i; i = i->next) {
+    NiceCandidatePairStats *stats = i->data;
+
+    if (nice_address_equal (&stats->remote->addr, &cand->addr))
+      return stats;
+  }
+
+  return NULL;
+}
+
+/* Pairs are checked in decreasing priority order, with a single waiting pair
+ * per foundation at first. Pairs of equal priority are all checked, before
+ * any pair of lower priority. */
+static void
+test_priority_order (void)
+{
+  TestData data = { 0, };
+  GSList *pairs, *i;
+  guint64 priority = G_MAXUINT64;
+
+  setup (&data, TRUE, 20, 7);
+
+  data.cands[0].priority = 100;
+  data.cands[1].priority = 300;
+  data.cands[2].priority = 200;
+  data.cands[3].priority = 300;
+  data.cands[4].priority = 50;
+
+  /* Only one of those two is unfrozen before the other foundations are all
+   * checked. */
+  data.cands[5].priority = 300;
+  data.cands[6].priority = 300;
+  g_strlcpy (data.cands[6].foundation, data.cands[5].foundation,
+      NICE_CANDIDATE_MAX_FOUNDATION);
+
+  start_checks (&data);
+  wait_for_checks (&data, 7);
+
+  g_assert_cmpint (MAX (data.cands[1].rank, data.cands[3].rank), <=, 2);
+  g_assert_cmpint (MIN (data.cands[5].rank, data.cands[6].rank), <=, 2);
+  g_assert_cmpint (data.cands[2].rank, ==, 3);
+  g_assert_cmpint (data.cands[0].rank, ==, 4);
+  g_assert_cmpint (data.cands[4].rank, ==, 5);
+  g_assert_cmpint (MAX (data.cands[5].rank, data.cands[6].rank), ==, 6);
+
+  /* The check list is sorted the same way. */
+  pairs = nice_agent_get_candidate_pair_stats (data.agents.lagent,
+      data.agents.ls_id, 1);
+  g_assert_cmpuint (g_slist_length (pairs), ==, 7);
+  for (i = pairs; i; i = i->next) {
+    NiceCandidatePairStats *stats = i->data;
+
+    g_assert_cmpuint (stats->priority, <=, priority);
+    priority = stats->priority;
+  }
+  g_slist_free_full (pairs, (GDestroyNotify) nice_candidate_pair_stats_free);
+
+  teardown (&data);
+}
+
+/* Pairs of equal priority are checked in check list order. */
+static void
+test_priority_ties (void)
+{
+  TestData data = { 0, };
+  GSList *pairs, *i;
+  gint rank = 0;
+  guint j;
+
+  setup (&data, TRUE, 20, 4);
+  for (j = 0; j < data.n_cands; j++)
+    data.cands[j].priority = 300;
+
+  start_checks (&data);
+  wait_for_checks (&data, 4);
+
+  pairs = nice_agent_get_candidate_pair_stats (data.agents.lagent,
+      data.agents.ls_id, 1);
+  g_assert_cmpuint (g_slist_length (pairs), ==, 4);
+  for (i = pairs; i; i = i->next) {
+    NiceCandidatePairStats *stats = i->data;
+
+    for (j = 0; j < data.n_cands; j++)
+      if (nice_address_equal (&stats->remote->addr, &data.cands[j].addr))
+        break;
+    g_assert_cmpuint (j, <, data.n_cands);
+    g_assert_cmpint (data.cands[j].rank, ==, rank++);
+  }
+  g_slist_free_full (pairs, (GDestroyNotify) nice_candidate_pair_stats_free);
+
+  teardown (&data);
+}
+
+static void
+send_triggering_checks (TestData *data, FakeCandidate *cand)
+{
+  if (cand != &data->cands[0])
+    return;
+
+  send_check (data, &data->cands[3], FALSE, 0);
+  send_check (data, &data->cands[2], FALSE, 0);
+}
+
+/* Triggered checks are sent in the order the checks of the peer arrived,
+ * before the ordinary checks of higher priority pairs. */
+static void
+test_triggered_order (void)
+{
+  TestData data = { 0, };
+
+  setup (&data, TRUE, 100, 4);
+  data.first_check = send_triggering_checks;
+
+  start_checks (&data);
+  wait_for_checks (&data, 4);
+
+  g_assert_cmpint (data.cands[0].rank, ==, 0);
+  g_assert_cmpint (data.cands[3].rank, ==, 1);
+  g_assert_cmpint (data.cands[2].rank, ==, 2);
+  g_assert_cmpint (data.cands[1].rank, ==, 3);
+
+  teardown (&data);
+}
+
+static void
+send_nominating_check (TestData *data, FakeCandidate *cand)
+{
+  if (cand == &data->cands[0])
+    send_check (data, &data->cands[3], TRUE, 0);
+}
+
+/* Once a pair is selected, the waiting and frozen pairs of the component
+ * are removed, but a higher priority check in progress is kept. */
+static void
+test_prune_after_nomination (void)
+{
+  TestData data = { 0, };
+  GSList *pairs;
+  NiceCandidatePairStats *stats;
+
+  /* The peer nominates the lowest priority pair while the first check, on
+   * the highest priority one, is left unanswered. */
+  setup (&data, FALSE, 100, 4);
+  data.first_check = send_nominating_check;
+  data.cands[3].respond = TRUE;
+
+  start_checks (&data);
+  wait_for_selected_pair (&data);
+
+  g_assert_cmpint (data.cands[0].rank, ==, 0);
+  g_assert_cmpint (data.cands[3].rank, ==, 1);
+
+  pairs = nice_agent_get_candidate_pair_stats (data.agents.lagent,
+      data.agents.ls_id, 1);
+  g_assert_cmpuint (g_slist_length (pairs), ==, 2);
+  stats = find_pair_stats (pairs, &data.cands[3]);
+  g_assert (stats != NULL && stats->nominated && stats->selected);
+  stats = find_pair_stats (pairs, &data.cands[0]);
+  g_assert (stats != NULL && !stats->valid);
+  g_slist_free_full (pairs, (GDestroyNotify) nice_candidate_pair_stats_free);
+
+  /* The pruned pairs are never checked. */
+  iterate_for (&data, 500);
+  g_assert_cmpuint (data.cands[1].n_checks, ==, 0);
+  g_assert_cmpuint (data.cands[2].n_checks, ==, 0);
+
+  teardown (&data);
+}
+
+/* Responses are matched to the pair of their request by transaction, so
+ * that a response from another address fails the pair it answers, and a
+ * response already received is ignored. */
+static void
+test_reply_by_transaction (void)
+{
+  TestData data = { 0, };
+  GSList *pairs;
+  NiceCandidatePairStats *stats;
+
+  setup (&data, TRUE, 100, 2);
+  data.cands[0].respond = TRUE;
+  data.cands[0].reply_via = &data.cands[1];
+  data.cands[1].respond = TRUE;
+  data.cands[1].duplicate = TRUE;
+
+  start_checks (&data);
+  wait_for_checks (&data, 2);
+  iterate_for (&data, 300);
+
+  pairs = nice_agent_get_candidate_pair_stats (data.agents.lagent,
+      data.agents.ls_id, 1);
+  stats = find_pair_stats (pairs, &data.cands[0]);
+  g_assert (stats != NULL && !stats->valid);
+  g_assert_cmpuint (stats->responses_received, ==, 1);
+  stats = find_pair_stats (pairs, &data.cands[1]);
+  g_assert (stats != NULL && stats->valid);
+  g_assert_cmpuint (stats->responses_received, ==, data.cands[1].n_checks);
+  g_slist_free_full (pairs, (GDestroyNotify) nice_candidate_pair_stats_free);
+
+  teardown (&data);
+}
+
+/* Returns how many candidates are checked in the first tick of the
+ * connectivity check timer, with @rate as NiceAgent:stun-pacing-rate. */
+static guint
+checks_in_first_tick (guint rate)
+{
+  TestData data = { 0, };
+  guint value;
+  guint n_checked;
+
+  setup (&data, TRUE, 500, 8);
+  g_object_get (data.agents.lagent, "stun-pacing-rate", &value, NULL);
+  g_assert_cmpuint (value, ==, 0);
+  g_object_set (data.agents.lagent, "stun-pacing-rate", rate, NULL);
+  g_object_get (data.agents.lagent, "stun-pacing-rate", &value, NULL);
+  g_assert_cmpuint (value, ==, rate);
+
+  start_checks (&data);
+  wait_for_checks (&data, 1);
+  iterate_for (&data, 200);
+  n_checked = data.n_checked;
+
+  teardown (&data);
+
+  return n_checked;
+}
+
+/* Without a pacing rate, a single check is sent per tick. With one, the
+ * checks of a tick are bounded by its share of the rate: 500 bytes here,
+ * and a check takes more than 80 of them. */
+static void
+test_pacing_rate (void)
+{
+  guint n_checked;
+
+  g_assert_cmpuint (checks_in_first_tick (0), ==, 1);
+
+  n_checked = checks_in_first_tick (1000);
+  g_assert_cmpuint (n_checked, >, 1);
+  g_assert_cmpuint (n_checked, <=, 500 / 80 + 1);
+}
+
+/* Returns the statistics of the selected pair, to be freed with
+ * nice_candidate_pair_stats_free(). */
+static NiceCandidatePairStats *
+get_selected_pair_stats (TestData *data)
+{
+  NiceCandidatePairStats *ret = NULL;
+  GSList *pairs, *i;
+
+  pairs = nice_agent_get_candidate_pair_stats (data->agents.lagent,
+      data->agents.ls_id, 1);
+  for (i = pairs; i; i = i->next) {
+    NiceCandidatePairStats *stats = i->data;
+
+    if (stats->selected) {
+      ret = stats;
+      i->data = NULL;
+      break;
+    }
+  }
+  g_slist_free_full (pairs, (GDestroyNotify) nice_candidate_pair_stats_free);
+  g_assert (ret != NULL);
+
+  return ret;
+}
+
+/* Consent is refreshed by the responses to the consent checks. Once they
+ * stop for the consent timeout, the component fails, and sending on it is
+ * refused. */
+static void
+test_consent_expiry (void)
+{
+  TestData data = { 0, };
+  NiceCandidatePairStats *stats;
+  NiceOutputMessage message;
+  GOutputVector buffer = { "hello", 5 };
+  GError *error = NULL;
+  NiceComponentState state;
+  gint64 deadline;
+  guint n_checks;
+
+  data.options = NICE_AGENT_OPTION_CONSENT_FRESHNESS;
+  setup (&data, TRUE, 20, 1);
+  data.agents.lagent->consent_interval = 100;
+  data.agents.lagent->consent_timeout = 500;
+  data.cands[0].respond = TRUE;
+
+  start_checks (&data);
+  wait_for_selected_pair (&data);
+
+  /* Consent checks are sent, and their responses keep consent. */
+  n_checks = data.cands[0].n_checks;
+  iterate_for (&data, 1000);
+  g_assert_cmpuint (data.cands[0].n_checks - n_checks, >=, 5);
+  state = nice_agent_get_component_state (data.agents.lagent,
+      data.agents.ls_id, 1);
+  g_assert_cmpint (state, !=, NICE_COMPONENT_STATE_FAILED);
+
+  stats = get_selected_pair_stats (&data);
+  g_assert_cmpint (stats->consent_time, >, 0);
+  g_assert_cmpint (g_get_monotonic_time () - stats->consent_time, <,
+      500 * 1000);
+  g_assert (!stats->consent_lost);
+  nice_candidate_pair_stats_free (stats);
+
+  /* The peer stops answering. */
+  data.cands[0].respond = FALSE;
+  deadline = g_get_monotonic_time () + 10 * G_USEC_PER_SEC;
+  while (state != NICE_COMPONENT_STATE_FAILED) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate (&data);
+    state = nice_agent_get_component_state (data.agents.lagent,
+        data.agents.ls_id, 1);
+  }
+
+  stats = get_selected_pair_stats (&data);
+  g_assert (stats->consent_lost);
+  g_assert_cmpint (g_get_monotonic_time () - stats->consent_time, >=,
+      500 * 1000);
+  nice_candidate_pair_stats_free (stats);
+
+  message.buffers = &buffer;
+  message.n_buffers = 1;
+  g_assert_cmpint (nice_agent_send_messages_nonblocking (data.agents.lagent,
+          data.agents.ls_id, 1, &message, 1, NULL, &error), ==, -1);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE);
+  g_clear_error (&error);
+
+  teardown (&data);
+}
+
+/* Past max-connectivity-checks, the lowest priority frozen pairs are
+ * dropped from the check list, and never checked. */
+static void
+test_check_list_limit (void)
+{
+  TestData data = { 0, };
+  GSList *pairs;
+  guint i;
+
+  setup (&data, TRUE, 20, 6);
+  g_object_set (data.agents.lagent, "max-connectivity-checks", 3, NULL);
+
+  start_checks (&data);
+
+  pairs = nice_agent_get_candidate_pair_stats (data.agents.lagent,
+      data.agents.ls_id, 1);
+  g_assert_cmpuint (g_slist_length (pairs), ==, 3);
+  for (i = 0; i < 3; i++)
+    g_assert (find_pair_stats (pairs, &data.cands[i]) != NULL);
+  g_slist_free_full (pairs, (GDestroyNotify) nice_candidate_pair_stats_free);
+
+  wait_for_checks (&data, 3);
+  iterate_for (&data, 300);
+  for (i = 3; i < 6; i++)
+    g_assert_cmpuint (data.cands[i].n_checks, ==, 0);
+
+  teardown (&data);
+}
+
+/* When a check of the peer makes the agent change its role, the priorities
+ * of the pairs are recalculated for the new role before the check is
+ * handled, and not on the next tick. */
+static void
+test_role_conflict (void)
+{
+  TestData data = { 0, };
+  gboolean controlling = TRUE;
+  guint64 priority = G_MAXUINT64;
+  GSList *pairs, *i;
+  gint64 deadline;
+
+  /* No tick happens during the test. */
+  setup (&data, TRUE, 5000, 4);
+  start_checks (&data);
+
+  /* The peer claims the controlling role with the highest tie-breaker. */
+  data.peer_controlling = TRUE;
+  send_check (&data, &data.cands[1], FALSE, G_MAXUINT64);
+
+  deadline = g_get_monotonic_time () + 2 * G_USEC_PER_SEC;
+  while (controlling) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate (&data);
+    g_object_get (data.agents.lagent, "controlling-mode", &controlling, NULL);
+  }
+
+  pairs = nice_agent_get_candidate_pair_stats (data.agents.lagent,
+      data.agents.ls_id, 1);
+  g_assert_cmpuint (g_slist_length (pairs), ==, 4);
+  for (i = pairs; i; i = i->next) {
+    NiceCandidatePairStats *stats = i->data;
+
+    g_assert_cmpuint (stats->priority, ==, nice_candidate_pair_priority (
+            stats->remote->priority, stats->local->priority));
+    g_assert_cmpuint (stats->priority, <=, priority);
+    priority = stats->priority;
+  }
+  g_slist_free_full (pairs, (GDestroyNotify) nice_candidate_pair_stats_free);
+
+  teardown (&data);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+
+#ifdef G_OS_WIN32
+  WSADATA w;
+
+  WSAStartup (0x0202, &w);
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/conncheck/priority-order", test_priority_order);
+  g_test_add_func ("/conncheck/priority-ties", test_priority_ties);
+  g_test_add_func ("/conncheck/triggered-order", test_triggered_order);
+  g_test_add_func ("/conncheck/prune-after-nomination",
+      test_prune_after_nomination);
+  g_test_add_func ("/conncheck/reply-by-transaction",
+      test_reply_by_transaction);
+  g_test_add_func ("/conncheck/pacing-rate", test_pacing_rate);
+  g_test_add_func ("/conncheck/consent-expiry", test_consent_expiry);
+  g_test_add_func ("/conncheck/check-list-limit", test_check_list_limit);
+  g_test_add_func ("/conncheck/role-conflict", test_role_conflict);
+
+  ret = g_test_run ();
+
+#ifdef G_OS_WIN32
+  WSACleanup ();
+#endif
+
+  return ret;
+}
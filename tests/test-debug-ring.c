@@ -0,0 +1,181 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+/* Check that nice_debug_ring_start() records the messages of the enabled
+ * categories only, keeps the last ones, and that nice_debug_ring_dump()
+ * formats them. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "agent.h"
+#include "debug.h"
+
+#include <string.h>
+
+static guint
+count_lines (const gchar *dump, const gchar *needle)
+{
+  gchar **lines = g_strsplit (dump, "\n", -1);
+  guint i, n = 0;
+
+  for (i = 0; lines[i] != NULL; i++)
+    if (strstr (lines[i], needle) != NULL)
+      n++;
+
+  g_strfreev (lines);
+
+  return n;
+}
+
+/* Adds @n_remotes remote candidates to a new stream of a new agent, which
+ * creates as many FROZEN check pairs. */
+static void
+create_check_pairs (guint n_remotes)
+{
+  NiceAgent *agent;
+  NiceAddress addr;
+  GSList *remotes = NULL;
+  guint stream_id, i;
+
+  agent = nice_agent_new (NULL, NICE_COMPATIBILITY_RFC5245);
+  g_object_set (agent, "ice-tcp", FALSE, "upnp", FALSE, NULL);
+
+  g_assert (nice_address_set_from_string (&addr, "127.0.0.1"));
+  nice_agent_add_local_address (agent, &addr);
+
+  stream_id = nice_agent_add_stream (agent, 1);
+  g_assert (nice_agent_gather_candidates (agent, stream_id));
+  g_assert (nice_agent_set_remote_credentials (agent, stream_id,
+          "ufrag", "passwordpasswordpassword"));
+
+  for (i = 0; i < n_remotes; i++) {
+    NiceCandidate *cand = nice_candidate_new (NICE_CANDIDATE_TYPE_HOST);
+
+    cand->stream_id = stream_id;
+    cand->component_id = 1;
+    cand->transport = NICE_CANDIDATE_TRANSPORT_UDP;
+    cand->priority = 1000 + i;
+    g_snprintf (cand->foundation, NICE_CANDIDATE_MAX_FOUNDATION, "%u", i + 1);
+    nice_address_set_from_string (&cand->addr, "127.0.0.1");
+    nice_address_set_port (&cand->addr, 10000 + i);
+    remotes = g_slist_prepend (remotes, cand);
+  }
+
+  g_assert_cmpint (nice_agent_set_remote_candidates (agent, stream_id, 1,
+          remotes), ==, n_remotes);
+  g_slist_free_full (remotes, (GDestroyNotify) nice_candidate_free);
+
+  g_object_unref (agent);
+}
+
+static void
+test_record (void)
+{
+  gchar *dump;
+
+  nice_debug_ring_start (64, "conncheck", FALSE);
+  create_check_pairs (3);
+
+  dump = nice_debug_ring_dump ();
+  g_assert_cmpuint (count_lines (dump, " conncheck Agent 0x"), >=, 3);
+  g_assert_cmpuint (count_lines (dump, "state FROZEN"), >=, 3);
+  g_assert_cmpuint (count_lines (dump, " agent "), ==, 0);
+  g_free (dump);
+
+  nice_debug_ring_stop ();
+
+  dump = nice_debug_ring_dump ();
+  g_assert_cmpstr (dump, ==, "");
+  g_free (dump);
+}
+
+static void
+test_categories (void)
+{
+  gchar *dump;
+
+  /* Pair state changes are not agent messages. */
+  nice_debug_ring_start (64, "agent", TRUE);
+  create_check_pairs (3);
+
+  dump = nice_debug_ring_dump ();
+  g_assert_cmpuint (count_lines (dump, "state FROZEN"), ==, 0);
+  g_free (dump);
+
+  nice_debug_ring_stop ();
+}
+
+static void
+test_wrap (void)
+{
+  gchar *dump;
+
+  nice_debug_ring_start (2, NULL, FALSE);
+  create_check_pairs (5);
+
+  /* Only the last two messages are kept. */
+  dump = nice_debug_ring_dump ();
+  g_assert_cmpuint (count_lines (dump, "Agent"), ==, 2);
+  g_free (dump);
+
+  nice_debug_ring_stop ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+
+#ifdef G_OS_WIN32
+  WSADATA w;
+
+  WSAStartup (0x0202, &w);
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/debug-ring/record", test_record);
+  g_test_add_func ("/debug-ring/categories", test_categories);
+  g_test_add_func ("/debug-ring/wrap", test_wrap);
+
+  ret = g_test_run ();
+
+#ifdef G_OS_WIN32
+  WSACleanup ();
+#endif
+
+  return ret;
+}
@@ -38,6 +38,7 @@
 
 #define RTP_HEADER_SIZE 12
 #define RTP_PAYLOAD_SIZE 1024
+#define N_PENDING_BUFFERS 64
 
 static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
@@ -51,6 +52,7 @@ static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("src",
 
 GMainLoop *loop;
 static gint ready = 0;
+static gint n_components = 1;
 
 
 static GCond cond;
@@ -165,19 +167,22 @@ static void
 cb_candidate_gathering_done (NiceAgent * agent, guint stream_id, gpointer data)
 {
   GSList *candidates;
+  gint c;
 
   g_debug ("Candidates gathered on agent %p, stream: %d",
       agent, stream_id);
 
-  candidates = nice_agent_get_local_candidates (agent, stream_id, 1);
+  for (c = 1; c <= n_components; c++) {
+    candidates = nice_agent_get_local_candidates (agent, stream_id, c);
 
-  nice_agent_set_remote_candidates (NICE_AGENT (data), stream_id, 1,
-      candidates);
+    nice_agent_set_remote_candidates (NICE_AGENT (data), stream_id, c,
+        candidates);
 
-  g_debug ("Got %d candidates", g_slist_length (candidates));
-  g_slist_foreach (candidates, print_candidate, NULL);
+    g_debug ("Got %d candidates", g_slist_length (candidates));
+    g_slist_foreach (candidates, print_candidate, NULL);
 
-  g_slist_free_full (candidates, (GDestroyNotify) nice_candidate_free);
+    g_slist_free_full (candidates, (GDestroyNotify) nice_candidate_free);
+  }
 }
 
 static void
@@ -205,7 +210,7 @@ cb_component_state_changed (NiceAgent * agent, guint stream_id,
 
   if (state == NICE_COMPONENT_STATE_READY) {
     ready++;
-    if (ready >= 2) {
+    if (ready >= 2 * n_components) {
       g_main_loop_quit (loop);
     }
   }
@@ -320,6 +325,318 @@ GST_START_TEST (buffer_list_test)
 
 GST_END_TEST;
 
+static gpointer
+push_pending_buffers (gpointer user_data)
+{
+  GstPad *srcpad = user_data;
+  GstFlowReturn flow_ret = GST_FLOW_OK;
+  GstBuffer *buffer;
+  guint i;
+
+  for (i = 0; i < N_PENDING_BUFFERS && flow_ret == GST_FLOW_OK; i++) {
+    buffer = gst_buffer_new_allocate (NULL, RTP_PAYLOAD_SIZE, NULL);
+    gst_buffer_memset (buffer, 0, i, RTP_PAYLOAD_SIZE);
+    flow_ret = gst_pad_push (srcpad, buffer);
+  }
+
+  return GINT_TO_POINTER (flow_ret);
+}
+
+/* Push N_PENDING_BUFFERS into a reliable nicesink with the given byte budget
+ * before the transport is writable, and check that all of them arrive. If the
+ * budget holds them all, they are pushed without blocking from the test
+ * thread; otherwise the sink must block, so they are pushed from another. */
+static void
+run_reliable_pending (guint max_pending_bytes)
+{
+  GstSegment segment;
+  GstElement *nicesink, *nicesrc;
+  GstPad *srcpad, *sinkpad;
+  NiceAgent *sink_agent, *src_agent;
+  guint sink_stream, src_stream;
+  NiceAddress *addr;
+  GThread *thread = NULL;
+  guint received;
+
+  loop = g_main_loop_new (NULL, TRUE);
+  ready = 0;
+  bytes_received = 0;
+  data_size = N_PENDING_BUFFERS * RTP_PAYLOAD_SIZE;
+
+  addr = nice_address_new ();
+  nice_address_set_from_string (addr, "127.0.0.1");
+
+  sink_agent = nice_agent_new_reliable (NULL, NICE_COMPATIBILITY_RFC5245);
+  src_agent = nice_agent_new_reliable (NULL, NICE_COMPATIBILITY_RFC5245);
+
+  g_object_set (G_OBJECT (sink_agent), "upnp", FALSE, NULL);
+  g_object_set (G_OBJECT (src_agent), "upnp", FALSE, NULL);
+
+  nice_agent_add_local_address (sink_agent, addr);
+  nice_agent_add_local_address (src_agent, addr);
+
+  sink_stream = nice_agent_add_stream (sink_agent, 1);
+  src_stream = nice_agent_add_stream (src_agent, 1);
+
+  nice_agent_attach_recv (sink_agent, sink_stream, NICE_COMPONENT_TYPE_RTP,
+      NULL, recv_cb, NULL);
+  nice_agent_attach_recv (src_agent, src_stream, NICE_COMPONENT_TYPE_RTP,
+      NULL, recv_cb, NULL);
+
+  g_signal_connect (G_OBJECT (sink_agent), "candidate-gathering-done",
+      G_CALLBACK (cb_candidate_gathering_done), src_agent);
+  g_signal_connect (G_OBJECT (src_agent), "candidate-gathering-done",
+      G_CALLBACK (cb_candidate_gathering_done), sink_agent);
+
+  g_signal_connect (G_OBJECT (sink_agent), "component-state-changed",
+      G_CALLBACK (cb_component_state_changed), NULL);
+  g_signal_connect (G_OBJECT (src_agent), "component-state-changed",
+      G_CALLBACK (cb_component_state_changed), NULL);
+
+  credentials_negotiation (sink_agent, src_agent, sink_stream, src_stream);
+  credentials_negotiation (src_agent, sink_agent, src_stream, src_stream);
+
+  nice_agent_gather_candidates (sink_agent, sink_stream);
+  nice_agent_gather_candidates (src_agent, src_stream);
+
+  nicesink = gst_check_setup_element ("nicesink");
+  nicesrc = gst_check_setup_element ("nicesrc");
+
+  g_object_set (nicesink, "agent", sink_agent, "stream", sink_stream,
+      "component", 1, "max-pending-bytes", max_pending_bytes, NULL);
+  g_object_set (nicesrc, "agent", src_agent, "stream", src_stream, "component",
+      1, NULL);
+
+  srcpad = gst_check_setup_src_pad_by_name (nicesink, &srctemplate, "sink");
+  sinkpad = gst_check_setup_sink_pad_by_name (nicesrc, &sinktemplate, "src");
+
+  gst_pad_set_chain_list_function_full (sinkpad, sink_chain_list_function, NULL,
+      NULL);
+  gst_pad_set_chain_function_full (sinkpad, sink_chain_function, NULL, NULL);
+
+  gst_element_set_state (nicesink, GST_STATE_PLAYING);
+  gst_pad_set_active (srcpad, TRUE);
+
+  gst_element_set_state (nicesrc, GST_STATE_PLAYING);
+  gst_pad_set_active (sinkpad, TRUE);
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  if (max_pending_bytes >= data_size)
+    fail_unless_equals_int (GPOINTER_TO_INT (push_pending_buffers (srcpad)),
+        GST_FLOW_OK);
+  else
+    thread = g_thread_new ("push", push_pending_buffers, srcpad);
+
+  g_debug ("Waiting for agents to be ready ready");
+
+  g_main_loop_run (loop);
+
+  /* The sink agent is only serviced by the default main context, which must
+   * keep running for the pseudo-TCP connection to open. */
+  g_debug ("Waiting for buffers");
+
+  do {
+    if (!g_main_context_iteration (NULL, FALSE))
+      g_usleep (1000);
+
+    g_mutex_lock (&mutex);
+    received = bytes_received;
+    g_mutex_unlock (&mutex);
+  } while (received < data_size);
+
+  fail_unless_equals_int (data_size, received);
+  if (thread)
+    fail_unless_equals_int (GPOINTER_TO_INT (g_thread_join (thread)),
+        GST_FLOW_OK);
+
+  gst_check_teardown_pad_by_name (nicesink, "sink");
+  gst_check_teardown_element (nicesink);
+
+  gst_check_teardown_pad_by_name (nicesrc, "src");
+  gst_check_teardown_element (nicesrc);
+
+  g_object_unref (sink_agent);
+  g_object_unref (src_agent);
+  nice_address_free (addr);
+  g_main_loop_unref (loop);
+}
+
+/* With a byte budget, a reliable nicesink must not block while the
+ * transport is not writable: the buffers wait in the sink and are sent once
+ * the pseudo-TCP connection opens. */
+GST_START_TEST (reliable_pending_test)
+{
+  run_reliable_pending (N_PENDING_BUFFERS * RTP_PAYLOAD_SIZE);
+}
+
+GST_END_TEST;
+
+/* Past its budget, a reliable nicesink blocks instead of dropping: every
+ * buffer still arrives. */
+GST_START_TEST (reliable_backpressure_test)
+{
+  run_reliable_pending (8 * RTP_PAYLOAD_SIZE);
+}
+
+GST_END_TEST;
+
+/* A single nicemultisrc and nicemultisink serve both components of a stream,
+ * each through its own request pad. */
+GST_START_TEST (multi_component_test)
+{
+  GstSegment segment;
+  GstElement *nicesink, *nicesrc;
+  GstPad *srcpads[2], *sinkpads[2], *reqpads[2][2];
+  NiceAgent *sink_agent, *src_agent;
+  guint sink_stream, src_stream;
+  NiceAddress *addr;
+  gchar *name;
+  guint c;
+
+  loop = g_main_loop_new (NULL, TRUE);
+  ready = 0;
+  n_components = 2;
+  bytes_received = 0;
+
+  addr = nice_address_new ();
+  nice_address_set_from_string (addr, "127.0.0.1");
+
+  sink_agent = nice_agent_new (NULL, NICE_COMPATIBILITY_RFC5245);
+  src_agent = nice_agent_new (NULL, NICE_COMPATIBILITY_RFC5245);
+
+  g_object_set (G_OBJECT (sink_agent), "upnp", FALSE, NULL);
+  g_object_set (G_OBJECT (src_agent), "upnp", FALSE, NULL);
+
+  nice_agent_add_local_address (sink_agent, addr);
+  nice_agent_add_local_address (src_agent, addr);
+
+  sink_stream = nice_agent_add_stream (sink_agent, 2);
+  src_stream = nice_agent_add_stream (src_agent, 2);
+
+  for (c = 1; c <= 2; c++)
+    nice_agent_attach_recv (sink_agent, sink_stream, c, NULL, recv_cb, NULL);
+
+  g_signal_connect (G_OBJECT (sink_agent), "candidate-gathering-done",
+      G_CALLBACK (cb_candidate_gathering_done), src_agent);
+  g_signal_connect (G_OBJECT (src_agent), "candidate-gathering-done",
+      G_CALLBACK (cb_candidate_gathering_done), sink_agent);
+
+  g_signal_connect (G_OBJECT (sink_agent), "component-state-changed",
+      G_CALLBACK (cb_component_state_changed), NULL);
+  g_signal_connect (G_OBJECT (src_agent), "component-state-changed",
+      G_CALLBACK (cb_component_state_changed), NULL);
+
+  credentials_negotiation (sink_agent, src_agent, sink_stream, src_stream);
+  credentials_negotiation (src_agent, sink_agent, src_stream, src_stream);
+
+  nicesink = gst_check_setup_element ("nicemultisink");
+  nicesrc = gst_check_setup_element ("nicemultisrc");
+
+  g_object_set (nicesink, "agent", sink_agent, NULL);
+  g_object_set (nicesrc, "agent", src_agent, NULL);
+
+  /* The source agent only answers connectivity checks on the components
+   * nicemultisrc has pads for. */
+  for (c = 0; c < 2; c++) {
+    name = g_strdup_printf ("sink_%u_%u", sink_stream, c + 1);
+    reqpads[0][c] = gst_element_get_request_pad (nicesink, name);
+    g_free (name);
+    fail_unless (reqpads[0][c] != NULL);
+
+    name = g_strdup_printf ("src_%u_%u", src_stream, c + 1);
+    reqpads[1][c] = gst_element_get_request_pad (nicesrc, name);
+    g_free (name);
+    fail_unless (reqpads[1][c] != NULL);
+
+    srcpads[c] = gst_pad_new_from_static_template (&srctemplate, "src");
+    sinkpads[c] = gst_pad_new_from_static_template (&sinktemplate, "sink");
+    gst_pad_set_chain_list_function_full (sinkpads[c],
+        sink_chain_list_function, NULL, NULL);
+    gst_pad_set_chain_function_full (sinkpads[c], sink_chain_function, NULL,
+        NULL);
+
+    fail_unless_equals_int (gst_pad_link (srcpads[c], reqpads[0][c]),
+        GST_PAD_LINK_OK);
+    fail_unless_equals_int (gst_pad_link (reqpads[1][c], sinkpads[c]),
+        GST_PAD_LINK_OK);
+  }
+
+  nice_agent_gather_candidates (sink_agent, sink_stream);
+  nice_agent_gather_candidates (src_agent, src_stream);
+
+  gst_element_set_state (nicesink, GST_STATE_PLAYING);
+  gst_element_set_state (nicesrc, GST_STATE_PLAYING);
+
+  for (c = 0; c < 2; c++) {
+    gst_pad_set_active (srcpads[c], TRUE);
+    gst_pad_set_active (sinkpads[c], TRUE);
+
+    gst_pad_push_event (srcpads[c], gst_event_new_stream_start ("test"));
+    gst_segment_init (&segment, GST_FORMAT_TIME);
+    gst_pad_push_event (srcpads[c], gst_event_new_segment (&segment));
+  }
+
+  g_debug ("Waiting for agents to be ready ready");
+
+  g_main_loop_run (loop);
+
+  for (c = 0; c < 2; c++)
+    fail_unless_equals_int (gst_pad_push_list (srcpads[c],
+            create_buffer_list ()), GST_FLOW_OK);
+
+  g_debug ("Waiting for buffers");
+
+  g_mutex_lock (&mutex);
+  while (bytes_received < 2 * data_size) {
+    g_cond_wait (&cond, &mutex);
+  }
+  g_mutex_unlock (&mutex);
+
+  fail_unless_equals_int (2 * data_size, bytes_received);
+
+  /* Releasing a pad must not wait for the running streaming thread to stop
+   * polling the other components. */
+  gst_pad_unlink (reqpads[1][1], sinkpads[1]);
+  gst_element_release_request_pad (nicesrc, reqpads[1][1]);
+  gst_object_unref (reqpads[1][1]);
+  reqpads[1][1] = NULL;
+
+  gst_element_set_state (nicesink, GST_STATE_NULL);
+  gst_element_set_state (nicesrc, GST_STATE_NULL);
+
+  for (c = 0; c < 2; c++) {
+    gst_pad_set_active (srcpads[c], FALSE);
+    gst_pad_set_active (sinkpads[c], FALSE);
+    gst_pad_unlink (srcpads[c], reqpads[0][c]);
+    gst_object_unref (srcpads[c]);
+
+    gst_element_release_request_pad (nicesink, reqpads[0][c]);
+    gst_object_unref (reqpads[0][c]);
+
+    if (reqpads[1][c] != NULL) {
+      gst_pad_unlink (reqpads[1][c], sinkpads[c]);
+      gst_element_release_request_pad (nicesrc, reqpads[1][c]);
+      gst_object_unref (reqpads[1][c]);
+    }
+    gst_object_unref (sinkpads[c]);
+  }
+
+  gst_check_teardown_element (nicesink);
+  gst_check_teardown_element (nicesrc);
+
+  n_components = 1;
+  g_object_unref (sink_agent);
+  g_object_unref (src_agent);
+  nice_address_free (addr);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
+
 static Suite *
 udpsink_suite (void)
 {
@@ -329,6 +646,9 @@ udpsink_suite (void)
   suite_add_tcase (s, tc_chain);
 
   tcase_add_test (tc_chain, buffer_list_test);
+  tcase_add_test (tc_chain, reliable_pending_test);
+  tcase_add_test (tc_chain, reliable_backpressure_test);
+  tcase_add_test (tc_chain, multi_component_test);
 
   return s;
 }
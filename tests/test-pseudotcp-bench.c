@@ -0,0 +1,555 @@
+/* vim: et ts=2 sw=2 tw=80: */
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <locale.h>
+#include <string.h>
+
+#include "pseudotcp.h"
+
+
+/**
+ * A benchmark for the pseudotcp socket. This connects two sockets through a
+ * simulated link and sends data from the left one to the right one.
+ *
+ * Each direction of the link is modelled as a bottleneck of a given bandwidth
+ * with a drop-tail queue in front of it, followed by a propagation delay with
+ * optional jitter. Packets can additionally be lost at random, or held back by
+ * an extra delay so that they arrive out of order.
+ *
+ * Nothing here depends on the wall clock: the simulation keeps its own time,
+ * which is passed to both sockets with pseudo_tcp_socket_set_time(), and jumps
+ * straight from one event to the next. Runs with the same options and seed
+ * therefore give the same results, however loaded the machine is, which makes
+ * it possible to compare congestion control and buffering changes.
+ *
+ * By default the left socket sends as fast as it can (bulk mode). With
+ * --message-interval, it instead sends a message of --message-size bytes at
+ * that interval. In both modes the data is split into messages, and the
+ * latency of each one is measured from the moment it was generated by the
+ * application to the moment its last byte was read on the right.
+ *
+ * At the end of the run, the following is reported:
+ *  • goodput: payload bytes read by the receiving application per second,
+ *    from the moment the connection was established;
+ *  • retransmission ratio: payload bytes put on the wire by the sender,
+ *    divided by payload bytes delivered, minus one;
+ *  • message latency percentiles.
+ */
+
+
+/* Bytes added to every packet on the wire by the IP and UDP headers. */
+#define UDP_IP_OVERHEAD 28
+/* Size of the pseudotcp header, as the payload is counted without it. */
+#define HEADER_SIZE 24
+
+typedef struct {
+  PseudoTcpSocket *to;
+  guint64 busy_until;    /* µs; when the bottleneck has sent its queue */
+  guint64 last_arrival;  /* µs; used to keep jittered packets in order */
+  guint n_packets;
+  guint n_lost;
+  guint n_queue_drops;
+} Link;
+
+typedef struct {
+  guint64 arrival;  /* µs */
+  PseudoTcpSocket *to;
+  guint32 len;
+  guint8 data[];
+} Packet;
+
+typedef struct {
+  gsize size;
+  gsize sent;
+  guint64 created;     /* µs */
+  guint64 end_offset;  /* stream offset just past the message's last byte */
+} Message;
+
+PseudoTcpSocket *left;
+PseudoTcpSocket *right;
+GRand *prng = NULL;
+
+/* Simulation time at which the run starts, in µs. Away from zero since a time
+ * of zero makes the sockets fall back to the monotonic clock. */
+#define START_TIME G_USEC_PER_SEC
+
+/* Current simulation time, in µs. */
+guint64 now = START_TIME;
+
+Link left_to_right = { NULL, };
+Link right_to_left = { NULL, };
+GQueue packets = G_QUEUE_INIT;  /* Packet, in arrival order */
+
+gboolean left_opened = FALSE;
+guint64 opened_time = 0;         /* µs */
+guint64 next_message_time = 0;   /* µs */
+GQueue backlog = G_QUEUE_INIT;   /* Message, not yet fully sent */
+GQueue unacked = G_QUEUE_INIT;   /* Message, sent but not fully received */
+guint64 bytes_queued = 0;        /* payload bytes given to the left socket */
+guint64 bytes_received = 0;      /* payload bytes read from the right socket */
+guint64 bytes_on_wire = 0;       /* payload bytes transmitted by the left */
+GArray *latencies = NULL;        /* gdouble, ms */
+gchar *send_buf = NULL;
+
+/* Configuration options. */
+gint64 seed = 1;
+guint bandwidth = 10000;      /* kbit/s; 0 for unlimited */
+guint delay = 25;             /* ms, one way */
+guint jitter = 0;             /* ms */
+gdouble loss = 0.0;           /* % */
+gdouble reorder = 0.0;        /* % */
+guint reorder_delay = 10;     /* ms */
+guint queue_size = 64 * 1024; /* bytes; 0 for unlimited */
+guint message_size = 1200;    /* bytes */
+guint message_interval = 0;   /* ms; 0 for bulk */
+guint duration = 30;          /* s */
+gboolean pacing = FALSE;
+gboolean rack = FALSE;
+guint min_rto = 0;            /* ms; 0 for the socket's default */
+
+
+static void
+opened (PseudoTcpSocket *sock, gpointer data)
+{
+  if (sock == left) {
+    left_opened = TRUE;
+    opened_time = now;
+    next_message_time = now;
+  }
+}
+
+static void
+readable (PseudoTcpSocket *sock, gpointer data)
+{
+  gchar buf[16 * 1024];
+  gint len;
+
+  do {
+    len = pseudo_tcp_socket_recv (sock, buf, sizeof (buf));
+
+    if (len > 0 && sock == right) {
+      bytes_received += len;
+
+      while (!g_queue_is_empty (&unacked)) {
+        Message *message = g_queue_peek_head (&unacked);
+        gdouble latency;
+
+        if (message->end_offset > bytes_received)
+          break;
+
+        latency = (gdouble) (now - message->created) / 1000.0;
+        g_array_append_val (latencies, latency);
+        g_slice_free (Message, g_queue_pop_head (&unacked));
+      }
+    }
+  } while (len > 0);
+}
+
+static void
+writable (PseudoTcpSocket *sock, gpointer data)
+{
+  /* Data is pushed into the left socket on every step of the simulation, so
+   * there is nothing to do here. */
+}
+
+static void
+closed (PseudoTcpSocket *sock, guint32 err, gpointer data)
+{
+  g_printerr ("Socket %p closed: %s\n", sock, g_strerror (err));
+}
+
+static PseudoTcpWriteResult
+write_packet (PseudoTcpSocket *sock, const gchar *buffer, guint32 len,
+    gpointer user_data)
+{
+  Link *link = (sock == left) ? &left_to_right : &right_to_left;
+  guint32 wire_len = len + UDP_IP_OVERHEAD;
+  guint64 start, arrival;
+  Packet *packet;
+
+  link->n_packets++;
+
+  if (sock == left && len > HEADER_SIZE)
+    bytes_on_wire += len - HEADER_SIZE;
+
+  /* Queue behind whatever the bottleneck is still sending, dropping the packet
+   * if the queue is full. */
+  start = MAX (now, link->busy_until);
+
+  if (bandwidth > 0) {
+    guint64 queued = (start - now) * bandwidth / 8000;
+
+    if (queue_size > 0 && queued + wire_len > queue_size) {
+      link->n_queue_drops++;
+      return WR_SUCCESS;
+    }
+
+    link->busy_until = start + (guint64) wire_len * 8000 / bandwidth;
+  } else {
+    link->busy_until = start;
+  }
+
+  /* Random loss happens past the bottleneck, so lost packets still use up
+   * bandwidth. */
+  if (loss > 0.0 && g_rand_double (prng) * 100.0 < loss) {
+    link->n_lost++;
+    return WR_SUCCESS;
+  }
+
+  arrival = link->busy_until + (guint64) delay * 1000;
+  if (jitter > 0)
+    arrival += g_rand_int_range (prng, 0, jitter * 1000 + 1);
+
+  /* Jitter alone doesn’t reorder packets; only --reorder does. */
+  arrival = MAX (arrival, link->last_arrival);
+  link->last_arrival = arrival;
+
+  if (reorder > 0.0 && g_rand_double (prng) * 100.0 < reorder)
+    arrival += (guint64) reorder_delay * 1000;
+
+  packet = g_malloc (sizeof (Packet) + len);
+  packet->arrival = arrival;
+  packet->to = link->to;
+  packet->len = len;
+  memcpy (packet->data, buffer, len);
+
+  /* Packets are almost always appended, so search from the tail. */
+  {
+    GList *l;
+
+    for (l = packets.tail; l != NULL; l = l->prev) {
+      if (((Packet *) l->data)->arrival <= arrival)
+        break;
+    }
+
+    if (l == NULL)
+      g_queue_push_head (&packets, packet);
+    else
+      g_queue_insert_after (&packets, l, packet);
+  }
+
+  return WR_SUCCESS;
+}
+
+static void
+queue_message (void)
+{
+  Message *message = g_slice_new0 (Message);
+
+  message->size = message_size;
+  message->created = now;
+  g_queue_push_tail (&backlog, message);
+}
+
+/* Hand as much of the backlog to the left socket as it will accept. In bulk
+ * mode, new messages are generated for as long as there is space for them. */
+static void
+push_messages (void)
+{
+  while (TRUE) {
+    Message *message;
+    gint len;
+
+    if (g_queue_is_empty (&backlog)) {
+      if (message_interval > 0 ||
+          pseudo_tcp_socket_get_available_send_space (left) == 0)
+        break;
+
+      queue_message ();
+    }
+
+    message = g_queue_peek_head (&backlog);
+    len = pseudo_tcp_socket_send (left, send_buf,
+        message->size - message->sent);
+    if (len <= 0)
+      break;
+
+    message->sent += len;
+    bytes_queued += len;
+
+    if (message->sent == message->size) {
+      message->end_offset = bytes_queued;
+      g_queue_push_tail (&unacked, g_queue_pop_head (&backlog));
+    }
+  }
+}
+
+static void
+clock_socket (PseudoTcpSocket *sock)
+{
+  guint64 timeout = 0;
+
+  if (pseudo_tcp_socket_get_next_clock (sock, &timeout) &&
+      timeout <= now / 1000)
+    pseudo_tcp_socket_notify_clock (sock);
+}
+
+/* Returns the time of the next clock event of @sock, in µs. */
+static guint64
+next_clock (PseudoTcpSocket *sock)
+{
+  guint64 timeout = 0;
+
+  if (!pseudo_tcp_socket_get_next_clock (sock, &timeout))
+    return G_MAXUINT64;
+
+  /* The sockets only have millisecond resolution. */
+  if (timeout <= now / 1000)
+    return (now / 1000 + 1) * 1000;
+
+  return timeout * 1000;
+}
+
+static void
+run (void)
+{
+  guint64 end_time = now + (guint64) duration * G_USEC_PER_SEC;
+
+  while (now < end_time) {
+    guint64 next_event = end_time;
+    Packet *packet;
+
+    pseudo_tcp_socket_set_time (left, now / 1000);
+    pseudo_tcp_socket_set_time (right, now / 1000);
+
+    while ((packet = g_queue_peek_head (&packets)) != NULL &&
+        packet->arrival <= now) {
+      g_queue_pop_head (&packets);
+      pseudo_tcp_socket_notify_packet (packet->to,
+          (const gchar *) packet->data, packet->len);
+      g_free (packet);
+    }
+
+    clock_socket (left);
+    clock_socket (right);
+
+    if (left_opened) {
+      while (message_interval > 0 && next_message_time <= now) {
+        queue_message ();
+        next_message_time += (guint64) message_interval * 1000;
+      }
+
+      push_messages ();
+    }
+
+    /* Jump to the next event. */
+    next_event = MIN (next_event, next_clock (left));
+    next_event = MIN (next_event, next_clock (right));
+
+    packet = g_queue_peek_head (&packets);
+    if (packet != NULL)
+      next_event = MIN (next_event, packet->arrival);
+
+    if (left_opened && message_interval > 0)
+      next_event = MIN (next_event, next_message_time);
+
+    now = MAX (next_event, now + 1);
+  }
+}
+
+static gint
+compare_doubles (gconstpointer a, gconstpointer b)
+{
+  gdouble x = *(const gdouble *) a, y = *(const gdouble *) b;
+
+  return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of the sorted @latencies. */
+static gdouble
+percentile (gdouble p)
+{
+  guint rank;
+
+  if (latencies->len == 0)
+    return 0.0;
+
+  rank = (guint) (p / 100.0 * latencies->len + 0.999999);
+  rank = CLAMP (rank, 1, latencies->len);
+
+  return g_array_index (latencies, gdouble, rank - 1);
+}
+
+static void
+report (void)
+{
+  gdouble elapsed = 0.0, goodput = 0.0, retransmissions = 0.0;
+
+  if (left_opened)
+    elapsed = (gdouble) (now - opened_time) / G_USEC_PER_SEC;
+  if (elapsed > 0.0)
+    goodput = (gdouble) bytes_received * 8.0 / elapsed / 1000000.0;
+  if (bytes_received > 0)
+    retransmissions = (gdouble) bytes_on_wire / bytes_received - 1.0;
+
+  g_array_sort (latencies, compare_doubles);
+
+  g_print ("Link: %u kbit/s, %u ms delay, %u ms jitter, %.2f%% loss, "
+      "%.2f%% reordering (%u ms), %u byte queue\n", bandwidth, delay, jitter,
+      loss, reorder, reorder_delay, queue_size);
+  g_print ("Connected after: %.3f s\n",
+      left_opened ? (gdouble) (opened_time - START_TIME) / G_USEC_PER_SEC : -1.0);
+  g_print ("Bytes delivered: %" G_GUINT64_FORMAT " in %.3f s\n",
+      bytes_received, elapsed);
+  g_print ("Goodput: %.3f Mbit/s\n", goodput);
+  g_print ("Retransmission ratio: %.4f\n", retransmissions);
+  g_print ("Packets left→right: %u sent, %u lost, %u queue drops\n",
+      left_to_right.n_packets, left_to_right.n_lost,
+      left_to_right.n_queue_drops);
+  g_print ("Packets right→left: %u sent, %u lost, %u queue drops\n",
+      right_to_left.n_packets, right_to_left.n_lost,
+      right_to_left.n_queue_drops);
+  g_print ("Messages delivered: %u\n", latencies->len);
+  g_print ("Message latency (ms): p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+      percentile (50.0), percentile (90.0), percentile (99.0),
+      percentile (100.0));
+}
+
+static GOptionEntry entries[] = {
+  { "seed", 's', 0, G_OPTION_ARG_INT64, &seed, "PRNG seed", "N" },
+  { "bandwidth", 'b', 0, G_OPTION_ARG_INT, &bandwidth,
+    "Link bandwidth in each direction, 0 for unlimited", "KBIT/S" },
+  { "delay", 'd', 0, G_OPTION_ARG_INT, &delay, "One-way link delay", "MS" },
+  { "jitter", 'j', 0, G_OPTION_ARG_INT, &jitter,
+    "Maximum random delay added to each packet", "MS" },
+  { "loss", 'l', 0, G_OPTION_ARG_DOUBLE, &loss,
+    "Percentage of packets lost at random", "PERCENT" },
+  { "reorder", 'r', 0, G_OPTION_ARG_DOUBLE, &reorder,
+    "Percentage of packets delivered out of order", "PERCENT" },
+  { "reorder-delay", 0, 0, G_OPTION_ARG_INT, &reorder_delay,
+    "Extra delay of packets delivered out of order", "MS" },
+  { "queue", 'q', 0, G_OPTION_ARG_INT, &queue_size,
+    "Size of the queue in front of the bottleneck, 0 for unlimited", "BYTES" },
+  { "message-size", 'm', 0, G_OPTION_ARG_INT, &message_size,
+    "Size of the messages sent", "BYTES" },
+  { "message-interval", 'i', 0, G_OPTION_ARG_INT, &message_interval,
+    "Interval between messages, 0 to send as fast as possible", "MS" },
+  { "duration", 't', 0, G_OPTION_ARG_INT, &duration,
+    "Simulated duration of the run", "S" },
+  { "pacing", 0, 0, G_OPTION_ARG_NONE, &pacing,
+    "Enable sender pacing", NULL },
+  { "rack", 0, 0, G_OPTION_ARG_NONE, &rack,
+    "Enable RACK-TLP loss recovery", NULL },
+  { "min-rto", 0, 0, G_OPTION_ARG_INT, &min_rto,
+    "Minimum retransmission timeout, 0 for the default", "MS" },
+  { NULL }
+};
+
+int main (int argc, char *argv[])
+{
+  PseudoTcpCallbacks cbs = {
+    NULL, opened, readable, writable, closed, write_packet
+  };
+  GOptionContext *context;
+  GError *error = NULL;
+
+  setlocale (LC_ALL, "");
+
+  /* Configuration. */
+  context = g_option_context_new ("— benchmark the pseudotcp socket");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("Option parsing failed: %s\n", error->message);
+    goto context_error;
+  }
+
+  if (message_size == 0 || duration == 0) {
+    g_printerr ("Option parsing failed: %s\n",
+        "Message size and duration must be positive.");
+    goto context_error;
+  }
+
+  if (loss < 0.0 || loss > 100.0 || reorder < 0.0 || reorder > 100.0) {
+    g_printerr ("Option parsing failed: %s\n",
+        "Percentages must be between 0 and 100.");
+    goto context_error;
+  }
+
+  g_option_context_free (context);
+
+  g_print ("Using seed: %" G_GINT64_FORMAT "\n", seed);
+  prng = g_rand_new_with_seed (seed);
+  latencies = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  send_buf = g_malloc0 (message_size);
+
+  left = pseudo_tcp_socket_new (0, &cbs);
+  right = pseudo_tcp_socket_new (0, &cbs);
+  left_to_right.to = right;
+  right_to_left.to = left;
+
+  g_object_set (left, "pacing", pacing, "rack", rack, NULL);
+  g_object_set (right, "pacing", pacing, "rack", rack, NULL);
+  if (min_rto > 0) {
+    g_object_set (left, "min-rto", min_rto, NULL);
+    g_object_set (right, "min-rto", min_rto, NULL);
+  }
+
+  pseudo_tcp_socket_notify_mtu (left, 1496);
+  pseudo_tcp_socket_notify_mtu (right, 1496);
+
+  pseudo_tcp_socket_set_time (left, now / 1000);
+  pseudo_tcp_socket_set_time (right, now / 1000);
+  pseudo_tcp_socket_connect (left);
+
+  run ();
+  report ();
+
+  g_object_unref (left);
+  g_object_unref (right);
+
+  while (!g_queue_is_empty (&packets))
+    g_free (g_queue_pop_head (&packets));
+  while (!g_queue_is_empty (&backlog))
+    g_slice_free (Message, g_queue_pop_head (&backlog));
+  while (!g_queue_is_empty (&unacked))
+    g_slice_free (Message, g_queue_pop_head (&unacked));
+
+  g_array_unref (latencies);
+  g_free (send_buf);
+  g_rand_free (prng);
+
+  /* A run which delivers nothing is broken, whatever the link. */
+  return (bytes_received > 0) ? 0 : 1;
+
+context_error:
+  g_printerr ("\n%s\n", g_option_context_get_help (context, TRUE, NULL));
+  g_option_context_free (context);
+
+  return 1;
+}
@@ -1198,6 +1198,149 @@ pseudotcp_close_recv_queued (void)
   data_clear (&data);
 }
 
+/* Check that with pacing enabled, a send larger than one segment is spread out
+ * over time rather than being sent as one burst, and that the next clock
+ * deadline reflects the departure time of the held-back segment. */
+static void
+pseudotcp_pacing (void)
+{
+  Data data = { 0, };
+  guint8 buf[4000];
+  guint64 timeout = 0;
+
+  create_sockets (&data, TRUE);
+  g_object_set (data.left, "pacing", TRUE, NULL);
+
+  /* Establish a connection, delaying the SYN-ACK so that the LHS gets a
+   * non-zero RTT sample; pacing is only active once one is available. */
+  pseudo_tcp_socket_connect (data.left);
+  expect_syn_sent (&data);
+  forward_segment_ltr (&data);
+  expect_syn_received (&data);
+  increment_time (data.left, &data.left_current_time, 100);
+  forward_segment_rtl (&data);
+  increment_time_both (&data, 110);
+  expect_ack (data.left, data.left_sent, 7, 7);
+  forward_segment_ltr (&data);
+  expect_sockets_connected (&data);
+
+  assert_empty_queues (&data);
+
+  /* Queue more than two segments. The congestion window would allow two to be
+   * sent straight away, but the pacer only releases the first. */
+  memset (buf, 'a', sizeof (buf));
+  g_assert_cmpint (pseudo_tcp_socket_send (data.left, (char *) buf,
+      sizeof (buf)), ==, sizeof (buf));
+  expect_data (data.left, data.left_sent, 7, 7, 1284);
+  forward_segment_ltr (&data);
+  assert_empty_queues (&data);
+
+  g_assert (pseudo_tcp_socket_get_next_clock (data.left, &timeout));
+  g_assert_cmpuint (timeout, >, data.left_current_time);
+  g_assert_cmpuint (timeout, <, data.left_current_time + 100);
+
+  /* The second segment goes out once its departure time is reached. */
+  increment_time (data.left, &data.left_current_time,
+      timeout - data.left_current_time);
+  expect_data (data.left, data.left_sent, 1291, 7, 1284);
+  forward_segment_ltr (&data);
+  assert_empty_queues (&data);
+
+  data_clear (&data);
+}
+
+/* Establish a connection with RACK-TLP enabled on the LHS, delaying the
+ * SYN-ACK so that the LHS gets a non-zero RTT sample. */
+static void
+establish_connection_rack (Data *data)
+{
+  create_sockets (data, TRUE);
+  g_object_set (data->left, "rack", TRUE, NULL);
+
+  pseudo_tcp_socket_connect (data->left);
+  expect_syn_sent (data);
+  forward_segment_ltr (data);
+  expect_syn_received (data);
+  increment_time (data->left, &data->left_current_time, 100);
+  forward_segment_rtl (data);
+  increment_time_both (data, 110);
+  expect_ack (data->left, data->left_sent, 7, 7);
+  forward_segment_ltr (data);
+  expect_sockets_connected (data);
+
+  assert_empty_queues (data);
+}
+
+/* Check that a lost segment is retransmitted on the first duplicate ACK once
+ * it has been outstanding for longer than the RTT, rather than waiting for
+ * three duplicate ACKs or the RTO. */
+static void
+pseudotcp_rack (void)
+{
+  Data data = { 0, };
+  guint8 buf[2568];
+
+  establish_connection_rack (&data);
+
+  memset (buf, 'a', sizeof (buf));
+  g_assert_cmpint (pseudo_tcp_socket_send (data.left, (char *) buf,
+      sizeof (buf)), ==, sizeof (buf));
+  expect_data (data.left, data.left_sent, 7, 7, 1284);
+  expect_data (data.left, data.left_sent, 1291, 7, 1284);
+
+  /* Drop the first segment; the second one triggers a duplicate ACK. */
+  drop_segment (data.left, data.left_sent);
+  forward_segment_ltr (&data);
+  expect_ack (data.right, data.right_sent, 7, 7);
+
+  /* Deliver it more than srtt + min_rtt / 4 after the original transmission,
+   * but before the tail loss probe would fire. */
+  increment_time (data.left, &data.left_current_time, 150);
+  assert_empty_queues (&data);
+  forward_segment_rtl (&data);
+  expect_data (data.left, data.left_sent, 7, 7, 1284);
+  forward_segment_ltr (&data);
+  expect_ack (data.right, data.right_sent, 7, 2575);
+  forward_segment_rtl (&data);
+
+  assert_empty_queues (&data);
+
+  data_clear (&data);
+}
+
+/* Check that a probe is sent if the tail of a flight is lost and no ACKs come
+ * back, well before the RTO would expire. */
+static void
+pseudotcp_tlp (void)
+{
+  Data data = { 0, };
+  guint64 timeout = 0;
+
+  establish_connection_rack (&data);
+
+  g_assert_cmpint (pseudo_tcp_socket_send (data.left, "foo", 3), ==, 3);
+  expect_data (data.left, data.left_sent, 7, 7, 3);
+  drop_segment (data.left, data.left_sent);
+
+  /* The probe timeout is 2 * srtt, plus the delayed ACK timeout since only
+   * one segment is in flight; the RTO is still one second. */
+  g_assert (pseudo_tcp_socket_get_next_clock (data.left, &timeout));
+  g_assert_cmpuint (timeout, >, data.left_current_time + 2 * 90);
+  g_assert_cmpuint (timeout, <, data.left_current_time + 1000);
+
+  increment_time (data.left, &data.left_current_time,
+      timeout - data.left_current_time);
+  expect_data (data.left, data.left_sent, 7, 7, 3);
+  forward_segment_ltr (&data);
+  increment_time (data.right, &data.right_current_time, 300);
+  expect_ack (data.right, data.right_sent, 7, 10);
+  forward_segment_rtl (&data);
+
+  assert_empty_queues (&data);
+
+  data_clear (&data);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -1272,6 +1415,13 @@ main (int argc, char *argv[])
   g_test_add_func ("/pseudotcp/compatibility",
       pseudotcp_compatibility);
 
+  g_test_add_func ("/pseudotcp/pacing",
+      pseudotcp_pacing);
+  g_test_add_func ("/pseudotcp/rack",
+      pseudotcp_rack);
+  g_test_add_func ("/pseudotcp/tlp",
+      pseudotcp_tlp);
+
   g_test_run ();
 
   return 0;
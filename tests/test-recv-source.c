@@ -0,0 +1,204 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+/* Check that the source returned by nice_agent_create_recv_source() is
+ * dispatched when the component has something to receive, so that a
+ * component can be driven from it with nice_agent_recv_messages_nonblocking()
+ * alone. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "agent.h"
+#include "test-agent-common.h"
+
+#include <string.h>
+
+#define N_MESSAGES 10
+#define MESSAGE_SIZE 100
+
+typedef struct {
+  TestAgents agents;
+  gboolean connected;
+  guint n_dispatched;
+  guint n_received;
+} TestData;
+
+static void
+cb_nice_recv (NiceAgent *agent, guint stream_id, guint component_id,
+    guint len, gchar *buf, gpointer user_data)
+{
+  g_assert_not_reached ();
+}
+
+static void
+cb_component_state_changed (NiceAgent *agent, guint stream_id,
+    guint component_id, guint state, gpointer user_data)
+{
+  TestData *data = user_data;
+
+  if (agent == data->agents.lagent && state == NICE_COMPONENT_STATE_READY)
+    data->connected = TRUE;
+}
+
+/* Nothing else polls the right agent's sockets, so this also handles its
+ * connectivity checks. Receive until it would block, as a readable socket
+ * may only have had STUN on it. */
+static gboolean
+cb_recv_source (gpointer user_data)
+{
+  TestData *data = user_data;
+  guint8 payload[MESSAGE_SIZE * 2];
+  GInputVector buffer = { payload, sizeof (payload) };
+  NiceInputMessage message = { &buffer, 1, NULL, 0 };
+  GError *error = NULL;
+  gint n_valid;
+
+  data->n_dispatched++;
+
+  while ((n_valid = nice_agent_recv_messages_nonblocking (data->agents.ragent,
+              data->agents.rs_id, 1, &message, 1, NULL, &error)) > 0) {
+    g_assert_cmpuint (message.length, ==, MESSAGE_SIZE);
+    g_assert_cmpuint (payload[0], ==, 0xab);
+    data->n_received++;
+  }
+
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
+  g_clear_error (&error);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+test_recv_source (void)
+{
+  TestData data = { 0, };
+  TestAgents *agents = &data.agents;
+  GSource *source;
+  guint8 payload[MESSAGE_SIZE];
+  gint64 deadline;
+  guint i;
+
+  agents->context = g_main_context_new ();
+  agents->lagent = create_test_agent (agents, TRUE, 0);
+  agents->ragent = create_test_agent (agents, FALSE, 0);
+  g_signal_connect (agents->lagent, "component-state-changed",
+      G_CALLBACK (cb_component_state_changed), &data);
+
+  agents->ls_id = nice_agent_add_stream (agents->lagent, 1);
+  agents->rs_id = nice_agent_add_stream (agents->ragent, 1);
+
+  /* Unknown streams and components have no source. */
+  g_assert (nice_agent_create_recv_source (agents->ragent, agents->rs_id + 1,
+          1, NULL) == NULL);
+  g_assert (nice_agent_create_recv_source (agents->ragent, agents->rs_id, 2,
+          NULL) == NULL);
+
+  /* The source is created before gathering, and follows the sockets added
+   * to the component afterwards. */
+  source = nice_agent_create_recv_source (agents->ragent, agents->rs_id, 1,
+      NULL);
+  g_assert (source != NULL);
+  g_source_set_callback (source, cb_recv_source, &data, NULL);
+  g_source_attach (source, agents->context);
+
+  nice_agent_attach_recv (agents->lagent, agents->ls_id, 1, agents->context,
+      cb_nice_recv, &data);
+
+  g_assert (nice_agent_gather_candidates (agents->lagent, agents->ls_id));
+  g_assert (nice_agent_gather_candidates (agents->ragent, agents->rs_id));
+
+  deadline = g_get_monotonic_time () + 30 * G_USEC_PER_SEC;
+
+  while (agents->gathering_done < 2) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate_test_agents (agents);
+  }
+
+  set_credentials_and_candidates (agents->lagent, agents->ls_id,
+      agents->ragent, agents->rs_id);
+  set_credentials_and_candidates (agents->ragent, agents->rs_id,
+      agents->lagent, agents->ls_id);
+
+  while (!data.connected) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate_test_agents (agents);
+  }
+
+  /* The checks of the left agent could only be answered from the source. */
+  g_assert_cmpuint (data.n_dispatched, >, 0);
+  g_assert_cmpuint (data.n_received, ==, 0);
+
+  memset (payload, 0xab, sizeof (payload));
+  for (i = 0; i < N_MESSAGES; i++)
+    g_assert_cmpint (nice_agent_send (agents->lagent, agents->ls_id, 1,
+            sizeof (payload), (const gchar *) payload), ==, sizeof (payload));
+
+  while (data.n_received < N_MESSAGES) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate_test_agents (agents);
+  }
+
+  g_source_destroy (source);
+  g_source_unref (source);
+
+  g_object_unref (agents->lagent);
+  g_object_unref (agents->ragent);
+  g_main_context_unref (agents->context);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+
+#ifdef G_OS_WIN32
+  WSADATA w;
+
+  WSAStartup (0x0202, &w);
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/agent/recv-source", test_recv_source);
+
+  ret = g_test_run ();
+
+#ifdef G_OS_WIN32
+  WSACleanup ();
+#endif
+
+  return ret;
+}
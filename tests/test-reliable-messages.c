@@ -0,0 +1,306 @@
+/*
+ * This file is part of the Nice GLib ICE library.
+ *
+ * (C) 2026 Kurento.
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Nice GLib ICE library.
+ *
+ * The Initial Developers of the Original Code are Collabora Ltd and Nokia
+ * Corporation. All Rights Reserved.
+ *
+ * Contributors:
+ *   Kurento.
+ *
+ * Alternatively, the contents of this file may be used under the terms of the
+ * the GNU Lesser General Public License Version 2.1 (the "LGPL"), in which
+ * case the provisions of LGPL are applicable instead of those above. If you
+ * wish to allow use of your version of this file only under the terms of the
+ * LGPL and not to allow others to use your version of this file under the
+ * MPL, indicate your decision by deleting the provisions above and replace
+ * them with the notice and other provisions required by the LGPL. If you do
+ * not delete the provisions above, a recipient may use your version of this
+ * file under either the MPL or the LGPL.
+ */
+
+/* Check that a reliable agent with #NiceAgent:reliable-messages set delivers
+ * the messages it is given one by one, with their boundaries intact, both
+ * through the receive callback and through nice_agent_recv_messages(). */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include "agent.h"
+#include "test-agent-common.h"
+
+#include <string.h>
+
+/* Sizes of the messages sent, in order. The 40000 byte one is larger than
+ * the threshold at which partially received messages are reassembled. */
+static const gsize message_sizes[] = { 1, 100, 1284, 5000, 40000, 7 };
+#define N_MESSAGES G_N_ELEMENTS (message_sizes)
+
+/* Large enough for any message in @message_sizes when split in two. */
+#define RECV_BUFFER_SIZE (32 * 1024)
+
+typedef struct {
+  TestAgents agents;
+  gboolean writable;
+  guint n_received;
+
+  /* Only used when receiving with nice_agent_recv_messages_nonblocking(). */
+  NiceInputMessage *recv_messages;
+  guint8 (*recv_payloads)[2][RECV_BUFFER_SIZE];
+} TestData;
+
+static void
+fill_message (guint8 *buf, guint index)
+{
+  gsize i;
+
+  for (i = 0; i < message_sizes[index]; i++)
+    buf[i] = (guint8) (index + i);
+}
+
+static void
+check_message (const guint8 *buf, gsize len, guint index)
+{
+  gsize i;
+
+  g_assert_cmpuint (index, <, N_MESSAGES);
+  g_assert_cmpuint (len, ==, message_sizes[index]);
+
+  for (i = 0; i < len; i++)
+    g_assert_cmpuint (buf[i], ==, (guint8) (index + i));
+}
+
+static void
+cb_nice_recv (NiceAgent *agent, guint stream_id, guint component_id,
+    guint len, gchar *buf, gpointer user_data)
+{
+  TestData *data = user_data;
+
+  g_assert (agent == data->agents.ragent);
+
+  check_message ((const guint8 *) buf, len, data->n_received);
+  data->n_received++;
+}
+
+static void
+cb_reliable_transport_writable (NiceAgent *agent, guint stream_id,
+    guint component_id, gpointer user_data)
+{
+  TestData *data = user_data;
+
+  data->writable = TRUE;
+}
+
+/* Receive whatever complete messages are pending on the right agent. */
+static void
+recv_pending_messages (TestData *data)
+{
+  GError *error = NULL;
+  gint n_valid;
+  guint i;
+
+  n_valid = nice_agent_recv_messages_nonblocking (data->agents.ragent,
+      data->agents.rs_id, 1, data->recv_messages + data->n_received,
+      N_MESSAGES - data->n_received, NULL, &error);
+
+  if (n_valid < 0) {
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
+    g_clear_error (&error);
+    return;
+  }
+
+  g_assert_no_error (error);
+  g_assert_cmpint (n_valid, >, 0);
+
+  for (i = data->n_received; i < data->n_received + n_valid; i++) {
+    NiceInputMessage *message = &data->recv_messages[i];
+    gsize first = MIN (message->length, RECV_BUFFER_SIZE);
+    guint8 *flat = g_malloc (message->length + 1);
+
+    memcpy (flat, data->recv_payloads[i][0], first);
+    memcpy (flat + first, data->recv_payloads[i][1], message->length - first);
+    check_message (flat, message->length, i);
+    g_free (flat);
+  }
+
+  data->n_received += n_valid;
+}
+
+/* Without a receive callback, the right agent’s sockets are only polled from
+ * nice_agent_recv_messages_nonblocking(), so call it on every iteration. */
+static void
+iterate (TestData *data)
+{
+  iterate_test_agents (&data->agents);
+
+  if (data->recv_messages != NULL && data->n_received < N_MESSAGES)
+    recv_pending_messages (data);
+}
+
+/* Connect the agents, send all the messages from the left one to the right
+ * one, and wait until they have all been received. */
+static void
+run_test (TestData *data, gboolean use_callback)
+{
+  TestAgents *agents = &data->agents;
+  NiceOutputMessage messages[N_MESSAGES], empty;
+  GOutputVector buffers[N_MESSAGES][2];
+  guint8 *payloads[N_MESSAGES];
+  GError *error = NULL;
+  gint64 deadline;
+  guint i;
+
+  agents->context = g_main_context_new ();
+  agents->lagent = create_test_agent (agents, TRUE,
+      NICE_AGENT_OPTION_RELIABLE | NICE_AGENT_OPTION_RELIABLE_MESSAGES);
+  agents->ragent = create_test_agent (agents, FALSE,
+      NICE_AGENT_OPTION_RELIABLE | NICE_AGENT_OPTION_RELIABLE_MESSAGES);
+  g_signal_connect (agents->lagent, "reliable-transport-writable",
+      G_CALLBACK (cb_reliable_transport_writable), data);
+
+  agents->ls_id = nice_agent_add_stream (agents->lagent, 1);
+  agents->rs_id = nice_agent_add_stream (agents->ragent, 1);
+  g_assert_cmpuint (agents->ls_id, >, 0);
+  g_assert_cmpuint (agents->rs_id, >, 0);
+
+  nice_agent_attach_recv (agents->lagent, agents->ls_id, 1, agents->context,
+      cb_nice_recv, data);
+  if (use_callback)
+    nice_agent_attach_recv (agents->ragent, agents->rs_id, 1, agents->context,
+        cb_nice_recv, data);
+
+  g_assert (nice_agent_gather_candidates (agents->lagent, agents->ls_id));
+  g_assert (nice_agent_gather_candidates (agents->ragent, agents->rs_id));
+
+  deadline = g_get_monotonic_time () + 30 * G_USEC_PER_SEC;
+
+  while (agents->gathering_done < 2) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate (data);
+  }
+
+  set_credentials_and_candidates (agents->lagent, agents->ls_id,
+      agents->ragent, agents->rs_id);
+  set_credentials_and_candidates (agents->ragent, agents->rs_id,
+      agents->lagent, agents->ls_id);
+
+  while (!data->writable) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate (data);
+  }
+
+  /* An empty message would read as EOS on the right agent, so it is
+   * rejected without anything being sent. */
+  empty.buffers = NULL;
+  empty.n_buffers = 0;
+  g_assert_cmpint (nice_agent_send_messages_nonblocking (agents->lagent,
+      agents->ls_id, 1, &empty, 1, NULL, &error), ==, -1);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+  g_clear_error (&error);
+
+  /* Split each message across two buffers to check they’re not treated as
+   * separate messages. */
+  for (i = 0; i < N_MESSAGES; i++) {
+    gsize half = message_sizes[i] / 2;
+
+    payloads[i] = g_malloc (message_sizes[i]);
+    fill_message (payloads[i], i);
+
+    buffers[i][0].buffer = payloads[i];
+    buffers[i][0].size = half;
+    buffers[i][1].buffer = payloads[i] + half;
+    buffers[i][1].size = message_sizes[i] - half;
+    messages[i].buffers = buffers[i];
+    messages[i].n_buffers = 2;
+  }
+
+  g_assert_cmpint (nice_agent_send_messages_nonblocking (agents->lagent,
+      agents->ls_id, 1, messages, N_MESSAGES, NULL, &error), ==, N_MESSAGES);
+  g_assert_no_error (error);
+
+  for (i = 0; i < N_MESSAGES; i++)
+    g_free (payloads[i]);
+
+  while (data->n_received < N_MESSAGES) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    iterate (data);
+  }
+
+  g_object_unref (agents->lagent);
+  g_object_unref (agents->ragent);
+  g_main_context_unref (agents->context);
+}
+
+static void
+test_recv_callback (void)
+{
+  TestData data = { 0, };
+
+  run_test (&data, TRUE);
+}
+
+static void
+test_recv_messages (void)
+{
+  TestData data = { 0, };
+  NiceInputMessage messages[N_MESSAGES];
+  GInputVector buffers[N_MESSAGES][2];
+  guint i;
+
+  /* Each message is received into its own NiceInputMessage. */
+  data.recv_payloads = g_malloc (N_MESSAGES * sizeof (*data.recv_payloads));
+  for (i = 0; i < N_MESSAGES; i++) {
+    buffers[i][0].buffer = data.recv_payloads[i][0];
+    buffers[i][0].size = RECV_BUFFER_SIZE;
+    buffers[i][1].buffer = data.recv_payloads[i][1];
+    buffers[i][1].size = RECV_BUFFER_SIZE;
+    messages[i].buffers = buffers[i];
+    messages[i].n_buffers = 2;
+    messages[i].from = NULL;
+    messages[i].length = 0;
+  }
+  data.recv_messages = messages;
+
+  run_test (&data, FALSE);
+
+  g_free (data.recv_payloads);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+
+#ifdef G_OS_WIN32
+  WSADATA w;
+
+  WSAStartup (0x0202, &w);
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/reliable-messages/recv-callback", test_recv_callback);
+  g_test_add_func ("/reliable-messages/recv-messages", test_recv_messages);
+
+  ret = g_test_run ();
+
+#ifdef G_OS_WIN32
+  WSACleanup ();
+#endif
+
+  return ret;
+}